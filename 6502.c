@@ -1,82 +1,156 @@
+#include "6502.h"
 #include "opcodes.h"
+#include <pthread.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
-#include <sys/types.h>
 #include <stdbool.h>
 
+#ifdef ALU_TABLES
+#include "alu_tables.h"
+#endif
+
 #define CLOCK_TIME 10000
 
-typedef u_int8_t Byte;
-typedef u_int16_t Word;
+void cpu_reset(CPU *cpu) {
+    cpu->PC = (cpu->mem->Data[0xFFFD] << 8) | cpu->mem->Data[0xFFFC];
+    cpu->SP = 0xFF;
+    cpu->A = cpu->X = cpu->Y = 0;
+    cpu->C = cpu->Z = cpu->I = cpu->D = cpu->B = cpu->V = cpu->N = 0;
+}
 
-typedef struct {
-    Byte Data[0x10000];
-} Memory;
+void init_mem(Memory *mem) {
+    memset(mem, 0, sizeof(*mem));
+}
 
-typedef struct {
-    Word PC;    // Program Counter
-    Byte SP;    // Stack Pointer
+// routes every access to page to handler, or back to RAM with NULL; zero
+// page and the stack stay RAM
+int map_io(Memory *mem, Byte page, const PageHandler *handler) {
+    if (page < IO_FIRST_PAGE) return -1;
+    mem->io[page] = handler;
+    return 0;
+}
 
-    Byte A, X, Y;    // Registers
+// a device read can change with time or have side effects, so it counts as
+// a write for idle loop detection unless the device says otherwise
+__attribute__((cold, noinline)) Byte io_read(CPU *cpu, Word addr) {
+    const PageHandler *io = cpu->mem->io[addr >> 8];
+    if (!io->steady_reads) cpu->writes++;
+    return io->read(io->ctx, addr);
+}
 
-    Byte C : 1; // carry flag (LSB)
-    Byte Z : 1; // zero flag
-    Byte I : 1; // interrupt disable flag
-    Byte D : 1; // decimal flag
-    Byte B : 1; // break flag
-    Byte V : 1; // overflow flag
-    Byte N : 1; // negative flag (MSB)
-} CPU;
+__attribute__((cold, noinline)) void io_write(CPU *cpu, Word addr, Byte value) {
+    const PageHandler *io = cpu->mem->io[addr >> 8];
+    io->write(io->ctx, addr, value);
+}
 
-CPU cpu;
-Memory mem;
+Byte peek_stack(CPU *cpu) {
+    return cpu->mem->Data[0x100 + cpu->SP];
+}
 
-void cpu_reset() {
-    cpu.PC = (mem.Data[0xFFFD] << 8) | mem.Data[0xFFFC];
-    cpu.SP = 0xFF;
-    cpu.A = cpu.X = cpu.Y = 0;
-    cpu.C = cpu.Z = cpu.I = cpu.D = cpu.B = cpu.V = cpu.N = 0;
+void push_to_stack(CPU *cpu, Byte val) {
+    write_byte(cpu, 0x0100 + cpu->SP, val);
+    cpu->SP--;
 }
 
-void init_mem() {
-    memset(mem.Data, 0, 0x10000);
+Byte pop_from_stack(CPU *cpu) {
+    cpu->SP++;
+    COVER(cpu->mem->accessed, 0x0100 + cpu->SP);
+    return cpu->mem->Data[0x0100 + cpu->SP];
 }
 
-Byte peek_stack() {
-    return mem.Data[0x100 + cpu.SP];
+Word read_word(CPU *cpu, Word offset) {
+    Word val = read_byte(cpu, offset) | (read_byte(cpu, offset + 1) << 8);
+    return val;
 }
 
-void push_to_stack(Byte val) {
-    mem.Data[0x0100 + cpu.SP] = val;
-    cpu.SP--;
+Byte read_from_pc(CPU *cpu) {
+    Byte val = fetch_byte(cpu, cpu->PC);
+    cpu->PC++;
+    return val;
 }
 
-Byte pop_from_stack() {
-    cpu.SP++;
-    return mem.Data[0x0100 + cpu.SP];
+/*
+ * Decimal mode results, indexed by carry, A and operand.
+ * Each entry packs the result byte with N, V, Z and C in their P positions
+ * (result | P << 8). Built once, on first use from any thread, from the
+ * NMOS formulas below.
+ */
+static Word bcd_adc_table[2][256][256];
+static Word bcd_sbc_table[2][256][256];
+static pthread_once_t bcd_tables_once = PTHREAD_ONCE_INIT;
+
+// NMOS: Z comes from the binary sum, N and V from the sum before the high
+// nibble is adjusted, C from the adjusted sum
+static Word bcd_adc(Byte a, Byte val, Byte carry) {
+    unsigned lo = (a & 0x0F) + (val & 0x0F) + carry;
+    if (lo > 0x09) lo += 0x06;
+    unsigned tmp = (a & 0xF0) + (val & 0xF0) + (lo > 0x0F ? 0x10 : 0) + (lo & 0x0F);
+
+    Byte z = ((a + val + carry) & 0xFF) == 0;
+    Byte n = (tmp & 0x80) != 0;
+    Byte v = ((a ^ tmp) & 0x80) != 0 && ((a ^ val) & 0x80) == 0;
+
+    if ((tmp & 0x1F0) > 0x90) tmp += 0x60;
+    Byte c = (tmp & 0xFF0) > 0xF0;
+
+    return (tmp & 0xFF) | (Word)(n << 7 | v << 6 | z << 1 | c) << 8;
 }
 
-Byte read_byte(Word addr) {
-    return mem.Data[addr];
+// NMOS: all flags come from the binary difference, only A is adjusted
+static Word bcd_sbc(Byte a, Byte val, Byte carry) {
+    unsigned result = (unsigned)a - val - (1 - carry);
+    int lo = (a & 0x0F) - (val & 0x0F) - (1 - carry);
+    int tmp;
+    if (lo & 0x10) tmp = ((lo - 0x06) & 0x0F) | ((a & 0xF0) - (val & 0xF0) - 0x10);
+    else tmp = (lo & 0x0F) | ((a & 0xF0) - (val & 0xF0));
+    if (tmp & 0x100) tmp -= 0x60;
+
+    Byte z = (result & 0xFF) == 0;
+    Byte n = (result & 0x80) != 0;
+    Byte v = ((a ^ result) & 0x80) != 0 && ((a ^ val) & 0x80) != 0;
+    Byte c = result < 0x100;
+
+    return (tmp & 0xFF) | (Word)(n << 7 | v << 6 | z << 1 | c) << 8;
 }
 
-void write_byte(Word addr, Byte value) {
-    mem.Data[addr] = value;
+static void build_bcd_tables(void) {
+    for (int c = 0; c < 2; c++) {
+        for (int a = 0; a < 256; a++) {
+            for (int val = 0; val < 256; val++) {
+                bcd_adc_table[c][a][val] = bcd_adc(a, val, c);
+                bcd_sbc_table[c][a][val] = bcd_sbc(a, val, c);
+            }
+        }
+    }
 }
 
-Word read_word(Word offset) {
-    Word val = read_byte(offset) | (read_byte(offset + 1) << 8);
-    return val;
+static void apply_packed(CPU *cpu, Word entry) {
+    cpu->A = entry & 0xFF;
+    cpu->C = (entry >> 8) & 1;
+    cpu->Z = (entry >> 9) & 1;
+    cpu->V = (entry >> 14) & 1;
+    cpu->N = (entry >> 15) & 1;
 }
 
-Byte read_from_pc() {
-    Byte val = read_byte(cpu.PC);
-    cpu.PC++;
-    return val;
+#ifdef ALU_TABLES
+static void apply_nzc(CPU *cpu, Byte p) {
+    cpu->C = p & 1;
+    cpu->Z = (p >> 1) & 1;
+    cpu->N = (p >> 7) & 1;
 }
+#endif
 
 void adc(CPU *cpu, Byte val) {
+    if (cpu->D) {
+        pthread_once(&bcd_tables_once, build_bcd_tables);
+        apply_packed(cpu, bcd_adc_table[cpu->C][cpu->A][val]);
+        return;
+    }
+
+#ifdef ALU_TABLES
+    apply_packed(cpu, alu_adc[cpu->C << 16 | cpu->A << 8 | val]);
+#else
     Word result = cpu->A + val + cpu->C;
 
     // Set carry flag
@@ -94,6 +168,7 @@ void adc(CPU *cpu, Byte val) {
 
     // Update accumulator
     cpu->A = result & 0xFF;
+#endif
 }
 
 void and(CPU *cpu, Byte val) {
@@ -104,32 +179,44 @@ void and(CPU *cpu, Byte val) {
 }
 
 void cmp (CPU *cpu, Byte val) {
+#ifdef ALU_TABLES
+    apply_nzc(cpu, alu_cmp[cpu->A << 8 | val]);
+#else
     Byte ans = cpu->A - val;
-    if (ans == 0x00) cpu->Z = 1;
-    if (cpu->A >= val) cpu->C = 1;
+    cpu->Z = (ans == 0x00);
+    cpu->C = (cpu->A >= val);
     cpu->N = (ans & 0x80) != 0;
+#endif
 }
 
 void cpx (CPU *cpu, Byte val) {
+#ifdef ALU_TABLES
+    apply_nzc(cpu, alu_cmp[cpu->X << 8 | val]);
+#else
     Byte ans = cpu->X - val;
-    if (ans == 0x00) cpu->Z = 1;
-    if (cpu->X >= val) cpu->C = 1;
+    cpu->Z = (ans == 0x00);
+    cpu->C = (cpu->X >= val);
     cpu->N = (ans & 0x80) != 0;
+#endif
 }
 
 void cpy (CPU *cpu, Byte val) {
+#ifdef ALU_TABLES
+    apply_nzc(cpu, alu_cmp[cpu->Y << 8 | val]);
+#else
     Byte ans = cpu->Y - val;
-    if (ans == 0x00) cpu->Z = 1;
-    if (cpu->Y >= val) cpu->C = 1;
+    cpu->Z = (ans == 0x00);
+    cpu->C = (cpu->Y >= val);
     cpu->N = (ans & 0x80) != 0;
+#endif
 }
 
 void dec(CPU *cpu, Word addr) {
-    Byte val = read_byte(addr);
+    Byte val = read_byte(cpu, addr);
     val--;
-    if (val == 0) cpu->Z = 1;
+    cpu->Z = (val == 0) ? 1 : 0;
     cpu->N = (val & 0x80) != 0;
-    write_byte(addr, val);
+    write_byte(cpu, addr, val);
 }
 
 void eor(CPU *cpu, Byte val) {
@@ -139,11 +226,11 @@ void eor(CPU *cpu, Byte val) {
 }
 
 void inc(CPU *cpu, Word addr) {
-    Byte val = read_byte(addr);
+    Byte val = read_byte(cpu, addr);
     val = val + 1;
     cpu->Z = (val == 0) ? 1: 0;
     cpu->N = (val & 0x80) != 0;
-    write_byte(addr, val);
+    write_byte(cpu, addr, val);
 }
 
 void lda(CPU *cpu, Byte val) {
@@ -164,13 +251,32 @@ void ldy(CPU *cpu, Byte val) {
     cpu->N = (cpu->Y & 0x80) != 0;
 }
 
-void lsr(CPU *cpu, Word addr) {
-    Byte val = read_byte(addr);
-    val = val >> 1;
+Byte asl(CPU *cpu, Byte val) {
+#ifdef ALU_TABLES
+    Word entry = alu_asl[val];
+    apply_nzc(cpu, entry >> 8);
+    return entry & 0xFF;
+#else
+    cpu->C = (val & 0x80) != 0;
+    val = val << 1;
+    cpu->Z = (val == 0x00);
+    cpu->N = (val & 0x80) != 0;
+    return val;
+#endif
+}
+
+Byte lsr(CPU *cpu, Byte val) {
+#ifdef ALU_TABLES
+    Word entry = alu_lsr[val];
+    apply_nzc(cpu, entry >> 8);
+    return entry & 0xFF;
+#else
     cpu->C = ((val & 0x01) != 0);
+    val = val >> 1;
     cpu->Z = (val == 0x00);
     cpu->N = (val & 0x80) != 0;
-    write_byte(addr, val);
+    return val;
+#endif
 }
 
 void ora(CPU *cpu, Byte val) {
@@ -179,1308 +285,2026 @@ void ora(CPU *cpu, Byte val) {
     cpu->N = (cpu->A & 0x80) != 0;
 }
 
-void rol(CPU *cpu, Byte val) {
+Byte rol(CPU *cpu, Byte val) {
+#ifdef ALU_TABLES
+    Word entry = alu_rol[cpu->C << 8 | val];
+    apply_nzc(cpu, entry >> 8);
+    return entry & 0xFF;
+#else
+    Byte carry = cpu->C;
     cpu->C =  (val & 0x80) != 0;
-    val = val << 1;
+    val = (val << 1) | carry;
     cpu->Z = (val == 0x00);
     cpu->N = (val & 0x80) != 0;
+    return val;
+#endif
 }
 
-void ror(CPU *cpu, Byte val) {
-    cpu->C =  (val & 0x80) != 0;
-    val = val >> 1;
+Byte ror(CPU *cpu, Byte val) {
+#ifdef ALU_TABLES
+    Word entry = alu_ror[cpu->C << 8 | val];
+    apply_nzc(cpu, entry >> 8);
+    return entry & 0xFF;
+#else
+    Byte carry = cpu->C;
+    cpu->C =  (val & 0x01) != 0;
+    val = (val >> 1) | (carry << 7);
     cpu->Z = (val == 0x00);
     cpu->N = (val & 0x80) != 0;
+    return val;
+#endif
 }
 
 void sbc(CPU *cpu, Byte val) {
+    if (cpu->D) {
+        pthread_once(&bcd_tables_once, build_bcd_tables);
+        apply_packed(cpu, bcd_sbc_table[cpu->C][cpu->A][val]);
+        return;
+    }
+
+#ifdef ALU_TABLES
+    apply_packed(cpu, alu_sbc[cpu->C << 16 | cpu->A << 8 | val]);
+#else
     Word result = (Word)cpu->A - (Word)val - (1 - cpu->C);
     cpu->Z = (result & 0xFF) == 0x00;
     cpu->N = (result & 0x80) != 0;
     cpu->C = (result < 0x100);
-    cpu->V = (((cpu->A ^ result ) & (val ^ result)) & 0x80) != 0;
+    cpu->V = (((cpu->A ^ val) & (cpu->A ^ result)) & 0x80) != 0;
     cpu->A = (Byte)(result & 0xFF);
+#endif
 
 }
 
 void sta(CPU *cpu, Word mem) {
-    write_byte(mem, cpu->A);
+    write_byte(cpu, mem, cpu->A);
 }
 
 void stx(CPU *cpu, Word mem) {
-    write_byte(mem, cpu->X);
+    write_byte(cpu, mem, cpu->X);
 }
 
 void sty(CPU *cpu, Word mem) {
-    write_byte(mem, cpu->Y);
+    write_byte(cpu, mem, cpu->Y);
 }
 
-void print_debug() {
+void print_debug(CPU *cpu) {
     printf("------------------------------\n");
-    printf("PC : 0x%04X\n", cpu.PC);
-    printf("Memory at PC : 0x%04X\n", read_byte(cpu.PC));
-    printf("SP : 0x%04X\n", cpu.SP);
-    printf("A : 0x%04X\n", cpu.A);
-    printf("X : 0x%04X\n", cpu.X);
-    printf("Y : 0x%04X\n", cpu.Y);
-    printf("C : 0x%04X\n", cpu.C);
-    printf("Z : 0x%04X\n", cpu.Z);
-    printf("I : 0x%04X\n", cpu.I);
-    printf("D : 0x%04X\n", cpu.D);
-    printf("B : 0x%04X\n", cpu.B);
-    printf("V : 0x%04X\n", cpu.V);
-    printf("N : 0x%04X\n--------------------------------------\n", cpu.N);
-}
-
-void execute_instructions() {
-    Byte opcode = read_from_pc();
+    printf("PC : 0x%04X\n", cpu->PC);
+    printf("Memory at PC : 0x%04X\n", read_byte(cpu, cpu->PC));
+    printf("SP : 0x%04X\n", cpu->SP);
+    printf("A : 0x%04X\n", cpu->A);
+    printf("X : 0x%04X\n", cpu->X);
+    printf("Y : 0x%04X\n", cpu->Y);
+    printf("C : 0x%04X\n", cpu->C);
+    printf("Z : 0x%04X\n", cpu->Z);
+    printf("I : 0x%04X\n", cpu->I);
+    printf("D : 0x%04X\n", cpu->D);
+    printf("B : 0x%04X\n", cpu->B);
+    printf("V : 0x%04X\n", cpu->V);
+    printf("N : 0x%04X\n--------------------------------------\n", cpu->N);
+}
+
+/*
+ * Undocumented opcodes. Everything here sits behind the default: label of
+ * execute_instructions() so legal opcodes never pay for it.
+ */
+
+// 65C02 operand length of the opcodes NMOS leaves undefined, by low nibble
+static const Byte cmos_nop_length[16] = {
+    2, 0, 2, 1, 2, 0, 0, 2, 0, 2, 1, 1, 3, 0, 3, 3
+};
+
+static Word undocumented_zp(CPU *cpu, Byte index) {
+    return ((Word)read_from_pc(cpu) + index) & 0xFF;
+}
+
+static Word undocumented_abs(CPU *cpu, Byte index) {
+    Word addr = (Word)read_from_pc(cpu);
+    Word addr2 = (Word)read_from_pc(cpu);
+    return (addr | (addr2 << 8)) + index;
+}
+
+static Word undocumented_indx(CPU *cpu) {
+    Word addr = ((Word)read_from_pc(cpu) + cpu->X) & 0xFF;
+    Word low = (Word)read_byte(cpu, addr);
+    Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
+    return (high << 8) | low;
+}
+
+static Word undocumented_indy(CPU *cpu) {
+    Word addr = (Word)read_from_pc(cpu);
+    Word low = (Word)read_byte(cpu, addr);
+    Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
+    return ((high << 8) | low) + (Word)cpu->Y;
+}
+
+// effective address for the regular xx3/xx7/xxF/... columns; SAX and LAX
+// index zero page and absolute by Y where the others use X
+static Word undocumented_address(CPU *cpu, Byte opcode) {
+    Byte index = ((opcode & 0xC0) == 0x80) ? cpu->Y : cpu->X;
+    switch (opcode & 0x1F) {
+        case 0x03: return undocumented_indx(cpu);
+        case 0x07: return undocumented_zp(cpu, 0);
+        case 0x0F: return undocumented_abs(cpu, 0);
+        case 0x13: return undocumented_indy(cpu);
+        case 0x17: return undocumented_zp(cpu, index);
+        case 0x1B: return undocumented_abs(cpu, cpu->Y);
+        default:   return undocumented_abs(cpu, index);
+    }
+}
+
+// ARR: AND then ROR, with V and C taken from bits 6 and 5 of the result
+// and the NMOS nibble fixups in decimal mode
+static void arr(CPU *cpu, Byte val) {
+    Byte tmp = cpu->A & val;
+    Byte res = (tmp >> 1) | (cpu->C << 7);
+    cpu->N = cpu->C;
+    cpu->Z = (res == 0x00);
+    if (!cpu->D) {
+        cpu->C = (res & 0x40) != 0;
+        cpu->V = ((res >> 6) ^ (res >> 5)) & 1;
+        cpu->A = res;
+        return;
+    }
+    cpu->V = ((res ^ tmp) & 0x40) != 0;
+    if ((tmp & 0x0F) + (tmp & 0x01) > 0x05) res = (res & 0xF0) | ((res + 0x06) & 0x0F);
+    cpu->C = (tmp & 0xF0) + (tmp & 0x10) > 0x50;
+    if (cpu->C) res = (res & 0x0F) | ((res + 0x60) & 0xF0);
+    cpu->A = res;
+}
+
+static void execute_nmos(CPU *cpu, Byte opcode) {
+    switch (opcode) {
+        case SLO_ZP: case SLO_ZPX: case SLO_ABS: case SLO_ABSX:
+        case SLO_ABSY: case SLO_INDX: case SLO_INDY: {
+            TRACE("SLO\n");
+            Word addr = undocumented_address(cpu, opcode);
+            Byte val = asl(cpu, read_byte(cpu, addr));
+            write_byte(cpu, addr, val);
+            ora(cpu, val);
+            break;
+        }
+        case RLA_ZP: case RLA_ZPX: case RLA_ABS: case RLA_ABSX:
+        case RLA_ABSY: case RLA_INDX: case RLA_INDY: {
+            TRACE("RLA\n");
+            Word addr = undocumented_address(cpu, opcode);
+            Byte val = rol(cpu, read_byte(cpu, addr));
+            write_byte(cpu, addr, val);
+            and(cpu, val);
+            break;
+        }
+        case SRE_ZP: case SRE_ZPX: case SRE_ABS: case SRE_ABSX:
+        case SRE_ABSY: case SRE_INDX: case SRE_INDY: {
+            TRACE("SRE\n");
+            Word addr = undocumented_address(cpu, opcode);
+            Byte val = lsr(cpu, read_byte(cpu, addr));
+            write_byte(cpu, addr, val);
+            eor(cpu, val);
+            break;
+        }
+        case RRA_ZP: case RRA_ZPX: case RRA_ABS: case RRA_ABSX:
+        case RRA_ABSY: case RRA_INDX: case RRA_INDY: {
+            TRACE("RRA\n");
+            Word addr = undocumented_address(cpu, opcode);
+            Byte val = ror(cpu, read_byte(cpu, addr));
+            write_byte(cpu, addr, val);
+            adc(cpu, val);
+            break;
+        }
+        case SAX_ZP: case SAX_ZPY: case SAX_ABS: case SAX_INDX: {
+            TRACE("SAX\n");
+            write_byte(cpu, undocumented_address(cpu, opcode), cpu->A & cpu->X);
+            break;
+        }
+        case LAX_ZP: case LAX_ZPY: case LAX_ABS: case LAX_ABSY:
+        case LAX_INDX: case LAX_INDY: {
+            TRACE("LAX\n");
+            lda(cpu, read_byte(cpu, undocumented_address(cpu, opcode)));
+            cpu->X = cpu->A;
+            break;
+        }
+        case DCP_ZP: case DCP_ZPX: case DCP_ABS: case DCP_ABSX:
+        case DCP_ABSY: case DCP_INDX: case DCP_INDY: {
+            TRACE("DCP\n");
+            Word addr = undocumented_address(cpu, opcode);
+            Byte val = read_byte(cpu, addr) - 1;
+            write_byte(cpu, addr, val);
+            cmp(cpu, val);
+            break;
+        }
+        case ISC_ZP: case ISC_ZPX: case ISC_ABS: case ISC_ABSX:
+        case ISC_ABSY: case ISC_INDX: case ISC_INDY: {
+            TRACE("ISC\n");
+            Word addr = undocumented_address(cpu, opcode);
+            Byte val = read_byte(cpu, addr) + 1;
+            write_byte(cpu, addr, val);
+            sbc(cpu, val);
+            break;
+        }
+        case ANC_IM: case ANC_IM2: {
+            TRACE("ANC_IM\n");
+            and(cpu, read_from_pc(cpu));
+            cpu->C = cpu->N;
+            break;
+        }
+        case ALR_IM: {
+            TRACE("ALR_IM\n");
+            cpu->A = lsr(cpu, cpu->A & read_from_pc(cpu));
+            break;
+        }
+        case ARR_IM: {
+            TRACE("ARR_IM\n");
+            arr(cpu, read_from_pc(cpu));
+            break;
+        }
+        case ANE_IM: {
+            // unstable on real parts, 0xEE is the commonly observed constant
+            TRACE("ANE_IM\n");
+            lda(cpu, (cpu->A | 0xEE) & cpu->X & read_from_pc(cpu));
+            break;
+        }
+        case LAX_IM: {
+            TRACE("LAX_IM\n");
+            lda(cpu, (cpu->A | 0xEE) & read_from_pc(cpu));
+            cpu->X = cpu->A;
+            break;
+        }
+        case SBX_IM: {
+            TRACE("SBX_IM\n");
+            Byte val = read_from_pc(cpu);
+            Byte ax = cpu->A & cpu->X;
+            cpu->C = (ax >= val);
+            cpu->X = ax - val;
+            cpu->Z = (cpu->X == 0x00);
+            cpu->N = (cpu->X & 0x80) != 0;
+            break;
+        }
+        case SBC_IM2: {
+            TRACE("SBC_IM\n");
+            sbc(cpu, read_from_pc(cpu));
+            break;
+        }
+        case SHA_INDY: case SHA_ABSY: {
+            TRACE("SHA\n");
+            Word addr = opcode == SHA_INDY ? undocumented_indy(cpu) : undocumented_abs(cpu, cpu->Y);
+            write_byte(cpu, addr, cpu->A & cpu->X & ((addr >> 8) + 1));
+            break;
+        }
+        case TAS_ABSY: {
+            TRACE("TAS_ABSY\n");
+            Word addr = undocumented_abs(cpu, cpu->Y);
+            cpu->SP = cpu->A & cpu->X;
+            write_byte(cpu, addr, cpu->SP & ((addr >> 8) + 1));
+            break;
+        }
+        case SHY_ABSX: {
+            TRACE("SHY_ABSX\n");
+            Word addr = undocumented_abs(cpu, cpu->X);
+            write_byte(cpu, addr, cpu->Y & ((addr >> 8) + 1));
+            break;
+        }
+        case SHX_ABSY: {
+            TRACE("SHX_ABSY\n");
+            Word addr = undocumented_abs(cpu, cpu->Y);
+            write_byte(cpu, addr, cpu->X & ((addr >> 8) + 1));
+            break;
+        }
+        case LAS_ABSY: {
+            TRACE("LAS_ABSY\n");
+            Byte val = read_byte(cpu, undocumented_abs(cpu, cpu->Y)) & cpu->SP;
+            lda(cpu, val);
+            cpu->X = cpu->SP = val;
+            break;
+        }
+        case 0x1A: case 0x3A: case 0x5A: case 0x7A: case 0xDA: case 0xFA: {
+            TRACE("NOP_IMPL\n");
+            break;
+        }
+        case 0x80: case 0x82: case 0x89: case 0xC2: case 0xE2: {
+            TRACE("NOP_IM\n");
+            cpu->PC++;
+            break;
+        }
+        case 0x04: case 0x44: case 0x64: {
+            TRACE("NOP_ZP\n");
+            read_byte(cpu, undocumented_zp(cpu, 0));
+            break;
+        }
+        case 0x14: case 0x34: case 0x54: case 0x74: case 0xD4: case 0xF4: {
+            TRACE("NOP_ZPX\n");
+            read_byte(cpu, undocumented_zp(cpu, cpu->X));
+            break;
+        }
+        case 0x0C: {
+            TRACE("NOP_ABS\n");
+            read_byte(cpu, undocumented_abs(cpu, 0));
+            break;
+        }
+        case 0x1C: case 0x3C: case 0x5C: case 0x7C: case 0xDC: case 0xFC: {
+            TRACE("NOP_ABSX\n");
+            read_byte(cpu, undocumented_abs(cpu, cpu->X));
+            break;
+        }
+        default: {
+            // JAM: the part stops fetching, PC stays on the opcode
+            TRACE("JAM\n");
+            cpu->PC--;
+            break;
+        }
+    }
+}
+
+void execute_undocumented(CPU *cpu, Byte opcode) {
+    switch (cpu->opcodes) {
+        case OPCODES_NMOS:
+            execute_nmos(cpu, opcode);
+            break;
+        case OPCODES_CMOS_NOP:
+            TRACE("NOP\n");
+            cpu->PC += cmos_nop_length[opcode & 0x0F] - 1;
+            break;
+        default:
+            TRACE("Unhandled Opcode : 0x%04X\n", opcode);
+            cpu->PC--;
+            break;
+    }
+}
+
+/*
+ * Cycle counts. Every opcode is charged its base count from the table when
+ * it is dispatched; indexed reads add one when the index carries into the
+ * high byte of the address, taken branches add one, and one more when they
+ * land in another page. Undocumented opcodes use the NMOS counts, the JAMs
+ * are charged as two cycle NOPs since they never finish anyway.
+ */
+const Byte opcode_cycles[256] = {
+//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+    7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,  // 0
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,  // 1
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,  // 2
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,  // 3
+    6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,  // 4
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,  // 5
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,  // 6
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,  // 7
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,  // 8
+    2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,  // 9
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,  // A
+    2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,  // B
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,  // C
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,  // D
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,  // E
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,  // F
+};
+
+enum { CROSS_NONE, CROSS_ABSX, CROSS_ABSY, CROSS_INDY };
+
+// reads that pay a cycle for crossing a page, and the index they use
+static const Byte page_cross[256] = {
+    [ORA_ABSX] = CROSS_ABSX, [AND_ABSX] = CROSS_ABSX, [EOR_ABSX] = CROSS_ABSX,
+    [ADC_ABSX] = CROSS_ABSX, [LDA_ABSX] = CROSS_ABSX, [CMP_ABSX] = CROSS_ABSX,
+    [SBC_ABSX] = CROSS_ABSX, [LDY_ABSX] = CROSS_ABSX,
+    [0x1C] = CROSS_ABSX, [0x3C] = CROSS_ABSX, [0x5C] = CROSS_ABSX,
+    [0x7C] = CROSS_ABSX, [0xDC] = CROSS_ABSX, [0xFC] = CROSS_ABSX,
+    [ORA_ABSY] = CROSS_ABSY, [AND_ABSY] = CROSS_ABSY, [EOR_ABSY] = CROSS_ABSY,
+    [ADC_ABSY] = CROSS_ABSY, [LDA_ABSY] = CROSS_ABSY, [CMP_ABSY] = CROSS_ABSY,
+    [SBC_ABSY] = CROSS_ABSY, [LDX_ABSY] = CROSS_ABSY,
+    [LAX_ABSY] = CROSS_ABSY, [LAS_ABSY] = CROSS_ABSY,
+    [ORA_INDY] = CROSS_INDY, [AND_INDY] = CROSS_INDY, [EOR_INDY] = CROSS_INDY,
+    [ADC_INDY] = CROSS_INDY, [LDA_INDY] = CROSS_INDY, [CMP_INDY] = CROSS_INDY,
+    [SBC_INDY] = CROSS_INDY, [LAX_INDY] = CROSS_INDY,
+};
+
+// PC is on the operand of an opcode from page_cross
+static int crosses_page(CPU *cpu, Byte mode) {
+    Word base;
+    Byte index = cpu->Y;
+    if (mode == CROSS_INDY) {
+        Byte ptr = fetch_byte(cpu, cpu->PC);
+        base = read_byte(cpu, ptr) | (read_byte(cpu, (Byte)(ptr + 1)) << 8);
+    } else {
+        base = fetch_byte(cpu, cpu->PC) | fetch_byte(cpu, cpu->PC + 1) << 8;
+        if (mode == CROSS_ABSX) index = cpu->X;
+    }
+    return (base & 0xFF) + index > 0xFF;
+}
+
+// records the control transfer that landed on to, when edges are counted
+static inline void edge(CPU *cpu, Word to) {
+    if (__builtin_expect(cpu->edges == NULL, 1)) return;
+    Word cur = (u_int32_t)to * 0x9E3779B1u >> (32 - EDGE_MAP_BITS);
+    cpu->edges[cur ^ cpu->edge_prev]++;
+    cpu->edge_prev = cur >> 1;
+}
+
+static inline void branch(CPU *cpu, Byte offset, bool taken) {
+    if (taken) {
+        Word target = cpu->PC + (int8_t)offset;
+        cpu->cycles += 1 + ((target ^ cpu->PC) > 0xFF);
+        cpu->PC = target;
+    }
+    edge(cpu, cpu->PC);
+}
+
+/*
+ * Superinstructions. The handler of an instruction that usually starts one
+ * of the idioms below also runs the instruction that follows it when that
+ * is the expected one, so the pair costs a single trip through the switch:
+ *
+ *   LDA, ADC, SBC / STA    copies, stores of constants and sums
+ *   CMP, CPX, CPY, DEX, DEY / BNE, BEQ
+ *   INX / CPX #, INY / CPY # and the branch after them
+ *   CLC / ADC, SEC / SBC   and the STA after those
+ *
+ * The set comes from the opcode pair counts of a -DPAIR_STATS build. Each
+ * tail returns how many instructions it ran so execute_instructions() can
+ * report the total. -DNO_FUSION turns fusion off; PAIR_STATS does too, so
+ * that every pair goes through the switch and is counted.
+ */
+#if defined(NO_FUSION) || defined(PAIR_STATS)
+#define FUSE(tail) 0
+#else
+#define FUSE(tail) (debug_stop(cpu) ? 0 : (tail))
+#endif
+
+// with a debugger attached the tail must not run past a breakpoint or a
+// watch that just fired, nor run at all when single stepping
+static inline bool debug_stop(CPU *cpu) {
+    return __builtin_expect(cpu->debug != NULL, 0) &&
+           (cpu->debug->step || cpu->debug->hit || breakpoint(cpu, cpu->PC));
+}
+
+#ifdef PAIR_STATS
+static u_int64_t pair_count[256][256];
+static int last_opcode = -1;
+
+void print_pair_stats(int top) {
+    u_int64_t total = 0;
+    for (int i = 0; i < 0x10000; i++) total += pair_count[i >> 8][i & 0xFF];
+    printf("opcode pairs : %llu\n", (unsigned long long)total);
+    for (int n = 0; n < top; n++) {
+        int best = 0;
+        for (int i = 1; i < 0x10000; i++) {
+            if (pair_count[i >> 8][i & 0xFF] > pair_count[best >> 8][best & 0xFF]) best = i;
+        }
+        u_int64_t count = pair_count[best >> 8][best & 0xFF];
+        if (count == 0) break;
+        printf("  %02X %02X : %12llu  %5.2f%%\n", best >> 8, best & 0xFF,
+               (unsigned long long)count, 100.0 * count / total);
+        pair_count[best >> 8][best & 0xFF] = 0;
+    }
+}
+#endif
+
+// BNE or BEQ after an instruction that sets Z
+static inline int fuse_branch(CPU *cpu) {
+    Byte next = fetch_byte(cpu, cpu->PC);
+    if (next != BNE_REL && next != BEQ_REL) return 0;
+    TRACE("%s\n", next == BNE_REL ? "BNE_REL" : "BEQ_REL");
+    COVER(cpu->mem->executed, cpu->PC);
+    cpu->PC++;
+    cpu->cycles += opcode_cycles[next];
+    Byte val = read_from_pc(cpu);
+    branch(cpu, val, cpu->Z == (next == BEQ_REL));
+    return 1;
+}
+
+// STA after LDA, ADC or SBC
+static inline int fuse_store(CPU *cpu) {
+    Word at = cpu->PC;
+    Byte next = fetch_byte(cpu, at);
+    Word addr;
+    switch (next) {
+        case STA_ZP:
+            TRACE("STA_ZP\n");
+            cpu->PC++;
+            addr = (Word)read_from_pc(cpu);
+            break;
+        case STA_ABS: case STA_ABSX: case STA_ABSY:
+            TRACE("%s\n", next == STA_ABS ? "STA_ABS" : next == STA_ABSX ? "STA_ABSX" : "STA_ABSY");
+            cpu->PC++;
+            addr = (Word)read_from_pc(cpu);
+            addr |= (Word)read_from_pc(cpu) << 8;
+            addr += next == STA_ABSX ? cpu->X : next == STA_ABSY ? cpu->Y : 0;
+            break;
+        case STA_INDY: {
+            TRACE("STA_INDY\n");
+            cpu->PC++;
+            Byte zp = read_from_pc(cpu);
+            addr = (Word)((read_byte(cpu, (Byte)(zp + 1)) << 8) | read_byte(cpu, zp)) + cpu->Y;
+            break;
+        }
+        default:
+            return 0;
+    }
+    COVER(cpu->mem->executed, at);
+    cpu->cycles += opcode_cycles[next];
+    sta(cpu, addr);
+    return 1;
+}
+
+// CPX # after INX or CPY # after INY, then the loop branch
+static inline int fuse_compare(CPU *cpu, Byte opcode) {
+    if (fetch_byte(cpu, cpu->PC) != opcode) return fuse_branch(cpu);
+    TRACE("%s\n", opcode == CPX_IM ? "CPX_IM" : "CPY_IM");
+    COVER(cpu->mem->executed, cpu->PC);
+    cpu->PC++;
+    cpu->cycles += opcode_cycles[opcode];
+    Byte val = read_from_pc(cpu);
+    if (opcode == CPX_IM) cpx(cpu, val);
+    else cpy(cpu, val);
+    return 1 + fuse_branch(cpu);
+}
+
+// ADC or SBC after CLC or SEC; its cycles are counted before the operand
+// is read, as for the instruction on its own
+static inline int fuse_carry_op(CPU *cpu) {
+    Word at = cpu->PC;
+    Byte next = fetch_byte(cpu, at);
+    Byte val;
+    switch (next) {
+        case ADC_IM: case SBC_IM:
+            cpu->PC++;
+            cpu->cycles += opcode_cycles[next];
+            val = read_from_pc(cpu);
+            break;
+        case ADC_ZP: case SBC_ZP:
+            cpu->PC++;
+            cpu->cycles += opcode_cycles[next];
+            val = read_byte(cpu, read_from_pc(cpu));
+            break;
+        case ADC_ABS: case SBC_ABS: {
+            cpu->PC++;
+            cpu->cycles += opcode_cycles[next];
+            Word addr = (Word)read_from_pc(cpu);
+            addr |= (Word)read_from_pc(cpu) << 8;
+            val = read_byte(cpu, addr);
+            break;
+        }
+        default:
+            return 0;
+    }
+    COVER(cpu->mem->executed, at);
+    if (next == ADC_IM || next == ADC_ZP || next == ADC_ABS) {
+        TRACE("%s\n", next == ADC_IM ? "ADC_IM" : next == ADC_ZP ? "ADC_ZP" : "ADC_ABS");
+        adc(cpu, val);
+    } else {
+        TRACE("%s\n", next == SBC_IM ? "SBC_IM" : next == SBC_ZP ? "SBC_ZP" : "SBC_ABS");
+        sbc(cpu, val);
+    }
+    return 1 + fuse_store(cpu);
+}
+
+int execute_instructions(CPU *cpu) {
+    COVER(cpu->mem->executed, cpu->PC);
+    Byte opcode = read_from_pc(cpu);
+    int fused = 0;
+    cpu->cycles += opcode_cycles[opcode];
+    if (page_cross[opcode]) cpu->cycles += crosses_page(cpu, page_cross[opcode]);
+#ifdef PAIR_STATS
+    if (last_opcode >= 0) pair_count[last_opcode][opcode]++;
+    last_opcode = opcode;
+#endif
     switch(opcode) {
         case ADC_IM: {
-            printf("ADC_IM\n");
-            Byte val = read_from_pc();
-            adc(&cpu, val);
+            TRACE("ADC_IM\n");
+            Byte val = read_from_pc(cpu);
+            adc(cpu, val);
+            fused = FUSE(fuse_store(cpu));
             break;
         }
         case ADC_ZP: {
-            printf("ADC_ZP\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr);
-            adc(&cpu, val);
+            TRACE("ADC_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            adc(cpu, val);
+            fused = FUSE(fuse_store(cpu));
             break;
         }
         case ADC_ZPX: {
-            printf("ADC_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr + cpu.X);
-            adc(&cpu, val);
+            TRACE("ADC_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, (addr + cpu->X) & 0xFF);
+            adc(cpu, val);
             break;
         }
         case ADC_ABS: {
-            printf("ADC_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            adc(&cpu, val);
+            TRACE("ADC_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            adc(cpu, val);
             break;
         }
         case ADC_ABSX: {
-            printf("ADC_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            Byte val = read_byte(addr);
-            adc(&cpu, val);
+            TRACE("ADC_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            Byte val = read_byte(cpu, addr);
+            adc(cpu, val);
             break;
         }
         case ADC_ABSY: {
-            printf("ADC_ABSY\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.Y;
-            Byte val = read_byte(addr);
-            adc(&cpu, val);
+            TRACE("ADC_ABSY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            adc(cpu, val);
             break;
         }
         case ADC_INDX: {
-            printf("ADC_INDX\n");
-            Word addr = (Word)read_from_pc();
-            addr += (Word)cpu.X;
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr + 1);
+            TRACE("ADC_INDX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + (Word)cpu->X) & 0xFF;
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
             addr = ((high << 8) | low);
-            Byte val = read_byte(addr);
-            adc(&cpu, val);
+            Byte val = read_byte(cpu, addr);
+            adc(cpu, val);
             break;
         }
         case ADC_INDY: {
-            printf("ADC_INDY\n");
-            Word addr = (Word)read_from_pc();
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr);
-            addr = ((high << 8) | low) + (Word)cpu.Y;
-            Byte val = read_byte(addr);
-            adc(&cpu, val);
+            TRACE("ADC_INDY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
+            addr = ((high << 8) | low) + (Word)cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            adc(cpu, val);
             break;
         }
 
         case AND_IM: {
-            printf("AND_IM\n");
-            Byte val = read_from_pc();
-            and(&cpu, val);
+            TRACE("AND_IM\n");
+            Byte val = read_from_pc(cpu);
+            and(cpu, val);
             break;
         }
         case AND_ZP: {
-            printf("AND_ZP\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr);
-            adc(&cpu, val);
+            TRACE("AND_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            and(cpu, val);
             break;
         }
         case AND_ZPX: {
-            printf("AND_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr + cpu.X);
-            adc(&cpu, val);
+            TRACE("AND_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, (addr + cpu->X) & 0xFF);
+            and(cpu, val);
             break;
         }
         case AND_ABS: {
-            printf("AND_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            and(&cpu, val);
+            TRACE("AND_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            and(cpu, val);
             break;
         }
         case AND_ABSX: {
-            printf("AND_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            Byte val = read_byte(addr);
-            and(&cpu, val);
+            TRACE("AND_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            Byte val = read_byte(cpu, addr);
+            and(cpu, val);
             break;
         }
         case AND_ABSY: {
-            printf("AND_ABSY");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.Y;
-            Byte val = read_byte(addr);
-            and(&cpu, val);
+            TRACE("AND_ABSY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            and(cpu, val);
             break;
         }
         case AND_INDX: {
-            printf("AND_INDX\n");
-            Word addr = (Word)read_from_pc();
-            addr += (Word)cpu.X;
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr + 1);
+            TRACE("AND_INDX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + (Word)cpu->X) & 0xFF;
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
             addr = ((high << 8) | low);
-            Byte val = read_byte(addr);
-            and(&cpu, val);
+            Byte val = read_byte(cpu, addr);
+            and(cpu, val);
             break;
         }
         case AND_INDY: {
-            printf("AND_INDY\n");
-            Word addr = (Word)read_from_pc();
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr);
-            addr = ((high << 8) | low) + (Word)cpu.Y;
-            Byte val = read_byte(addr);
-            and(&cpu, val);
+            TRACE("AND_INDY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
+            addr = ((high << 8) | low) + (Word)cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            and(cpu, val);
             break;
         }
         case ASL_ACC: {
-            printf("ASL_ACC\n");
-            cpu.C =  (cpu.A & 0x80) != 0;
-            cpu.A = cpu.A << 1;
-            cpu.Z = (cpu.A & 0xFF) == 0;
-            cpu.N = (cpu.A & 0x80) != 0;
+            TRACE("ASL_ACC\n");
+            cpu->A = asl(cpu, cpu->A);
             break;
         }
         case ASL_ZP: {
-            printf("ASL_ZP\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr);
-            cpu.C = (val & 0x80) != 0;
-            val = val << 1;
-            cpu.Z = (val & 0xFF) == 0;
-            cpu.N = (val & 0x80) != 0;
-            write_byte(addr, val);
+            TRACE("ASL_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, asl(cpu, val));
             break;
         }
         case ASL_ZPX: {
-            printf("ASL_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            addr += cpu.X;
-            Byte val = read_byte(addr);
-            cpu.C = (val & 0x80) != 0;
-            val = val << 1;
-            cpu.Z = (val & 0xFF) == 0;
-            cpu.N = (val & 0x80) != 0;
-            write_byte(addr, val);
+            TRACE("ASL_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + cpu->X) & 0xFF;
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, asl(cpu, val));
             break;
         }
         case ASL_ABS: {
-            printf("ASL_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            cpu.C = (val & 0x80) != 0;
-            val = val << 1;
-            cpu.Z = (val & 0xFF) == 0;
-            cpu.N = (val & 0x80) != 0;
-            write_byte(addr, val);
+            TRACE("ASL_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, asl(cpu, val));
             break;
         }
         case ASL_ABSX: {
-            printf("ASL_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            Byte val = read_byte(addr);
-            cpu.C = (val & 0x80) != 0;
-            val = val << 1;
-            cpu.Z = (val & 0xFF) == 0;
-            cpu.N = (val & 0x80) != 0;
-            write_byte(addr, val);
+            TRACE("ASL_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, asl(cpu, val));
             break;
         }
         case BCC_REL: {
-            printf("BCC_REL\n");
-            Byte val = read_from_pc();
-            if (val & 0x80) val |= 0xFFFFFF00;
-            if (cpu.C == 0) cpu.PC += (Byte)val;
+            TRACE("BCC_REL\n");
+            Byte val = read_from_pc(cpu);
+            branch(cpu, val, cpu->C == 0);
             break;
         }
         case BCS_REL: {
-            printf("BCS_REL\n");
-            Byte val = read_from_pc();
-            if (val & 0x80) val |= 0xFFFFFF00;
-            if (cpu.PC == 1) cpu.PC += (Byte)val;
+            TRACE("BCS_REL\n");
+            Byte val = read_from_pc(cpu);
+            branch(cpu, val, cpu->C == 1);
             break;
         }
         case BEQ_REL: {
-            printf("BEQ_REL\n");
-            Byte val = read_from_pc();
-            if (val & 0x80) val |= 0xFFFFFF00;
-            if (cpu.Z == 1) cpu.PC += (Byte)val;
+            TRACE("BEQ_REL\n");
+            Byte val = read_from_pc(cpu);
+            branch(cpu, val, cpu->Z == 1);
             break;
         }
         case BIT_ZP: {
-           printf("BIT_ZP\n");
-           Word addr = (Word)read_from_pc();
-           Byte val = read_byte(addr);
-           Byte temp = cpu.A & val;
-           cpu.Z = temp == 0;
-           cpu.V = (val & 0b01000000) != 0;
-           cpu.N = (val & 0b10000000) != 0;
+           TRACE("BIT_ZP\n");
+           Word addr = (Word)read_from_pc(cpu);
+           Byte val = read_byte(cpu, addr);
+           Byte temp = cpu->A & val;
+           cpu->Z = temp == 0;
+           cpu->V = (val & 0b01000000) != 0;
+           cpu->N = (val & 0b10000000) != 0;
            break;
         }
         case BIT_ABS: {
-            printf("BIT_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            Byte temp = cpu.A & val;
-            cpu.Z = temp == 0;
-            cpu.V = (val & 0b01000000) != 0;
-            cpu.N = (val & 0b10000000) != 0;
+            TRACE("BIT_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            Byte temp = cpu->A & val;
+            cpu->Z = temp == 0;
+            cpu->V = (val & 0b01000000) != 0;
+            cpu->N = (val & 0b10000000) != 0;
             break;
         }
         case BMI_REL: {
-            printf("BMI_REL\n");
-            Byte val = read_from_pc();
-            if (val & 0x80) val |= 0xFFFFFF00;
-            if (cpu.N == 1) cpu.PC += (Byte)val;
+            TRACE("BMI_REL\n");
+            Byte val = read_from_pc(cpu);
+            branch(cpu, val, cpu->N == 1);
             break;
         }
         case BNE_REL: {
-            printf("BNE_REL\n");
-            Byte val = read_from_pc();
-            if (val & 0x80) val |= 0xFFFFFF00;
-            if (cpu.Z == 0) cpu.PC += (Byte)val;
+            TRACE("BNE_REL\n");
+            Byte val = read_from_pc(cpu);
+            branch(cpu, val, cpu->Z == 0);
             break;
         }
         case BPL_REL: {
-            printf("BPL_REL\n");
-            Byte val = read_from_pc();
-            if (val & 0x80) val |= 0xFFFFFF00;
-            if (cpu.N == 0) cpu.PC += (Byte)val;
+            TRACE("BPL_REL\n");
+            Byte val = read_from_pc(cpu);
+            branch(cpu, val, cpu->N == 0);
             break;
         }
         case BRK_IMPL: {
-            printf("BRK_IMPL\n");
-            push_to_stack(((cpu.PC + 2) >> 8) & 0xFF);
-            push_to_stack((cpu.PC+2) & 0xFF);
+            TRACE("BRK_IMPL\n");
+            push_to_stack(cpu, ((cpu->PC + 1) >> 8) & 0xFF);
+            push_to_stack(cpu, (cpu->PC + 1) & 0xFF);
 
-            Byte Status = ((cpu.N) << 7) | (cpu.V << 6) | (1 << 5) | (cpu.B << 4) | (cpu.D << 3) | (cpu.I << 2) | (cpu.Z << 1) | (cpu.C << 0);
+            Byte Status = ((cpu->N) << 7) | (cpu->V << 6) | (1 << 5) | (cpu->B << 4) | (cpu->D << 3) | (cpu->I << 2) | (cpu->Z << 1) | (cpu->C << 0);
             Status |= 0x10;
-            push_to_stack(Status);
+            push_to_stack(cpu, Status);
 
-            cpu.I = 1;
-            cpu.B = 1;
+            cpu->I = 1;
+            cpu->B = 1;
 
-            Byte low = read_byte(0xFFFE);
-            Byte high = read_byte(0xFFFF);
-            cpu.PC = (high << 8) | low;
+            Byte low = read_byte(cpu, 0xFFFE);
+            Byte high = read_byte(cpu, 0xFFFF);
+            cpu->PC = (high << 8) | low;
+            edge(cpu, cpu->PC);
             break;
         }
         case BVC_REL: {
-            printf("BVC_REL\n");
-            Byte val = read_from_pc();
-            if (val & 0x80) val |= 0xFFFFFF00;
-            if (cpu.V == 0) cpu.PC += (Byte)val;
+            TRACE("BVC_REL\n");
+            Byte val = read_from_pc(cpu);
+            branch(cpu, val, cpu->V == 0);
             break;
         }
         case BVS_REL: {
-            printf("BVS_REL\n");
-            Byte val = read_from_pc();
-            if (val & 0x80) val |= 0xFFFFFF00;
-            if (cpu.V == 1) cpu.PC += (Byte)val;
+            TRACE("BVS_REL\n");
+            Byte val = read_from_pc(cpu);
+            branch(cpu, val, cpu->V == 1);
             break;
         }
         case CLC_IMPL: {
-            printf("CLC_IMPL\n");
-            cpu.C = 0;
+            TRACE("CLC_IMPL\n");
+            cpu->C = 0;
+            fused = FUSE(fuse_carry_op(cpu));
             break;
         }
         case CLD_IMPL: {
-            printf("CLD_IMPL\n");
-            cpu.D = 0;
+            TRACE("CLD_IMPL\n");
+            cpu->D = 0;
             break;
         }
         case CLI_IMPL: {
-            printf("CLI_IMPL\n");
-            cpu.I = 0;
+            TRACE("CLI_IMPL\n");
+            cpu->I = 0;
             break;
         }
         case CLV_IMPL: {
-            printf("CLV_IMPL\n");
-            cpu.V = 0;
+            TRACE("CLV_IMPL\n");
+            cpu->V = 0;
             break;
         }
         case CMP_IM: {
-            printf("CMP_IM\n");
-            Byte val = read_from_pc();
-            cmp(&cpu, val);
+            TRACE("CMP_IM\n");
+            Byte val = read_from_pc(cpu);
+            cmp(cpu, val);
+            fused = FUSE(fuse_branch(cpu));
             break;
         }
         case CMP_ZP: {
-            printf("CMP_ZP\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr);
-            cmp(&cpu, val);
+            TRACE("CMP_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            cmp(cpu, val);
+            fused = FUSE(fuse_branch(cpu));
             break;
         }
         case CMP_ZPX: {
-            printf("CMP_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr + cpu.X);
-            cmp(&cpu, val);
+            TRACE("CMP_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, (addr + cpu->X) & 0xFF);
+            cmp(cpu, val);
             break;
         }
         case CMP_ABS: {
-            printf("CMP_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            cmp(&cpu, val);
+            TRACE("CMP_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            cmp(cpu, val);
             break;
         }
         case CMP_ABSX: {
-            printf("CMP_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            Byte val = read_byte(addr);
-            cmp(&cpu, val);
+            TRACE("CMP_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            Byte val = read_byte(cpu, addr);
+            cmp(cpu, val);
             break;
         }
         case CMP_ABSY: {
-            printf("CMP_ABSY\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.Y;
-            Byte val = read_word(addr);
-            cmp(&cpu, val);
+            TRACE("CMP_ABSY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            cmp(cpu, val);
             break;
         }
         case CMP_INDX: {
-            printf("CMP_INDX\n");
-            Word addr = (Word)read_from_pc();
-            addr += (Word)cpu.X;
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr + 1);
+            TRACE("CMP_INDX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + (Word)cpu->X) & 0xFF;
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
             addr = ((high << 8) | low);
-            Byte val = read_byte(addr);
-            cmp(&cpu, val);
+            Byte val = read_byte(cpu, addr);
+            cmp(cpu, val);
             break;
         }
         case CMP_INDY: {
-            printf("CMP_INDY\n");
-            Word addr = (Word)read_from_pc();
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr);
-            addr = ((high << 8) | low) + (Word)cpu.Y;
-            Byte val = read_byte(addr);
-            cmp(&cpu, val);
+            TRACE("CMP_INDY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
+            addr = ((high << 8) | low) + (Word)cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            cmp(cpu, val);
             break;
         }
         case CPX_IM: {
-            printf("CPX_IM\n");
-            Byte val = read_from_pc();
-            cpx(&cpu, val);
+            TRACE("CPX_IM\n");
+            Byte val = read_from_pc(cpu);
+            cpx(cpu, val);
+            fused = FUSE(fuse_branch(cpu));
             break;
         }
         case CPX_ZP: {
-            printf("CPX_ZP\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr);
-            cpx(&cpu, val);
+            TRACE("CPX_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            cpx(cpu, val);
             break;
         }
         case CPX_ABS: {
-            printf("CPX_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            cpx(&cpu, val);
+            TRACE("CPX_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            cpx(cpu, val);
             break;
         }
         case CPY_IM: {
-            printf("CPY_IM\n");
-            Byte val = read_from_pc();
-            cpy(&cpu, val);
+            TRACE("CPY_IM\n");
+            Byte val = read_from_pc(cpu);
+            cpy(cpu, val);
+            fused = FUSE(fuse_branch(cpu));
             break;
         }
         case CPY_ZP: {
-            printf("CPY_ZP\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr);
-            cpy(&cpu, val);
+            TRACE("CPY_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            cpy(cpu, val);
             break;
         }
         case CPY_ABS: {
-            printf("CPY_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            cpy(&cpu, val);
+            TRACE("CPY_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            cpy(cpu, val);
             break;
         }
         case DEC_ABS: {
-            printf("DEC_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            dec(&cpu, addr);
+            TRACE("DEC_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            dec(cpu, addr);
             break;
         }
         case DEC_ZP: {
-            printf("DEC_ZP\n");
-            Word addr = (Word)read_from_pc();
-            dec(&cpu, addr);
+            TRACE("DEC_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            dec(cpu, addr);
             break;
         }
         case DEC_ZPX: {
-            printf("DEC_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            dec(&cpu, addr + cpu.X);
+            TRACE("DEC_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            dec(cpu, (addr + cpu->X) & 0xFF);
             break;
         }
         case DEC_ABSX: {
-            printf("DEC_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            addr += cpu.X;
-            dec(&cpu, addr);
+            TRACE("DEC_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            addr += cpu->X;
+            dec(cpu, addr);
             break;
         }
         case DEX_IMPL: {
-            printf("DEX_IMPL\n");
-            cpu.X--;
-            if (cpu.X == 0) cpu.Z = 1;
-            cpu.N = (cpu.X & 0x80) != 0;
+            TRACE("DEX_IMPL\n");
+            cpu->X--;
+            cpu->Z = (cpu->X == 0) ? 1 : 0;
+            cpu->N = (cpu->X & 0x80) != 0;
+            fused = FUSE(fuse_branch(cpu));
             break;
         }
         case DEY_IMPL: {
-            printf("DEY_IMPL\n");
-            cpu.Y--;
-            cpu.Z = (cpu.X == 0)? 1: 0;
-            cpu.N = (cpu.X & 0x80) != 0;
+            TRACE("DEY_IMPL\n");
+            cpu->Y--;
+            cpu->Z = (cpu->Y == 0) ? 1 : 0;
+            cpu->N = (cpu->Y & 0x80) != 0;
+            fused = FUSE(fuse_branch(cpu));
             break;
         }
         case EOR_IM: {
-            printf("EOR_IM\n");
-            Byte val = read_from_pc();
-            eor(&cpu, val);
+            TRACE("EOR_IM\n");
+            Byte val = read_from_pc(cpu);
+            eor(cpu, val);
             break;
         }
         case EOR_ZP: {
-            printf("EOR_ZP\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr);
-            eor(&cpu, val);
+            TRACE("EOR_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            eor(cpu, val);
             break;
         }
         case EOR_ZPX: {
-            printf("EOR_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            addr += cpu.X;
-            Byte val = read_byte(addr);
-            eor(&cpu, val);
+            TRACE("EOR_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + cpu->X) & 0xFF;
+            Byte val = read_byte(cpu, addr);
+            eor(cpu, val);
             break;
         }
         case EOR_ABS: {
-            printf("EOR_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            eor(&cpu, val);
+            TRACE("EOR_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            eor(cpu, val);
             break;
         }
         case EOR_ABSX: {
-            printf("EOR_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            Byte val = read_byte(addr);
-            eor(&cpu, val);
+            TRACE("EOR_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            Byte val = read_byte(cpu, addr);
+            eor(cpu, val);
             break;
         }
         case EOR_ABSY: {
-            printf("EOR_ABSY\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.Y;
-            Byte val = read_byte(addr);
-            eor(&cpu, val);
+            TRACE("EOR_ABSY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            eor(cpu, val);
             break;
         }
         case EOR_INDX: {
-            printf("EOR_INDX\n");
-            Word addr = (Word)read_from_pc();
-            addr += (Word)cpu.X;
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr + 1);
+            TRACE("EOR_INDX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + (Word)cpu->X) & 0xFF;
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
             addr = ((high << 8) | low);
-            Byte val = read_byte(addr);
-            eor(&cpu, val);
+            Byte val = read_byte(cpu, addr);
+            eor(cpu, val);
             break;
         }
         case EOR_INDY: {
-            printf("EOR_INDY\n");
-            Word addr = (Word)read_from_pc();
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr);
-            addr = ((high << 8) | low) + (Word)cpu.Y;
-            Byte val = read_byte(addr);
-            eor(&cpu, val);
+            TRACE("EOR_INDY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
+            addr = ((high << 8) | low) + (Word)cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            eor(cpu, val);
             break;
         }
         case INC_ABS: {
-            printf("INC_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            inc(&cpu, addr);
+            TRACE("INC_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            inc(cpu, addr);
             break;
         }
         case INC_ZP: {
-            printf("INC_ZP\n");
-            Word addr = (Word)read_from_pc();
-            inc(&cpu, addr);
+            TRACE("INC_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            inc(cpu, addr);
             break;
         }
         case INC_ZPX: {
-            printf("INC_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            addr += cpu.X;
-            inc(&cpu, addr);
+            TRACE("INC_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + cpu->X) & 0xFF;
+            inc(cpu, addr);
             break;
         }
         case INC_ABSX: {
-            printf("INC_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            inc(&cpu, addr);
+            TRACE("INC_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            inc(cpu, addr);
             break;
         }
         case INX_IMPL: {
-            printf("INX_IMPL\n");
-            cpu.X++;
-            cpu.Z = (cpu.X == 0) ? 1: 0;
-            cpu.N = ((cpu.X & 0x80) != 0);
+            TRACE("INX_IMPL\n");
+            cpu->X++;
+            cpu->Z = (cpu->X == 0) ? 1: 0;
+            cpu->N = ((cpu->X & 0x80) != 0);
+            fused = FUSE(fuse_compare(cpu, CPX_IM));
             break;
         }
         case INY_IMPL: {
-            printf("INY_IMPL\n");
-            cpu.Y++;
-            cpu.Z = (cpu.X == 0) ? 1 : 0;
-            cpu.N = ((cpu.X & 0x80) != 0);
+            TRACE("INY_IMPL\n");
+            cpu->Y++;
+            cpu->Z = (cpu->Y == 0) ? 1 : 0;
+            cpu->N = ((cpu->Y & 0x80) != 0);
+            fused = FUSE(fuse_compare(cpu, CPY_IM));
             break;
         }
         case JMP_ABS: {
-            printf("JMP_ABS\n");
-            Word addr1 = (Word)read_from_pc();
-            Byte addr2 = read_from_pc();
+            TRACE("JMP_ABS\n");
+            Word addr1 = (Word)read_from_pc(cpu);
+            Byte addr2 = read_from_pc(cpu);
             addr1 = (addr1) | (addr2 << 8);
-            cpu.PC = addr1;
+            cpu->PC = addr1;
+            edge(cpu, cpu->PC);
             break;
         }
         case JMP_IND: {
-            printf("JMP_IND\n");
-            Word addr = (Word)read_from_pc();
-            Byte addr2 = read_from_pc();
+            TRACE("JMP_IND\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte addr2 = read_from_pc(cpu);
             addr = (addr) | (addr2 << 8);
-            Word val = read_word(addr);
-            cpu.PC = val;
+            // NMOS parts do not carry into the high byte of the pointer
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr & 0xFF00) | ((addr + 1) & 0x00FF));
+            cpu->PC = (high << 8) | low;
+            edge(cpu, cpu->PC);
             break;
         }
         case JSR_ABS: {
-            printf("JSR_ABS\n");
-            Word addr1 = (Word)read_from_pc();
-            Byte addr2 = read_from_pc();
+            TRACE("JSR_ABS\n");
+            Word addr1 = (Word)read_from_pc(cpu);
+            Byte addr2 = read_from_pc(cpu);
             addr1 = (addr1) | (addr2 << 8);
-            cpu.PC = addr1;
-            Word ret_addr = cpu.PC - 1;
-            push_to_stack((Byte)((ret_addr >> 8) & 0xFF));
-            push_to_stack((Byte)(ret_addr & 0xFF));
+            Word ret_addr = cpu->PC - 1;
+            push_to_stack(cpu, (Byte)((ret_addr >> 8) & 0xFF));
+            push_to_stack(cpu, (Byte)(ret_addr & 0xFF));
+            cpu->PC = addr1;
+            edge(cpu, cpu->PC);
+            if (hooked(cpu, addr1)) call_hook(cpu);
             break;
         }
         case LDA_IM: {
-            printf("LDA_IM\n");
-            Byte val = read_from_pc();
-            lda(&cpu, val);
+            TRACE("LDA_IM\n");
+            Byte val = read_from_pc(cpu);
+            lda(cpu, val);
+            fused = FUSE(fuse_store(cpu));
             break;
         }
         case LDA_ZP: {
-            printf("LDA_ZP\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr);
-            lda(&cpu, val);
+            TRACE("LDA_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            lda(cpu, val);
+            fused = FUSE(fuse_store(cpu));
             break;
         }
         case LDA_ZPX: {
-            printf("LDA_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            addr += cpu.X;
-            Byte val = read_byte(addr);
-            lda(&cpu, val);
+            TRACE("LDA_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + cpu->X) & 0xFF;
+            Byte val = read_byte(cpu, addr);
+            lda(cpu, val);
             break;
         }
         case LDA_ABS: {
-            printf("LDA_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            lda(&cpu, val);
+            TRACE("LDA_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            lda(cpu, val);
+            fused = FUSE(fuse_store(cpu));
             break;
         }
         case LDA_ABSX: {
-            printf("LDA_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            Byte val = read_byte(addr);
-            lda(&cpu, val);
+            TRACE("LDA_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            Byte val = read_byte(cpu, addr);
+            lda(cpu, val);
+            fused = FUSE(fuse_store(cpu));
             break;
         }
         case LDA_ABSY: {
-            printf("LDA_ABSY\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.Y;
-            Byte val = read_byte(addr);
-            lda(&cpu, val);
+            TRACE("LDA_ABSY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            lda(cpu, val);
+            fused = FUSE(fuse_store(cpu));
             break;
         }
         case LDA_INDX: {
-            printf("LDA_INDX\n");
-            Word addr = (Word)read_from_pc();
-            addr += (Word)cpu.X;
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr + 1);
+            TRACE("LDA_INDX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + (Word)cpu->X) & 0xFF;
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
             addr = ((high << 8) | low);
-            Byte val = read_byte(addr);
-            lda(&cpu, val);
+            Byte val = read_byte(cpu, addr);
+            lda(cpu, val);
             break;
         }
         case LDA_INDY: {
-            printf("LDA_INDY\n");
-            Word addr = (Word)read_from_pc();
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr);
-            addr = ((high << 8) | low) + (Word)cpu.Y;
-            Byte val = read_byte(addr);
-            lda(&cpu, val);
+            TRACE("LDA_INDY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
+            addr = ((high << 8) | low) + (Word)cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            lda(cpu, val);
+            fused = FUSE(fuse_store(cpu));
             break;
         }
         case LDX_IM: {
-            printf("LDX_IM\n");
-            Byte val = read_from_pc();
-            ldx(&cpu, val);
+            TRACE("LDX_IM\n");
+            Byte val = read_from_pc(cpu);
+            ldx(cpu, val);
             break;
         }
         case LDX_ZP: {
-            printf("LDX_ZP\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr);
-            ldx(&cpu, val);
+            TRACE("LDX_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            ldx(cpu, val);
             break;
         }
         case LDX_ZPY: {
-            printf("LDX_ZPY\n");
-            Word addr = (Word)read_from_pc();
-            addr += cpu.Y;
-            Byte val = read_byte(addr);
-            ldx(&cpu, val);
+            TRACE("LDX_ZPY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + cpu->Y) & 0xFF;
+            Byte val = read_byte(cpu, addr);
+            ldx(cpu, val);
             break;
         }
         case LDX_ABS: {
-            printf("LDX_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            ldx(&cpu, val);
+            TRACE("LDX_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            ldx(cpu, val);
             break;
         }
         case LDX_ABSY: {
-            printf("LDX_ABSY\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.Y;
-            Byte val = read_byte(addr);
-            ldx(&cpu, val);
+            TRACE("LDX_ABSY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            ldx(cpu, val);
             break;
         }
         case LDY_IM: {
-            printf("LDY_IM\n");
-            Byte val = read_from_pc();
-            ldy(&cpu, val);
+            TRACE("LDY_IM\n");
+            Byte val = read_from_pc(cpu);
+            ldy(cpu, val);
             break;
         }
         case LDY_ZP: {
-            printf("LDY_ZP\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr);
-            ldy(&cpu, val);
+            TRACE("LDY_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            ldy(cpu, val);
             break;
         }
         case LDY_ZPX: {
-            printf("LDY_ZPY\n");
-            Word addr = (Word)read_from_pc();
-            addr += cpu.X;
-            Byte val = read_byte(addr);
-            ldy(&cpu, val);
+            TRACE("LDY_ZPY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + cpu->X) & 0xFF;
+            Byte val = read_byte(cpu, addr);
+            ldy(cpu, val);
             break;
         }
         case LDY_ABS: {
-            printf("LDY_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            ldy(&cpu, val);
+            TRACE("LDY_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            ldy(cpu, val);
             break;
         }
         case LDY_ABSX: {
-            printf("LDY_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            Byte val = read_byte(addr);
-            ldy(&cpu, val);
+            TRACE("LDY_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            Byte val = read_byte(cpu, addr);
+            ldy(cpu, val);
             break;
         }
         case LSR_ACC: {
-            printf("LSR_ACC\n");
-            cpu.A = cpu.A >> 1;
-            cpu.C = ((cpu.A & 0x01) != 0);
-            cpu.Z = (cpu.A == 0x00);
-            cpu.N = (cpu.A & 0x80) != 0;
+            TRACE("LSR_ACC\n");
+            cpu->A = lsr(cpu, cpu->A);
             break;
         }
         case LSR_ABS: {
-            printf("LSR_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            lsr(&cpu, addr);
+            TRACE("LSR_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, lsr(cpu, val));
             break;
         }
         case LSR_ABSX: {
-            printf("LSR_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            lsr(&cpu, addr);
+            TRACE("LSR_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, lsr(cpu, val));
             break;
         }
         case LSR_ZP: {
-            printf("LSR_ZP\n");
-            Word addr = (Word)read_from_pc();
-            lsr(&cpu, addr);
+            TRACE("LSR_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, lsr(cpu, val));
             break;
         }
         case LSR_ZPX: {
-            printf("LSR_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            addr += cpu.X;
-            lsr(&cpu, addr);
+            TRACE("LSR_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + cpu->X) & 0xFF;
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, lsr(cpu, val));
             break;
         }
         case NOP_IMPL: {
-            printf("NOP_IMPL\n");
+            TRACE("NOP_IMPL\n");
             break;
         }
         case ORA_IM: {
-            printf("ORA_IM\n");
-            Byte val = read_from_pc();
-            ora(&cpu, val);
+            TRACE("ORA_IM\n");
+            Byte val = read_from_pc(cpu);
+            ora(cpu, val);
             break;
         }
         case ORA_ZP: {
-            printf("ORA_ZP\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr);
-            ora(&cpu, val);
+            TRACE("ORA_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            ora(cpu, val);
             break;
         }
         case ORA_ZPX: {
-            printf("ORA_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            addr += cpu.Y;
-            Byte val = read_byte(addr);
-            ora(&cpu, val);
+            TRACE("ORA_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + cpu->X) & 0xFF;
+            Byte val = read_byte(cpu, addr);
+            ora(cpu, val);
             break;
         }
         case ORA_ABS: {
-            printf("ORA_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            ora(&cpu, val);
+            TRACE("ORA_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            ora(cpu, val);
             break;
         }
         case ORA_ABSX: {
-            printf("ORA_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            Byte val = read_byte(addr);
-            ora(&cpu, val);
+            TRACE("ORA_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            Byte val = read_byte(cpu, addr);
+            ora(cpu, val);
             break;
         }
         case ORA_ABSY: {
-            printf("ORA_ABSY\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.Y;
-            Byte val = read_byte(addr);
-            ora(&cpu, val);
+            TRACE("ORA_ABSY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            ora(cpu, val);
             break;
         }
         case ORA_INDX: {
-            printf("ORA_INDX\n");
-            Word addr = (Word)read_from_pc();
-            addr += (Word)cpu.X;
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr + 1);
+            TRACE("ORA_INDX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + (Word)cpu->X) & 0xFF;
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
             addr = ((high << 8) | low);
-            Byte val = read_byte(addr);
-            ora(&cpu, val);
+            Byte val = read_byte(cpu, addr);
+            ora(cpu, val);
             break;
         }
         case ORA_INDY: {
-            printf("ORA_INDY\n");
-            Word addr = (Word)read_from_pc();
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr);
-            addr = ((high << 8) | low) + (Word)cpu.Y;
-            Byte val = read_byte(addr);
-            ora(&cpu, val);
+            TRACE("ORA_INDY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
+            addr = ((high << 8) | low) + (Word)cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            ora(cpu, val);
             break;
         }
         case PHA_IMPL: {
-            printf("PHA_IMPL\n");
-            push_to_stack(cpu.A);
+            TRACE("PHA_IMPL\n");
+            push_to_stack(cpu, cpu->A);
             break;
         }
         case PHP_IMPL: {
-            printf("PHP_IMPL\n");
-            push_to_stack((Byte)(cpu.N << 7 | cpu.V << 6 | 1 << 5 | cpu.B << 4 | cpu.D << 3 | cpu.I << 2 | cpu.Z << 1 | cpu.C));
+            TRACE("PHP_IMPL\n");
+            push_to_stack(cpu, (Byte)(cpu->N << 7 | cpu->V << 6 | 1 << 5 | 1 << 4 | cpu->D << 3 | cpu->I << 2 | cpu->Z << 1 | cpu->C));
             break;
         }
         case PLA_IMPL: {
-            printf("PLA_IMPL\n");
-            cpu.A = pop_from_stack();
-            cpu.Z = (cpu.A == 0x00) ? 1 : 0;
-            cpu.N = (cpu.A & 0x80) != 0;
+            TRACE("PLA_IMPL\n");
+            cpu->A = pop_from_stack(cpu);
+            cpu->Z = (cpu->A == 0x00) ? 1 : 0;
+            cpu->N = (cpu->A & 0x80) != 0;
             break;
         }
         case PLP_IMPL: {
-            printf("PLP_IMPL\n");
-            Byte val = pop_from_stack();
-            cpu.N = (val & (1 << 7)) != 0;
-            cpu.V = (val & (1 << 6)) != 0;
-            cpu.B = (val & (1 << 4)) != 0;
-            cpu.D = (val & (1 << 3)) != 0;
-            cpu.I = (val & (1 << 2)) != 0;
-            cpu.Z = (val & (1 << 1)) != 0;
-            cpu.C = (val & (1)) != 0;
+            TRACE("PLP_IMPL\n");
+            Byte val = pop_from_stack(cpu);
+            cpu->N = (val & (1 << 7)) != 0;
+            cpu->V = (val & (1 << 6)) != 0;
+            cpu->B = (val & (1 << 4)) != 0;
+            cpu->D = (val & (1 << 3)) != 0;
+            cpu->I = (val & (1 << 2)) != 0;
+            cpu->Z = (val & (1 << 1)) != 0;
+            cpu->C = (val & (1)) != 0;
             break;
         }
         case ROL_ACC: {
-            printf("ROL_ACC\n");
-            cpu.C =  (cpu.A & 0x80) != 0;
-            cpu.A = cpu.A << 1;
-            cpu.Z = (cpu.A == 0x00);
-            cpu.N = (cpu.A & 0x80) != 0;
+            TRACE("ROL_ACC\n");
+            cpu->A = rol(cpu, cpu->A);
             break;
         }
         case ROL_ZP: {
-            printf("ROL_ZP\n");
-            Word addr = (Word) read_from_pc();
-            Byte val = read_byte(addr);
-            rol(&cpu, val);
+            TRACE("ROL_ZP\n");
+            Word addr = (Word) read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, rol(cpu, val));
             break;
         }
         case ROL_ZPX: {
-            printf("ROL_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr + cpu.X);
-            rol(&cpu, val);
+            TRACE("ROL_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + cpu->X) & 0xFF;
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, rol(cpu, val));
             break;
         }
         case ROL_ABS: {
-            printf("ROL_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            rol(&cpu, val);
+            TRACE("ROL_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, rol(cpu, val));
             break;
         }
         case ROL_ABSX: {
-            printf("ROL_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            Byte val = read_byte(addr);
-            rol(&cpu, val);
+            TRACE("ROL_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, rol(cpu, val));
             break;
         }
         case ROR_ACC: {
-            printf("ROR_ACC\n");
-            cpu.C =  (cpu.A & 0x80) != 0;
-            cpu.A = cpu.A >> 1;
-            cpu.Z = (cpu.A == 0x00);
-            cpu.N = (cpu.A & 0x80) != 0;
+            TRACE("ROR_ACC\n");
+            cpu->A = ror(cpu, cpu->A);
             break;
         }
         case ROR_ZP: {
-            printf("ROR_ZP\n");
-            Word addr = (Word) read_from_pc();
-            Byte val = read_byte(addr);
-            ror(&cpu, val);
+            TRACE("ROR_ZP\n");
+            Word addr = (Word) read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, ror(cpu, val));
             break;
         }
         case ROR_ZPX: {
-            printf("ROR_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr + cpu.X);
-            ror(&cpu, val);
+            TRACE("ROR_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + cpu->X) & 0xFF;
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, ror(cpu, val));
             break;
         }
         case ROR_ABS: {
-            printf("ROR_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            ror(&cpu, val);
+            TRACE("ROR_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, ror(cpu, val));
             break;
         }
         case ROR_ABSX: {
-            printf("ROR_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            Byte val = read_byte(addr);
-            ror(&cpu, val);
+            TRACE("ROR_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            Byte val = read_byte(cpu, addr);
+            write_byte(cpu, addr, ror(cpu, val));
             break;
         }
         case RTI_IMPL: {
-            printf("RTI_IMPL\n");
-            Byte val = pop_from_stack();
-            cpu.N = (val & (1 << 7)) != 0;
-            cpu.V = (val & (1 << 6)) != 0;
-            cpu.B = (val & (1 << 4)) != 0;
-            cpu.D = (val & (1 << 3)) != 0;
-            cpu.I = (val & (1 << 2)) != 0;
-            cpu.Z = (val & (1 << 1)) != 0;
-            cpu.C = (val & (1)) != 0;
+            TRACE("RTI_IMPL\n");
+            Byte val = pop_from_stack(cpu);
+            cpu->N = (val & (1 << 7)) != 0;
+            cpu->V = (val & (1 << 6)) != 0;
+            cpu->B = (val & (1 << 4)) != 0;
+            cpu->D = (val & (1 << 3)) != 0;
+            cpu->I = (val & (1 << 2)) != 0;
+            cpu->Z = (val & (1 << 1)) != 0;
+            cpu->C = (val & (1)) != 0;
 
-            Byte low = pop_from_stack();
-            Byte high = pop_from_stack();
-            cpu.PC = ((high << 8) | low);
+            Byte low = pop_from_stack(cpu);
+            Byte high = pop_from_stack(cpu);
+            cpu->PC = ((high << 8) | low);
+            edge(cpu, cpu->PC);
             break;
         }
         case RTS_IMPL: {
-            printf("RTS_IMPL\n");
-            Byte low = pop_from_stack();
-            Byte high = pop_from_stack();
-            cpu.PC = ((high << 8) | low) + 1;
+            TRACE("RTS_IMPL\n");
+            Byte low = pop_from_stack(cpu);
+            Byte high = pop_from_stack(cpu);
+            cpu->PC = ((high << 8) | low) + 1;
+            edge(cpu, cpu->PC);
             break;
         }
         case SBC_IM: {
-            printf("SBC_IM\n");
-            Byte val = read_from_pc();
-            sbc(&cpu, val);
+            TRACE("SBC_IM\n");
+            Byte val = read_from_pc(cpu);
+            sbc(cpu, val);
+            fused = FUSE(fuse_store(cpu));
             break;
         }
         case SBC_ZP: {
-            printf("SBC_ZP\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr);
-            sbc(&cpu, val);
+            TRACE("SBC_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, addr);
+            sbc(cpu, val);
+            fused = FUSE(fuse_store(cpu));
             break;
         }
         case SBC_ZPX: {
-            printf("SBC_ZPX\n");
-            Word addr = (Word)read_from_pc();
-            Byte val = read_byte(addr + cpu.X);
-            sbc(&cpu, val);
+            TRACE("SBC_ZPX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Byte val = read_byte(cpu, (addr + cpu->X) & 0xFF);
+            sbc(cpu, val);
             break;
         }
         case SBC_ABS: {
-            printf("SBC_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            Byte val = read_byte(addr);
-            sbc(&cpu, val);
+            TRACE("SBC_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            Byte val = read_byte(cpu, addr);
+            sbc(cpu, val);
             break;
         }
         case SBC_ABSX: {
-            printf("SBC_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            Byte val = read_byte(addr);
-            sbc(&cpu, val);
+            TRACE("SBC_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            Byte val = read_byte(cpu, addr);
+            sbc(cpu, val);
             break;
         }
         case SBC_ABSY: {
-            printf("SBC_ABSY\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.Y;
-            Byte val = read_word(addr);
-            cmp(&cpu, val);
+            TRACE("SBC_ABSY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            sbc(cpu, val);
             break;
         }
         case SBC_INDX: {
-            printf("SBC_INDX\n");
-            Word addr = (Word)read_from_pc();
-            addr += (Word)cpu.X;
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr + 1);
+            TRACE("SBC_INDX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + (Word)cpu->X) & 0xFF;
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
             addr = ((high << 8) | low);
-            Byte val = read_byte(addr);
-            sbc(&cpu, val);
+            Byte val = read_byte(cpu, addr);
+            sbc(cpu, val);
             break;
         }
         case SBC_INDY: {
-            printf("SBC_INDY\n");
-            Word addr = (Word)read_from_pc();
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr);
-            addr = ((high << 8) | low) + (Word)cpu.Y;
-            Byte val = read_byte(addr);
-            sbc(&cpu, val);
+            TRACE("SBC_INDY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
+            addr = ((high << 8) | low) + (Word)cpu->Y;
+            Byte val = read_byte(cpu, addr);
+            sbc(cpu, val);
             break;
         }
         case SEC_IMPL: {
-            printf("SEC_IMPL\n");
-            cpu.C = 1;
+            TRACE("SEC_IMPL\n");
+            cpu->C = 1;
+            fused = FUSE(fuse_carry_op(cpu));
             break;
         }
         case SED_IMPL: {
-            printf("SED_IMPL\n");
-            cpu.D = 1;
+            TRACE("SED_IMPL\n");
+            cpu->D = 1;
             break;
         };
         case SEI_IMPL: {
-            printf("SEI_IMPL\n");
-            cpu.I = 1;
+            TRACE("SEI_IMPL\n");
+            cpu->I = 1;
             break;
         }
         case STA_ZP: {
-            printf("STA_ZP\n");
-            Word addr = (Word)read_from_pc();
-            sta(&cpu, addr);
+            TRACE("STA_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            sta(cpu, addr);
             break;
         }
         case STA_ZPX: {
-            printf("STA_ZPX\n");
-            Word addr = (Word)read_from_pc() + cpu.X;
-            sta(&cpu, addr);
+            TRACE("STA_ZPX\n");
+            Word addr = ((Word)read_from_pc(cpu) + cpu->X) & 0xFF;
+            sta(cpu, addr);
             break;
         }
         case STA_ABS: {
-            printf("STA_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            sta(&cpu, addr);
+            TRACE("STA_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            sta(cpu, addr);
             break;
         }
         case STA_ABSX: {
-            printf("STA_ABSX\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.X;
-            sta(&cpu, addr);
+            TRACE("STA_ABSX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->X;
+            sta(cpu, addr);
             break;
         }
         case STA_ABSY: {
-            printf("STA_ABSY\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = ((addr << 8) | addr2) + cpu.Y;
-            sta(&cpu, addr);
+            TRACE("STA_ABSY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = (addr | (addr2 << 8)) + cpu->Y;
+            sta(cpu, addr);
             break;
         }
         case STA_INDX: {
-            printf("STA_INDX\n");
-            Word addr = (Word)read_from_pc();
-            addr += (Word)cpu.X;
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr + 1);
+            TRACE("STA_INDX\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + (Word)cpu->X) & 0xFF;
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
             addr = ((high << 8) | low);
-            sta(&cpu, addr);
+            sta(cpu, addr);
             break;
         }
         case STA_INDY: {
-            printf("STA_INDY\n");
-            Word addr = (Word)read_from_pc();
-            Word low = (Word)read_byte(addr);
-            Word high = (Word)read_byte(addr);
-            addr = ((high << 8) | low) + (Word)cpu.Y;
-            sta(&cpu, addr);
+            TRACE("STA_INDY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word low = (Word)read_byte(cpu, addr);
+            Word high = (Word)read_byte(cpu, (addr + 1) & 0xFF);
+            addr = ((high << 8) | low) + (Word)cpu->Y;
+            sta(cpu, addr);
             break;
         }
         case STX_ZP: {
-            printf("STX_ZP\n");
-            Word addr = (Word)read_from_pc();
-            stx(&cpu, addr);
+            TRACE("STX_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            stx(cpu, addr);
             break;
         }
         case STX_ZPY: {
-            printf("STX_ZPY\n");
-            Word addr = (Word)read_from_pc();
-            addr += cpu.Y;
-            stx(&cpu, addr);
+            TRACE("STX_ZPY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + cpu->Y) & 0xFF;
+            stx(cpu, addr);
             break;
         }
         case STX_ABS: {
-            printf("STX_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            stx(&cpu, addr);
+            TRACE("STX_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            stx(cpu, addr);
             break;
         }
         case STY_ZP: {
-            printf("STY_ZP\n");
-            Word addr = (Word)read_from_pc();
-            sty(&cpu, addr);
+            TRACE("STY_ZP\n");
+            Word addr = (Word)read_from_pc(cpu);
+            sty(cpu, addr);
             break;
         }
         case STY_ZPX: {
-            printf("STY_ZPY\n");
-            Word addr = (Word)read_from_pc();
-            addr += cpu.X;
-            sty(&cpu, addr);
+            TRACE("STY_ZPY\n");
+            Word addr = (Word)read_from_pc(cpu);
+            addr = (addr + cpu->X) & 0xFF;
+            sty(cpu, addr);
             break;
         }
         case STY_ABS: {
-            printf("STY_ABS\n");
-            Word addr = (Word)read_from_pc();
-            Word addr2 = (Word)read_from_pc();
-            addr = (addr << 8) | addr2;
-            sty(&cpu, addr);
+            TRACE("STY_ABS\n");
+            Word addr = (Word)read_from_pc(cpu);
+            Word addr2 = (Word)read_from_pc(cpu);
+            addr = addr | (addr2 << 8);
+            sty(cpu, addr);
             break;
         }
         case TAX_IMPL: {
-            printf("TAX_IMPL\n");
-            cpu.X = cpu.A;
-            cpu.Z = (cpu.X == 0x00);
-            cpu.N = ((cpu.X & 0x80) != 0);
+            TRACE("TAX_IMPL\n");
+            cpu->X = cpu->A;
+            cpu->Z = (cpu->X == 0x00);
+            cpu->N = ((cpu->X & 0x80) != 0);
             break;
         }
         case TAY_IMPL: {
-            printf("TAY_IMPL\n");
-            cpu.Y = cpu.A;
-            cpu.Z = (cpu.Y == 0x00);
-            cpu.N = ((cpu.Y & 0x80) != 0);
+            TRACE("TAY_IMPL\n");
+            cpu->Y = cpu->A;
+            cpu->Z = (cpu->Y == 0x00);
+            cpu->N = ((cpu->Y & 0x80) != 0);
             break;
         }
         case TSX_IMPL: {
-            printf("TSX_IMPL\n");
-            cpu.X = peek_stack();
-            cpu.Z = (cpu.X == 0x00);
-            cpu.N = (cpu.X & 0x80) != 0;
+            TRACE("TSX_IMPL\n");
+            cpu->X = cpu->SP;
+            cpu->Z = (cpu->X == 0x00);
+            cpu->N = (cpu->X & 0x80) != 0;
             break;
         }
         case TXA_IMPL: {
-            printf("TXA_IMPL\n");
-            cpu.A = cpu.X;
-            cpu.Z = (cpu.A == 0x00);
-            cpu.N = (cpu.A & 0x80) != 0;
+            TRACE("TXA_IMPL\n");
+            cpu->A = cpu->X;
+            cpu->Z = (cpu->A == 0x00);
+            cpu->N = (cpu->A & 0x80) != 0;
             break;
         }
         case TXS_IMPL: {
-            printf("TXS_IMPL\n");
-            push_to_stack(cpu.X);
+            TRACE("TXS_IMPL\n");
+            cpu->SP = cpu->X;
             break;
         }
         case TYA_IMPL: {
-            printf("TYA_IMPL\n");
-            cpu.A = cpu.Y;
-            cpu.Z = (cpu.A == 0x00);
-            cpu.N = (cpu.A & 0x80) != 0;
+            TRACE("TYA_IMPL\n");
+            cpu->A = cpu->Y;
+            cpu->Z = (cpu->A == 0x00);
+            cpu->N = (cpu->A & 0x80) != 0;
             break;
         }
         default: {
-            printf("Unhandled Opcode : 0x%04X\n", opcode);
+            execute_undocumented(cpu, opcode);
             break;
         }
 
     }
+    return 1 + fused;
 }
 
-int main(void) {
-    fflush(stdout);
-    init_mem();
-    /* debug data */
-    mem.Data[0xFFFC] = 0x00; // Low byte of reset vector
-    mem.Data[0xFFFD] = 0x10; // High byte of reset vector
+#ifndef NO_IDLE_SKIP
+// what an idle loop has to come back to
+typedef struct {
+    u_int64_t regs;     // PC, A, X, Y, SP and flags
+    u_int64_t writes, cycles;
+} LoopState;
 
-    mem.Data[0x1000] = ADC_INDX;
-    mem.Data[0x0014] = 0x20;
-    mem.Data[0x0015] = 0x30;
-    mem.Data[0x3020] = 0x55;
-    mem.Data[0x1001] = 0x10;
+static LoopState loop_state(CPU *cpu) {
+    Byte p = cpu->N << 7 | cpu->V << 6 | cpu->D << 3 | cpu->I << 2 | cpu->Z << 1 | cpu->C;
+    return (LoopState){
+        .regs = (u_int64_t)cpu->PC << 40 | (u_int64_t)cpu->A << 32 | (u_int64_t)cpu->X << 24 |
+                cpu->Y << 16 | cpu->SP << 8 | p,
+        .writes = cpu->writes,
+        .cycles = cpu->cycles,
+    };
+}
+#endif
 
+void hooks_init(Hooks *h) {
+    memset(h, 0, sizeof(*h));
+}
 
+// runs fn in place of the routine at addr; returns -1 if the table is full
+int hook_add(Hooks *h, Word addr, HookFn fn, void *ctx, u_int32_t cycles) {
+    hook_remove(h, addr);
+    if (h->count == HOOKS_MAX) return -1;
+    h->hook[h->count].addr = addr;
+    h->hook[h->count].cycles = cycles;
+    h->hook[h->count].fn = fn;
+    h->hook[h->count].ctx = ctx;
+    h->count++;
+    h->at[addr >> 6] |= 1ull << (addr & 63);
+    return 0;
+}
 
-    /*------------------------------------------- */
-    cpu_reset();
+void hook_remove(Hooks *h, Word addr) {
+    for (int i = 0; i < h->count; i++) {
+        if (h->hook[i].addr != addr) continue;
+        h->hook[i] = h->hook[--h->count];
+        h->at[addr >> 6] &= ~(1ull << (addr & 63));
+        return;
+    }
+}
 
-    print_debug();
-    int i = 2;
-    while (i > 0) {
-        execute_instructions();
-        print_debug();
-        i--;
+// runs the hook at PC, then returns from it like RTS
+void call_hook(CPU *cpu) {
+    Hooks *h = cpu->hooks;
+    for (int i = 0; i < h->count; i++) {
+        if (h->hook[i].addr != cpu->PC) continue;
+        h->hook[i].fn(cpu, h->hook[i].ctx);
+        h->calls++;
+        cpu->cycles += h->hook[i].cycles;
+        Byte low = pop_from_stack(cpu);
+        Byte high = pop_from_stack(cpu);
+        cpu->PC = ((high << 8) | low) + 1;
+        edge(cpu, cpu->PC);
+        return;
     }
+}
+
+static bool marked(const u_int64_t *map, Word addr) {
+    return map[addr >> 6] >> (addr & 63) & 1;
+}
 
+// ends the run in progress after the instruction that touched addr
+static void watch_hit(Debugger *d, Word addr, Byte value, int write) {
+    if (d->hit) return;
+    d->hit = 1;
+    d->hit_addr = addr;
+    d->hit_value = value;
+    d->hit_write = write;
+    d->cpu->until = d->cpu->cycles;
+}
+
+static Byte watch_read(void *ctx, Word addr) {
+    Debugger *d = ctx;
+    const PageHandler *under = d->under[addr >> 8];
+    Byte value = under ? under->read(under->ctx, addr) : d->cpu->mem->Data[addr];
+    if (marked(d->watch_read, addr)) watch_hit(d, addr, value, 0);
+    return value;
+}
+
+static void watch_write(void *ctx, Word addr, Byte value) {
+    Debugger *d = ctx;
+    const PageHandler *under = d->under[addr >> 8];
+    if (under) {
+        under->write(under->ctx, addr, value);
+    } else {
+        d->cpu->mem->Data[addr] = value;
+        d->cpu->mem->dirty[addr >> 8] = 1;
+    }
+    if (marked(d->watch_write, addr)) watch_hit(d, addr, value, 1);
+}
+
+// attaches an empty debugger to cpu
+void debug_init(Debugger *d, CPU *cpu) {
+    memset(d, 0, sizeof(*d));
+    d->io = (PageHandler){ .read = watch_read, .write = watch_write, .ctx = d };
+    d->cpu = cpu;
+    cpu->debug = d;
+}
+
+// gives watched pages back to RAM or their devices and detaches
+void debug_detach(Debugger *d) {
+    for (int page = 0; page < 0x100; page++) {
+        if (d->cpu->mem->io[page] == &d->io) d->cpu->mem->io[page] = d->under[page];
+    }
+    d->cpu->debug = NULL;
+}
+
+void break_add(Debugger *d, Word addr) {
+    d->breaks[addr >> 6] |= 1ull << (addr & 63);
+}
+
+void break_remove(Debugger *d, Word addr) {
+    d->breaks[addr >> 6] &= ~(1ull << (addr & 63));
+}
+
+// stops on kind (WATCH_READ, WATCH_WRITE or both) of data access to addr;
+// returns -1 in zero page and the stack. Map devices before watching their
+// pages.
+int watch_add(Debugger *d, Word addr, int kind) {
+    Byte page = addr >> 8;
+    if (page < IO_FIRST_PAGE) return -1;
+    Memory *mem = d->cpu->mem;
+    if (mem->io[page] != &d->io) {
+        d->under[page] = mem->io[page];
+        mem->io[page] = &d->io;
+    }
+    if (kind & WATCH_READ) d->watch_read[addr >> 6] |= 1ull << (addr & 63);
+    if (kind & WATCH_WRITE) d->watch_write[addr >> 6] |= 1ull << (addr & 63);
     return 0;
 }
+
+// the page goes back to the fast path once nothing on it is watched
+void watch_remove(Debugger *d, Word addr, int kind) {
+    if (kind & WATCH_READ) d->watch_read[addr >> 6] &= ~(1ull << (addr & 63));
+    if (kind & WATCH_WRITE) d->watch_write[addr >> 6] &= ~(1ull << (addr & 63));
+    Byte page = addr >> 8;
+    for (int i = page * 4; i < page * 4 + 4; i++) {
+        if (d->watch_read[i] | d->watch_write[i]) return;
+    }
+    if (d->cpu->mem->io[page] == &d->io) d->cpu->mem->io[page] = d->under[page];
+}
+
+// IRQ or NMI sequence: pushes PC and P with B clear and jumps through vector
+void cpu_interrupt(CPU *cpu, Word vector) {
+    if (cpu->interrupted) cpu->interrupted(cpu->interrupted_ctx, vector);
+    push_to_stack(cpu, cpu->PC >> 8);
+    push_to_stack(cpu, cpu->PC & 0xFF);
+    push_to_stack(cpu, (cpu->N << 7) | (cpu->V << 6) | (1 << 5) | (cpu->D << 3) |
+                       (cpu->I << 2) | (cpu->Z << 1) | cpu->C);
+    cpu->I = 1;
+    cpu->PC = read_word(cpu, vector);
+    edge(cpu, cpu->PC);
+    cpu->cycles += 7;
+}
+
+/*
+ * Runs until the cycle counter reaches until, or the CPU is stuck.
+ *
+ * Polling loops are not run at full speed. Whenever control goes back to
+ * an earlier address the registers, flags and store count are noted; if
+ * the loop comes round to the same address with all of them unchanged it
+ * has done nothing but read memory that did not change, so every further
+ * iteration will do the same until a device or interrupt steps in. The
+ * whole iterations that fit before until are then skipped by adding their
+ * cycles, which keeps the loop's phase exact. Devices must therefore only
+ * change what the CPU reads at a deadline passed in as until. Build with
+ * -DNO_IDLE_SKIP to run such loops instruction by instruction.
+ *
+ * With until == CYCLES_FOREVER nothing can end an idle loop and it is
+ * reported as RUN_TRAP, like an instruction that jumps to itself.
+ *
+ * The deadline is kept in cpu->until while running, so a device that
+ * schedules something sooner from inside an access can pull it in. A
+ * pending IRQ is taken between instructions whenever I is clear, and a
+ * hooked address reached other than by JSR is called here.
+ *
+ * With a debugger attached the run stops before an instruction at a
+ * breakpoint, except the first one, so running again from a breakpoint
+ * gets past it, and after an instruction that hit a watchpoint.
+ */
+RunResult cpu_run(CPU *cpu, u_int64_t until) {
+#ifndef NO_IDLE_SKIP
+    LoopState seen = { .regs = UINT64_MAX };
+#endif
+    u_int64_t start = cpu->cycles;
+    if (cpu->debug) cpu->debug->hit = 0;
+    cpu->until = until;
+    while (cpu->cycles < cpu->until) {
+        if (cpu->irq && !cpu->I) cpu_interrupt(cpu, 0xFFFE);
+        if (breakpoint(cpu, cpu->PC) && cpu->cycles != start) return RUN_BREAKPOINT;
+        // JSR already took hooks it calls, this catches JMPs and branches in
+        if (hooked(cpu, cpu->PC)) {
+            call_hook(cpu);
+            continue;
+        }
+        Word pc = cpu->PC;
+        int n = execute_instructions(cpu);
+        if (cpu->PC > pc) continue;
+        if (cpu->PC == pc && n == 1 && cpu->until == CYCLES_FOREVER) return RUN_TRAP;
+#ifndef NO_IDLE_SKIP
+        LoopState now = loop_state(cpu);
+        if (now.regs == seen.regs && now.writes == seen.writes && now.cycles < cpu->until) {
+            if (cpu->until == CYCLES_FOREVER) return RUN_TRAP;
+            u_int64_t period = now.cycles - seen.cycles;
+            u_int64_t skip = (cpu->until - now.cycles) / period * period;
+            cpu->cycles += skip;
+            cpu->idle_cycles += skip;
+            now.cycles += skip;
+        }
+        seen = now;
+#endif
+    }
+    if (__builtin_expect(cpu->debug != NULL, 0) && cpu->debug->hit) {
+        cpu->debug->hit = 0;
+        return RUN_WATCHPOINT;
+    }
+    return RUN_DEADLINE;
+}
@@ -0,0 +1,275 @@
+#ifndef MOS6502_H
+#define MOS6502_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef u_int8_t Byte;
+typedef u_int16_t Word;
+
+/*
+ * A page routed to a device instead of RAM. Accesses to it go to read and
+ * write with the full address; pages without a handler cost one table
+ * lookup per access and never leave the inline path.
+ *
+ * A device read counts as a store for idle loop detection, since it may
+ * have side effects or return something new every cycle. A device whose
+ * reads have no side effects and change only in scheduler events (a
+ * raster line latched once per line, say) sets steady_reads, so a guest
+ * polling it is skipped ahead like one polling RAM.
+ */
+typedef struct {
+    Byte (*read)(void *ctx, Word addr);
+    void (*write)(void *ctx, Word addr, Byte value);
+    void *ctx;
+    int steady_reads;
+} PageHandler;
+
+typedef struct {
+    Byte Data[0x10000];
+    const PageHandler *io[0x100];   // per page, NULL for plain RAM
+    Byte dirty[0x100];  // per page, set by every store to RAM through the core;
+                        // whoever restores or saves memory clears them, with
+                        // clean_page(), which keeps the flag in touched
+    Byte touched[0x100];    // per page, dirty since the pool last zeroed it
+#ifdef COVERAGE
+    u_int64_t executed[0x10000 / 64];   // addresses an instruction ran from
+    u_int64_t accessed[0x10000 / 64];   // addresses read or written as data
+#endif
+} Memory;
+
+/*
+ * -DCOVERAGE builds mark every instruction the interpreter runs and every
+ * data access in the bitmaps above with a single OR each; coverage.c
+ * reports on them. Without it the marks compile to nothing.
+ */
+#ifdef COVERAGE
+#define COVER(map, addr) ((map)[(addr) >> 6] |= 1ull << ((addr) & 63))
+#else
+#define COVER(map, addr) ((void)0)
+#endif
+
+// what the core does with opcodes the NMOS 6502 does not document
+typedef enum {
+    OPCODES_STRICT,     // trap: PC stays on the opcode, like a JAM
+    OPCODES_NMOS,       // undocumented NMOS behaviour (LAX, SAX, DCP, ...)
+    OPCODES_CMOS_NOP,   // 65C02 style: skip the operand bytes as a NOP
+} OpcodeSet;
+
+/*
+ * Native stand-ins for guest subroutines. When the CPU enters a hooked
+ * address, by JSR or otherwise, fn runs against the CPU and memory in
+ * place of the routine, cycles are charged for it, and the CPU returns as
+ * if the routine's RTS had run: the return address JSR pushed is on the
+ * stack when fn runs, so it can read arguments placed after the JSR and
+ * move the return address past them.
+ */
+struct CPU;
+typedef void (*HookFn)(struct CPU *cpu, void *ctx);
+
+#define HOOKS_MAX 32
+
+typedef struct {
+    u_int64_t at[0x10000 / 64];     // bitmap of hooked addresses
+    struct {
+        Word addr;
+        u_int32_t cycles;   // charged per call, body through RTS
+        HookFn fn;
+        void *ctx;
+    } hook[HOOKS_MAX];
+    int count;
+    u_int64_t calls;
+} Hooks;
+
+typedef struct CPU {
+    Word PC;    // Program Counter
+    Byte SP;    // Stack Pointer
+
+    Byte A, X, Y;    // Registers
+
+    Byte C : 1; // carry flag (LSB)
+    Byte Z : 1; // zero flag
+    Byte I : 1; // interrupt disable flag
+    Byte D : 1; // decimal flag
+    Byte B : 1; // break flag
+    Byte V : 1; // overflow flag
+    Byte N : 1; // negative flag (MSB)
+
+    OpcodeSet opcodes; // handling of undocumented opcodes
+
+    Memory *mem;    // address space this CPU runs against
+    Hooks *hooks;   // native routines, NULL for none
+
+    u_int64_t cycles;       // clock cycles run
+    u_int64_t until;        // deadline of the cpu_run() in progress
+    u_int64_t writes;       // stores and device accesses so far, lets cpu_run()
+                            // see a loop is idle
+    Byte irq;               // IRQ line, one bit per device pulling it low
+    u_int64_t idle_cycles;  // cycles cpu_run() skipped over idle loops
+
+    Byte *edges;            // EDGE_MAP_SIZE edge hit counters, NULL for none
+    Word edge_prev;         // hash of the block the last edge went to, >> 1
+
+    struct Debugger *debug; // breakpoints and watchpoints, NULL for none
+
+    // told of each interrupt as it is taken, NULL for none
+    void (*interrupted)(void *ctx, Word vector);
+    void *interrupted_ctx;
+} CPU;
+
+/*
+ * AFL style edge coverage. Every control transfer (branches taken or not,
+ * jumps, calls, returns, interrupts) hashes the address it lands on and
+ * bumps edges[hash ^ edge_prev]; straight-line code costs nothing.
+ */
+#ifndef EDGE_MAP_BITS
+#define EDGE_MAP_BITS 13
+#endif
+#define EDGE_MAP_SIZE (1 << EDGE_MAP_BITS)
+
+// why cpu_run() returned
+typedef enum {
+    RUN_DEADLINE,   // reached the cycle it was asked to run to
+    RUN_TRAP,       // stuck: an instruction jumped to itself, or an idle loop
+                    // with no deadline to wait for
+    RUN_BREAKPOINT, // PC reached a breakpoint, the instruction there has not run
+    RUN_WATCHPOINT, // the instruction before PC touched a watched address
+} RunResult;
+
+/*
+ * Breakpoints and watchpoints. Breakpoints are a bitmap cpu_run() tests
+ * before each dispatch, and only with a debugger attached to the CPU.
+ * Watchpoints route their pages through the device path, so the rest of
+ * memory keeps the inline RAM path; like devices they cannot sit in zero
+ * page or the stack. The watch that stopped the last run is in hit_addr,
+ * hit_value and hit_write.
+ */
+enum { WATCH_READ = 1, WATCH_WRITE = 2 };
+
+typedef struct Debugger {
+    u_int64_t breaks[0x10000 / 64];
+    u_int64_t watch_read[0x10000 / 64];
+    u_int64_t watch_write[0x10000 / 64];
+    const PageHandler *under[0x100];    // what a watched page was mapped to
+    PageHandler io;                     // the slow path of watched pages
+    CPU *cpu;
+    int step;           // single stepping: no fused instructions
+    int hit;            // a watch fired in the run in progress
+    Word hit_addr;
+    Byte hit_value;
+    int hit_write;
+} Debugger;
+
+#define CYCLES_FOREVER UINT64_MAX
+
+// per-instruction trace output, compile with -DDEBUG to enable
+#ifdef DEBUG
+#define TRACE(...) printf(__VA_ARGS__)
+#else
+#define TRACE(...)
+#endif
+
+void cpu_reset(CPU *cpu);
+void init_mem(Memory *mem);
+int map_io(Memory *mem, Byte page, const PageHandler *handler);
+
+// device accesses, kept out of line so the RAM path stays small
+Byte io_read(CPU *cpu, Word addr);
+void io_write(CPU *cpu, Word addr, Byte value);
+
+// pages 0 and 1 are never mapped: with the address known to be in zero page
+// or the stack the compiler drops the device check altogether
+#define IO_FIRST_PAGE 0x02
+#define is_io(cpu, addr) \
+    __builtin_expect((addr) >= IO_FIRST_PAGE << 8 && (cpu)->mem->io[(addr) >> 8] != NULL, 0)
+
+// memory accessors live here so every translation unit can inline them
+static inline Byte read_byte(CPU *cpu, Word addr) {
+    COVER(cpu->mem->accessed, addr);
+    if (is_io(cpu, addr)) return io_read(cpu, addr);
+    return cpu->mem->Data[addr];
+}
+
+static inline void write_byte(CPU *cpu, Word addr, Byte value) {
+    COVER(cpu->mem->accessed, addr);
+    cpu->writes++;
+    if (is_io(cpu, addr)) {
+        io_write(cpu, addr, value);
+    } else {
+        cpu->mem->Data[addr] = value;
+        cpu->mem->dirty[addr >> 8] = 1;
+    }
+}
+
+// clears a dirty flag for its user without losing it for the pool
+static inline void clean_page(Memory *mem, int page) {
+    mem->touched[page] |= mem->dirty[page];
+    mem->dirty[page] = 0;
+}
+
+static inline void clean_pages(Memory *mem) {
+    for (int page = 0; page < 0x100; page++) clean_page(mem, page);
+}
+
+// opcode and operand fetch: code always runs from RAM, never a device page
+static inline Byte fetch_byte(CPU *cpu, Word addr) {
+    return cpu->mem->Data[addr];
+}
+
+// devices raise and release their bit of the IRQ line; cpu_run() takes the
+// interrupt at the next instruction boundary while I is clear
+static inline void set_irq(CPU *cpu, Byte source, int asserted) {
+    if (asserted) cpu->irq |= source;
+    else cpu->irq &= ~source;
+}
+
+Word read_word(CPU *cpu, Word offset);
+
+void adc(CPU *cpu, Byte val);
+void sbc(CPU *cpu, Byte val);
+void cmp(CPU *cpu, Byte val);
+void cpx(CPU *cpu, Byte val);
+void cpy(CPU *cpu, Byte val);
+Byte asl(CPU *cpu, Byte val);
+Byte rol(CPU *cpu, Byte val);
+Byte ror(CPU *cpu, Byte val);
+Byte lsr(CPU *cpu, Byte val);
+
+void print_debug(CPU *cpu);
+void execute_undocumented(CPU *cpu, Byte opcode);
+// base cycle count of each opcode, before page crossing and branch penalties
+extern const Byte opcode_cycles[256];
+
+// runs the instruction at PC, or a fused pair or triple starting there, and
+// returns how many instructions that was
+int execute_instructions(CPU *cpu);
+
+void hooks_init(Hooks *h);
+int hook_add(Hooks *h, Word addr, HookFn fn, void *ctx, u_int32_t cycles);
+void hook_remove(Hooks *h, Word addr);
+void call_hook(CPU *cpu);
+
+static inline int hooked(CPU *cpu, Word addr) {
+    return __builtin_expect(cpu->hooks != NULL, 0) && (cpu->hooks->at[addr >> 6] >> (addr & 63) & 1);
+}
+
+static inline int breakpoint(CPU *cpu, Word addr) {
+    return __builtin_expect(cpu->debug != NULL, 0) && (cpu->debug->breaks[addr >> 6] >> (addr & 63) & 1);
+}
+
+void debug_init(Debugger *d, CPU *cpu);
+void debug_detach(Debugger *d);
+void break_add(Debugger *d, Word addr);
+void break_remove(Debugger *d, Word addr);
+int watch_add(Debugger *d, Word addr, int kind);
+void watch_remove(Debugger *d, Word addr, int kind);
+
+void cpu_interrupt(CPU *cpu, Word vector);
+RunResult cpu_run(CPU *cpu, u_int64_t until);
+
+#ifdef PAIR_STATS
+void print_pair_stats(int top);
+#endif
+
+#endif
@@ -0,0 +1,165 @@
+#define _POSIX_C_SOURCE 200809L
+#include "acia.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CMD_DTR 0x01
+#define CMD_RX_IRQ_OFF 0x02
+
+static u_int64_t now(Acia *acia) {
+    return acia->sched->cpu->cycles;
+}
+
+static bool rx_full(Acia *acia) {
+    return acia->rx_pos < acia->rx_len;
+}
+
+static bool rx_irq(Acia *acia) {
+    return (acia->command & (CMD_DTR | CMD_RX_IRQ_OFF)) == CMD_DTR;
+}
+
+static void update_irq(Acia *acia) {
+    set_irq(acia->sched->cpu, acia->irq_source, rx_irq(acia) && rx_full(acia));
+}
+
+void acia_flush(Acia *acia) {
+    size_t done = 0;
+    while (done < acia->out_len) {
+        ssize_t n = write(acia->out_fd, acia->out + done, acia->out_len - done);
+        acia->writes++;
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;      // the host side is gone, drop the output
+        done += n;
+    }
+    acia->out_len = 0;
+    if (acia->flush_event) sched_cancel(acia->sched, acia->flush_event);
+    acia->flush_event = 0;
+}
+
+static void flush_due(void *ctx, u_int64_t when) {
+    (void)when;
+    Acia *acia = ctx;
+    acia->flush_event = 0;
+    acia_flush(acia);
+}
+
+static void transmit(Acia *acia, Byte value) {
+    if (acia->out_len == 0) {
+        acia->flush_event = sched_add(acia->sched, now(acia) + ACIA_FLUSH_CYCLES, flush_due, acia);
+    }
+    acia->out[acia->out_len++] = value;
+    if (acia->out_len == ACIA_BUFFER) acia_flush(acia);
+}
+
+// takes whatever the fd has ready, in one read; poll() first, so the fd
+// can stay blocking for whoever else has it (stdin, say)
+static void refill(Acia *acia) {
+    if (rx_full(acia) || acia->in_fd < 0) return;
+    struct pollfd p = { .fd = acia->in_fd, .events = POLLIN };
+    int ready = poll(&p, 1, 0);
+    acia->reads++;
+    acia->next_poll = now(acia) + ACIA_POLL_CYCLES;
+    if (ready == 0 || (ready < 0 && errno == EINTR)) return;
+    ssize_t n = ready < 0 ? -1 : read(acia->in_fd, acia->in, sizeof(acia->in));
+    acia->reads += ready > 0;
+    if (n > 0) {
+        acia->rx = acia->in;
+        acia->rx_len = n;
+        acia->rx_pos = 0;
+    } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        acia->in_fd = -1;
+    }
+    update_irq(acia);
+}
+
+static void poll_due(void *ctx, u_int64_t when) {
+    Acia *acia = ctx;
+    acia->poll_event = 0;
+    refill(acia);
+    if (acia->in_fd >= 0 && rx_irq(acia)) {
+        acia->poll_event = sched_add(acia->sched, when + ACIA_POLL_CYCLES, poll_due, acia);
+    }
+}
+
+// with receive interrupts on, the fd is read on a timer instead of on access
+static void arm_poll(Acia *acia) {
+    if (acia->poll_event || acia->in_fd < 0 || !rx_irq(acia)) return;
+    acia->poll_event = sched_add(acia->sched, now(acia), poll_due, acia);
+}
+
+static void poll_lazily(Acia *acia) {
+    if (!rx_full(acia) && now(acia) >= acia->next_poll) refill(acia);
+}
+
+static Byte acia_read(void *ctx, Word addr) {
+    Acia *acia = ctx;
+    switch (addr & 3) {
+        case ACIA_DATA: {
+            poll_lazily(acia);
+            if (!rx_full(acia)) return 0;
+            Byte value = acia->rx[acia->rx_pos++];
+            update_irq(acia);
+            return value;
+        }
+        case ACIA_STATUS: {
+            poll_lazily(acia);
+            Byte status = ACIA_TDRE;
+            if (rx_full(acia)) status |= ACIA_RDRF;
+            if (acia->sched->cpu->irq & acia->irq_source) status |= ACIA_IRQ;
+            return status;
+        }
+        case ACIA_COMMAND: return acia->command;
+        default: return acia->control;
+    }
+}
+
+static void acia_write(void *ctx, Word addr, Byte value) {
+    Acia *acia = ctx;
+    switch (addr & 3) {
+        case ACIA_DATA: transmit(acia, value); break;
+        case ACIA_STATUS: acia->command &= 0xE0; break;     // programmed reset
+        case ACIA_COMMAND: acia->command = value; break;
+        default: acia->control = value; break;
+    }
+    update_irq(acia);
+    arm_poll(acia);
+}
+
+/*
+ * Maps an ACIA at page of the scheduler's CPU, sending its output to
+ * out_fd. Input is empty until acia_input_fd() or acia_input_buffer().
+ * Returns -1 if the page cannot be mapped.
+ */
+int acia_init(Acia *acia, Scheduler *sched, Byte page, Byte irq_source, int out_fd) {
+    memset(acia, 0, sizeof(*acia));
+    acia->sched = sched;
+    acia->irq_source = irq_source;
+    acia->out_fd = out_fd;
+    acia->in_fd = -1;
+    acia->page = (PageHandler){ .read = acia_read, .write = acia_write, .ctx = acia };
+    return map_io(sched->cpu->mem, page, &acia->page);
+}
+
+// receive from fd; its flags are left as they are
+void acia_input_fd(Acia *acia, int fd) {
+    acia->in_fd = fd;
+    acia->rx_len = acia->rx_pos = 0;
+    acia->next_poll = 0;
+    arm_poll(acia);
+}
+
+// receive the len bytes at data, which must stay valid until they are read
+void acia_input_buffer(Acia *acia, const Byte *data, size_t len) {
+    acia->in_fd = -1;
+    acia->rx = data;
+    acia->rx_len = len;
+    acia->rx_pos = 0;
+    update_irq(acia);
+}
+
+// true once every byte has been received and no more can come
+bool acia_input_done(Acia *acia) {
+    return !rx_full(acia) && acia->in_fd < 0;
+}
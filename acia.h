@@ -0,0 +1,59 @@
+#ifndef ACIA_H
+#define ACIA_H
+
+#include "sched.h"
+#include <stdbool.h>
+
+/*
+ * 6551 ACIA used as a console: data, status, command and control registers
+ * (repeating through its page). Bytes the guest transmits collect in a
+ * buffer that goes to the host in one write() when it fills, when
+ * ACIA_FLUSH_CYCLES have passed since the first byte went in, or on
+ * acia_flush(). Received bytes come from a preloaded buffer or from an fd
+ * read a block at a time when poll() says it has something, at most once
+ * per ACIA_POLL_CYCLES however hard the guest polls. The fd's flags are
+ * not touched, so stdin stays blocking for the rest of the process. There
+ * is no baud rate: the transmitter is always empty and a received byte is
+ * there as soon as the host has it.
+ */
+
+#define ACIA_BUFFER 4096
+#define ACIA_POLL_CYCLES 10000
+#define ACIA_FLUSH_CYCLES 100000
+
+// register offsets
+enum { ACIA_DATA, ACIA_STATUS, ACIA_COMMAND, ACIA_CONTROL };
+
+// status bits
+#define ACIA_RDRF 0x08      // receive data register full
+#define ACIA_TDRE 0x10      // transmit data register empty
+#define ACIA_IRQ 0x80
+
+typedef struct {
+    Scheduler *sched;
+    PageHandler page;
+    Byte irq_source;        // this ACIA's bit of cpu->irq
+    Byte command, control;
+
+    int out_fd;
+    Byte out[ACIA_BUFFER];
+    size_t out_len;
+    u_int64_t flush_event;
+
+    int in_fd;              // -1 once closed, or when input is preloaded
+    Byte in[ACIA_BUFFER];
+    const Byte *rx;         // bytes not yet received: in, or the preloaded data
+    size_t rx_len, rx_pos;
+    u_int64_t next_poll;    // earliest cycle to try in_fd again
+    u_int64_t poll_event;   // periodic read while receive interrupts are on
+
+    u_int64_t reads, writes;    // host syscalls made
+} Acia;
+
+int acia_init(Acia *acia, Scheduler *sched, Byte page, Byte irq_source, int out_fd);
+void acia_input_fd(Acia *acia, int fd);
+void acia_input_buffer(Acia *acia, const Byte *data, size_t len);
+void acia_flush(Acia *acia);
+bool acia_input_done(Acia *acia);
+
+#endif
@@ -0,0 +1,35 @@
+#include "aot.h"
+#include <stddef.h>
+
+/*
+ * Runs until the cycle counter reaches until, or the CPU is stuck, calling
+ * compiled code wherever there is some and stepping the interpreter
+ * elsewhere. Like cpu_run(), an instruction that jumps to itself with no
+ * deadline is RUN_TRAP; idle loops are not skipped. stats may be NULL.
+ */
+RunResult aot_run(CPU *cpu, u_int64_t until, AotStats *stats) {
+    AotStats unused;
+    if (stats == NULL) stats = &unused;
+    cpu->until = until;
+    while (cpu->cycles < cpu->until) {
+        if (cpu->irq && !cpu->I) cpu_interrupt(cpu, 0xFFFE);
+        if (hooked(cpu, cpu->PC)) {
+            call_hook(cpu);
+            continue;
+        }
+        Word pc = cpu->PC;
+        u_int64_t cycles = cpu->cycles;
+        AotFn fn = aot_lookup(pc);
+        if (fn != NULL) {
+            stats->compiled++;
+            fn(cpu, pc, 0);
+            // compiled code leaves without running anything when it is
+            // entered on an instruction it hands to the interpreter
+            if (cpu->cycles != cycles) continue;
+        }
+        int n = execute_instructions(cpu);
+        stats->interpreted += n;
+        if (cpu->PC == pc && n == 1 && cpu->until == CYCLES_FOREVER) return RUN_TRAP;
+    }
+    return RUN_DEADLINE;
+}
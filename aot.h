@@ -0,0 +1,82 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "6502.h"
+
+/*
+ * Running code produced by tools/recompile. The recompiler turns each
+ * routine of a fixed image into a C function with the registers and flags
+ * in locals; memory goes through read_byte() and write_byte() like the
+ * interpreter, and cycles are charged the same way, so a compiled run
+ * leaves the same state as an interpreted one.
+ *
+ * aot_run() calls compiled code wherever PC is at a block it knows and
+ * interprets everything else: BRK, RTI, interrupts, undocumented opcodes
+ * and code the recompiler never saw, which includes wherever an indirect
+ * jump goes. Compiled code checks the deadline and the IRQ line on every
+ * taken branch, jump and return from a call, and the IRQ line after stores
+ * outside zero page and the stack, and leaves to aot_run() when either
+ * needs attention, so a deadline can be overrun by the rest of a block
+ * as fused instructions in the interpreter also do. It assumes the image
+ * is not modified while it runs; aot_matches() tells whether memory still
+ * holds the bytes it was compiled from.
+ */
+
+// native call depth beyond which a JSR leaves to aot_run() instead
+#define AOT_DEPTH 128
+
+typedef void (*AotFn)(CPU *cpu, Word entry, int depth);
+
+typedef struct {
+    u_int64_t compiled;     // calls into compiled code
+    u_int64_t interpreted;  // instructions run by the interpreter
+} AotStats;
+
+// generated by tools/recompile
+AotFn aot_lookup(Word pc);
+int aot_matches(const Memory *mem);
+
+RunResult aot_run(CPU *cpu, u_int64_t until, AotStats *stats);
+
+#ifdef AOT_GENERATED
+// what generated code is written in; cpu, the register and flag locals
+// and depth are in scope in every compiled function
+
+#define LOAD() (A = cpu->A, X = cpu->X, Y = cpu->Y, SP = cpu->SP, C = cpu->C, Z = cpu->Z, \
+                I = cpu->I, D = cpu->D, V = cpu->V, N = cpu->N)
+#define SAVE() (cpu->A = A, cpu->X = X, cpu->Y = Y, cpu->SP = SP, cpu->C = C, cpu->Z = Z, \
+                cpu->I = I, cpu->D = D, cpu->V = V, cpu->N = N)
+#define EXIT(pc) do { SAVE(); cpu->PC = (pc); return; } while (0)
+// taken branches and jumps: stop for the deadline or an interrupt
+#define CHECK(pc) do { if (cpu->cycles >= cpu->until || (cpu->irq && !I)) EXIT(pc); } while (0)
+// after a store that may have gone to a device, or a change to I
+#define POLL(pc) do { if (cpu->irq && !I) EXIT(pc); } while (0)
+
+#define RD(a) read_byte(cpu, (a))
+#define WR(a, v) write_byte(cpu, (a), (v))
+#define PUSH(v) (write_byte(cpu, 0x100 + SP, (v)), SP--)
+#define PULL() (SP++, cpu->mem->Data[0x100 + SP])
+#define NZ(v) (Z = (v) == 0, N = (v) >> 7)
+#define P() (N << 7 | V << 6 | 1 << 5 | 1 << 4 | D << 3 | I << 2 | Z << 1 | C)
+
+#define ADC(m) do { Byte m_ = (m); \
+    if (D) { SAVE(); adc(cpu, m_); LOAD(); break; } \
+    Word r_ = A + m_ + C; \
+    V = (~(A ^ m_) & (A ^ r_) & 0x80) != 0; C = r_ > 0xFF; A = r_; NZ(A); } while (0)
+#define SBC(m) do { Byte m_ = (m); \
+    if (D) { SAVE(); sbc(cpu, m_); LOAD(); break; } \
+    Word r_ = (Word)A - m_ - (1 - C); \
+    V = ((A ^ m_) & (A ^ r_) & 0x80) != 0; C = r_ < 0x100; A = r_; NZ(A); } while (0)
+#define CMP(r, m) do { Byte m_ = (m), t_ = (r) - m_; C = (r) >= m_; NZ(t_); } while (0)
+#define BIT(m) do { Byte m_ = (m); Z = (A & m_) == 0; V = m_ >> 6 & 1; N = m_ >> 7; } while (0)
+
+#define ASL(x) (C = (x) >> 7, (x) <<= 1, NZ(x))
+#define LSR(x) (C = (x) & 1, (x) >>= 1, NZ(x))
+#define ROL(x) do { Byte c_ = C; C = (x) >> 7; (x) = (x) << 1 | c_; NZ(x); } while (0)
+#define ROR(x) do { Byte c_ = C; C = (x) & 1; (x) = (x) >> 1 | c_ << 7; NZ(x); } while (0)
+#define RMW(a, op) do { Word e_ = (a); Byte m_ = RD(e_); op(m_); WR(e_, m_); } while (0)
+#define INC(x) ((x)++, NZ(x))
+#define DEC(x) ((x)--, NZ(x))
+#endif
+
+#endif
@@ -0,0 +1,491 @@
+#define _POSIX_C_SOURCE 200809L
+#include "batch.h"
+#include "pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BATCH_PATH_MAX 4096
+
+typedef struct {
+    char *line;         // from getline(), kept for the next line in the slot
+    size_t cap;
+    ssize_t len;
+    u_int64_t number;
+} Slot;
+
+typedef struct {
+    FILE *in, *out;
+    int window;
+    Slot *slots;
+    int *ready, ready_head, ready_count;    // slots read and waiting, a ring
+    int *free_slots, free_count;
+    int eof;
+    pthread_mutex_t lock, out_lock;
+    pthread_cond_t work, room;
+    int write_error;
+    BatchStats stats;
+} Batch;
+
+typedef struct {
+    Batch *batch;
+    pthread_t thread;
+    Pool pool;
+    char *out;
+    size_t out_cap;
+    char path[BATCH_PATH_MAX];
+} Worker;
+
+// a line taken apart; strings point into it
+typedef struct {
+    const char *id, *hex, *file;
+    size_t id_len, hex_len, file_len;
+    u_int64_t load, entry, cycles;
+    int has_entry;
+    int ranges;
+    u_int64_t range[BATCH_RANGES][2];
+    OpcodeSet opcodes;
+} Job;
+
+typedef struct {
+    const char *p, *end;
+} Parser;
+
+static signed char hex_value[256];
+
+static void init_hex(void) {
+    memset(hex_value, -1, sizeof(hex_value));
+    for (int i = 0; i < 10; i++) hex_value['0' + i] = i;
+    for (int i = 0; i < 6; i++) hex_value['a' + i] = hex_value['A' + i] = 10 + i;
+}
+
+static void ws(Parser *ps) {
+    while (ps->p < ps->end && (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\r' || *ps->p == '\n')) ps->p++;
+}
+
+static int next_is(Parser *ps, char c) {
+    ws(ps);
+    if (ps->p == ps->end || *ps->p != c) return 0;
+    ps->p++;
+    return 1;
+}
+
+// a string's contents as they are, escapes and all, so long as they are
+// valid JSON: no control characters, and only the escapes JSON has
+static int string(Parser *ps, const char **s, size_t *len) {
+    if (!next_is(ps, '"')) return -1;
+    const char *start = ps->p;
+    while (ps->p < ps->end && *ps->p != '"') {
+        if ((unsigned char)*ps->p < 0x20) return -1;
+        if (*ps->p++ != '\\') continue;
+        if (ps->p == ps->end || *ps->p == '\0' || !strchr("\"\\/bfnrtu", *ps->p)) return -1;
+        if (*ps->p++ != 'u') continue;
+        for (int i = 0; i < 4; i++) {
+            if (ps->p == ps->end || hex_value[(unsigned char)*ps->p++] < 0) return -1;
+        }
+    }
+    if (ps->p == ps->end) return -1;
+    *s = start;
+    *len = ps->p++ - start;
+    return 0;
+}
+
+// an unsigned integer
+static int number(Parser *ps, u_int64_t *n) {
+    ws(ps);
+    const char *start = ps->p;
+    for (*n = 0; ps->p < ps->end && *ps->p >= '0' && *ps->p <= '9'; ps->p++) {
+        if (*n > (UINT64_MAX - 9) / 10) return -1;
+        *n = *n * 10 + (*ps->p - '0');
+    }
+    return ps->p == start ? -1 : 0;
+}
+
+static int digits(Parser *ps) {
+    const char *start = ps->p;
+    while (ps->p < ps->end && *ps->p >= '0' && *ps->p <= '9') ps->p++;
+    return ps->p == start ? -1 : 0;
+}
+
+// a number as JSON has them: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+static int json_number(Parser *ps) {
+    if (ps->p < ps->end && *ps->p == '-') ps->p++;
+    if (ps->p < ps->end && *ps->p == '0') ps->p++;
+    else if (digits(ps) != 0) return -1;
+    if (ps->p < ps->end && *ps->p == '.' && (ps->p++, digits(ps) != 0)) return -1;
+    if (ps->p < ps->end && (*ps->p == 'e' || *ps->p == 'E')) {
+        ps->p++;
+        if (ps->p < ps->end && (*ps->p == '+' || *ps->p == '-')) ps->p++;
+        if (digits(ps) != 0) return -1;
+    }
+    return 0;
+}
+
+static int literal(Parser *ps, const char *word) {
+    size_t len = strlen(word);
+    if ((size_t)(ps->end - ps->p) < len || memcmp(ps->p, word, len) != 0) return -1;
+    ps->p += len;
+    return 0;
+}
+
+static int skip_value(Parser *ps, int depth) {
+    ws(ps);
+    if (ps->p == ps->end || depth > 64) return -1;
+    const char *s;
+    size_t len;
+    char open = *ps->p;
+    if (open == '"') return string(ps, &s, &len);
+    if (open == '[' || open == '{') {
+        char close = open == '[' ? ']' : '}';
+        ps->p++;
+        if (next_is(ps, close)) return 0;
+        do {
+            if (open == '{' && (string(ps, &s, &len) != 0 || !next_is(ps, ':'))) return -1;
+            if (skip_value(ps, depth + 1) != 0) return -1;
+        } while (next_is(ps, ','));
+        return next_is(ps, close) ? 0 : -1;
+    }
+    if (open == 't') return literal(ps, "true");
+    if (open == 'f') return literal(ps, "false");
+    if (open == 'n') return literal(ps, "null");
+    return json_number(ps);
+}
+
+static int is(const char *key, size_t len, const char *name) {
+    return len == strlen(name) && memcmp(key, name, len) == 0;
+}
+
+static const char *parse_read(Parser *ps, Job *job) {
+    if (!next_is(ps, '[')) return "read is not an array";
+    if (next_is(ps, ']')) return NULL;
+    u_int64_t total = 0;
+    do {
+        if (job->ranges == BATCH_RANGES) return "too many ranges to read";
+        u_int64_t *r = job->range[job->ranges++];
+        if (!next_is(ps, '[') || number(ps, &r[0]) != 0 || !next_is(ps, ',') || number(ps, &r[1]) != 0 ||
+            !next_is(ps, ']'))
+            return "a range to read is not [address, length]";
+        if (r[0] > 0xFFFF || r[1] > 0x10000 - r[0]) return "a range to read runs past $FFFF";
+        if ((total += r[1]) > BATCH_READ_MAX) return "too much to read";
+    } while (next_is(ps, ','));
+    return next_is(ps, ']') ? NULL : "read is not an array";
+}
+
+// fills job from the object on a line; an error message if it is not one
+static const char *parse(const char *line, size_t len, Job *job) {
+    Parser ps = { line, line + len };
+    *job = (Job){ .cycles = BATCH_DEFAULT_CYCLES, .opcodes = OPCODES_STRICT };
+    if (!next_is(&ps, '{')) return "not a JSON object";
+    if (!next_is(&ps, '}')) {
+        do {
+            const char *key, *s;
+            size_t key_len, s_len;
+            if (string(&ps, &key, &key_len) != 0 || !next_is(&ps, ':')) return "not a JSON object";
+            ws(&ps);
+            const char *value = ps.p;
+            if (is(key, key_len, "id")) {
+                if (ps.p == ps.end || (*ps.p != '"' && *ps.p != '-' && (*ps.p < '0' || *ps.p > '9')) ||
+                    skip_value(&ps, 0) != 0)
+                    return "id is not a string or a number";
+                job->id = value;
+                job->id_len = ps.p - value;
+            } else if (is(key, key_len, "hex")) {
+                if (string(&ps, &job->hex, &job->hex_len) != 0) return "hex is not a string";
+            } else if (is(key, key_len, "file")) {
+                if (string(&ps, &job->file, &job->file_len) != 0) return "file is not a string";
+            } else if (is(key, key_len, "load")) {
+                if (number(&ps, &job->load) != 0 || job->load > 0xFFFF) return "load is not an address";
+            } else if (is(key, key_len, "entry")) {
+                if (number(&ps, &job->entry) != 0 || job->entry > 0xFFFF) return "entry is not an address";
+                job->has_entry = 1;
+            } else if (is(key, key_len, "cycles")) {
+                if (number(&ps, &job->cycles) != 0 || job->cycles == 0) return "cycles is not a positive number";
+            } else if (is(key, key_len, "read")) {
+                const char *error = parse_read(&ps, job);
+                if (error) return error;
+            } else if (is(key, key_len, "opcodes")) {
+                if (string(&ps, &s, &s_len) != 0) return "opcodes is not a string";
+                if (is(s, s_len, "strict")) job->opcodes = OPCODES_STRICT;
+                else if (is(s, s_len, "nmos")) job->opcodes = OPCODES_NMOS;
+                else if (is(s, s_len, "cmos")) job->opcodes = OPCODES_CMOS_NOP;
+                else return "opcodes is not strict, nmos or cmos";
+            } else if (skip_value(&ps, 0) != 0) {
+                return "not a JSON object";
+            }
+        } while (next_is(&ps, ','));
+        if (!next_is(&ps, '}')) return "not a JSON object";
+    }
+    ws(&ps);
+    if (ps.p != ps.end) return "more after the object";
+    if ((job->hex != NULL) == (job->file != NULL)) return "needs one of hex and file";
+    return NULL;
+}
+
+static void mark_dirty(Memory *mem, size_t from, size_t len) {
+    if (len > 0) memset(&mem->dirty[from >> 8], 1, ((from + len - 1) >> 8) - (from >> 8) + 1);
+}
+
+static const char *load_hex(Memory *mem, const Job *job) {
+    if (job->hex_len % 2) return "hex has an odd number of digits";
+    size_t n = job->hex_len / 2;
+    if (n > 0x10000 - job->load) return "program runs past $FFFF";
+    const unsigned char *h = (const unsigned char *)job->hex;
+    Byte *to = &mem->Data[job->load];
+    mark_dirty(mem, job->load, n);
+    for (size_t i = 0; i < n; i++) {
+        int hi = hex_value[h[2 * i]], lo = hex_value[h[2 * i + 1]];
+        if ((hi | lo) < 0) return "hex has something other than hex digits";
+        to[i] = hi << 4 | lo;
+    }
+    return NULL;
+}
+
+// the path with its JSON escapes undone
+static const char *unescape_path(Worker *w, const Job *job) {
+    size_t n = 0;
+    for (size_t i = 0; i < job->file_len; i++) {
+        char c = job->file[i];
+        if (c == '\\') {
+            c = job->file[++i];
+            if (c == 'u') return NULL;
+            c = c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' : c == 'b' ? '\b' : c == 'f' ? '\f' : c;
+        }
+        if (c == 0 || n == BATCH_PATH_MAX - 1) return NULL;
+        w->path[n++] = c;
+    }
+    w->path[n] = 0;
+    return w->path;
+}
+
+static const char *load_file(Worker *w, Memory *mem, const Job *job) {
+    const char *path = unescape_path(w, job);
+    if (path == NULL) return "file is not a usable path";
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return "file cannot be opened";
+    size_t room = 0x10000 - job->load;
+    size_t n = fread(&mem->Data[job->load], 1, room, f);
+    int error = ferror(f), more = n == room && fgetc(f) != EOF;
+    fclose(f);
+    mark_dirty(mem, job->load, n);
+    return error ? "file cannot be read" : more ? "file runs past $FFFF" : NULL;
+}
+
+// output, into the worker's buffer
+
+static char *put(char *o, const char *s, size_t len) {
+    memcpy(o, s, len);
+    return o + len;
+}
+
+#define PUT(o, literal) put(o, literal, sizeof(literal) - 1)
+
+static char *put_number(char *o, u_int64_t n) {
+    char digits[20];
+    int i = 0;
+    do digits[i++] = '0' + n % 10;
+    while ((n /= 10) > 0);
+    while (i > 0) *o++ = digits[--i];
+    return o;
+}
+
+static char *put_field(char *o, const char *name, size_t len, u_int64_t n) {
+    *o++ = ',';
+    o = put(o, name, len);
+    return put_number(o, n);
+}
+
+#define FIELD(o, name, n) put_field(o, "\"" name "\":", sizeof(name) + 2, n)
+
+static char *put_id(char *o, const Job *job, u_int64_t number) {
+    o = PUT(o, "{\"id\":");
+    return job->id ? put(o, job->id, job->id_len) : put_number(o, number);
+}
+
+static void ensure(Worker *w, size_t need) {
+    if (need <= w->out_cap) return;
+    w->out_cap = need * 2;
+    w->out = realloc(w->out, w->out_cap);
+    if (w->out == NULL) abort();
+}
+
+static size_t format_error(Worker *w, const Job *job, u_int64_t number, const char *error) {
+    ensure(w, job->id_len + strlen(error) + 64);
+    char *o = put_id(w->out, job, number);
+    o = PUT(o, ",\"error\":\"");
+    o = put(o, error, strlen(error));
+    o = PUT(o, "\"}\n");
+    return o - w->out;
+}
+
+static size_t format_result(Worker *w, const Job *job, u_int64_t number, const CPU *cpu, int stuck,
+                            u_int64_t cycles) {
+    static const char digits[] = "0123456789abcdef";
+    ensure(w, job->id_len + 2 * BATCH_READ_MAX + 4 * BATCH_RANGES + 256);
+    char *o = put_id(w->out, job, number);
+    o = stuck ? PUT(o, ",\"status\":\"stuck\"") : PUT(o, ",\"status\":\"capped\"");
+    o = FIELD(o, "cycles", cycles);
+    o = FIELD(o, "pc", cpu->PC);
+    o = FIELD(o, "a", cpu->A);
+    o = FIELD(o, "x", cpu->X);
+    o = FIELD(o, "y", cpu->Y);
+    o = FIELD(o, "sp", cpu->SP);
+    o = FIELD(o, "p", cpu->N << 7 | cpu->V << 6 | 1 << 5 | cpu->B << 4 | cpu->D << 3 | cpu->I << 2 | cpu->Z << 1 | cpu->C);
+    o = PUT(o, ",\"read\":[");
+    for (int r = 0; r < job->ranges; r++) {
+        if (r > 0) *o++ = ',';
+        *o++ = '"';
+        const Byte *data = &cpu->mem->Data[job->range[r][0]];
+        for (u_int64_t i = 0; i < job->range[r][1]; i++) {
+            *o++ = digits[data[i] >> 4];
+            *o++ = digits[data[i] & 15];
+        }
+        *o++ = '"';
+    }
+    o = PUT(o, "]}\n");
+    return o - w->out;
+}
+
+// runs the job on a line and writes its result; -1 for a blank line
+static int process(Worker *w, const Slot *slot, u_int64_t *cycles) {
+    const char *line = slot->line;
+    size_t len = slot->len;
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) len--;
+    Parser blank = { line, line + len };
+    ws(&blank);
+    if (blank.p == blank.end) return -1;
+
+    Job job;
+    size_t n;
+    int failed = 0;
+    const char *error = parse(line, len, &job);
+    if (error == NULL) {
+        CPU *cpu = pool_create(&w->pool);
+        error = job.hex ? load_hex(cpu->mem, &job) : load_file(w, cpu->mem, &job);
+        if (error == NULL) {
+            cpu_reset(cpu);
+            cpu->PC = job.has_entry ? job.entry : job.load;
+            cpu->opcodes = job.opcodes;
+            cpu_run(cpu, job.cycles);
+            // an idle loop with no devices is a loop that never ends; count
+            // the cycles up to where it was seen, not the ones skipped
+            int stuck = cpu->idle_cycles != 0;
+            *cycles = cpu->cycles - cpu->idle_cycles;
+            n = format_result(w, &job, slot->number, cpu, stuck, *cycles);
+        }
+        pool_destroy(&w->pool, cpu);
+    }
+    if (error != NULL) {
+        n = format_error(w, &job, slot->number, error);
+        failed = 1;
+        *cycles = 0;
+    }
+    Batch *b = w->batch;
+    pthread_mutex_lock(&b->out_lock);
+    if (fwrite(w->out, 1, n, b->out) != n) b->write_error = 1;
+    pthread_mutex_unlock(&b->out_lock);
+    return failed;
+}
+
+static void *work(void *arg) {
+    Worker *w = arg;
+    Batch *b = w->batch;
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        while (b->ready_count == 0 && !b->eof) pthread_cond_wait(&b->work, &b->lock);
+        if (b->ready_count == 0) {
+            pthread_mutex_unlock(&b->lock);
+            return NULL;
+        }
+        int s = b->ready[b->ready_head];
+        b->ready_head = (b->ready_head + 1) % b->window;
+        b->ready_count--;
+        pthread_mutex_unlock(&b->lock);
+
+        u_int64_t cycles = 0;
+        int failed = process(w, &b->slots[s], &cycles);
+
+        pthread_mutex_lock(&b->lock);
+        b->free_slots[b->free_count++] = s;
+        if (failed >= 0) {
+            b->stats.jobs++;
+            b->stats.errors += failed;
+            b->stats.cycles += cycles;
+        }
+        pthread_cond_signal(&b->room);
+        pthread_mutex_unlock(&b->lock);
+    }
+}
+
+// runs every job in in and writes results to out, with workers threads and
+// at most window jobs in flight; -1 if in or out failed or the threads or
+// their machines cannot be had
+int batch_run(FILE *in, FILE *out, int workers, int window, BatchStats *stats) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, init_hex);
+    if (stats) memset(stats, 0, sizeof(*stats));
+    if (workers < 1 || window < 1) return -1;
+    Batch b = { .in = in, .out = out, .window = window };
+    b.slots = calloc(window, sizeof(Slot));
+    b.ready = calloc(window, sizeof(int));
+    b.free_slots = calloc(window, sizeof(int));
+    Worker *w = calloc(workers, sizeof(Worker));
+    int result = -1, started = 0;
+    if (b.slots == NULL || b.ready == NULL || b.free_slots == NULL || w == NULL) goto done;
+    for (int s = window - 1; s >= 0; s--) b.free_slots[b.free_count++] = s;
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_mutex_init(&b.out_lock, NULL);
+    pthread_cond_init(&b.work, NULL);
+    pthread_cond_init(&b.room, NULL);
+    for (; started < workers; started++) {
+        w[started].batch = &b;
+        if (pool_init(&w[started].pool, 1, POOL_DIRTY_ONLY) != 0) break;
+        if (pthread_create(&w[started].thread, NULL, work, &w[started]) != 0) {
+            pool_free(&w[started].pool);
+            break;
+        }
+    }
+
+    u_int64_t number = 0;
+    while (started == workers) {
+        pthread_mutex_lock(&b.lock);
+        while (b.free_count == 0) pthread_cond_wait(&b.room, &b.lock);
+        int s = b.free_slots[--b.free_count];
+        pthread_mutex_unlock(&b.lock);
+        Slot *slot = &b.slots[s];
+        slot->len = getline(&slot->line, &slot->cap, in);
+        pthread_mutex_lock(&b.lock);
+        if (slot->len < 0) {
+            b.free_slots[b.free_count++] = s;
+            pthread_mutex_unlock(&b.lock);
+            break;
+        }
+        slot->number = ++number;
+        b.ready[(b.ready_head + b.ready_count++) % window] = s;
+        pthread_cond_signal(&b.work);
+        pthread_mutex_unlock(&b.lock);
+    }
+
+    pthread_mutex_lock(&b.lock);
+    b.eof = 1;
+    pthread_cond_broadcast(&b.work);
+    pthread_mutex_unlock(&b.lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(w[i].thread, NULL);
+        pool_free(&w[i].pool);
+        free(w[i].out);
+    }
+    pthread_mutex_destroy(&b.lock);
+    pthread_mutex_destroy(&b.out_lock);
+    pthread_cond_destroy(&b.work);
+    pthread_cond_destroy(&b.room);
+    if (fflush(out) != 0) b.write_error = 1;
+    if (stats) *stats = b.stats;
+    result = started == workers && !ferror(in) && !b.write_error ? 0 : -1;
+done:
+    for (int s = 0; b.slots && s < window; s++) free(b.slots[s].line);
+    free(b.slots);
+    free(b.ready);
+    free(b.free_slots);
+    free(w);
+    return result;
+}
@@ -0,0 +1,50 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "6502.h"
+#include <stdio.h>
+
+/*
+ * Batch mode: jobs as newline-delimited JSON in, results the same way out.
+ * Each input line is an object with
+ *
+ *   "id"       any string or number, given back as is (the line number
+ *              when there is none)
+ *   "hex"      program bytes as hex digits, or
+ *   "file"     a path to load instead
+ *   "load"     where the bytes go, 0 by default
+ *   "entry"    where to start, the load address by default
+ *   "cycles"   cap, BATCH_DEFAULT_CYCLES by default
+ *   "read"     memory to return, as [[address, length], ...]
+ *   "opcodes"  "strict" (default), "nmos" or "cmos"
+ *
+ * Numbers are plain decimal JSON numbers. Other keys are skipped. A job
+ * ends "stuck" as soon as the guest sits in a loop that can never end, or
+ * "capped" when it has run its cycles, and the result line gives the id,
+ * status, cycles, registers and each range read as a hex string:
+ *
+ *   {"id":7,"status":"stuck","cycles":282,"pc":1037,"a":120,"x":16,
+ *    "y":0,"sp":255,"p":35,"read":["7800"]}
+ *
+ * A line that cannot be run gets {"id":...,"error":"..."} instead.
+ *
+ * batch_run() reads in on the calling thread and hands lines to workers
+ * threads, each with its own machine from a pool of one, with no more
+ * than window lines read and not yet answered. Workers parse their own
+ * lines, decode hex straight into guest memory and format their results
+ * into a buffer of their own, so the only things shared are the queue and
+ * one write per result. Results come out in the order jobs finish.
+ */
+
+#define BATCH_DEFAULT_CYCLES 1000000
+#define BATCH_RANGES 16
+#define BATCH_READ_MAX 4096     // bytes over all of a job's ranges
+
+typedef struct {
+    u_int64_t jobs, errors;     // lines answered, and those with an error
+    u_int64_t cycles;           // run by the jobs
+} BatchStats;
+
+int batch_run(FILE *in, FILE *out, int workers, int window, BatchStats *stats);
+
+#endif
@@ -0,0 +1,102 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../6502.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Times the ALU helpers of whichever backend this was built with
+ * (computed flags, or -DALU_TABLES lookups) over a fixed op mix.
+ * Two operand distributions are run: uniform, which spreads lookups over
+ * the whole of each table, and skewed, where most operands come from a
+ * handful of values the way loop counters and constants do in real code.
+ *
+ * usage: alu_bench [adc% sbc% cmp% shift%]
+ */
+
+#define INPUTS (1 << 16)
+#define ROUNDS 200
+
+enum { OP_ADC, OP_SBC, OP_CMP, OP_CPX, OP_ASL, OP_LSR, OP_ROL, OP_ROR };
+
+typedef struct {
+    Byte op, a, val, c;
+} Input;
+
+static Input inputs[INPUTS];
+static u_int32_t seed = 0x6502;
+
+static u_int32_t next_rand(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static Byte operand(int skewed) {
+    // skewed: 7 in 8 operands come from 16 values
+    if (skewed && (next_rand() & 7)) return (next_rand() & 0x0F) * 0x11;
+    return next_rand() & 0xFF;
+}
+
+static void fill(const int mix[4], int skewed) {
+    for (int i = 0; i < INPUTS; i++) {
+        int r = next_rand() % 100;
+        Byte op;
+        if (r < mix[0]) op = OP_ADC;
+        else if (r < mix[0] + mix[1]) op = OP_SBC;
+        else if (r < mix[0] + mix[1] + mix[2]) op = (r & 1) ? OP_CMP : OP_CPX;
+        else op = OP_ASL + (r & 3);
+        inputs[i] = (Input){ op, operand(skewed), operand(skewed), next_rand() & 1 };
+    }
+}
+
+static double run(void) {
+    struct timespec t0, t1;
+    CPU c = {0};
+    u_int32_t sum = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < INPUTS; i++) {
+            const Input *in = &inputs[i];
+            c.A = in->a;
+            c.X = in->a;
+            c.C = in->c;
+            switch (in->op) {
+                case OP_ADC: adc(&c, in->val); break;
+                case OP_SBC: sbc(&c, in->val); break;
+                case OP_CMP: cmp(&c, in->val); break;
+                case OP_CPX: cpx(&c, in->val); break;
+                case OP_ASL: c.A = asl(&c, in->val); break;
+                case OP_LSR: c.A = lsr(&c, in->val); break;
+                case OP_ROL: c.A = rol(&c, in->val); break;
+                default:     c.A = ror(&c, in->val); break;
+            }
+            sum += c.A + (c.C | c.Z << 1 | c.V << 6 | c.N << 7);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if (sum == 0x12345678) printf(" ");
+    return elapsed * 1e9 / ((double)ROUNDS * INPUTS);
+}
+
+int main(int argc, char **argv) {
+    int mix[4] = { 25, 10, 35, 30 };
+    if (argc == 5) {
+        for (int i = 0; i < 4; i++) mix[i] = atoi(argv[i + 1]);
+    }
+
+#ifdef ALU_TABLES
+    const char *backend = "tables";
+#else
+    const char *backend = "computed";
+#endif
+    printf("%-8s mix adc %d%% sbc %d%% cmp %d%% shift %d%%\n", backend, mix[0], mix[1], mix[2], mix[3]);
+
+    fill(mix, 0);
+    printf("    uniform : %.2f ns/op\n", run());
+    fill(mix, 1);
+    printf("    skewed  : %.2f ns/op\n", run());
+    return 0;
+}
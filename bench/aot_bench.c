@@ -0,0 +1,56 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../aot.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * The aot_test image run to its final JMP by the interpreter and by the
+ * code tools/recompile made from it. Both must finish on the same cycle.
+ */
+
+#define RUNS 200
+
+static Byte image[0x10000];
+static CPU cpu;
+static Memory mem;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double run(int compiled) {
+    double t0 = now();
+    for (int i = 0; i < RUNS; i++) {
+        init_mem(&mem);
+        memcpy(mem.Data, image, sizeof(image));
+        memset(&cpu, 0, sizeof(cpu));
+        cpu.mem = &mem;
+        cpu.opcodes = OPCODES_NMOS;
+        cpu_reset(&cpu);
+        if (compiled) aot_run(&cpu, CYCLES_FOREVER, NULL);
+        else cpu_run(&cpu, CYCLES_FOREVER);
+    }
+    return now() - t0;
+}
+
+int main(void) {
+    FILE *f = fopen("tests/aot_prog.bin", "rb");
+    if (f == NULL || fread(image, 1, sizeof(image), f) != sizeof(image)) {
+        perror("tests/aot_prog.bin");
+        return 1;
+    }
+    fclose(f);
+
+    double interpreted = run(0);
+    u_int64_t cycles = cpu.cycles;
+    double compiled = run(1);
+    printf("ahead-of-time compiled code\n");
+    printf("    interpreted : %10llu cycles in %.4f s (%.1f MHz)\n", (unsigned long long)cycles * RUNS, interpreted,
+           cycles * RUNS / interpreted / 1e6);
+    printf("    compiled    : %10llu cycles in %.4f s (%.1f MHz, %.1fx)\n", (unsigned long long)cpu.cycles * RUNS,
+           compiled, cpu.cycles * RUNS / compiled / 1e6, interpreted / compiled);
+    return cpu.cycles != cycles;
+}
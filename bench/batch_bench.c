@@ -0,0 +1,72 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../batch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * JOBS small jobs as NDJSON from memory to /dev/null: a program of a few
+ * dozen bytes that sums a table it fills, about 6700 cycles, returning 64
+ * bytes. Run once as they are and once capped at a single cycle, which
+ * leaves only reading, parsing, loading and formatting; the second shows
+ * what batch mode costs per job next to the emulation it feeds.
+ */
+
+#define JOBS 50000
+
+// fills $3000-$30FF with X, sums it into $20, then stops
+static const char program[] =
+    "a200"      // 0400 LDX #0
+    "8a"        // 0402 TXA
+    "9d0030"    // 0403 STA $3000,X
+    "e8"        // 0406 INX
+    "d0f9"      // 0407 BNE $0402
+    "18"        // 0409 CLC
+    "7d0030"    // 040A ADC $3000,X
+    "8520"      // 040D STA $20
+    "e8"        // 040F INX
+    "d0f7"      // 0410 BNE $0409
+    "4c1204";   // 0412 JMP $0412
+
+static char *make_input(u_int64_t cycles, size_t *len) {
+    char *input = malloc((size_t)JOBS * 256), *o = input;
+    for (int i = 0; i < JOBS; i++) {
+        o += sprintf(o, "{\"id\":%d,\"hex\":\"%s\",\"load\":1024,\"cycles\":%llu,\"read\":[[32,1],[12288,64]]}\n",
+                     i, program, (unsigned long long)cycles);
+    }
+    *len = o - input;
+    return input;
+}
+
+static double run(const char *input, size_t len, int workers, BatchStats *stats) {
+    FILE *in = fmemopen((void *)input, len, "r");
+    FILE *out = fopen("/dev/null", "w");
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    batch_run(in, out, workers, 64 * workers, stats);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fclose(in);
+    fclose(out);
+    return t1.tv_sec - t0.tv_sec + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+int main(void) {
+    size_t full_len, bare_len;
+    char *full = make_input(1000000, &full_len), *bare = make_input(1, &bare_len);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("%d jobs, %zu bytes of input\n", JOBS, full_len);
+    for (int workers = 1; workers <= (cpus > 1 ? cpus : 1); workers *= 2) {
+        BatchStats stats;
+        double t_full = run(full, full_len, workers, &stats);
+        u_int64_t cycles = stats.cycles;
+        double t_bare = run(bare, bare_len, workers, &stats);
+        printf("    %2d workers: %8.0f jobs/s, %6.0f Mcycles/s, %5.2f us per job of which %5.2f us outside "
+               "the emulator (%2.0f%%)\n",
+               workers, JOBS / t_full, cycles / t_full / 1e6, t_full / JOBS * 1e6, t_bare / JOBS * 1e6,
+               100 * t_bare / t_full);
+    }
+    free(full);
+    free(bare);
+    return 0;
+}
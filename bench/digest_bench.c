@@ -0,0 +1,81 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../digest.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Digesting memory after each slice of a run: a byte-at-a-time FNV-1a of
+ * all 64 KiB, as a regression check would do it, against the vector page
+ * hash over all pages and against digest_update() rehashing only the
+ * pages the slice stored to. The guest keeps a counter in zero page and
+ * fills a 4 KiB buffer.
+ */
+
+#define SLICES 20000
+#define SLICE 2000
+
+static const Byte program[] = {
+    0xA0, 0x00,         // 0400 LDY #0
+    0xE6, 0x10,         // 0402 INC $10
+    0xA5, 0x10,         // 0404 LDA $10
+    0x91, 0x12,         // 0406 STA ($12),Y
+    0xC8,               // 0408 INY
+    0xD0, 0xF7,         // 0409 BNE $0402
+    0xE6, 0x13,         // 040B INC $13
+    0xA5, 0x13,         // 040D LDA $13
+    0x29, 0x0F,         // 040F AND #$0F
+    0x09, 0x20,         // 0411 ORA #$20
+    0x85, 0x13,         // 0413 STA $13
+    0x4C, 0x00, 0x04,   // 0415 JMP $0400
+};
+
+static CPU cpu;
+static Memory mem;
+static Digest d;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static u_int64_t fnv(const Byte *data, size_t len) {
+    u_int64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) h = (h ^ data[i]) * 1099511628211ull;
+    return h;
+}
+
+static void start(void) {
+    init_mem(&mem);
+    memcpy(&mem.Data[0x0400], program, sizeof(program));
+    mem.Data[0x13] = 0x20;
+    memset(&cpu, 0, sizeof(cpu));
+    cpu.mem = &mem;
+    cpu.PC = 0x0400;
+    cpu.SP = 0xFF;
+}
+
+int main(void) {
+    double t[3];
+    u_int64_t sum[3] = { 0 };
+    for (int way = 0; way < 3; way++) {
+        start();
+        digest_init(&d, &mem);
+        double spent = 0;
+        for (int s = 1; s <= SLICES; s++) {
+            cpu_run(&cpu, (u_int64_t)s * SLICE);
+            double t0 = now();
+            if (way == 0) sum[way] += fnv(mem.Data, sizeof(mem.Data));
+            else if (way == 1) digest_init(&d, &mem), sum[way] += d.value;
+            else sum[way] += digest_update(&d, &mem);
+            spent += now() - t0;
+        }
+        t[way] = spent / SLICES;
+    }
+    printf("digest after every %d cycles (FNV %016llx)\n", SLICE, (unsigned long long)sum[0]);
+    printf("    FNV-1a of 64 KiB    %8.3f us\n", t[0] * 1e6);
+    printf("    all pages hashed    %8.3f us\n", t[1] * 1e6);
+    printf("    dirty pages only    %8.3f us (%s)\n", t[2] * 1e6, sum[1] == sum[2] ? "same digests" : "DIGESTS DIFFER");
+    return 0;
+}
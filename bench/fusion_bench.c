@@ -0,0 +1,126 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../6502.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Runs a few loops written the way 6502 code usually is and reports how
+ * many dispatches superinstruction fusion saved on each. Built three ways
+ * by make bench: fused, with -DNO_FUSION for the baseline, and with
+ * -DPAIR_STATS to print the opcode pairs the loops execute most.
+ *
+ * copy   : LDA (src),Y / STA (dst),Y / INY / BNE, 256 bytes x 64
+ * sum    : 16-bit add with LDA / CLC / ADC / STA, DEX / BNE and DEY / BNE
+ * search : LDA abs,Y / CMP # / BEQ and INY / CPY # / BNE over a table
+ */
+
+#define ORIGIN 0x0400
+#define REPEAT 50
+
+static const Byte copy[] = {
+    0xA2, 0x40,         // 0400 LDX #64
+    0xA0, 0x00,         // 0402 LDY #0
+    0xB1, 0x10,         // 0404 LDA ($10),Y
+    0x91, 0x12,         // 0406 STA ($12),Y
+    0xC8,               // 0408 INY
+    0xD0, 0xF9,         // 0409 BNE $0404
+    0xCA,               // 040B DEX
+    0xD0, 0xF4,         // 040C BNE $0402
+    0x4C, 0x0E, 0x04,   // 040E JMP $040E
+};
+
+static const Byte sum[] = {
+    0xA0, 0x00,         // 0400 LDY #0
+    0xA2, 0x00,         // 0402 LDX #0
+    0xA5, 0x20,         // 0404 LDA $20
+    0x18,               // 0406 CLC
+    0x69, 0x03,         // 0407 ADC #3
+    0x85, 0x20,         // 0409 STA $20
+    0xA5, 0x21,         // 040B LDA $21
+    0x69, 0x00,         // 040D ADC #0
+    0x85, 0x21,         // 040F STA $21
+    0xCA,               // 0411 DEX
+    0xD0, 0xF0,         // 0412 BNE $0404
+    0x88,               // 0414 DEY
+    0xD0, 0xEB,         // 0415 BNE $0402
+    0x4C, 0x17, 0x04,   // 0417 JMP $0417
+};
+
+static const Byte search[] = {
+    0xA2, 0x00,         // 0400 LDX #0
+    0xA0, 0x00,         // 0402 LDY #0
+    0xB9, 0x00, 0x10,   // 0404 LDA $1000,Y
+    0xC9, 0xFF,         // 0407 CMP #$FF
+    0xF0, 0x05,         // 0409 BEQ $0410
+    0xC8,               // 040B INY
+    0xC0, 0xC8,         // 040C CPY #200
+    0xD0, 0xF4,         // 040E BNE $0404
+    0xCA,               // 0410 DEX
+    0xD0, 0xEF,         // 0411 BNE $0402
+    0x4C, 0x13, 0x04,   // 0413 JMP $0413
+};
+
+static const struct {
+    const char *name;
+    const Byte *code;
+    size_t size;
+} kernels[] = {
+    { "copy", copy, sizeof(copy) },
+    { "sum", sum, sizeof(sum) },
+    { "search", search, sizeof(search) },
+};
+
+static CPU cpu;
+static Memory mem;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void load(const Byte *code, size_t size) {
+    init_mem(&mem);
+    memcpy(&mem.Data[ORIGIN], code, size);
+    for (int i = 0; i < 0x100; i++) mem.Data[0x1000 + i] = i & 0x7F;
+    mem.Data[0x11] = 0x10;  // copy from $1000
+    mem.Data[0x13] = 0x20;  // to $2000
+    memset(&cpu, 0, sizeof(cpu));
+    cpu.mem = &mem;
+    cpu_reset(&cpu);
+    cpu.PC = ORIGIN;
+}
+
+int main(void) {
+    printf("fusion %s\n",
+#if defined(NO_FUSION) || defined(PAIR_STATS)
+           "off"
+#else
+           "on"
+#endif
+    );
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        u_int64_t count = 0, dispatches = 0;
+        double t0 = now();
+        for (int r = 0; r < REPEAT; r++) {
+            load(kernels[k].code, kernels[k].size);
+            Word pc;
+            int n;
+            do {
+                pc = cpu.PC;
+                n = execute_instructions(&cpu);
+                count += n;
+                dispatches++;
+            } while (cpu.PC != pc || n > 1);
+        }
+        double elapsed = now() - t0;
+        printf("    %-6s : %10llu instructions, %10llu dispatches (%4.1f%% saved), %6.1f MIPS\n",
+               kernels[k].name, (unsigned long long)count, (unsigned long long)dispatches,
+               100.0 * (count - dispatches) / count, count / elapsed / 1e6);
+    }
+#ifdef PAIR_STATS
+    print_pair_stats(12);
+#endif
+    return 0;
+}
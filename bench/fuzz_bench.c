@@ -0,0 +1,72 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../fuzz.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Executions per second of the fuzzing harness on a small target: a
+ * checksum over a 32 byte input that also copies it into a buffer, so
+ * each run dirties a few pages that the next one has to restore.
+ */
+
+#define EXECS 1000000
+#define INPUT 0x0300
+
+static const Byte program[] = {
+    0x20, 0x00, 0x06,   // 0400 JSR $0600
+    0x4C, 0x03, 0x04,   // 0403 JMP $0403
+};
+
+static const Byte target[] = {
+    0xA0, 0x00,         // 0600 LDY #0
+    0x98,               // 0602 TYA
+    0xB9, 0x00, 0x03,   // 0603 LDA $0300,Y
+    0x99, 0x00, 0x05,   // 0606 STA $0500,Y
+    0x65, 0x10,         // 0609 ADC $10
+    0x85, 0x10,         // 060B STA $10
+    0x90, 0x02,         // 060D BCC $0611
+    0xE6, 0x11,         // 060F INC $11
+    0xC8,               // 0611 INY
+    0xC0, 0x20,         // 0612 CPY #32
+    0xD0, 0xED,         // 0614 BNE $0603
+    0x60,               // 0616 RTS
+};
+
+static CPU cpu;
+static Memory mem;
+static Fuzzer f;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(void) {
+    init_mem(&mem);
+    memcpy(&mem.Data[0x0400], program, sizeof(program));
+    memcpy(&mem.Data[0x0600], target, sizeof(target));
+    cpu.mem = &mem;
+    cpu.SP = 0xFF;
+    cpu.PC = 0x0400;
+    if (fuzz_init(&f, &cpu, INPUT, 32, 0x0403, 100000) != 0) return 1;
+
+    Byte input[32];
+    u_int32_t seed = 1;
+    int interesting = 0;
+    double t0 = now();
+    for (int i = 0; i < EXECS; i++) {
+        for (int j = 0; j < 32; j += 4) {
+            seed = seed * 1103515245 + 12345;
+            memcpy(&input[j], &seed, 4);
+        }
+        if (fuzz_run(&f, input, sizeof(input)) != FUZZ_OK) return 1;
+        interesting += fuzz_new_coverage(&f);
+    }
+    double elapsed = now() - t0;
+    printf("in-process fuzzing\n");
+    printf("    %d execs of %llu cycles in %.3f s: %.0f execs/s, %d with new coverage\n", EXECS,
+           (unsigned long long)f.cpu.cycles, elapsed, EXECS / elapsed, interesting);
+    return 0;
+}
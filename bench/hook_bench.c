@@ -0,0 +1,103 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../6502.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * A guest that spends its time in a page copy routine, run once emulated
+ * and once with the routine hooked to a native memcpy. The memory state
+ * after both runs must be the same.
+ */
+
+#define ORIGIN 0x0400
+#define REPEAT 200
+#define PAGES 16
+#define COPY_CYCLES (PAGES * 4120)  // roughly what the guest loop takes
+
+static const Byte program[] = {
+    0xA9, 0x10,         // 0400 LDA #$10
+    0x85, 0x21,         // 0402 STA $21         from $1000
+    0xA9, 0x20,         // 0404 LDA #$20
+    0x85, 0x23,         // 0406 STA $23         to $2000
+    0xA2, PAGES,        // 0408 LDX #PAGES
+    0x20, 0x00, 0x06,   // 040A JSR $0600
+    0xC6, 0x30,         // 040D DEC $30
+    0xD0, 0xEF,         // 040F BNE $0400
+    0x4C, 0x11, 0x04,   // 0411 JMP $0411
+};
+
+// copies X pages from ($20) to ($22)
+static const Byte copy[] = {
+    0xA0, 0x00,         // 0600 LDY #0
+    0xB1, 0x20,         // 0602 LDA ($20),Y
+    0x91, 0x22,         // 0604 STA ($22),Y
+    0xC8,               // 0606 INY
+    0xD0, 0xF9,         // 0607 BNE $0602
+    0xE6, 0x21,         // 0609 INC $21
+    0xE6, 0x23,         // 060B INC $23
+    0xCA,               // 060D DEX
+    0xD0, 0xF2,         // 060E BNE $0602
+    0x60,               // 0610 RTS
+};
+
+static void native_copy(CPU *cpu, void *ctx) {
+    (void)ctx;
+    Byte *d = cpu->mem->Data;
+    Word src = d[0x20] | d[0x21] << 8, dst = d[0x22] | d[0x23] << 8;
+    memmove(&d[dst], &d[src], cpu->X * 0x100);
+    d[0x21] += cpu->X;
+    d[0x23] += cpu->X;
+    cpu->writes += cpu->X * 0x100 + 2;
+    cpu->A = d[dst + cpu->X * 0x100 - 1];
+    cpu->X = cpu->Y = 0;
+    cpu->Z = 1;
+    cpu->N = 0;
+}
+
+static CPU cpu;
+static Memory mem;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static u_int64_t run(Hooks *hooks, double *elapsed) {
+    init_mem(&mem);
+    memcpy(&mem.Data[ORIGIN], program, sizeof(program));
+    memcpy(&mem.Data[0x0600], copy, sizeof(copy));
+    for (int i = 0; i < PAGES * 0x100; i++) mem.Data[0x1000 + i] = i * 7;
+    mem.Data[0x30] = REPEAT;
+    memset(&cpu, 0, sizeof(cpu));
+    cpu.mem = &mem;
+    cpu.hooks = hooks;
+    cpu.SP = 0xFF;
+    cpu.PC = ORIGIN;
+
+    double t0 = now();
+    cpu_run(&cpu, CYCLES_FOREVER);
+    *elapsed = now() - t0;
+
+    u_int64_t h = 14695981039346656037ull;   // FNV-1a over memory
+    for (int i = 0; i < 0x10000; i++) h = (h ^ mem.Data[i]) * 1099511628211ull;
+    return h ^ cpu.A ^ (u_int64_t)cpu.PC << 8;
+}
+
+int main(void) {
+    Hooks hooks;
+    hooks_init(&hooks);
+    hook_add(&hooks, 0x0600, native_copy, NULL, COPY_CYCLES);
+
+    double emulated, native;
+    u_int64_t a = run(NULL, &emulated);
+    u_int64_t emulated_cycles = cpu.cycles;
+    u_int64_t b = run(&hooks, &native);
+    printf("native hooks\n");
+    printf("    emulated : %10llu cycles in %.4f s\n", (unsigned long long)emulated_cycles, emulated);
+    printf("    hooked   : %10llu cycles in %.4f s (%.0fx), %llu calls\n", (unsigned long long)cpu.cycles,
+           native, emulated / native, (unsigned long long)hooks.calls);
+    printf("    state    : %s\n", a == b ? "same" : "DIFFERENT");
+    return a != b;
+}
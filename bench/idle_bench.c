@@ -0,0 +1,73 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../sched.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * A mostly idle machine: the guest polls a mailbox that a stand-in device
+ * sets every PERIOD cycles, counts the event and goes back to polling. The
+ * device is a scheduler event that re-arms itself.
+ * make bench runs it with idle loop skipping and with -DNO_IDLE_SKIP; the
+ * final state line must be the same for both.
+ */
+
+#define ORIGIN 0x0400
+#define MAILBOX 0x0200
+#define HANDLED 0x0201
+#define PERIOD 20000
+#define EVENTS 10000
+
+static const Byte poll[] = {
+    0xAD, 0x00, 0x02,   // 0400 LDA $0200
+    0xF0, 0xFB,         // 0403 BEQ $0400
+    0xEE, 0x01, 0x02,   // 0405 INC $0201
+    0xA9, 0x00,         // 0408 LDA #0
+    0x8D, 0x00, 0x02,   // 040A STA $0200
+    0x4C, 0x00, 0x04,   // 040D JMP $0400
+};
+
+static CPU cpu;
+static Memory mem;
+
+static void deliver(void *ctx, u_int64_t when) {
+    Scheduler *s = ctx;
+    mem.Data[MAILBOX] = 1;
+    sched_add(s, when + PERIOD, deliver, s);
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(void) {
+    init_mem(&mem);
+    memcpy(&mem.Data[ORIGIN], poll, sizeof(poll));
+    cpu.mem = &mem;
+    cpu_reset(&cpu);
+    cpu.PC = ORIGIN;
+
+    Scheduler s;
+    sched_init(&s, &cpu);
+    sched_add(&s, PERIOD, deliver, &s);
+
+    double t0 = now();
+    sched_run(&s, (u_int64_t)EVENTS * PERIOD);
+    double elapsed = now() - t0;
+
+    printf("idle skip %s\n",
+#ifdef NO_IDLE_SKIP
+           "off"
+#else
+           "on"
+#endif
+    );
+    printf("    %llu cycles in %.3f s (%.0f MHz), %.1f%% skipped\n",
+           (unsigned long long)cpu.cycles, elapsed, cpu.cycles / elapsed / 1e6,
+           100.0 * cpu.idle_cycles / cpu.cycles);
+    printf("    state: cycles %llu, PC %04X, events handled %u\n",
+           (unsigned long long)cpu.cycles, cpu.PC, mem.Data[HANDLED] | 0u);
+    return 0;
+}
@@ -0,0 +1,114 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../jobs.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * A job server in a child process and a client keeping WINDOW jobs in
+ * flight against one shared 64 KiB image: JOBS short jobs (the guest sums
+ * a page and stops), then the same with every 50th job a long one that
+ * runs LONG cycles. Reports jobs per second and the latency the client
+ * sees for the short jobs, which time slicing keeps low next to the long.
+ */
+
+#define MACHINES 64
+#define JOBS 20000
+#define WINDOW 256
+#define LONG 1000000
+
+// sums page $30 into $20, then stops
+static const Byte program[] = {
+    0xA2, 0x00,         // 0400 LDX #0
+    0x18,               // 0402 CLC
+    0xBD, 0x00, 0x30,   // 0403 LDA $3000,X
+    0x65, 0x20,         // 0406 ADC $20
+    0x85, 0x20,         // 0408 STA $20
+    0xE8,               // 040A INX
+    0xD0, 0xF5,         // 040B BNE $0402
+    0x4C, 0x0D, 0x04,   // 040D JMP $040D
+};
+
+static Byte image[0x10000];
+static double sent[JOBS];
+static double latency[JOBS];
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void run(int fd, int long_every, const char *name) {
+    int next = 0, done = 0, shorts = 0;
+    u_int64_t sum = 0;
+    double t0 = now();
+    while (done < JOBS) {
+        while (next < JOBS && next - done < WINDOW) {
+            int slow = long_every && next % long_every == 0;
+            JobRequest req = { .type = JOB_RUN, .tag = next, .image = slow ? 2 : 1, .flags = JOB_AT_ENTRY,
+                               .entry = 0x0400, .cycles = slow ? LONG : 100000, .out_addr = 0x20, .out_len = 1 };
+            sent[next++] = now();
+            job_send(fd, &req, -1);
+        }
+        JobResult r;
+        Byte out;
+        if (job_receive(fd, &r, &out, 1) != 1) {
+            fprintf(stderr, "jobs_bench: lost the server\n");
+            exit(1);
+        }
+        if (!(long_every && r.tag % long_every == 0)) latency[shorts++] = now() - sent[r.tag];
+        sum += out;
+        done++;
+    }
+    double t = now() - t0;
+    qsort(latency, shorts, sizeof(*latency), by_value);
+    printf("    %-6s %8.0f jobs/s  short jobs p50 %7.1f us  p99 %7.1f us  max %7.1f us  (checksum %llx)\n", name,
+           JOBS / t, latency[shorts / 2] * 1e6, latency[shorts * 99 / 100] * 1e6, latency[shorts - 1] * 1e6,
+           (unsigned long long)sum);
+}
+
+int main(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/6502-jobs-bench-%ld", (long)getpid());
+    static JobServer server;
+    if (job_server_init(&server, path, MACHINES) != 0) return 1;
+    pid_t child = fork();
+    if (child == 0) {
+        for (;;) job_serve(&server, 1000);
+    }
+    int fd = job_connect(path);
+    memcpy(&image[0x0400], program, sizeof(program));
+    for (int i = 0; i < 0x100; i++) image[0x3000 + i] = i * 7;
+    int shm = job_share(image, sizeof(image));
+    JobRequest req = { .type = JOB_IMAGE, .image = 1, .size = sizeof(image) };
+    job_send(fd, &req, shm);
+    // the same with the loop never ending
+    image[0x040E] = 0x00;
+    int shm2 = job_share(image, sizeof(image));
+    req.image = 2;
+    job_send(fd, &req, shm2);
+    JobResult r;
+    if (fd < 0 || shm < 0 || shm2 < 0 || job_receive(fd, &r, NULL, 0) != 0 || job_receive(fd, &r, NULL, 0) != 0) {
+        fprintf(stderr, "jobs_bench: no server\n");
+        return 1;
+    }
+
+    printf("%d jobs, %d in flight, %d machines, one shared 64 KiB image\n", JOBS, WINDOW, MACHINES);
+    run(fd, 0, "short");
+    run(fd, 50, "mixed");
+
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+    unlink(path);
+    return 0;
+}
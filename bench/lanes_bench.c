@@ -0,0 +1,132 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../lanes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Runs LANES machines on the same program with different inputs, first one
+ * after the other on the scalar core, then together in a LaneGroup, checks
+ * both end in the same state and reports throughput for each.
+ *
+ * uniform   : the same control flow on every input
+ * divergent : a data dependent branch inside the inner loop
+ */
+
+#define ORIGIN 0x0400
+#define MAX_STEPS 100000000ULL
+
+// acc = (acc + a) ^ b, 256 x 256 times
+static const Byte uniform[] = {
+    0xA0, 0x00,         // 0400 LDY #0
+    0xA2, 0x00,         // 0402 LDX #0
+    0xA5, 0x10,         // 0404 LDA $10
+    0x18,               // 0406 CLC
+    0x65, 0x00,         // 0407 ADC $00
+    0x45, 0x01,         // 0409 EOR $01
+    0x85, 0x10,         // 040B STA $10
+    0xE8,               // 040D INX
+    0xD0, 0xF4,         // 040E BNE $0404
+    0xC8,               // 0410 INY
+    0xC0, 0x00,         // 0411 CPY #0
+    0xD0, 0xED,         // 0413 BNE $0402
+    0x4C, 0x15, 0x04,   // 0415 JMP $0415
+};
+
+// acc = X & b ? acc + a : acc - a, 256 x 256 times
+static const Byte divergent[] = {
+    0xA0, 0x00,         // 0400 LDY #0
+    0xA2, 0x00,         // 0402 LDX #0
+    0x8A,               // 0404 TXA
+    0x25, 0x01,         // 0405 AND $01
+    0xF0, 0x07,         // 0407 BEQ $0410
+    0xA5, 0x10,         // 0409 LDA $10
+    0x65, 0x00,         // 040B ADC $00
+    0x4C, 0x14, 0x04,   // 040D JMP $0414
+    0xA5, 0x10,         // 0410 LDA $10
+    0xE5, 0x00,         // 0412 SBC $00
+    0x85, 0x10,         // 0414 STA $10
+    0xE8,               // 0416 INX
+    0xD0, 0xEB,         // 0417 BNE $0404
+    0xC8,               // 0419 INY
+    0xC0, 0x00,         // 041A CPY #0
+    0xD0, 0xE4,         // 041C BNE $0402
+    0x4C, 0x1E, 0x04,   // 041E JMP $041E
+};
+
+static Memory mem[2][LANES];
+static CPU cpu[2][LANES];
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void setup(int set, const Byte *prog, size_t size) {
+    for (int i = 0; i < LANES; i++) {
+        CPU *c = &cpu[set][i];
+        init_mem(&mem[set][i]);
+        memset(c, 0, sizeof(*c));
+        c->mem = &mem[set][i];
+        memcpy(&c->mem->Data[ORIGIN], prog, size);
+        c->mem->Data[0x00] = i * 7 + 3;
+        c->mem->Data[0x01] = i * 13 + 5;
+        cpu_reset(c);
+        c->PC = ORIGIN;
+    }
+}
+
+static int run(const char *name, const Byte *prog, size_t size) {
+    setup(0, prog, size);
+    setup(1, prog, size);
+
+    u_int64_t scalar_count = 0;
+    double t0 = now();
+    for (int i = 0; i < LANES; i++) {
+        CPU *c = &cpu[0][i];
+        Word pc;
+        int n;
+        do {
+            pc = c->PC;
+            n = execute_instructions(c);
+            scalar_count += n;
+        } while (c->PC != pc || n > 1);
+    }
+    double scalar_time = now() - t0;
+
+    LaneGroup g;
+    CPU *group[LANES];
+    for (int i = 0; i < LANES; i++) group[i] = &cpu[1][i];
+    t0 = now();
+    lanes_init(&g, group, LANES);
+    lanes_run(&g, MAX_STEPS);
+    lanes_sync(&g);
+    double lane_time = now() - t0;
+    u_int64_t lane_count = g.lockstep + g.masked + g.scalar;
+
+    int same = lane_count == scalar_count;
+    for (int i = 0; i < LANES; i++) {
+        CPU *a = &cpu[0][i], *b = &cpu[1][i];
+        same &= a->A == b->A && a->X == b->X && a->Y == b->Y && a->PC == b->PC &&
+                a->C == b->C && a->Z == b->Z && a->V == b->V && a->N == b->N &&
+                a->cycles == b->cycles &&
+                memcmp(a->mem->Data, b->mem->Data, sizeof(a->mem->Data)) == 0;
+    }
+
+    printf("%s, %d machines, %llu instructions\n", name, LANES, (unsigned long long)scalar_count);
+    printf("    one by one : %7.1f M instructions/s\n", scalar_count / scalar_time / 1e6);
+    printf("    lanes      : %7.1f M instructions/s (%.2fx)\n", lane_count / lane_time / 1e6,
+           scalar_time / lane_time);
+    printf("    lockstep %llu, masked %llu, scalar %llu\n", (unsigned long long)g.lockstep,
+           (unsigned long long)g.masked, (unsigned long long)g.scalar);
+    if (!same) printf("    MISMATCH between scalar and lane results\n");
+    return !same;
+}
+
+int main(void) {
+    int failed = run("uniform", uniform, sizeof(uniform));
+    failed |= run("divergent", divergent, sizeof(divergent));
+    return failed;
+}
@@ -0,0 +1,111 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * MACHINES machines, each made, loaded with a small program, run in turn
+ * a slice at a time, and torn down, ROUNDS times over: once with a
+ * malloc() and init_mem() per machine, once from a pool. The guest walks
+ * a pointer through a few pages, so every slice touches memory spread
+ * over all the machines. The checksum line must be the same for both.
+ */
+
+#define MACHINES 2048
+#define ROUNDS 4
+#define SLICES 20
+#define SLICE 1000
+
+static const Byte program[] = {
+    0xA0, 0x00,         // 0400 LDY #0
+    0xB1, 0x10,         // 0402 LDA ($10),Y
+    0x69, 0x01,         // 0404 ADC #1
+    0x91, 0x10,         // 0406 STA ($10),Y
+    0xC8,               // 0408 INY
+    0xD0, 0xF7,         // 0409 BNE $0402
+    0xE6, 0x11,         // 040B INC $11
+    0xA5, 0x11,         // 040D LDA $11
+    0x29, 0x03,         // 040F AND #$03
+    0x09, 0x20,         // 0411 ORA #$20
+    0x85, 0x11,         // 0413 STA $11
+    0x4C, 0x00, 0x04,   // 0415 JMP $0400
+};
+
+typedef struct {
+    CPU cpu;
+    Memory mem;
+} Heap;
+
+static CPU *cpus[MACHINES];
+static Heap *heap[MACHINES];
+static Pool pool;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void load(CPU *cpu, int i) {
+    memcpy(&cpu->mem->Data[0x0400], program, sizeof(program));
+    cpu->mem->Data[0x11] = 0x20 | (i & 3);
+    cpu->PC = 0x0400;
+    cpu->SP = 0xFF;
+}
+
+static u_int64_t run_all(void) {
+    for (int s = 1; s <= SLICES; s++) {
+        for (int i = 0; i < MACHINES; i++) cpu_run(cpus[i], (u_int64_t)s * SLICE);
+    }
+    u_int64_t sum = 0;
+    for (int i = 0; i < MACHINES; i++) sum += cpus[i]->mem->Data[0x2000 + i % 0x400] + cpus[i]->A;
+    return sum;
+}
+
+int main(void) {
+    double make[2] = { 0 }, run[2] = { 0 }, drop[2] = { 0 };
+    u_int64_t sum[2] = { 0 };
+    if (pool_init(&pool, MACHINES, POOL_HUGE_PAGES) != 0) return 1;
+    for (int way = 0; way < 2; way++) {
+        for (int r = 0; r < ROUNDS; r++) {
+            double t0 = now();
+            for (int i = 0; i < MACHINES; i++) {
+                if (way == 0) {
+                    heap[i] = malloc(sizeof(Heap));
+                    memset(&heap[i]->cpu, 0, sizeof(CPU));
+                    init_mem(&heap[i]->mem);
+                    heap[i]->cpu.mem = &heap[i]->mem;
+                    cpus[i] = &heap[i]->cpu;
+                } else {
+                    cpus[i] = pool_create(&pool);
+                }
+                load(cpus[i], i);
+            }
+            double t1 = now();
+            sum[way] += run_all();
+            double t2 = now();
+            for (int i = 0; i < MACHINES; i++) {
+                if (way == 0) free(heap[i]);
+                else pool_destroy(&pool, cpus[i]);
+            }
+            double t3 = now();
+            make[way] += t1 - t0;
+            run[way] += t2 - t1;
+            drop[way] += t3 - t2;
+        }
+    }
+    const char *name[2] = { "malloc", "pool" };
+    printf("%d machines, %d rounds (checksums %llx %llx)\n", MACHINES, ROUNDS,
+           (unsigned long long)sum[0], (unsigned long long)sum[1]);
+    for (int way = 0; way < 2; way++) {
+        printf("    %-7s make %6.2f us  run %7.2f us  drop %6.2f us per machine\n", name[way],
+               make[way] / ROUNDS / MACHINES * 1e6, run[way] / ROUNDS / MACHINES * 1e6,
+               drop[way] / ROUNDS / MACHINES * 1e6);
+    }
+    printf("    pool: huge pages %s, %llu pages zeroed, peak %d\n", pool.huge ? "on" : "off",
+           (unsigned long long)pool.pages_zeroed, pool.peak);
+    pool_free(&pool);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../record.h"
+#include "../acia.h"
+#include "../via.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * What recording costs: a guest summing a page over and over, polling the
+ * ACIA between passes and taking a VIA timer interrupt every PERIOD
+ * cycles, run once plain and once recording to /dev/null. The final state
+ * line must be the same for both.
+ */
+
+#define CYCLES 200000000ull
+#define PERIOD 5000
+
+static const Byte program[] = {
+    0xA9, 0xC0,         // 0400 LDA #$C0        T1 interrupts on
+    0x8D, 0x0E, 0x60,   // 0402 STA $600E
+    0xA9, 0x40,         // 0405 LDA #$40        T1 free running
+    0x8D, 0x0B, 0x60,   // 0407 STA $600B
+    0xA9, PERIOD & 0xFF,    // 040A LDA #<PERIOD
+    0x8D, 0x04, 0x60,   // 040C STA $6004
+    0xA9, PERIOD >> 8,  // 040F LDA #>PERIOD
+    0x8D, 0x05, 0x60,   // 0411 STA $6005
+    0x58,               // 0414 CLI
+    0xAD, 0x01, 0x61,   // 0415 LDA $6101       ACIA status
+    0xA2, 0x00,         // 0418 LDX #0
+    0x18,               // 041A CLC
+    0x7D, 0x00, 0x02,   // 041B ADC $0200,X
+    0xE8,               // 041E INX
+    0xD0, 0xFA,         // 041F BNE $041B
+    0x85, 0x30,         // 0421 STA $30
+    0x4C, 0x15, 0x04,   // 0423 JMP $0415
+};
+
+static const Byte handler[] = {
+    0x48,               // 0500 PHA
+    0xAD, 0x04, 0x60,   // 0501 LDA $6004       acknowledge T1
+    0xE6, 0x32,         // 0504 INC $32
+    0x68,               // 0506 PLA
+    0x40,               // 0507 RTI
+};
+
+static CPU cpu;
+static Memory mem;
+static Scheduler s;
+static Via via;
+static Acia acia;
+static Recorder rec;
+
+static void start(void) {
+    init_mem(&mem);
+    memcpy(&mem.Data[0x0400], program, sizeof(program));
+    memcpy(&mem.Data[0x0500], handler, sizeof(handler));
+    for (int i = 0; i < 256; i++) mem.Data[0x0200 + i] = i * 7;
+    mem.Data[0xFFFE] = 0x00;
+    mem.Data[0xFFFF] = 0x05;
+    memset(&cpu, 0, sizeof(cpu));
+    cpu.mem = &mem;
+    cpu.SP = 0xFF;
+    cpu.PC = 0x0400;
+    cpu.I = 1;
+    sched_init(&s, &cpu);
+    via_init(&via, &s, 0x60, 1);
+    acia_init(&acia, &s, 0x61, 2, -1);
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double run(const char *name, int fd) {
+    start();
+    if (fd >= 0) record_start(&rec, &cpu, fd);
+    double t0 = now();
+    sched_run(&s, CYCLES);
+    if (fd >= 0) record_finish(&rec);
+    double elapsed = now() - t0;
+    printf("%-10s %llu cycles in %.3f s (%.0f MHz)\n", name, (unsigned long long)cpu.cycles, elapsed,
+           cpu.cycles / elapsed / 1e6);
+    printf("    state: PC %04X, A %02X, sum %02X, interrupts %02X\n", cpu.PC, cpu.A, mem.Data[0x30], mem.Data[0x32]);
+    return elapsed;
+}
+
+int main(void) {
+    int fd = open("/dev/null", O_WRONLY);
+    double plain = run("plain", -1);
+    double recording = run("recording", fd);
+    close(fd);
+    printf("    %llu records, recording costs %+.1f%%\n", (unsigned long long)rec.records, 100.0 * (recording - plain) / plain);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Save states against a raw dump: a typical image (8 KiB of code, text,
+ * a few tables, a used stack, the rest empty) saved and loaded ROUNDS
+ * times, next to init_mem() plus copying the raw 64 KiB image in, which
+ * is what loading a machine from a dump costs. Reports the state size.
+ */
+
+#define ROUNDS 20000
+
+static CPU cpu;
+static Memory mem;
+static Byte image[0x10000];
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(void) {
+    srand(6502);
+    for (int i = 0; i < 0x2000; i++) image[0x8000 + i] = rand() % 4 ? rand() % 0x40 : rand();
+    for (int i = 0; i < 0x600; i++) image[0x0600 + i] = "The quick brown fox jumps over the lazy dog. "[i % 45];
+    for (int i = 0; i < 0x100; i++) image[0x1000 + i] = i * i >> 8;
+    for (int i = 0; i < 0x100; i++) image[0x1100 + i] = (i * 37) ^ 0x5A;
+    for (int i = 0xC0; i < 0x100; i++) image[0x0100 + i] = rand();
+    for (int i = 0; i < 0x80; i++) image[i] = rand() % 3 ? 0 : rand();
+    image[0xFFFC] = 0x00;
+    image[0xFFFD] = 0x80;
+
+    cpu.mem = &mem;
+    double t0 = now();
+    for (int r = 0; r < ROUNDS; r++) {
+        init_mem(&mem);
+        memcpy(mem.Data, image, sizeof(image));
+        cpu_reset(&cpu);
+    }
+    double raw = (now() - t0) / ROUNDS;
+
+    FILE *f = tmpfile();
+    double t1 = now();
+    for (int r = 0; r < ROUNDS / 10; r++) {
+        rewind(f);
+        state_save(&cpu, fileno(f));
+    }
+    double save = (now() - t1) / (ROUNDS / 10);
+    long size = lseek(fileno(f), 0, SEEK_END);
+    Byte *state = malloc(size);
+    rewind(f);
+    if (fread(state, 1, size, f) != (size_t)size) return 1;
+    fclose(f);
+
+    double t2 = now();
+    for (int r = 0; r < ROUNDS; r++) state_decode(&cpu, state, size);
+    double load = (now() - t2) / ROUNDS;
+    int same = memcmp(mem.Data, image, sizeof(image)) == 0;
+    free(state);
+
+    printf("save state: %ld bytes for a %d byte image%s\n", size, (int)sizeof(image), same ? "" : " (MISMATCH)");
+    printf("    raw init_mem + copy %6.2f us\n", raw * 1e6);
+    printf("    state load          %6.2f us\n", load * 1e6);
+    printf("    state save          %6.2f us\n", save * 1e6);
+    return 0;
+}
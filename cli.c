@@ -0,0 +1,65 @@
+#include "lib6502.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * The 6502 command, built on lib6502 alone:
+ *
+ *   6502 image.bin load-address [start [cycles]]
+ *
+ * Addresses are hex. The CPU starts at the reset vector unless a start
+ * address is given, and runs until it is stuck, or for the given number
+ * of cycles (decimal); then the registers are printed.
+ */
+
+static int address(const char *arg, long *out) {
+    char *end;
+    *out = strtol(arg, &end, 16);
+    if (*arg == 0 || *end != 0 || *out < 0 || *out > 0xFFFF) {
+        fprintf(stderr, "6502: bad address %s\n", arg);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argc > 5) {
+        fprintf(stderr, "usage: %s image.bin load-address [start [cycles]]\n", argv[0]);
+        return 1;
+    }
+    long load, start = -1;
+    if (address(argv[2], &load) != 0 || (argc > 3 && address(argv[3], &start) != 0)) return 1;
+    unsigned long long budget = 0;
+    if (argc > 4) {
+        char *end;
+        budget = strtoull(argv[4], &end, 10);
+        if (*argv[4] == 0 || *end != 0 || budget == 0) {
+            fprintf(stderr, "6502: bad cycle count %s\n", argv[4]);
+            return 1;
+        }
+    }
+
+    M6502 *m = m6502_create();
+    if (m == NULL) {
+        fprintf(stderr, "6502: out of memory\n");
+        return 1;
+    }
+    if (m6502_load_file(m, argv[1], load) != 0) {
+        fprintf(stderr, "6502: cannot load %s at %04lX\n", argv[1], load);
+        m6502_destroy(m);
+        return 1;
+    }
+    m6502_reset(m);
+    if (start >= 0) m6502_set(m, M6502_PC, start);
+
+    M6502Stop stop = m6502_run(m, budget);
+    unsigned p = m6502_get(m, M6502_P);
+    printf("%s at %04X after %llu cycles\n", stop == M6502_STUCK ? "stuck" : "stopped", m6502_get(m, M6502_PC),
+           (unsigned long long)m6502_cycles(m));
+    printf("A=%02X X=%02X Y=%02X SP=%02X P=%02X ", m6502_get(m, M6502_A), m6502_get(m, M6502_X),
+           m6502_get(m, M6502_Y), m6502_get(m, M6502_SP), p);
+    for (int bit = 7; bit >= 0; bit--) putchar(p >> bit & 1 ? "CZIDB-VN"[bit] : '.');
+    putchar('\n');
+    m6502_destroy(m);
+    return 0;
+}
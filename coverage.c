@@ -0,0 +1,119 @@
+#include "coverage.h"
+#include "opcodes.h"
+#include "opinfo.h"
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef COVERAGE
+#error "coverage.c reads bitmaps that only -DCOVERAGE builds keep"
+#endif
+
+static bool marked(const u_int64_t *map, Word addr) {
+    return map[addr >> 6] >> (addr & 63) & 1;
+}
+
+void coverage_clear(Memory *mem) {
+    memset(mem->executed, 0, sizeof(mem->executed));
+    memset(mem->accessed, 0, sizeof(mem->accessed));
+}
+
+// adds what from has seen to into, to sum up runs over several images
+void coverage_merge(Memory *into, const Memory *from) {
+    for (int i = 0; i < 0x10000 / 64; i++) {
+        into->executed[i] |= from->executed[i];
+        into->accessed[i] |= from->accessed[i];
+    }
+}
+
+// addresses marked from start to end inclusive
+int coverage_count(const u_int64_t *map, Word start, Word end) {
+    int n = 0;
+    for (int a = start; a <= end; a++) n += marked(map, a);
+    return n;
+}
+
+// length of the instruction listed at pc, or 0 to list the byte as data:
+// undocumented opcodes that never ran, instructions running past end, and
+// instructions with an opcode that ran inside them
+static int decode(const Memory *mem, Word pc, Word end) {
+    const OpInfo *op = &opinfo[mem->Data[pc]];
+    int len = mode_bytes[op->mode];
+    bool ran = marked(mem->executed, pc);
+    if (!ran && !op->documented) return 0;
+    if (pc + len - 1 > end) return 0;
+    for (int i = 1; i < len; i++) {
+        if (marked(mem->executed, pc + i)) return 0;
+    }
+    return len;
+}
+
+static Byte length[0x10000];
+static bool entry[0x10000];
+
+// instructions, and instructions that ran, from pc to the next routine
+static void routine_counts(const Memory *mem, Word pc, Word end, int *insns, int *ran) {
+    *insns = *ran = 0;
+    for (int a = pc; a <= end; a += length[a] ? length[a] : 1) {
+        if (a != pc && entry[a]) break;
+        if (!length[a]) continue;
+        (*insns)++;
+        *ran += marked(mem->executed, a);
+    }
+}
+
+void coverage_report(FILE *out, const Memory *mem, Word start, Word end) {
+    int insns = 0, ran = 0;
+    memset(entry, 0, sizeof(entry));
+    entry[start] = true;
+    // calls that ran from anywhere, say a harness outside the range
+    for (int pc = 0; pc < 0x10000 - 2; pc++) {
+        if (mem->Data[pc] != JSR_ABS || !marked(mem->executed, pc)) continue;
+        Word target = mem->Data[pc + 1] | mem->Data[pc + 2] << 8;
+        if (target >= start && target <= end) entry[target] = true;
+    }
+    for (int pc = start; pc <= end;) {
+        length[pc] = decode(mem, pc, end);
+        if (length[pc] == 0) {
+            pc++;
+            continue;
+        }
+        insns++;
+        ran += marked(mem->executed, pc);
+        if (mem->Data[pc] == JSR_ABS) {
+            Word target = mem->Data[(Word)(pc + 1)] | mem->Data[(Word)(pc + 2)] << 8;
+            if (target >= start && target <= end) entry[target] = true;
+        }
+        pc += length[pc];
+    }
+
+    fprintf(out, "coverage $%04X-$%04X: %d of %d instructions ran (%.1f%%), %d data bytes accessed here, %d in all\n",
+            start, end, ran, insns, insns ? 100.0 * ran / insns : 0.0, coverage_count(mem->accessed, start, end),
+            coverage_count(mem->accessed, 0, 0xFFFF));
+
+    for (int pc = start; pc <= end;) {
+        if (entry[pc]) {
+            int n, r;
+            routine_counts(mem, pc, end, &n, &r);
+            fprintf(out, "\n$%04X: %d of %d instructions ran (%.1f%%)\n", pc, r, n, n ? 100.0 * r / n : 0.0);
+        }
+        char hex[16], text[32];
+        if (length[pc]) {
+            int n = 0;
+            for (int i = 0; i < length[pc]; i++) n += sprintf(hex + n, "%s%02X", i ? " " : "", mem->Data[pc + i]);
+            disassemble(mem->Data, pc, text, sizeof(text));
+            fprintf(out, "%c  %04X  %-8s  %s\n", marked(mem->executed, pc) ? '*' : ' ', pc, hex, text);
+            pc += length[pc];
+            continue;
+        }
+        // a run of up to 8 data bytes that were all accessed or all not
+        bool accessed = marked(mem->accessed, pc);
+        fprintf(out, "%c  %04X  %-8s  .byte ", accessed ? 'd' : ' ', pc, "");
+        int n = 0;
+        do {
+            fprintf(out, "%s$%02X", n ? "," : "", mem->Data[pc]);
+            pc++;
+            n++;
+        } while (pc <= end && n < 8 && !length[pc] && !entry[pc] && marked(mem->accessed, pc) == accessed);
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include "6502.h"
+#include <stdio.h>
+
+/*
+ * Reading the executed and accessed bitmaps of a -DCOVERAGE build. The
+ * report disassembles a range, marking each instruction that ran (*) and
+ * each data byte read or written (d), split into routines at the targets
+ * of JSRs in the range or JSRs that ran anywhere, with the share of each
+ * routine's instructions that ran. Bytes that sit inside an instruction
+ * but were themselves run as an opcode are listed as data, so code reached
+ * only at an offset still shows up.
+ */
+
+void coverage_clear(Memory *mem);
+void coverage_merge(Memory *into, const Memory *from);
+int coverage_count(const u_int64_t *map, Word start, Word end);
+void coverage_report(FILE *out, const Memory *mem, Word start, Word end);
+
+#endif
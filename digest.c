@@ -0,0 +1,78 @@
+#include "digest.h"
+#include <string.h>
+
+typedef u_int64_t HashVec __attribute__((vector_size(64)));
+
+#define PRIME 0x9E3779B97F4A7C15ull
+
+static inline u_int64_t mix(u_int64_t h) {
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBull;
+    return h ^ (h >> 31);
+}
+
+static inline u_int64_t rotl(u_int64_t v, int n) {
+    return n ? v << n | v >> (64 - n) : v;
+}
+
+/*
+ * Eight lanes each take every eighth 64-bit word of the page through an
+ * xor, multiply and shift; every step is invertible, so two pages that
+ * differ in one word always hash differently. The lanes are folded and
+ * mixed at the end.
+ */
+u_int64_t page_hash(const Byte *page) {
+    HashVec acc = { 0x243F6A8885A308D3ull, 0x13198A2E03707344ull, 0xA4093822299F31D0ull, 0x082EFA98EC4E6C89ull,
+                    0x452821E638D01377ull, 0xBE5466CF34E90C6Cull, 0xC0AC29B7C97C50DDull, 0x3F84D5B5B5470917ull };
+    for (int i = 0; i < 256; i += sizeof(HashVec)) {
+        HashVec w;
+        memcpy(&w, &page[i], sizeof(w));
+        acc ^= w;
+        acc *= PRIME;
+        acc ^= acc >> 29;
+    }
+    u_int64_t h = 0;
+    for (int lane = 0; lane < 8; lane++) h ^= rotl(acc[lane], lane * 8);
+    return mix(h);
+}
+
+// what a page adds to the digest, depending on where it is
+static inline u_int64_t term(u_int64_t hash, int page) {
+    return mix(hash + (u_int64_t)page * PRIME);
+}
+
+// hashes every page and clears the dirty flags
+void digest_init(Digest *d, Memory *mem) {
+    d->value = 0;
+    for (int page = 0; page < 0x100; page++) {
+        d->page[page] = page_hash(&mem->Data[page << 8]);
+        d->value += term(d->page[page], page);
+    }
+    clean_pages(mem);
+}
+
+// rehashes the pages stored to since the last update
+u_int64_t digest_update(Digest *d, Memory *mem) {
+    for (int page = 0; page < 0x100; page++) {
+        if (!mem->dirty[page]) continue;
+        clean_page(mem, page);
+        u_int64_t hash = page_hash(&mem->Data[page << 8]);
+        d->value += term(hash, page) - term(d->page[page], page);
+        d->page[page] = hash;
+    }
+    return d->value;
+}
+
+// the number of pages whose hashes differ, and their numbers in pages
+// (room for 256) unless it is NULL
+int digest_diff(const Digest *a, const Digest *b, Byte *pages) {
+    int n = 0;
+    for (int page = 0; page < 0x100; page++) {
+        if (a->page[page] == b->page[page]) continue;
+        if (pages) pages[n] = page;
+        n++;
+    }
+    return n;
+}
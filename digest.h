@@ -0,0 +1,37 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include "6502.h"
+
+/*
+ * Whole-memory digests kept up to date a page at a time. A Digest holds a
+ * 64-bit hash of each page and a digest of the whole address space made
+ * from them; digest_update() rehashes only the pages mem->dirty says were
+ * stored to since the last update and clears their flags, so a digest
+ * after a run that touched a few pages costs a few page hashes instead of
+ * 64 KiB. Pages are hashed eight 64-bit lanes at a time with GCC vector
+ * extensions.
+ *
+ * digest_init() and digest_update() consume the dirty flags. They are set
+ * by the core's stores (and the debugger's watched stores), by gdb, lib6502,
+ * jobs and batch when they write memory for the host, by the fuzzer for
+ * its input and by a replayed hook. Besides a digest they are consumed by
+ * the rewinder, the fuzzer and state loads, which clear them too, so only
+ * one of those can follow a given Memory; the recorder sets them aside
+ * while it runs a hook and puts them back. All of them clear flags with
+ * clean_page(), which keeps them in mem->touched for the pool. Memory the
+ * host changes directly must have its page marked dirty, or digest_init()
+ * run again. Digests are for telling states apart, not for security.
+ */
+
+typedef struct {
+    u_int64_t page[0x100];  // hash of each page as of the last update
+    u_int64_t value;        // digest of the whole memory
+} Digest;
+
+u_int64_t page_hash(const Byte *page);
+void digest_init(Digest *d, Memory *mem);
+u_int64_t digest_update(Digest *d, Memory *mem);
+int digest_diff(const Digest *a, const Digest *b, Byte *pages);
+
+#endif
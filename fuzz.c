@@ -0,0 +1,118 @@
+#include "fuzz.h"
+#include "opinfo.h"
+#include <string.h>
+
+static void stop(Fuzzer *f, CPU *cpu, FuzzResult result) {
+    f->result = result;
+    cpu->until = cpu->cycles;
+}
+
+static void at_exit(CPU *cpu, void *ctx) {
+    stop(ctx, cpu, FUZZ_OK);
+}
+
+static void at_crash(CPU *cpu, void *ctx) {
+    stop(ctx, cpu, FUZZ_CRASH);
+}
+
+// the opcode at PC stops the CPU for good
+static bool trapped(CPU *cpu) {
+    const OpInfo *op = &opinfo[fetch_byte(cpu, cpu->PC)];
+    if (op->documented || cpu->opcodes == OPCODES_CMOS_NOP) return false;
+    return cpu->opcodes == OPCODES_STRICT || strcmp(op->name, "JAM") == 0;
+}
+
+static void mark(Memory *mem, Word addr, size_t len) {
+    if (len == 0) return;
+    for (int p = addr >> 8; p <= (addr + (int)len - 1) >> 8; p++) mem->dirty[p] = 1;
+}
+
+// snapshots cpu and its memory; fails if the input region passes the end of
+// memory or there is no room for the exit hook
+int fuzz_init(Fuzzer *f, const CPU *cpu, Word input, Word input_max, Word exit, u_int64_t max_cycles) {
+    if (input + input_max > 0x10000) return -1;
+    f->saved = *cpu->mem;
+    memset(f->saved.dirty, 0, sizeof(f->saved.dirty));
+    f->mem = f->saved;
+    if (cpu->hooks != NULL) f->hooks = *cpu->hooks;
+    else hooks_init(&f->hooks);
+    f->snapshot = *cpu;
+    f->snapshot.mem = &f->mem;
+    f->snapshot.hooks = &f->hooks;
+    f->snapshot.edges = f->edges;
+    f->snapshot.edge_prev = 0;
+    f->input = input;
+    f->input_max = input_max;
+    f->length_at = -1;
+    f->max_cycles = max_cycles;
+    memset(f->edges, 0, sizeof(f->edges));
+    memset(f->virgin, 0, sizeof(f->virgin));
+    f->execs = 0;
+    return hook_add(&f->hooks, exit, at_exit, f, 0);
+}
+
+// each run also stores the input length, little-endian, at addr
+void fuzz_length_at(Fuzzer *f, Word addr) {
+    f->length_at = addr;
+}
+
+int fuzz_crash_at(Fuzzer *f, Word addr) {
+    return hook_add(&f->hooks, addr, at_crash, f, 0);
+}
+
+// runs one input from the snapshot; inputs longer than input_max are cut
+FuzzResult fuzz_run(Fuzzer *f, const Byte *data, size_t len) {
+    Memory *mem = &f->mem;
+    for (int p = 0; p < 0x100; p++) {
+        if (!mem->dirty[p]) continue;
+        memcpy(&mem->Data[p << 8], &f->saved.Data[p << 8], 0x100);
+        clean_page(mem, p);
+    }
+    if (len > f->input_max) len = f->input_max;
+    memcpy(&mem->Data[f->input], data, len);
+    mark(mem, f->input, len);
+    if (f->length_at >= 0) {
+        mem->Data[f->length_at] = len & 0xFF;
+        mem->Data[(Word)(f->length_at + 1)] = len >> 8;
+        mark(mem, f->length_at, 1);
+        mark(mem, f->length_at + 1, 1);
+    }
+
+    memset(f->edges, 0, sizeof(f->edges));
+    f->cpu = f->snapshot;
+    f->result = FUZZ_HANG;
+    f->execs++;
+    cpu_run(&f->cpu, f->snapshot.cycles + f->max_cycles);
+    if (f->result == FUZZ_HANG && trapped(&f->cpu)) f->result = FUZZ_CRASH;
+    return f->result;
+}
+
+// AFL's hit count classes
+static Byte bucket(Byte hits) {
+    if (hits <= 2) return hits;
+    if (hits == 3) return 4;
+    if (hits < 8) return 8;
+    if (hits < 16) return 16;
+    if (hits < 32) return 32;
+    if (hits < 128) return 64;
+    return 128;
+}
+
+// whether the last run hit an edge, or an edge a number of times, that no
+// run checked before did; remembers what it hit either way
+bool fuzz_new_coverage(Fuzzer *f) {
+    bool found = false;
+    for (size_t i = 0; i < EDGE_MAP_SIZE; i += 8) {
+        u_int64_t word;
+        memcpy(&word, &f->edges[i], 8);
+        if (word == 0) continue;
+        for (size_t j = i; j < i + 8; j++) {
+            Byte b = bucket(f->edges[j]);
+            if (b & ~f->virgin[j]) {
+                f->virgin[j] |= b;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
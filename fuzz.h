@@ -0,0 +1,51 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include "6502.h"
+#include <stdbool.h>
+
+/*
+ * In-process fuzzing of guest code. fuzz_init() snapshots a CPU and its
+ * memory; every fuzz_run() puts the machine back, copying only the pages
+ * the previous run stored to, writes the input (and its length, when
+ * fuzz_length_at() gave a place for it) and runs at most max_cycles with
+ * edge coverage counted into edges.
+ *
+ * A run is FUZZ_OK when it reaches the exit address, FUZZ_CRASH at a
+ * crash address or stuck on an opcode the CPU traps on (JAM, or any
+ * undocumented opcode with OPCODES_STRICT), and FUZZ_HANG when the cycles
+ * run out. Exit and crash addresses are hooks, so they are seen wherever
+ * cpu_run() sees hooks. Device pages stay mapped, but devices are not part
+ * of the snapshot.
+ */
+
+typedef enum {
+    FUZZ_OK,
+    FUZZ_CRASH,
+    FUZZ_HANG,
+} FuzzResult;
+
+typedef struct {
+    CPU snapshot;
+    Memory saved;
+    CPU cpu;                // the machine runs happen on
+    Memory mem;
+    Hooks hooks;            // the snapshot's hooks plus exit and crash
+
+    Word input, input_max;  // where inputs go and how much of them
+    int length_at;          // 16-bit length address, -1 for none
+    u_int64_t max_cycles;
+    FuzzResult result;      // of the run in progress
+
+    Byte edges[EDGE_MAP_SIZE];      // hit counts of the last run
+    Byte virgin[EDGE_MAP_SIZE];     // hit count buckets seen by fuzz_new_coverage()
+    u_int64_t execs;
+} Fuzzer;
+
+int fuzz_init(Fuzzer *f, const CPU *cpu, Word input, Word input_max, Word exit, u_int64_t max_cycles);
+void fuzz_length_at(Fuzzer *f, Word addr);
+int fuzz_crash_at(Fuzzer *f, Word addr);
+FuzzResult fuzz_run(Fuzzer *f, const Byte *data, size_t len);
+bool fuzz_new_coverage(Fuzzer *f);
+
+#endif
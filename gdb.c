@@ -0,0 +1,419 @@
+#define _POSIX_C_SOURCE 200809L
+#include "gdb.h"
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// signal numbers in stop replies, GDB's own numbering
+#define GDB_SIGINT 2
+#define GDB_SIGTRAP 5
+
+// the longest watch a Z packet can set, the whole address space
+#define GDB_WATCH_MAX 0x10000
+
+static const char digits[] = "0123456789abcdef";
+
+static int unhex(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// a hex number at *p, leaving *p after it
+static unsigned long number(const char **p) {
+    unsigned long n = 0;
+    for (int d; (d = unhex(**p)) >= 0; (*p)++) n = n << 4 | d;
+    return n;
+}
+
+// n bytes from the 2n hex digits at hex; -1 if any is not a hex digit
+static int unhex_bytes(const char *hex, Byte *out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        int high = unhex(hex[2 * i]), low = unhex(hex[2 * i + 1]);
+        if (high < 0 || low < 0) return -1;
+        out[i] = high << 4 | low;
+    }
+    return 0;
+}
+
+static void put_hex(char *out, Byte b) {
+    out[0] = digits[b >> 4];
+    out[1] = digits[b & 15];
+}
+
+void gdb_init(GdbStub *g, CPU *cpu) {
+    memset(g, 0, sizeof(*g));
+    g->cpu = cpu;
+    g->fd = -1;
+}
+
+// a path for a Unix socket, or ":port" for TCP on localhost; returns the
+// listening socket or -1
+int gdb_listen(const char *where) {
+    int fd;
+    if (where[0] == ':') {
+        struct sockaddr_in in = { .sin_family = AF_INET, .sin_port = htons(atoi(where + 1)),
+                                  .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+        int on = 1;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+            bind(fd, (struct sockaddr *)&in, sizeof(in)) != 0)
+            goto fail;
+    } else {
+        struct sockaddr_un un = { .sun_family = AF_UNIX };
+        if (strlen(where) >= sizeof(un.sun_path)) return -1;
+        strcpy(un.sun_path, where);
+        unlink(where);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&un, sizeof(un)) != 0) goto fail;
+    }
+    if (listen(fd, 1) == 0) return fd;
+fail:
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+// next byte from the client, -1 once it has gone
+static int next(GdbStub *g) {
+    if (g->in_pos == g->in_len) {
+        ssize_t n = read(g->fd, g->in, sizeof(g->in));
+        if (n <= 0) return -1;
+        g->in_len = n;
+        g->in_pos = 0;
+    }
+    return (Byte)g->in[g->in_pos++];
+}
+
+static int send_all(GdbStub *g, const char *data, size_t n) {
+    while (n > 0) {
+        ssize_t sent = send(g->fd, data, n, MSG_NOSIGNAL);
+        if (sent <= 0) return -1;
+        data += sent;
+        n -= sent;
+    }
+    return 0;
+}
+
+static int reply(GdbStub *g, const char *data) {
+    static char frame[GDB_PACKET_MAX + 4];
+    size_t n = 0;
+    Byte sum = 0;
+    frame[n++] = '$';
+    for (; *data && n < GDB_PACKET_MAX; data++) {
+        frame[n++] = *data;
+        sum += (Byte)*data;
+    }
+    frame[n++] = '#';
+    put_hex(&frame[n], sum);
+    return send_all(g, frame, n + 2);
+}
+
+// the next packet into g->packet, acknowledged; an interrupt from the
+// client comes back as "\x03". Returns -1 once the client has gone.
+static int receive(GdbStub *g) {
+    for (;;) {
+        int c = next(g);
+        if (c < 0) return -1;
+        if (c == 0x03) {
+            strcpy(g->packet, "\x03");
+            return 0;
+        }
+        if (c != '$') continue;     // acks, and anything out of step
+        int n = 0;
+        Byte sum = 0;
+        while ((c = next(g)) >= 0 && c != '#') {
+            if (n < GDB_PACKET_MAX) g->packet[n++] = c;
+            sum += c;
+        }
+        int high = next(g), low = next(g);
+        if (c < 0 || low < 0) return -1;
+        g->packet[n] = '\0';
+        if (unhex(high) < 0 || unhex(high) << 4 != (sum & 0xF0) || unhex(low) != (sum & 15)) {
+            if (g->ack && send_all(g, "-", 1) != 0) return -1;
+            continue;
+        }
+        if (g->ack && send_all(g, "+", 1) != 0) return -1;
+        return 0;
+    }
+}
+
+static Byte get_p(const CPU *cpu) {
+    return cpu->N << 7 | cpu->V << 6 | 1 << 5 | cpu->B << 4 | cpu->D << 3 | cpu->I << 2 | cpu->Z << 1 | cpu->C;
+}
+
+static void set_p(CPU *cpu, Byte p) {
+    cpu->N = p >> 7 & 1;
+    cpu->V = p >> 6 & 1;
+    cpu->B = p >> 4 & 1;
+    cpu->D = p >> 3 & 1;
+    cpu->I = p >> 2 & 1;
+    cpu->Z = p >> 1 & 1;
+    cpu->C = p & 1;
+}
+
+// registers in the order A, X, Y, P, SP, PC low, PC high
+static void get_registers(const CPU *cpu, Byte regs[7]) {
+    regs[0] = cpu->A;
+    regs[1] = cpu->X;
+    regs[2] = cpu->Y;
+    regs[3] = get_p(cpu);
+    regs[4] = cpu->SP;
+    regs[5] = cpu->PC & 0xFF;
+    regs[6] = cpu->PC >> 8;
+}
+
+static void set_registers(CPU *cpu, const Byte regs[7]) {
+    cpu->A = regs[0];
+    cpu->X = regs[1];
+    cpu->Y = regs[2];
+    set_p(cpu, regs[3]);
+    cpu->SP = regs[4];
+    cpu->PC = regs[5] | regs[6] << 8;
+}
+
+// register n as it appears in the g packet: offset and size in bytes
+static int register_at(unsigned long n, int *size) {
+    if (n > 5) return -1;
+    *size = n == 5 ? 2 : 1;
+    return n;
+}
+
+static int stopped(GdbStub *g, RunResult r, int signal) {
+    char out[32];
+    if (r == RUN_WATCHPOINT) {
+        Debugger *d = &g->dbg;
+        Word a = d->hit_addr;
+        bool both = (d->watch_read[a >> 6] & d->watch_write[a >> 6]) >> (a & 63) & 1;
+        snprintf(out, sizeof(out), "T%02x%swatch:%04x;", GDB_SIGTRAP, both ? "a" : d->hit_write ? "" : "r", a);
+    } else {
+        snprintf(out, sizeof(out), "S%02x", signal);
+    }
+    return reply(g, out);
+}
+
+static RunResult run(GdbStub *g, u_int64_t until) {
+    if (g->rewinder) return rewind_run(g->rewinder, until);
+    return g->run ? g->run(g->run_ctx, until) : cpu_run(g->cpu, until);
+}
+
+static int step(GdbStub *g) {
+    g->dbg.step = 1;
+    RunResult r = run(g, g->cpu->cycles + 1);
+    g->dbg.step = 0;
+    return stopped(g, r, GDB_SIGTRAP);
+}
+
+// full speed in slices, looking between them for an interrupt from the
+// client; a slice that starts on a breakpoint would step over it, so that
+// is checked here
+static int cont(GdbStub *g) {
+    for (bool first = true;; first = false) {
+        if (!first && breakpoint(g->cpu, g->cpu->PC)) return stopped(g, RUN_BREAKPOINT, GDB_SIGTRAP);
+        RunResult r = run(g, g->cpu->cycles + GDB_SLICE_CYCLES);
+        if (r != RUN_DEADLINE) return stopped(g, r, GDB_SIGTRAP);
+        struct pollfd p = { .fd = g->fd, .events = POLLIN };
+        while (g->in_pos < g->in_len || poll(&p, 1, 0) > 0) {
+            int c = next(g);
+            if (c < 0) return -1;
+            if (c == 0x03) return stopped(g, RUN_DEADLINE, GDB_SIGINT);
+            p.revents = 0;
+        }
+    }
+}
+
+// bs and bc; going back past the oldest checkpoint ends at it
+static int backwards(GdbStub *g, const char *args) {
+    if (g->rewinder == NULL) return reply(g, "");
+    RunResult r;
+    if (strcmp(args, "s") == 0) r = rewind_step(g->rewinder) == 0 ? RUN_BREAKPOINT : RUN_DEADLINE;
+    else if (strcmp(args, "c") == 0) r = rewind_continue(g->rewinder);
+    else return reply(g, "");
+    if (r == RUN_DEADLINE) return reply(g, "T05replaylog:begin;");
+    return stopped(g, r, GDB_SIGTRAP);
+}
+
+static int memory(GdbStub *g, const char *args) {
+    static char out[GDB_PACKET_MAX];
+    Memory *mem = g->cpu->mem;
+    unsigned long addr = number(&args);
+    if (*args++ != ',') return reply(g, "E01");
+    unsigned long len = number(&args);
+    if (len > (GDB_PACKET_MAX - 1) / 2) len = (GDB_PACKET_MAX - 1) / 2;
+    for (unsigned long i = 0; i < len; i++) put_hex(&out[2 * i], mem->Data[(Word)(addr + i)]);
+    out[2 * len] = '\0';
+    return reply(g, out);
+}
+
+static int write_memory(GdbStub *g, const char *args) {
+    Memory *mem = g->cpu->mem;
+    unsigned long addr = number(&args);
+    if (*args++ != ',') return reply(g, "E01");
+    unsigned long len = number(&args);
+    Byte data[GDB_PACKET_MAX / 2];
+    if (*args++ != ':' || strlen(args) < 2 * len || unhex_bytes(args, data, len) != 0) return reply(g, "E01");
+    for (unsigned long i = 0; i < len; i++) {
+        Word a = addr + i;
+        mem->Data[a] = data[i];
+        mem->dirty[a >> 8] = 1;
+    }
+    return reply(g, "OK");
+}
+
+// Z and z: type 0 or 1 a breakpoint, 2 to 4 a write, read or access watch
+// over length bytes
+static int point(GdbStub *g, const char *args, bool insert) {
+    unsigned long type = number(&args);
+    if (*args++ != ',') return reply(g, "E01");
+    unsigned long addr = number(&args);
+    unsigned long length = *args == ',' ? (args++, number(&args)) : 1;
+    if (length > GDB_WATCH_MAX) return reply(g, "E01");
+    if (type <= 1) {
+        if (insert) break_add(&g->dbg, addr);
+        else break_remove(&g->dbg, addr);
+        return reply(g, "OK");
+    }
+    if (type > 4) return reply(g, "");
+    int kind = type == 2 ? WATCH_WRITE : type == 3 ? WATCH_READ : WATCH_READ | WATCH_WRITE;
+    for (unsigned long i = 0; i < length; i++) {
+        if (!insert) {
+            watch_remove(&g->dbg, addr + i, kind);
+        } else if (watch_add(&g->dbg, addr + i, kind) != 0) {
+            while (i-- > 0) watch_remove(&g->dbg, addr + i, kind);
+            return reply(g, "E01");
+        }
+    }
+    return reply(g, "OK");
+}
+
+static int query(GdbStub *g, const char *q) {
+    char out[64];
+    if (strncmp(q, "qSupported", 10) == 0) {
+        snprintf(out, sizeof(out), "PacketSize=%x;QStartNoAckMode+%s", GDB_PACKET_MAX,
+                 g->rewinder ? ";ReverseStep+;ReverseContinue+" : "");
+        return reply(g, out);
+    }
+    if (strcmp(q, "QStartNoAckMode") == 0) {
+        int r = reply(g, "OK");
+        g->ack = 0;
+        return r;
+    }
+    if (strncmp(q, "qAttached", 9) == 0) return reply(g, "1");
+    if (strcmp(q, "qC") == 0) return reply(g, "QC1");
+    if (strcmp(q, "qfThreadInfo") == 0) return reply(g, "m1");
+    if (strcmp(q, "qsThreadInfo") == 0) return reply(g, "l");
+    return reply(g, "");
+}
+
+// answers the client on fd until it detaches (0) or goes away (-1); the
+// breakpoints and watchpoints it set go with it
+int gdb_serve(GdbStub *g, int fd) {
+    CPU *cpu = g->cpu;
+    g->fd = fd;
+    g->ack = 1;
+    g->in_len = g->in_pos = 0;
+    debug_init(&g->dbg, cpu);
+    int result = -1;
+    while (receive(g) == 0) {
+        const char *args = g->packet + 1;
+        char out[2 * 7 + 1];
+        Byte regs[7];
+        int r = 0;
+        switch (g->packet[0]) {
+            case '?':
+                r = stopped(g, RUN_BREAKPOINT, GDB_SIGTRAP);
+                break;
+            case 'g':
+                get_registers(cpu, regs);
+                for (int i = 0; i < 7; i++) put_hex(&out[2 * i], regs[i]);
+                out[14] = '\0';
+                r = reply(g, out);
+                break;
+            case 'G':
+                if (strlen(args) < 14 || unhex_bytes(args, regs, 7) != 0) {
+                    r = reply(g, "E01");
+                    break;
+                }
+                set_registers(cpu, regs);
+                r = reply(g, "OK");
+                break;
+            case 'p': {
+                int size, at = register_at(number(&args), &size);
+                if (at < 0) {
+                    r = reply(g, "E01");
+                    break;
+                }
+                get_registers(cpu, regs);
+                for (int i = 0; i < size; i++) put_hex(&out[2 * i], regs[at + i]);
+                out[2 * size] = '\0';
+                r = reply(g, out);
+                break;
+            }
+            case 'P': {
+                int size, at = register_at(number(&args), &size);
+                get_registers(cpu, regs);
+                if (at < 0 || *args++ != '=' || (int)strlen(args) < 2 * size ||
+                    unhex_bytes(args, &regs[at], size) != 0) {
+                    r = reply(g, "E01");
+                    break;
+                }
+                set_registers(cpu, regs);
+                r = reply(g, "OK");
+                break;
+            }
+            case 'm':
+                r = memory(g, args);
+                break;
+            case 'M':
+                r = write_memory(g, args);
+                break;
+            case 's':
+                if (*args) cpu->PC = number(&args);
+                r = step(g);
+                break;
+            case 'c':
+                if (*args) cpu->PC = number(&args);
+                r = cont(g);
+                break;
+            case 'b':
+                r = backwards(g, args);
+                break;
+            case 'Z':
+            case 'z':
+                r = point(g, args, g->packet[0] == 'Z');
+                break;
+            case 'H':
+            case 'T':
+                r = reply(g, "OK");
+                break;
+            case 'q':
+            case 'Q':
+                r = query(g, g->packet);
+                break;
+            case 'D':
+                reply(g, "OK");
+                result = 0;
+                goto done;
+            case 'k':
+                result = 0;
+                goto done;
+            case '\x03':    // interrupt while already stopped
+                r = stopped(g, RUN_DEADLINE, GDB_SIGINT);
+                break;
+            default:
+                r = reply(g, "");
+                break;
+        }
+        if (r != 0) break;
+    }
+done:
+    debug_detach(&g->dbg);
+    g->fd = -1;
+    return result;
+}
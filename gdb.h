@@ -0,0 +1,50 @@
+#ifndef GDB_H
+#define GDB_H
+
+#include "6502.h"
+#include "rewind.h"
+
+/*
+ * GDB remote serial protocol stub. gdb_listen() opens a Unix socket (a
+ * path) or a TCP port on localhost (":port"), and gdb_serve() answers one
+ * client on a connected socket until it detaches, kills or hangs up.
+ *
+ * Registers go out in the order A, X, Y, P, SP (a byte each) and PC (two
+ * bytes, low first). Memory reads and writes go straight to RAM, so the
+ * debugger never triggers device side effects. Breakpoints (Z0, Z1) and
+ * watchpoints (Z2 write, Z3 read, Z4 access) go to a Debugger attached
+ * for the length of the session. Continue runs the CPU at full speed in
+ * slices of GDB_SLICE_CYCLES, looking for the client's interrupt between
+ * slices, and a step runs a single instruction with fusion off.
+ *
+ * The CPU runs through run(run_ctx, until) when set, for instance a
+ * wrapper around sched_run() so devices keep working, and through
+ * cpu_run() otherwise. With a Rewinder it runs through rewind_run()
+ * instead (set the rewinder's own run to drive a scheduler), and the
+ * client can step and continue backwards.
+ */
+
+#ifndef GDB_SLICE_CYCLES
+#define GDB_SLICE_CYCLES 100000
+#endif
+
+#define GDB_PACKET_MAX 4096
+
+typedef struct {
+    CPU *cpu;
+    Debugger dbg;
+    RunResult (*run)(void *ctx, u_int64_t until);
+    void *run_ctx;
+    Rewinder *rewinder;     // reverse execution, NULL for none
+    int fd;
+    int ack;        // acknowledge packets, until the client turns it off
+    char packet[GDB_PACKET_MAX + 1];
+    char in[256];   // received, not yet parsed
+    int in_len, in_pos;
+} GdbStub;
+
+void gdb_init(GdbStub *g, CPU *cpu);
+int gdb_listen(const char *where);
+int gdb_serve(GdbStub *g, int fd);
+
+#endif
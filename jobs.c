@@ -0,0 +1,429 @@
+#define _GNU_SOURCE
+#include "jobs.h"
+#include "state.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// requests read from one client before the others get a turn
+#define JOB_READ_BURST 64
+
+// what an image's descriptor has to be sealed against
+#define JOB_SEALS (F_SEAL_SHRINK | F_SEAL_WRITE)
+
+static u_int64_t now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (u_int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// machines from a pool of the given size, listening on a Unix socket at
+// path (replacing whatever is there); -1 if either cannot be had
+int job_server_init(JobServer *s, const char *path, int machines) {
+    memset(s, 0, sizeof(*s));
+    s->listener = -1;
+    for (int c = 0; c < JOB_MAX_CLIENTS; c++) s->clients[c] = -1;
+    struct sockaddr_un un = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(un.sun_path) || pool_init(&s->pool, machines, POOL_HUGE_PAGES) != 0) return -1;
+    s->running = calloc(machines, sizeof(Job));
+    if (s->running == NULL) goto fail;
+    strcpy(un.sun_path, path);
+    unlink(path);
+    s->listener = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (s->listener < 0 || bind(s->listener, (struct sockaddr *)&un, sizeof(un)) != 0 ||
+        listen(s->listener, JOB_MAX_CLIENTS) != 0)
+        goto fail;
+    s->started_ns = now_ns();
+    return 0;
+fail:
+    job_server_free(s);
+    return -1;
+}
+
+void job_server_free(JobServer *s) {
+    for (int c = 0; c < JOB_MAX_CLIENTS; c++) {
+        if (s->clients[c] >= 0) close(s->clients[c]);
+    }
+    for (int i = 0; i < JOB_MAX_IMAGES; i++) {
+        if (s->images[i].used) munmap((void *)s->images[i].data, s->images[i].size);
+    }
+    if (s->listener >= 0) close(s->listener);
+    pool_free(&s->pool);
+    free(s->running);
+    memset(s, 0, sizeof(*s));
+    s->listener = -1;
+}
+
+// sends without waiting; a client whose socket is full is not reading, and
+// is marked to be hung up on once the round is over
+static void reply(JobServer *s, int client, const JobResult *result, const void *out) {
+    if (client < 0 || s->clients[client] < 0 || s->stalled[client]) return;
+    Byte packet[sizeof(JobResult) + JOB_OUTPUT_MAX];
+    memcpy(packet, result, sizeof(*result));
+    if (result->out_len > 0) memcpy(packet + sizeof(*result), out, result->out_len);
+    size_t len = sizeof(*result) + result->out_len;
+    if (send(s->clients[client], packet, len, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)len) s->stalled[client] = 1;
+}
+
+static void reply_status(JobServer *s, int client, u_int32_t tag, JobStatus status) {
+    JobResult result = { .tag = tag, .status = status };
+    reply(s, client, &result, NULL);
+}
+
+// ids are the client's own: another connection's images are not found
+static JobImage *find_image(JobServer *s, int client, u_int32_t id) {
+    for (int i = 0; i < JOB_MAX_IMAGES; i++) {
+        JobImage *image = &s->images[i];
+        if (image->used && image->client == client && image->id == id) return image;
+    }
+    return NULL;
+}
+
+static void drop_image(JobImage *image) {
+    munmap((void *)image->data, image->size);
+    image->used = 0;
+}
+
+// the part of a raw image that goes into page, as [*from, *to)
+static void page_span(const JobImage *image, int page, size_t *from, size_t *to) {
+    size_t start = (size_t)page << 8, end = start + 0x100;
+    *from = start > image->load ? start : image->load;
+    *to = end < image->load + image->size ? end : image->load + image->size;
+}
+
+static int empty(const Byte *data, size_t len) {
+    static const Byte zero[0x100];
+    return memcmp(data, zero, len) == 0;
+}
+
+// maps the image in fd under the client's req->image, or drops that id
+// with no fd. The mapping is shared with the client, so fd has to be sealed
+// against shrinking (which would fault the server on its next load) and
+// writing.
+static JobStatus register_image(JobServer *s, int client, const JobRequest *req, int fd) {
+    JobImage *image = find_image(s, client, req->image);
+    if (image != NULL) drop_image(image);
+    if (fd < 0) return JOB_OK;
+    int state = req->flags & JOB_STATE_IMAGE;
+    struct stat st;
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & JOB_SEALS) != JOB_SEALS) return JOB_BAD_IMAGE;
+    if (req->size == 0 || (!state && req->load + req->size > 0x10000) || fstat(fd, &st) != 0 ||
+        (u_int64_t)st.st_size < req->size)
+        return JOB_BAD_IMAGE;
+    for (image = s->images; image < s->images + JOB_MAX_IMAGES && image->used; image++);
+    if (image == s->images + JOB_MAX_IMAGES) return JOB_BUSY;
+    void *map = mmap(NULL, req->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) return JOB_BAD_IMAGE;
+    *image = (JobImage){ .id = req->image, .client = client, .used = 1, .data = map, .size = req->size,
+                         .load = req->load, .state = state };
+    for (int page = image->load >> 8; !state && page <= (int)((image->load + image->size - 1) >> 8); page++) {
+        size_t from, to;
+        page_span(image, page, &from, &to);
+        image->present[page] = !empty(&image->data[from - image->load], to - from);
+    }
+    return JOB_OK;
+}
+
+static void submit(JobServer *s, int client, const JobRequest *req) {
+    if (req->cycles == 0 || req->out_len > JOB_OUTPUT_MAX || req->out_addr + req->out_len > 0x10000) {
+        reply_status(s, client, req->tag, JOB_BAD_REQUEST);
+        return;
+    }
+    if (s->queued == JOB_BACKLOG) {
+        reply_status(s, client, req->tag, JOB_BUSY);
+        return;
+    }
+    Job *job = &s->queue[(s->queue_head + s->queued++) % JOB_BACKLOG];
+    *job = (Job){ .req = *req, .client = client, .received = now_ns() };
+}
+
+static void send_stats(JobServer *s, int client, u_int32_t tag) {
+    JobStats stats;
+    job_stats(s, &stats);
+    JobResult result = { .tag = tag, .status = JOB_OK, .out_len = sizeof(stats) };
+    reply(s, client, &result, &stats);
+}
+
+// stops every job of a client that has gone and drops its images
+static void hang_up(JobServer *s, int client) {
+    close(s->clients[client]);
+    s->clients[client] = -1;
+    s->stalled[client] = 0;
+    for (int i = 0; i < JOB_MAX_IMAGES; i++) {
+        if (s->images[i].used && s->images[i].client == client) drop_image(&s->images[i]);
+    }
+    for (int i = 0; i < s->queued; i++) {
+        Job *job = &s->queue[(s->queue_head + i) % JOB_BACKLOG];
+        if (job->client == client) job->client = -1;
+    }
+    for (int i = 0; i < s->n_running;) {
+        if (s->running[i].client != client) {
+            i++;
+            continue;
+        }
+        pool_destroy(&s->pool, s->running[i].cpu);
+        s->running[i] = s->running[--s->n_running];
+    }
+}
+
+// the requests a client has sent, up to JOB_READ_BURST of them
+static void serve_client(JobServer *s, int client) {
+    for (int burst = 0; burst < JOB_READ_BURST; burst++) {
+        JobRequest req;
+        union {
+            char buf[CMSG_SPACE(sizeof(int))];
+            struct cmsghdr align;
+        } control;
+        struct iovec iov = { &req, sizeof(req) };
+        struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf,
+                              .msg_controllen = sizeof(control.buf) };
+        ssize_t n = recvmsg(s->clients[client], &msg, MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        int fd = -1;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); n >= 0 && c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) memcpy(&fd, CMSG_DATA(c), sizeof(fd));
+        }
+        if (n <= 0) {
+            hang_up(s, client);
+            return;
+        }
+        if (n != sizeof(req) || msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+            reply_status(s, client, n >= 8 ? req.tag : 0, JOB_BAD_REQUEST);
+        } else if (req.type == JOB_IMAGE) {
+            reply_status(s, client, req.tag, register_image(s, client, &req, fd));
+        } else if (req.type == JOB_RUN) {
+            submit(s, client, &req);
+        } else if (req.type == JOB_STATS) {
+            send_stats(s, client, req.tag);
+        } else {
+            reply_status(s, client, req.tag, JOB_BAD_REQUEST);
+        }
+        if (fd >= 0) close(fd);
+    }
+}
+
+// memory from the pool is all zero, so a raw image copies in only the
+// pages that are not, and the pool zeroes only those again
+static JobStatus load(CPU *cpu, const JobImage *image, const JobRequest *req) {
+    if (image->state) {
+        if (state_decode(cpu, image->data, image->size) != 0) return JOB_BAD_IMAGE;
+    } else {
+        Memory *mem = cpu->mem;
+        for (int page = 0; page < 0x100; page++) {
+            if (!image->present[page]) continue;
+            size_t from, to;
+            page_span(image, page, &from, &to);
+            memcpy(&mem->Data[from], &image->data[from - image->load], to - from);
+            mem->dirty[page] = 1;
+        }
+        cpu_reset(cpu);
+    }
+    if (req->flags & JOB_AT_ENTRY) cpu->PC = req->entry;
+    return JOB_OK;
+}
+
+// queued jobs onto free machines
+static void start_jobs(JobServer *s) {
+    while (s->queued > 0 && s->n_running < s->pool.capacity) {
+        Job job = s->queue[s->queue_head];
+        s->queue_head = (s->queue_head + 1) % JOB_BACKLOG;
+        s->queued--;
+        if (job.client < 0) continue;
+        const JobImage *image = find_image(s, job.client, job.req.image);
+        if (image == NULL) {
+            reply_status(s, job.client, job.req.tag, JOB_NO_IMAGE);
+            continue;
+        }
+        job.cpu = pool_create(&s->pool);
+        JobStatus status = load(job.cpu, image, &job.req);
+        if (status != JOB_OK) {
+            pool_destroy(&s->pool, job.cpu);
+            reply_status(s, job.client, job.req.tag, status);
+            continue;
+        }
+        job.started = now_ns();
+        job.start_cycles = job.cpu->cycles;
+        s->running[s->n_running++] = job;
+    }
+}
+
+static void finish(JobServer *s, Job *job, JobStatus status, u_int64_t skipped) {
+    const CPU *cpu = job->cpu;
+    u_int64_t done = now_ns();
+    JobResult result = {
+        .tag = job->req.tag,
+        .status = status,
+        .cycles = cpu->cycles - skipped - job->start_cycles,
+        .wait_ns = job->started - job->received,
+        .run_ns = done - job->started,
+        .pc = cpu->PC,
+        .a = cpu->A,
+        .x = cpu->X,
+        .y = cpu->Y,
+        .sp = cpu->SP,
+        .p = cpu->N << 7 | cpu->V << 6 | 1 << 5 | cpu->B << 4 | cpu->D << 3 | cpu->I << 2 | cpu->Z << 1 | cpu->C,
+        .out_len = job->req.out_len,
+    };
+    reply(s, job->client, &result, &cpu->mem->Data[job->req.out_addr]);
+    s->latency[s->jobs % JOB_SAMPLES] = done - job->received;
+    s->jobs++;
+    s->cycles += result.cycles;
+    pool_destroy(&s->pool, job->cpu);
+}
+
+// a slice of every running job; a job that skipped idle cycles is in a
+// loop nothing can break, and counts the cycles up to where it was seen
+static void run_slices(JobServer *s) {
+    for (int i = 0; i < s->n_running;) {
+        Job *job = &s->running[i];
+        CPU *cpu = job->cpu;
+        u_int64_t end = job->start_cycles + job->req.cycles;
+        u_int64_t until = end - cpu->cycles > JOB_SLICE_CYCLES ? cpu->cycles + JOB_SLICE_CYCLES : end;
+        u_int64_t idle = cpu->idle_cycles;
+        cpu_run(cpu, until);
+        if (cpu->idle_cycles != idle) {
+            finish(s, job, JOB_STUCK, cpu->idle_cycles - idle);
+        } else if (cpu->cycles >= end) {
+            finish(s, job, JOB_CAPPED, 0);
+        } else {
+            i++;
+            continue;
+        }
+        s->running[i] = s->running[--s->n_running];
+    }
+}
+
+// one round: takes new clients and requests, waiting up to timeout_ms for
+// them when there is nothing to run, then runs a slice of every job;
+// returns how many jobs are left, -1 if poll() failed
+int job_serve(JobServer *s, int timeout_ms) {
+    struct pollfd fds[1 + JOB_MAX_CLIENTS];
+    int client[1 + JOB_MAX_CLIENTS], n = 1;
+    fds[0] = (struct pollfd){ .fd = s->listener, .events = POLLIN };
+    for (int c = 0; c < JOB_MAX_CLIENTS; c++) {
+        if (s->clients[c] < 0) continue;
+        fds[n] = (struct pollfd){ .fd = s->clients[c], .events = POLLIN };
+        client[n++] = c;
+    }
+    if (poll(fds, n, s->n_running > 0 || s->queued > 0 ? 0 : timeout_ms) < 0) return -1;
+    if (fds[0].revents & POLLIN) {
+        int fd = accept(s->listener, NULL, NULL);
+        int c = 0;
+        while (c < JOB_MAX_CLIENTS && s->clients[c] >= 0) c++;
+        if (c < JOB_MAX_CLIENTS) s->clients[c] = fd;
+        else if (fd >= 0) close(fd);
+    }
+    for (int i = 1; i < n; i++) {
+        if (fds[i].revents) serve_client(s, client[i]);
+    }
+    start_jobs(s);
+    run_slices(s);
+    start_jobs(s);
+    for (int c = 0; c < JOB_MAX_CLIENTS; c++) {
+        if (s->stalled[c]) hang_up(s, c);
+    }
+    return s->n_running + s->queued;
+}
+
+static int by_value(const void *a, const void *b) {
+    u_int64_t x = *(const u_int64_t *)a, y = *(const u_int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+void job_stats(const JobServer *s, JobStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->jobs = s->jobs;
+    stats->cycles = s->cycles;
+    stats->uptime_ns = now_ns() - s->started_ns;
+    stats->running = s->n_running;
+    stats->queued = s->queued;
+    for (int i = 0; i < JOB_MAX_IMAGES; i++) stats->images += s->images[i].used;
+    for (int c = 0; c < JOB_MAX_CLIENTS; c++) stats->clients += s->clients[c] >= 0;
+    size_t n = s->jobs < JOB_SAMPLES ? s->jobs : JOB_SAMPLES;
+    if (n == 0) return;
+    static u_int64_t sorted[JOB_SAMPLES];
+    memcpy(sorted, s->latency, n * sizeof(*sorted));
+    qsort(sorted, n, sizeof(*sorted), by_value);
+    stats->p50_ns = sorted[(n - 1) / 2];
+    stats->p99_ns = sorted[(n - 1) * 99 / 100];
+    stats->max_ns = sorted[n - 1];
+}
+
+// the client's end; -1 if there is no server at path
+int job_connect(const char *path) {
+    struct sockaddr_un un = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(un.sun_path)) return -1;
+    strcpy(un.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&un, sizeof(un)) == 0) return fd;
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+// seals a memory file made with memfd_create(MFD_ALLOW_SEALING) against
+// any change, as JOB_IMAGE wants it; -1 if it cannot be sealed
+int job_seal(int fd) {
+    return fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+}
+
+// a sealed memory file holding a copy of size bytes, to pass with
+// JOB_IMAGE; -1 if it cannot be made
+int job_share(const void *data, size_t size) {
+    int fd = memfd_create("6502-job", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, size) != 0) goto fail;
+    if (size > 0) {
+        void *map = mmap(NULL, size, PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) goto fail;
+        memcpy(map, data, size);
+        munmap(map, size);
+    }
+    if (job_seal(fd) != 0) goto fail;
+    return fd;
+fail:
+    close(fd);
+    return -1;
+}
+
+// sends a request, with image_fd passed along unless it is -1
+int job_send(int fd, const JobRequest *req, int image_fd) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { (void *)req, sizeof(*req) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    if (image_fd >= 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(c), &image_fd, sizeof(int));
+    }
+    return sendmsg(fd, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(*req) ? 0 : -1;
+}
+
+// the next reply, with up to out_max bytes of what follows it in out;
+// returns how many, -1 once the server has gone
+int job_receive(int fd, JobResult *result, void *out, size_t out_max) {
+    Byte packet[sizeof(JobResult) + JOB_OUTPUT_MAX];
+    ssize_t n = recv(fd, packet, sizeof(packet), 0);
+    if (n < (ssize_t)sizeof(*result)) return -1;
+    memcpy(result, packet, sizeof(*result));
+    size_t len = n - sizeof(*result) < out_max ? n - sizeof(*result) : out_max;
+    if (len > 0) memcpy(out, packet + sizeof(*result), len);
+    return len;
+}
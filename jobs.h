@@ -0,0 +1,156 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "6502.h"
+#include "pool.h"
+
+/*
+ * A job server: a long-running process keeps a pool of machines and runs
+ * jobs for other processes that connect over a Unix socket.
+ *
+ * Clients register images first. A JOB_IMAGE request passes a memory file
+ * descriptor along with it (SCM_RIGHTS), which the server maps read-only
+ * and keeps under an id the client picks, so an image crosses the socket
+ * once as a descriptor and is never copied through it. Ids belong to the
+ * connection: a client can only run or drop the images it sent itself,
+ * another client may use the same ids for its own, and a client's images
+ * are dropped when it hangs up. JOB_MAX_IMAGES is shared by all clients. The file has to be sealed
+ * against shrinking and writing (F_SEAL_SHRINK, F_SEAL_WRITE), so that no
+ * client can change an image under the server or fault it by truncating
+ * one; anything else is refused with JOB_BAD_IMAGE. An image is raw bytes
+ * for a load address or, with JOB_STATE_IMAGE, a save state from
+ * state_save(). The same request without a descriptor drops the id.
+ * job_share() puts bytes in a fresh sealed memory file for this, and
+ * job_seal() seals one made with memfd_create(MFD_ALLOW_SEALING) and
+ * written some other way.
+ *
+ * A JOB_RUN request names an image, a cycle cap, optionally an entry point
+ * (JOB_AT_ENTRY; raw images start from the reset vector otherwise, states
+ * where they were saved) and a range of memory to send back. The server
+ * loads the image into a machine from the pool and runs every job it has
+ * in turn, JOB_SLICE_CYCLES at a time, so a long job does not hold up
+ * short ones. Requests beyond the pool wait in a queue of JOB_BACKLOG and
+ * are refused with JOB_BUSY when that is full. Replies go out as jobs
+ * finish, not in the order they came in; the client's tag says which is
+ * which. A job ends JOB_CAPPED when it has run its cycles, or JOB_STUCK as
+ * soon as it sits in a loop that can never end (there are no devices, so
+ * an idle loop is one), with the cycles counted up to there.
+ *
+ * Each result carries how long the job waited for a machine and how long
+ * it ran. JOB_STATS returns JobStats: jobs and cycles done, uptime, and
+ * the median, 99th percentile and worst latency from request to reply
+ * over the last JOB_SAMPLES jobs.
+ *
+ * The socket is SOCK_SEQPACKET, so every request and reply is one packet:
+ * a JobRequest, or a JobResult followed by out_len bytes. The server is
+ * one thread and never waits on a client: one whose socket is too full to
+ * take a reply is hung up on, so a client should keep reading.
+ */
+
+#ifndef JOB_SLICE_CYCLES
+#define JOB_SLICE_CYCLES 100000
+#endif
+
+#define JOB_MAX_CLIENTS 32
+#define JOB_MAX_IMAGES 64
+#define JOB_BACKLOG 1024
+#define JOB_OUTPUT_MAX 4096
+#define JOB_SAMPLES 4096
+
+typedef enum {
+    JOB_IMAGE = 1,
+    JOB_RUN,
+    JOB_STATS,
+} JobType;
+
+#define JOB_STATE_IMAGE 1   // JOB_IMAGE: the image is a save state
+#define JOB_AT_ENTRY 2      // JOB_RUN: start at entry
+
+typedef enum {
+    JOB_OK,             // image registered or dropped, stats attached
+    JOB_STUCK,
+    JOB_CAPPED,
+    JOB_NO_IMAGE,
+    JOB_BAD_IMAGE,      // cannot be mapped, does not fit, or a bad state
+    JOB_BAD_REQUEST,
+    JOB_BUSY,
+} JobStatus;
+
+typedef struct {
+    u_int32_t type;     // JobType
+    u_int32_t tag;      // given back in the reply
+    u_int32_t image;    // id
+    u_int32_t flags;
+    u_int64_t size;     // JOB_IMAGE: bytes of shared memory that are the image
+    u_int64_t cycles;   // JOB_RUN: cap, at least 1
+    Word load;          // JOB_IMAGE: address of a raw image
+    Word entry;         // JOB_RUN with JOB_AT_ENTRY
+    Word out_addr;      // JOB_RUN: memory to send back
+    Word out_len;       // up to JOB_OUTPUT_MAX
+} JobRequest;
+
+typedef struct {
+    u_int32_t tag;
+    u_int32_t status;   // JobStatus
+    u_int64_t cycles;   // the job ran
+    u_int64_t wait_ns;  // from the request to a machine
+    u_int64_t run_ns;   // from a machine to the reply
+    Word pc;
+    Byte a, x, y, sp, p;
+    Byte unused[5];
+    u_int32_t out_len;  // bytes after this
+} JobResult;
+
+typedef struct {
+    u_int64_t jobs, cycles;     // finished, and the cycles they ran
+    u_int64_t uptime_ns;
+    u_int64_t p50_ns, p99_ns, max_ns;
+    u_int32_t running, queued, images, clients;
+} JobStats;
+
+typedef struct {
+    u_int32_t id;
+    int client;         // the connection that sent it, index into clients
+    int used;
+    const Byte *data;
+    size_t size;        // of the mapping, and so of the image
+    Word load;
+    int state;
+    Byte present[0x100];    // raw: pages with anything but zeros to copy in
+} JobImage;
+
+typedef struct {
+    JobRequest req;
+    int client;         // index into clients, -1 once it hung up
+    CPU *cpu;
+    u_int64_t received, started;    // ns
+    u_int64_t start_cycles;
+} Job;
+
+typedef struct {
+    int listener;
+    Pool pool;
+    int clients[JOB_MAX_CLIENTS];   // -1 for a free slot
+    int stalled[JOB_MAX_CLIENTS];   // a reply did not fit: hang up
+    JobImage images[JOB_MAX_IMAGES];
+    Job *running;       // one per machine in the pool
+    int n_running;
+    Job queue[JOB_BACKLOG];
+    int queue_head, queued;
+
+    u_int64_t started_ns, jobs, cycles;
+    u_int64_t latency[JOB_SAMPLES];     // the last jobs, round robin
+} JobServer;
+
+int job_server_init(JobServer *s, const char *path, int machines);
+int job_serve(JobServer *s, int timeout_ms);
+void job_stats(const JobServer *s, JobStats *stats);
+void job_server_free(JobServer *s);
+
+int job_connect(const char *path);
+int job_share(const void *data, size_t size);
+int job_seal(int fd);
+int job_send(int fd, const JobRequest *req, int image_fd);
+int job_receive(int fd, JobResult *result, void *out, size_t out_max);
+
+#endif
@@ -0,0 +1,504 @@
+#include "lanes.h"
+#include "opcodes.h"
+#include <string.h>
+#include <stdbool.h>
+
+// give up on lockstep after this many steps with under a quarter of the
+// live lanes agreeing on PC
+#define DIVERGE_LIMIT 256
+
+typedef enum {
+    K_NONE, K_LDA, K_LDX, K_LDY, K_STA, K_STX, K_STY,
+    K_ADC, K_SBC, K_AND, K_ORA, K_EOR, K_CMP, K_CPX, K_CPY,
+    K_INC, K_DEC, K_INX, K_INY, K_DEX, K_DEY,
+    K_TAX, K_TAY, K_TXA, K_TYA, K_TSX, K_TXS,
+    K_ASL, K_LSR, K_ROL, K_ROR, K_BIT,
+    K_CLC, K_SEC, K_CLV, K_CLD, K_SED, K_CLI, K_SEI, K_NOP,
+    K_BRANCH, K_JMP,
+} LaneKind;
+
+typedef enum {
+    M_IMPL, M_ACC, M_IM, M_ZP, M_ZPX, M_ZPY, M_ABS, M_ABSX, M_ABSY, M_INDX, M_INDY, M_REL,
+} LaneMode;
+
+static const Byte mode_length[] = {
+    [M_IMPL] = 1, [M_ACC] = 1, [M_IM] = 2, [M_ZP] = 2, [M_ZPX] = 2, [M_ZPY] = 2,
+    [M_ABS] = 3, [M_ABSX] = 3, [M_ABSY] = 3, [M_INDX] = 2, [M_INDY] = 2, [M_REL] = 2,
+};
+
+typedef struct {
+    Byte kind, mode;
+} LaneOp;
+
+// opcodes with a vector form; everything else is stepped per lane
+static const LaneOp lane_ops[256] = {
+    [LDA_IM] = {K_LDA, M_IM}, [LDA_ZP] = {K_LDA, M_ZP}, [LDA_ZPX] = {K_LDA, M_ZPX},
+    [LDA_ABS] = {K_LDA, M_ABS}, [LDA_ABSX] = {K_LDA, M_ABSX}, [LDA_ABSY] = {K_LDA, M_ABSY},
+    [LDA_INDX] = {K_LDA, M_INDX}, [LDA_INDY] = {K_LDA, M_INDY},
+    [LDX_IM] = {K_LDX, M_IM}, [LDX_ZP] = {K_LDX, M_ZP}, [LDX_ZPY] = {K_LDX, M_ZPY},
+    [LDX_ABS] = {K_LDX, M_ABS}, [LDX_ABSY] = {K_LDX, M_ABSY},
+    [LDY_IM] = {K_LDY, M_IM}, [LDY_ZP] = {K_LDY, M_ZP}, [LDY_ZPX] = {K_LDY, M_ZPX},
+    [LDY_ABS] = {K_LDY, M_ABS}, [LDY_ABSX] = {K_LDY, M_ABSX},
+    [STA_ZP] = {K_STA, M_ZP}, [STA_ZPX] = {K_STA, M_ZPX}, [STA_ABS] = {K_STA, M_ABS},
+    [STA_ABSX] = {K_STA, M_ABSX}, [STA_ABSY] = {K_STA, M_ABSY},
+    [STA_INDX] = {K_STA, M_INDX}, [STA_INDY] = {K_STA, M_INDY},
+    [STX_ZP] = {K_STX, M_ZP}, [STX_ZPY] = {K_STX, M_ZPY}, [STX_ABS] = {K_STX, M_ABS},
+    [STY_ZP] = {K_STY, M_ZP}, [STY_ZPX] = {K_STY, M_ZPX}, [STY_ABS] = {K_STY, M_ABS},
+    [ADC_IM] = {K_ADC, M_IM}, [ADC_ZP] = {K_ADC, M_ZP}, [ADC_ZPX] = {K_ADC, M_ZPX},
+    [ADC_ABS] = {K_ADC, M_ABS}, [ADC_ABSX] = {K_ADC, M_ABSX}, [ADC_ABSY] = {K_ADC, M_ABSY},
+    [ADC_INDX] = {K_ADC, M_INDX}, [ADC_INDY] = {K_ADC, M_INDY},
+    [SBC_IM] = {K_SBC, M_IM}, [SBC_ZP] = {K_SBC, M_ZP}, [SBC_ZPX] = {K_SBC, M_ZPX},
+    [SBC_ABS] = {K_SBC, M_ABS}, [SBC_ABSX] = {K_SBC, M_ABSX}, [SBC_ABSY] = {K_SBC, M_ABSY},
+    [SBC_INDX] = {K_SBC, M_INDX}, [SBC_INDY] = {K_SBC, M_INDY},
+    [AND_IM] = {K_AND, M_IM}, [AND_ZP] = {K_AND, M_ZP}, [AND_ZPX] = {K_AND, M_ZPX},
+    [AND_ABS] = {K_AND, M_ABS}, [AND_ABSX] = {K_AND, M_ABSX}, [AND_ABSY] = {K_AND, M_ABSY},
+    [AND_INDX] = {K_AND, M_INDX}, [AND_INDY] = {K_AND, M_INDY},
+    [ORA_IM] = {K_ORA, M_IM}, [ORA_ZP] = {K_ORA, M_ZP}, [ORA_ZPX] = {K_ORA, M_ZPX},
+    [ORA_ABS] = {K_ORA, M_ABS}, [ORA_ABSX] = {K_ORA, M_ABSX}, [ORA_ABSY] = {K_ORA, M_ABSY},
+    [ORA_INDX] = {K_ORA, M_INDX}, [ORA_INDY] = {K_ORA, M_INDY},
+    [EOR_IM] = {K_EOR, M_IM}, [EOR_ZP] = {K_EOR, M_ZP}, [EOR_ZPX] = {K_EOR, M_ZPX},
+    [EOR_ABS] = {K_EOR, M_ABS}, [EOR_ABSX] = {K_EOR, M_ABSX}, [EOR_ABSY] = {K_EOR, M_ABSY},
+    [EOR_INDX] = {K_EOR, M_INDX}, [EOR_INDY] = {K_EOR, M_INDY},
+    [CMP_IM] = {K_CMP, M_IM}, [CMP_ZP] = {K_CMP, M_ZP}, [CMP_ZPX] = {K_CMP, M_ZPX},
+    [CMP_ABS] = {K_CMP, M_ABS}, [CMP_ABSX] = {K_CMP, M_ABSX}, [CMP_ABSY] = {K_CMP, M_ABSY},
+    [CMP_INDX] = {K_CMP, M_INDX}, [CMP_INDY] = {K_CMP, M_INDY},
+    [CPX_IM] = {K_CPX, M_IM}, [CPX_ZP] = {K_CPX, M_ZP}, [CPX_ABS] = {K_CPX, M_ABS},
+    [CPY_IM] = {K_CPY, M_IM}, [CPY_ZP] = {K_CPY, M_ZP}, [CPY_ABS] = {K_CPY, M_ABS},
+    [INC_ZP] = {K_INC, M_ZP}, [INC_ZPX] = {K_INC, M_ZPX}, [INC_ABS] = {K_INC, M_ABS},
+    [INC_ABSX] = {K_INC, M_ABSX},
+    [DEC_ZP] = {K_DEC, M_ZP}, [DEC_ZPX] = {K_DEC, M_ZPX}, [DEC_ABS] = {K_DEC, M_ABS},
+    [DEC_ABSX] = {K_DEC, M_ABSX},
+    [INX_IMPL] = {K_INX, M_IMPL}, [INY_IMPL] = {K_INY, M_IMPL},
+    [DEX_IMPL] = {K_DEX, M_IMPL}, [DEY_IMPL] = {K_DEY, M_IMPL},
+    [TAX_IMPL] = {K_TAX, M_IMPL}, [TAY_IMPL] = {K_TAY, M_IMPL},
+    [TXA_IMPL] = {K_TXA, M_IMPL}, [TYA_IMPL] = {K_TYA, M_IMPL},
+    [TSX_IMPL] = {K_TSX, M_IMPL}, [TXS_IMPL] = {K_TXS, M_IMPL},
+    [ASL_ACC] = {K_ASL, M_ACC}, [ASL_ZP] = {K_ASL, M_ZP}, [ASL_ZPX] = {K_ASL, M_ZPX},
+    [ASL_ABS] = {K_ASL, M_ABS}, [ASL_ABSX] = {K_ASL, M_ABSX},
+    [LSR_ACC] = {K_LSR, M_ACC}, [LSR_ZP] = {K_LSR, M_ZP}, [LSR_ZPX] = {K_LSR, M_ZPX},
+    [LSR_ABS] = {K_LSR, M_ABS}, [LSR_ABSX] = {K_LSR, M_ABSX},
+    [ROL_ACC] = {K_ROL, M_ACC}, [ROL_ZP] = {K_ROL, M_ZP}, [ROL_ZPX] = {K_ROL, M_ZPX},
+    [ROL_ABS] = {K_ROL, M_ABS}, [ROL_ABSX] = {K_ROL, M_ABSX},
+    [ROR_ACC] = {K_ROR, M_ACC}, [ROR_ZP] = {K_ROR, M_ZP}, [ROR_ZPX] = {K_ROR, M_ZPX},
+    [ROR_ABS] = {K_ROR, M_ABS}, [ROR_ABSX] = {K_ROR, M_ABSX},
+    [BIT_ZP] = {K_BIT, M_ZP}, [BIT_ABS] = {K_BIT, M_ABS},
+    [CLC_IMPL] = {K_CLC, M_IMPL}, [SEC_IMPL] = {K_SEC, M_IMPL},
+    [CLV_IMPL] = {K_CLV, M_IMPL}, [CLD_IMPL] = {K_CLD, M_IMPL},
+    [SED_IMPL] = {K_SED, M_IMPL}, [CLI_IMPL] = {K_CLI, M_IMPL},
+    [SEI_IMPL] = {K_SEI, M_IMPL}, [NOP_IMPL] = {K_NOP, M_IMPL},
+    [BPL_REL] = {K_BRANCH, M_REL}, [BMI_REL] = {K_BRANCH, M_REL},
+    [BVC_REL] = {K_BRANCH, M_REL}, [BVS_REL] = {K_BRANCH, M_REL},
+    [BCC_REL] = {K_BRANCH, M_REL}, [BCS_REL] = {K_BRANCH, M_REL},
+    [BNE_REL] = {K_BRANCH, M_REL}, [BEQ_REL] = {K_BRANCH, M_REL},
+    [JMP_ABS] = {K_JMP, M_ABS},
+};
+
+// documented opcodes without a vector form, and what they may write
+enum { WRITES_ANY, WRITES_NONE, WRITES_STACK };
+
+static const Byte scalar_writes[256] = {
+    [PHA_IMPL] = WRITES_STACK, [PHP_IMPL] = WRITES_STACK,
+    [JSR_ABS] = WRITES_STACK, [BRK_IMPL] = WRITES_STACK,
+    [PLA_IMPL] = WRITES_NONE, [PLP_IMPL] = WRITES_NONE,
+    [RTS_IMPL] = WRITES_NONE, [RTI_IMPL] = WRITES_NONE, [JMP_IND] = WRITES_NONE,
+};
+
+static LaneVec splat(Byte b) {
+    return (LaneVec){0} + b;
+}
+
+// keep new where the mask is set, old elsewhere
+static LaneVec blend(LaneVec m, LaneVec new, LaneVec old) {
+    return (new & m) | (old & ~m);
+}
+
+// PC vectors are wider than an SSE register, so their helpers are macros
+// rather than functions passing them by value
+#define blend_pc(m, new, old) (((new) & (m)) | ((old) & ~(m)))
+#define splat_pc(w) ((LanePC){0} + (Word)(w))
+
+typedef int8_t LaneMask __attribute__((vector_size(LANES)));
+typedef int16_t LaneMaskPC __attribute__((vector_size(2 * LANES)));
+
+// widen a byte lane mask to PC width, 0xFF becomes 0xFFFF
+#define wide(m) ((LanePC)__builtin_convertvector((LaneMask)(m), LaneMaskPC))
+
+static void lane_load(LaneGroup *g, int i) {
+    CPU *c = g->cpu[i];
+    g->A[i] = c->A;
+    g->X[i] = c->X;
+    g->Y[i] = c->Y;
+    g->SP[i] = c->SP;
+    g->C[i] = c->C;
+    g->Z[i] = c->Z;
+    g->I[i] = c->I;
+    g->D[i] = c->D;
+    g->V[i] = c->V;
+    g->N[i] = c->N;
+    g->PC[i] = c->PC;
+}
+
+static void lane_store(LaneGroup *g, int i) {
+    CPU *c = g->cpu[i];
+    c->A = g->A[i];
+    c->X = g->X[i];
+    c->Y = g->Y[i];
+    c->SP = g->SP[i];
+    c->C = g->C[i];
+    c->Z = g->Z[i];
+    c->I = g->I[i];
+    c->D = g->D[i];
+    c->V = g->V[i];
+    c->N = g->N[i];
+    c->PC = g->PC[i];
+}
+
+void lanes_init(LaneGroup *g, CPU **cpus, int n) {
+    memset(g, 0, sizeof(*g));
+    g->lanes = n > LANES ? LANES : n;
+    for (int i = 0; i < g->lanes; i++) {
+        g->cpu[i] = cpus[i];
+        lane_load(g, i);
+        g->live[i] = 0xFF;
+    }
+}
+
+static void set_nz(LaneGroup *g, LaneVec m, LaneVec r) {
+    g->Z = blend(m, (LaneVec)(r == 0) & 1, g->Z);
+    g->N = blend(m, r >> 7, g->N);
+}
+
+static void add(LaneGroup *g, LaneVec m, LaneVec v) {
+    LaneVec t = g->A + v;
+    LaneVec r = t + g->C;
+    LaneVec carry = ((LaneVec)(t < g->A) | (LaneVec)(r < t)) & 1;
+    g->V = blend(m, ((g->A ^ r) & (v ^ r)) >> 7, g->V);
+    g->C = blend(m, carry, g->C);
+    g->A = blend(m, r, g->A);
+    set_nz(g, m, r);
+}
+
+static void compare(LaneGroup *g, LaneVec m, LaneVec reg, LaneVec v) {
+    g->C = blend(m, (LaneVec)(reg >= v) & 1, g->C);
+    set_nz(g, m, reg - v);
+}
+
+static bool known_same(LaneGroup *g, Word addr) {
+    return g->same[addr >> 6] >> (addr & 63) & 1;
+}
+
+static void forget(LaneGroup *g, Word addr) {
+    g->same[addr >> 6] &= ~(1ULL << (addr & 63));
+}
+
+static void store(LaneGroup *g, LaneVec m, const Word *ea, LaneVec r) {
+    for (int i = 0; i < g->lanes; i++) {
+        if (!m[i]) continue;
+        write_byte(g->cpu[i], ea[i], r[i]);
+        forget(g, ea[i]);
+    }
+}
+
+static int count_lanes(LaneVec m) {
+    u_int64_t w[LANES / 8];
+    memcpy(w, &m, sizeof(w));
+    int n = 0;
+    for (int i = 0; i < LANES / 8; i++) n += __builtin_popcountll(w[i]);
+    return n / 8;
+}
+
+// leave lockstep: give every live lane the shared PC
+static void spread(LaneGroup *g) {
+    if (!g->together) return;
+    g->PC = blend_pc(wide(g->live), splat_pc(g->pc), g->PC);
+    g->together = 0;
+}
+
+// write the lane registers back to the scalar machines
+void lanes_sync(LaneGroup *g) {
+    spread(g);
+    for (int i = 0; i < g->lanes; i++) lane_store(g, i);
+}
+
+// add an instruction's cycles to the machines behind the lanes in m
+static void charge(LaneGroup *g, LaneVec m, Byte base, LaneVec extra) {
+    for (int i = 0; i < g->lanes; i++) {
+        if (m[i]) g->cpu[i]->cycles += base + extra[i];
+    }
+}
+
+/*
+ * Runs one instruction for the lanes in m, which all sit at pc and hold the
+ * same instruction bytes. Returns false if the opcode has no vector form.
+ */
+static bool vector_step(LaneGroup *g, LaneVec m, Word pc, const Byte *code) {
+    Byte opcode = code[0];
+    LaneOp op = lane_ops[opcode];
+    if (op.kind == K_NONE) return false;
+    if ((op.kind == K_ADC || op.kind == K_SBC) && count_lanes((LaneVec)(g->D != 0) & m)) {
+        // decimal mode stays with the scalar core
+        return false;
+    }
+
+    Byte lo = code[1];
+    Word abs = lo | (code[2] << 8);
+    Word ea[LANES];
+    Word next = pc + mode_length[op.mode];
+
+    // the address is the same in every lane for zero page and absolute
+    switch (op.mode) {
+        case M_ZP:   for (int i = 0; i < LANES; i++) ea[i] = lo; break;
+        case M_ABS:  for (int i = 0; i < LANES; i++) ea[i] = abs; break;
+        case M_ZPX:  for (int i = 0; i < LANES; i++) ea[i] = (lo + g->X[i]) & 0xFF; break;
+        case M_ZPY:  for (int i = 0; i < LANES; i++) ea[i] = (lo + g->Y[i]) & 0xFF; break;
+        case M_ABSX: for (int i = 0; i < LANES; i++) ea[i] = abs + g->X[i]; break;
+        case M_ABSY: for (int i = 0; i < LANES; i++) ea[i] = abs + g->Y[i]; break;
+        case M_INDX:
+            for (int i = 0; i < g->lanes; i++) {
+                if (!m[i]) continue;
+                Byte ptr = lo + g->X[i];
+                ea[i] = read_byte(g->cpu[i], ptr) | (read_byte(g->cpu[i], (ptr + 1) & 0xFF) << 8);
+            }
+            break;
+        case M_INDY:
+            for (int i = 0; i < g->lanes; i++) {
+                if (!m[i]) continue;
+                Word base = read_byte(g->cpu[i], lo) | (read_byte(g->cpu[i], (lo + 1) & 0xFF) << 8);
+                ea[i] = base + g->Y[i];
+            }
+            break;
+        default: break;
+    }
+
+    // operand for the ops that read one
+    LaneVec v = splat(lo);
+    bool reads = op.mode > M_IM && op.mode != M_REL &&
+                 op.kind != K_STA && op.kind != K_STX && op.kind != K_STY && op.kind != K_JMP;
+    if (reads) {
+        for (int i = 0; i < g->lanes; i++) {
+            if (m[i]) v[i] = read_byte(g->cpu[i], ea[i]);
+        }
+    }
+
+    // indexed reads pay a cycle when the index carries into the high byte
+    LaneVec one = splat(1);
+    LaneVec extra = splat(0);
+    bool rmw = op.kind == K_INC || op.kind == K_DEC || (op.kind >= K_ASL && op.kind <= K_ROR);
+    if (reads && !rmw && (op.mode == M_ABSX || op.mode == M_ABSY || op.mode == M_INDY)) {
+        LaneVec index = op.mode == M_ABSX ? g->X : g->Y;
+        for (int i = 0; i < g->lanes; i++) extra[i] = (ea[i] & 0xFF) < index[i];
+    }
+    charge(g, m, opcode_cycles[opcode], extra);
+#ifdef COVERAGE
+    for (int i = 0; i < g->lanes; i++) {
+        if (m[i]) COVER(g->cpu[i]->mem->executed, pc);
+    }
+#endif
+
+    switch (op.kind) {
+        case K_LDA: g->A = blend(m, v, g->A); set_nz(g, m, v); break;
+        case K_LDX: g->X = blend(m, v, g->X); set_nz(g, m, v); break;
+        case K_LDY: g->Y = blend(m, v, g->Y); set_nz(g, m, v); break;
+        case K_STA: store(g, m, ea, g->A); break;
+        case K_STX: store(g, m, ea, g->X); break;
+        case K_STY: store(g, m, ea, g->Y); break;
+        case K_ADC: add(g, m, v); break;
+        case K_SBC: add(g, m, ~v); break;
+        case K_AND: g->A = blend(m, g->A & v, g->A); set_nz(g, m, g->A); break;
+        case K_ORA: g->A = blend(m, g->A | v, g->A); set_nz(g, m, g->A); break;
+        case K_EOR: g->A = blend(m, g->A ^ v, g->A); set_nz(g, m, g->A); break;
+        case K_CMP: compare(g, m, g->A, v); break;
+        case K_CPX: compare(g, m, g->X, v); break;
+        case K_CPY: compare(g, m, g->Y, v); break;
+        case K_INC: case K_DEC: {
+            LaneVec r = op.kind == K_INC ? v + one : v - one;
+            store(g, m, ea, r);
+            set_nz(g, m, r);
+            break;
+        }
+        case K_ASL: case K_LSR: case K_ROL: case K_ROR: {
+            if (op.mode == M_ACC) v = g->A;
+            LaneVec r;
+            if (op.kind == K_ASL || op.kind == K_ROL) {
+                r = (v << 1) | (op.kind == K_ROL ? g->C : splat(0));
+                g->C = blend(m, v >> 7, g->C);
+            } else {
+                r = (v >> 1) | (op.kind == K_ROR ? g->C << 7 : splat(0));
+                g->C = blend(m, v & one, g->C);
+            }
+            if (op.mode == M_ACC) g->A = blend(m, r, g->A);
+            else store(g, m, ea, r);
+            set_nz(g, m, r);
+            break;
+        }
+        case K_BIT:
+            g->Z = blend(m, (LaneVec)((g->A & v) == 0) & one, g->Z);
+            g->V = blend(m, (v >> 6) & one, g->V);
+            g->N = blend(m, v >> 7, g->N);
+            break;
+        case K_INX: g->X = blend(m, g->X + one, g->X); set_nz(g, m, g->X); break;
+        case K_INY: g->Y = blend(m, g->Y + one, g->Y); set_nz(g, m, g->Y); break;
+        case K_DEX: g->X = blend(m, g->X - one, g->X); set_nz(g, m, g->X); break;
+        case K_DEY: g->Y = blend(m, g->Y - one, g->Y); set_nz(g, m, g->Y); break;
+        case K_TAX: g->X = blend(m, g->A, g->X); set_nz(g, m, g->X); break;
+        case K_TAY: g->Y = blend(m, g->A, g->Y); set_nz(g, m, g->Y); break;
+        case K_TXA: g->A = blend(m, g->X, g->A); set_nz(g, m, g->A); break;
+        case K_TYA: g->A = blend(m, g->Y, g->A); set_nz(g, m, g->A); break;
+        case K_TSX: g->X = blend(m, g->SP, g->X); set_nz(g, m, g->X); break;
+        case K_TXS: g->SP = blend(m, g->X, g->SP); break;
+        case K_CLC: g->C = blend(m, splat(0), g->C); break;
+        case K_SEC: g->C = blend(m, one, g->C); break;
+        case K_CLV: g->V = blend(m, splat(0), g->V); break;
+        case K_CLD: g->D = blend(m, splat(0), g->D); break;
+        case K_SED: g->D = blend(m, one, g->D); break;
+        case K_CLI: g->I = blend(m, splat(0), g->I); break;
+        case K_SEI: g->I = blend(m, one, g->I); break;
+        case K_NOP: break;
+        case K_BRANCH: {
+            // bits 7-6 pick N, V, C or Z, bit 5 the value that takes the branch
+            LaneVec flag = (opcode >> 6) == 0 ? g->N : (opcode >> 6) == 1 ? g->V :
+                           (opcode >> 6) == 2 ? g->C : g->Z;
+            LaneVec taken = (LaneVec)(flag == splat((opcode >> 5) & 1)) & m;
+            Word target = next + (int8_t)lo;
+            charge(g, m, 0, (taken & one) << ((target ^ next) > 0xFF));
+            if (g->together && !count_lanes(taken)) break;
+            if (g->together && count_lanes(taken) == count_lanes(m)) {
+                next = target;
+                break;
+            }
+            spread(g);
+            LanePC to = blend_pc(wide(taken), splat_pc(target), splat_pc(next));
+            g->PC = blend_pc(wide(m), to, g->PC);
+            return true;
+        }
+        case K_JMP: next = abs; break;
+        default: break;
+    }
+
+    if (g->together) g->pc = next;
+    else g->PC = blend_pc(wide(m), splat_pc(next), g->PC);
+    return true;
+}
+
+static int scalar_step(LaneGroup *g, int i) {
+    lane_store(g, i);
+    int n = execute_instructions(g->cpu[i]);
+    lane_load(g, i);
+    return n;
+}
+
+// run every live lane on its own scalar core until it traps or runs out
+static void scalar_fallback(LaneGroup *g, u_int64_t steps) {
+    for (int i = 0; i < g->lanes; i++) {
+        if (!g->live[i]) continue;
+        lane_store(g, i);
+        CPU *c = g->cpu[i];
+        for (u_int64_t n = 0; n < steps; n++) {
+            Word pc = c->PC;
+            int done = execute_instructions(c);
+            g->scalar += done;
+            if (c->PC == pc && done == 1) {
+                g->live[i] = 0;
+                break;
+            }
+        }
+        lane_load(g, i);
+    }
+}
+
+/*
+ * Runs the group for at most max_steps scheduling steps, each of which
+ * executes one instruction on the lanes it selects. Returns the number of
+ * lanes that have not retired; call lanes_sync() to see their registers.
+ */
+int lanes_run(LaneGroup *g, u_int64_t max_steps) {
+    // memory may have been changed since the last run
+    memset(g->same, 0, sizeof(g->same));
+
+    int live = count_lanes(g->live);
+    for (u_int64_t step = 0; step < max_steps && live; step++) {
+        Word pc;
+        LaneVec m;
+        if (g->together) {
+            pc = g->pc;
+            m = g->live;
+        } else {
+            // lowest PC goes first so lanes that branched ahead wait for the rest
+            LanePC pcs = blend_pc(wide(g->live), g->PC, splat_pc(0xFFFF));
+            pc = pcs[0];
+            for (int i = 1; i < LANES; i++) pc = pcs[i] < pc ? pcs[i] : pc;
+            m = __builtin_convertvector(g->PC == splat_pc(pc), LaneVec) & g->live;
+            if (count_lanes(m) == live) {
+                g->together = 1;
+                g->pc = pc;
+            }
+        }
+
+        // only lanes whose instruction bytes match the leader's can share
+        // a vector op; opcodes stepped per lane just need the same PC
+        int lead = 0;
+        while (!m[lead]) lead++;
+        Byte code[3];
+        code[0] = fetch_byte(g->cpu[lead], pc);
+        LaneOp op = lane_ops[code[0]];
+        int length = op.kind == K_NONE ? 1 : mode_length[op.mode];
+        code[1] = length > 1 ? fetch_byte(g->cpu[lead], pc + 1) : 0;
+        code[2] = length > 2 ? fetch_byte(g->cpu[lead], pc + 2) : 0;
+        for (int k = 0; k < length; k++) {
+            Word addr = pc + k;
+            if (known_same(g, addr)) continue;
+            bool all = true;
+            for (int i = 0; i < g->lanes; i++) {
+                if (!g->live[i] || fetch_byte(g->cpu[i], addr) == code[k]) continue;
+                all = false;
+                m[i] = 0;
+            }
+            if (all) g->same[addr >> 6] |= 1ULL << (addr & 63);
+        }
+
+        int active = count_lanes(m);
+        if (active == live) {
+            g->diverged = 0;
+        } else {
+            spread(g);
+            if (active * 4 < live && ++g->diverged > DIVERGE_LIMIT) {
+                scalar_fallback(g, max_steps - step);
+                return count_lanes(g->live);
+            }
+        }
+
+        LaneVec fused = splat(0);
+        if (vector_step(g, m, pc, code)) {
+            if (active == live) g->lockstep += active;
+            else g->masked += active;
+        } else {
+            spread(g);
+            bool more = false;
+            for (int i = 0; i < g->lanes; i++) {
+                if (!m[i]) continue;
+                int n = scalar_step(g, i);
+                g->scalar += n;
+                if (n > 1) fused[i] = 0xFF;
+                more |= n > 1;
+            }
+            // a fused pair may have stored (a decimal ADC and the STA after
+            // it), so only a lone instruction goes by its opcode
+            int writes = more ? WRITES_ANY : op.kind != K_NONE ? WRITES_NONE : scalar_writes[code[0]];
+            if (writes == WRITES_STACK) {
+                memset(&g->same[0x100 / 64], 0, 0x100 / 8);
+            } else if (writes == WRITES_ANY) {
+                memset(g->same, 0, sizeof(g->same));
+            }
+        }
+
+        // a lane whose instruction left PC where it was has trapped, a
+        // fused pair that loops back to itself has not
+        if (g->together) {
+            if (g->pc != pc) continue;
+            spread(g);
+        }
+        g->live &= ~(m & ~fused & __builtin_convertvector(g->PC == splat_pc(pc), LaneVec));
+        live = count_lanes(g->live);
+    }
+    return live;
+}
@@ -0,0 +1,59 @@
+#ifndef LANES_H
+#define LANES_H
+
+#include "6502.h"
+
+/*
+ * Lane-parallel interpreter: up to LANES machines running the same program
+ * on different data. Registers and flags are held structure-of-arrays, one
+ * byte lane per machine, so while the machines agree on PC an instruction
+ * is decoded once and executed for every lane with vector operations.
+ *
+ * Lanes that disagree on PC are scheduled lowest PC first with the others
+ * masked off, which lets forward branches reconverge. Opcodes without a
+ * vector form are stepped lane by lane through execute_instructions(). Only
+ * lanes holding the same instruction bytes share a decode, so machines may
+ * modify their own code; the comparison result is cached per address. If
+ * the group stays split up for too long every lane is handed to the
+ * scalar core for the rest of the run.
+ *
+ * A lane retires when an instruction leaves PC where it started (a branch
+ * or JMP to itself, or a trap on an undocumented opcode).
+ */
+
+// registers are bytes, so 16 lanes fill an SSE register; 8 also works
+#ifndef LANES
+#define LANES 16
+#endif
+
+typedef Byte LaneVec __attribute__((vector_size(LANES)));
+typedef Word LanePC __attribute__((vector_size(2 * LANES)));
+
+typedef struct {
+    CPU *cpu[LANES];    // scalar machine behind each lane
+    int lanes;          // lanes in use
+
+    LaneVec A, X, Y, SP;
+    LaneVec C, Z, I, D, V, N;   // flags, 0 or 1
+    LanePC PC;          // per lane, stale while together is set
+    Word pc;            // shared PC while every live lane agrees on it
+    int together;
+    LaneVec live;       // 0xFF until the lane retires
+
+    // addresses known to hold the same byte in every lane, so instruction
+    // bytes there need not be compared lane by lane; cleared on stores
+    u_int64_t same[0x10000 / 64];
+
+    // instructions executed, counted per lane
+    u_int64_t lockstep; // every live lane in one vector op
+    u_int64_t masked;   // vector op on part of the group
+    u_int64_t scalar;   // through execute_instructions()
+
+    int diverged;       // consecutive steps not in lockstep
+} LaneGroup;
+
+void lanes_init(LaneGroup *g, CPU **cpus, int n);
+void lanes_sync(LaneGroup *g);
+int lanes_run(LaneGroup *g, u_int64_t max_steps);
+
+#endif
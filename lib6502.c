@@ -0,0 +1,138 @@
+#include "lib6502.h"
+#include "6502.h"
+#include "state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct M6502 {
+    CPU cpu;
+    Memory mem;
+};
+
+int m6502_version(void) {
+    return LIB6502_VERSION;
+}
+
+// a machine with zeroed memory and registers, NULL if out of memory
+M6502 *m6502_create(void) {
+    M6502 *m = malloc(sizeof(*m));
+    if (m == NULL) return NULL;
+    memset(&m->cpu, 0, sizeof(m->cpu));
+    init_mem(&m->mem);
+    m->cpu.mem = &m->mem;
+    return m;
+}
+
+void m6502_destroy(M6502 *m) {
+    free(m);
+}
+
+// registers as after a reset, PC from the reset vector; memory is kept
+void m6502_reset(M6502 *m) {
+    cpu_reset(&m->cpu);
+}
+
+void m6502_set_opcodes(M6502 *m, M6502Opcodes opcodes) {
+    m->cpu.opcodes = opcodes == M6502_OPCODES_NMOS ? OPCODES_NMOS
+                   : opcodes == M6502_OPCODES_CMOS_NOP ? OPCODES_CMOS_NOP
+                   : OPCODES_STRICT;
+}
+
+// copies len bytes in at addr; -1 if they would run past $FFFF
+int m6502_load(M6502 *m, uint16_t addr, const void *data, size_t len) {
+    if (addr + len > 0x10000) return -1;
+    m6502_write(m, addr, data, len);
+    return 0;
+}
+
+// loads a whole file at addr; -1 if it cannot be read or does not fit
+int m6502_load_file(M6502 *m, const char *path, uint16_t addr) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return -1;
+    // one byte more than fits, to tell a file that is too long
+    Byte *image = malloc(0x10000 + 1);
+    size_t len = image ? fread(image, 1, 0x10000 + 1, f) : 0;
+    int failed = image == NULL || ferror(f);
+    fclose(f);
+    int result = failed ? -1 : m6502_load(m, addr, image, len);
+    free(image);
+    return result;
+}
+
+int m6502_save_state(const M6502 *m, int fd) {
+    return state_save(&m->cpu, fd);
+}
+
+int m6502_load_state(M6502 *m, int fd) {
+    return state_load(&m->cpu, fd);
+}
+
+// runs for budget cycles, or with budget 0 until the machine is stuck;
+// with a budget, a stuck machine just uses it up
+M6502Stop m6502_run(M6502 *m, uint64_t budget) {
+    u_int64_t until = budget ? m->cpu.cycles + budget : CYCLES_FOREVER;
+    return cpu_run(&m->cpu, until) == RUN_TRAP ? M6502_STUCK : M6502_BUDGET;
+}
+
+uint64_t m6502_cycles(const M6502 *m) {
+    return m->cpu.cycles;
+}
+
+unsigned m6502_get(const M6502 *m, M6502Register r) {
+    const CPU *cpu = &m->cpu;
+    switch (r) {
+        case M6502_A: return cpu->A;
+        case M6502_X: return cpu->X;
+        case M6502_Y: return cpu->Y;
+        case M6502_SP: return cpu->SP;
+        case M6502_P:
+            return cpu->N << 7 | cpu->V << 6 | 1 << 5 | cpu->B << 4 | cpu->D << 3 | cpu->I << 2 | cpu->Z << 1 | cpu->C;
+        case M6502_PC: return cpu->PC;
+    }
+    return 0;
+}
+
+void m6502_set(M6502 *m, M6502Register r, unsigned value) {
+    CPU *cpu = &m->cpu;
+    switch (r) {
+        case M6502_A: cpu->A = value; break;
+        case M6502_X: cpu->X = value; break;
+        case M6502_Y: cpu->Y = value; break;
+        case M6502_SP: cpu->SP = value; break;
+        case M6502_P:
+            cpu->N = value >> 7 & 1;
+            cpu->V = value >> 6 & 1;
+            cpu->B = value >> 4 & 1;
+            cpu->D = value >> 3 & 1;
+            cpu->I = value >> 2 & 1;
+            cpu->Z = value >> 1 & 1;
+            cpu->C = value & 1;
+            break;
+        case M6502_PC: cpu->PC = value; break;
+    }
+}
+
+uint8_t m6502_peek(const M6502 *m, uint16_t addr) {
+    return m->mem.Data[addr];
+}
+
+void m6502_poke(M6502 *m, uint16_t addr, uint8_t value) {
+    m->mem.Data[addr] = value;
+    m->mem.dirty[addr >> 8] = 1;
+}
+
+// copies up to len bytes from addr on, stopping at $FFFF; returns how many
+size_t m6502_read(const M6502 *m, uint16_t addr, void *out, size_t len) {
+    if (len > 0x10000u - addr) len = 0x10000u - addr;
+    memcpy(out, &m->mem.Data[addr], len);
+    return len;
+}
+
+// the other way round; marks the pages written as stored to
+size_t m6502_write(M6502 *m, uint16_t addr, const void *data, size_t len) {
+    if (len > 0x10000u - addr) len = 0x10000u - addr;
+    memcpy(&m->mem.Data[addr], data, len);
+    for (size_t page = addr >> 8; len > 0 && page <= (addr + len - 1) >> 8; page++) m->mem.dirty[page] = 1;
+    return len;
+}
@@ -0,0 +1,73 @@
+#ifndef LIB6502_H
+#define LIB6502_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The embedding API of lib6502. A machine is an opaque handle holding a
+ * CPU and its 64 KiB of RAM, with no devices mapped. Nothing here exposes
+ * the core's structures, so programs built against this header keep
+ * working across releases with the same LIB6502_VERSION; the rest of the
+ * tree's headers are for code built along with the core.
+ *
+ * Machines are independent: any number can run at once, each from one
+ * thread at a time.
+ */
+
+#define LIB6502_VERSION 1
+
+#if defined(__GNUC__)
+#define M6502_API __attribute__((visibility("default")))
+#else
+#define M6502_API
+#endif
+
+typedef struct M6502 M6502;
+
+typedef enum {
+    M6502_A,
+    M6502_X,
+    M6502_Y,
+    M6502_SP,
+    M6502_P,    // NV-BDIZC, bit 5 reads as set
+    M6502_PC,
+} M6502Register;
+
+// what the machine does with opcodes the NMOS 6502 does not document
+typedef enum {
+    M6502_OPCODES_STRICT,   // stop on them, PC on the opcode
+    M6502_OPCODES_NMOS,     // run them as the NMOS part does
+    M6502_OPCODES_CMOS_NOP, // skip them like the 65C02
+} M6502Opcodes;
+
+// why m6502_run() returned
+typedef enum {
+    M6502_BUDGET,   // ran the cycles it was given
+    M6502_STUCK,    // with no budget: jumped to itself or idles forever
+} M6502Stop;
+
+M6502_API int m6502_version(void);
+
+M6502_API M6502 *m6502_create(void);
+M6502_API void m6502_destroy(M6502 *m);
+M6502_API void m6502_reset(M6502 *m);
+M6502_API void m6502_set_opcodes(M6502 *m, M6502Opcodes opcodes);
+
+M6502_API int m6502_load(M6502 *m, uint16_t addr, const void *data, size_t len);
+M6502_API int m6502_load_file(M6502 *m, const char *path, uint16_t addr);
+M6502_API int m6502_save_state(const M6502 *m, int fd);
+M6502_API int m6502_load_state(M6502 *m, int fd);
+
+M6502_API M6502Stop m6502_run(M6502 *m, uint64_t budget);
+M6502_API uint64_t m6502_cycles(const M6502 *m);
+
+M6502_API unsigned m6502_get(const M6502 *m, M6502Register r);
+M6502_API void m6502_set(M6502 *m, M6502Register r, unsigned value);
+
+M6502_API uint8_t m6502_peek(const M6502 *m, uint16_t addr);
+M6502_API void m6502_poke(M6502 *m, uint16_t addr, uint8_t value);
+M6502_API size_t m6502_read(const M6502 *m, uint16_t addr, void *out, size_t len);
+M6502_API size_t m6502_write(M6502 *m, uint16_t addr, const void *data, size_t len);
+
+#endif
@@ -210,4 +210,95 @@
 
 #define TYA_IMPL 0x98
 
+// undocumented NMOS opcodes
+
+#define SLO_ZP 0x07
+#define SLO_ZPX 0x17
+#define SLO_ABS 0x0F
+#define SLO_ABSX 0x1F
+#define SLO_ABSY 0x1B
+#define SLO_INDX 0x03
+#define SLO_INDY 0x13
+
+#define RLA_ZP 0x27
+#define RLA_ZPX 0x37
+#define RLA_ABS 0x2F
+#define RLA_ABSX 0x3F
+#define RLA_ABSY 0x3B
+#define RLA_INDX 0x23
+#define RLA_INDY 0x33
+
+#define SRE_ZP 0x47
+#define SRE_ZPX 0x57
+#define SRE_ABS 0x4F
+#define SRE_ABSX 0x5F
+#define SRE_ABSY 0x5B
+#define SRE_INDX 0x43
+#define SRE_INDY 0x53
+
+#define RRA_ZP 0x67
+#define RRA_ZPX 0x77
+#define RRA_ABS 0x6F
+#define RRA_ABSX 0x7F
+#define RRA_ABSY 0x7B
+#define RRA_INDX 0x63
+#define RRA_INDY 0x73
+
+#define SAX_ZP 0x87
+#define SAX_ZPY 0x97
+#define SAX_ABS 0x8F
+#define SAX_INDX 0x83
+
+#define LAX_IM 0xAB
+#define LAX_ZP 0xA7
+#define LAX_ZPY 0xB7
+#define LAX_ABS 0xAF
+#define LAX_ABSY 0xBF
+#define LAX_INDX 0xA3
+#define LAX_INDY 0xB3
+
+#define DCP_ZP 0xC7
+#define DCP_ZPX 0xD7
+#define DCP_ABS 0xCF
+#define DCP_ABSX 0xDF
+#define DCP_ABSY 0xDB
+#define DCP_INDX 0xC3
+#define DCP_INDY 0xD3
+
+#define ISC_ZP 0xE7
+#define ISC_ZPX 0xF7
+#define ISC_ABS 0xEF
+#define ISC_ABSX 0xFF
+#define ISC_ABSY 0xFB
+#define ISC_INDX 0xE3
+#define ISC_INDY 0xF3
+
+#define ANC_IM 0x0B
+#define ANC_IM2 0x2B
+
+#define ALR_IM 0x4B
+
+#define ARR_IM 0x6B
+
+#define ANE_IM 0x8B
+
+#define SBX_IM 0xCB
+
+#define SBC_IM2 0xEB
+
+#define SHA_INDY 0x93
+#define SHA_ABSY 0x9F
+
+#define TAS_ABSY 0x9B
+
+#define SHY_ABSX 0x9C
+
+#define SHX_ABSY 0x9E
+
+#define LAS_ABSY 0xBB
+
+// NOP: x2 (80 82 89 C2 E2) imm, x4 (04 44 64) zp, x4 (14 34 54 74 D4 F4) zpx,
+// xA (1A 3A 5A 7A DA FA) impl, 0C abs, xC (1C 3C 5C 7C DC FC) absx
+// JAM: 02 12 22 32 42 52 62 72 92 B2 D2 F2
+
 #endif
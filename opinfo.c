@@ -0,0 +1,292 @@
+#include "opinfo.h"
+#include "opcodes.h"
+#include <stdio.h>
+
+const Byte mode_bytes[] = {
+    [MODE_IMPL] = 1, [MODE_ACC] = 1, [MODE_IM] = 2, [MODE_ZP] = 2, [MODE_ZPX] = 2,
+    [MODE_ZPY] = 2, [MODE_ABS] = 3, [MODE_ABSX] = 3, [MODE_ABSY] = 3, [MODE_IND] = 3,
+    [MODE_INDX] = 2, [MODE_INDY] = 2, [MODE_REL] = 2,
+};
+
+// undocumented opcodes carry the names 6502.c runs them under with
+// OPCODES_NMOS; the multi-byte NOPs and JAMs are listed by number
+const OpInfo opinfo[256] = {
+    [BRK_IMPL] = {"BRK", MODE_IMPL, 1},
+    [ORA_INDX] = {"ORA", MODE_INDX, 1},
+    [0x02] = {"JAM", MODE_IMPL},
+    [SLO_INDX] = {"SLO", MODE_INDX},
+    [0x04] = {"NOP", MODE_ZP},
+    [ORA_ZP] = {"ORA", MODE_ZP, 1},
+    [ASL_ZP] = {"ASL", MODE_ZP, 1},
+    [SLO_ZP] = {"SLO", MODE_ZP},
+    [PHP_IMPL] = {"PHP", MODE_IMPL, 1},
+    [ORA_IM] = {"ORA", MODE_IM, 1},
+    [ASL_ACC] = {"ASL", MODE_ACC, 1},
+    [ANC_IM] = {"ANC", MODE_IM},
+    [0x0C] = {"NOP", MODE_ABS},
+    [ORA_ABS] = {"ORA", MODE_ABS, 1},
+    [ASL_ABS] = {"ASL", MODE_ABS, 1},
+    [SLO_ABS] = {"SLO", MODE_ABS},
+    [BPL_REL] = {"BPL", MODE_REL, 1},
+    [ORA_INDY] = {"ORA", MODE_INDY, 1},
+    [0x12] = {"JAM", MODE_IMPL},
+    [SLO_INDY] = {"SLO", MODE_INDY},
+    [0x14] = {"NOP", MODE_ZPX},
+    [ORA_ZPX] = {"ORA", MODE_ZPX, 1},
+    [ASL_ZPX] = {"ASL", MODE_ZPX, 1},
+    [SLO_ZPX] = {"SLO", MODE_ZPX},
+    [CLC_IMPL] = {"CLC", MODE_IMPL, 1},
+    [ORA_ABSY] = {"ORA", MODE_ABSY, 1},
+    [0x1A] = {"NOP", MODE_IMPL},
+    [SLO_ABSY] = {"SLO", MODE_ABSY},
+    [0x1C] = {"NOP", MODE_ABSX},
+    [ORA_ABSX] = {"ORA", MODE_ABSX, 1},
+    [ASL_ABSX] = {"ASL", MODE_ABSX, 1},
+    [SLO_ABSX] = {"SLO", MODE_ABSX},
+    [JSR_ABS] = {"JSR", MODE_ABS, 1},
+    [AND_INDX] = {"AND", MODE_INDX, 1},
+    [0x22] = {"JAM", MODE_IMPL},
+    [RLA_INDX] = {"RLA", MODE_INDX},
+    [BIT_ZP] = {"BIT", MODE_ZP, 1},
+    [AND_ZP] = {"AND", MODE_ZP, 1},
+    [ROL_ZP] = {"ROL", MODE_ZP, 1},
+    [RLA_ZP] = {"RLA", MODE_ZP},
+    [PLP_IMPL] = {"PLP", MODE_IMPL, 1},
+    [AND_IM] = {"AND", MODE_IM, 1},
+    [ROL_ACC] = {"ROL", MODE_ACC, 1},
+    [ANC_IM2] = {"ANC", MODE_IM},
+    [BIT_ABS] = {"BIT", MODE_ABS, 1},
+    [AND_ABS] = {"AND", MODE_ABS, 1},
+    [ROL_ABS] = {"ROL", MODE_ABS, 1},
+    [RLA_ABS] = {"RLA", MODE_ABS},
+    [BMI_REL] = {"BMI", MODE_REL, 1},
+    [AND_INDY] = {"AND", MODE_INDY, 1},
+    [0x32] = {"JAM", MODE_IMPL},
+    [RLA_INDY] = {"RLA", MODE_INDY},
+    [0x34] = {"NOP", MODE_ZPX},
+    [AND_ZPX] = {"AND", MODE_ZPX, 1},
+    [ROL_ZPX] = {"ROL", MODE_ZPX, 1},
+    [RLA_ZPX] = {"RLA", MODE_ZPX},
+    [SEC_IMPL] = {"SEC", MODE_IMPL, 1},
+    [AND_ABSY] = {"AND", MODE_ABSY, 1},
+    [0x3A] = {"NOP", MODE_IMPL},
+    [RLA_ABSY] = {"RLA", MODE_ABSY},
+    [0x3C] = {"NOP", MODE_ABSX},
+    [AND_ABSX] = {"AND", MODE_ABSX, 1},
+    [ROL_ABSX] = {"ROL", MODE_ABSX, 1},
+    [RLA_ABSX] = {"RLA", MODE_ABSX},
+    [RTI_IMPL] = {"RTI", MODE_IMPL, 1},
+    [EOR_INDX] = {"EOR", MODE_INDX, 1},
+    [0x42] = {"JAM", MODE_IMPL},
+    [SRE_INDX] = {"SRE", MODE_INDX},
+    [0x44] = {"NOP", MODE_ZP},
+    [EOR_ZP] = {"EOR", MODE_ZP, 1},
+    [LSR_ZP] = {"LSR", MODE_ZP, 1},
+    [SRE_ZP] = {"SRE", MODE_ZP},
+    [PHA_IMPL] = {"PHA", MODE_IMPL, 1},
+    [EOR_IM] = {"EOR", MODE_IM, 1},
+    [LSR_ACC] = {"LSR", MODE_ACC, 1},
+    [ALR_IM] = {"ALR", MODE_IM},
+    [JMP_ABS] = {"JMP", MODE_ABS, 1},
+    [EOR_ABS] = {"EOR", MODE_ABS, 1},
+    [LSR_ABS] = {"LSR", MODE_ABS, 1},
+    [SRE_ABS] = {"SRE", MODE_ABS},
+    [BVC_REL] = {"BVC", MODE_REL, 1},
+    [EOR_INDY] = {"EOR", MODE_INDY, 1},
+    [0x52] = {"JAM", MODE_IMPL},
+    [SRE_INDY] = {"SRE", MODE_INDY},
+    [0x54] = {"NOP", MODE_ZPX},
+    [EOR_ZPX] = {"EOR", MODE_ZPX, 1},
+    [LSR_ZPX] = {"LSR", MODE_ZPX, 1},
+    [SRE_ZPX] = {"SRE", MODE_ZPX},
+    [CLI_IMPL] = {"CLI", MODE_IMPL, 1},
+    [EOR_ABSY] = {"EOR", MODE_ABSY, 1},
+    [0x5A] = {"NOP", MODE_IMPL},
+    [SRE_ABSY] = {"SRE", MODE_ABSY},
+    [0x5C] = {"NOP", MODE_ABSX},
+    [EOR_ABSX] = {"EOR", MODE_ABSX, 1},
+    [LSR_ABSX] = {"LSR", MODE_ABSX, 1},
+    [SRE_ABSX] = {"SRE", MODE_ABSX},
+    [RTS_IMPL] = {"RTS", MODE_IMPL, 1},
+    [ADC_INDX] = {"ADC", MODE_INDX, 1},
+    [0x62] = {"JAM", MODE_IMPL},
+    [RRA_INDX] = {"RRA", MODE_INDX},
+    [0x64] = {"NOP", MODE_ZP},
+    [ADC_ZP] = {"ADC", MODE_ZP, 1},
+    [ROR_ZP] = {"ROR", MODE_ZP, 1},
+    [RRA_ZP] = {"RRA", MODE_ZP},
+    [PLA_IMPL] = {"PLA", MODE_IMPL, 1},
+    [ADC_IM] = {"ADC", MODE_IM, 1},
+    [ROR_ACC] = {"ROR", MODE_ACC, 1},
+    [ARR_IM] = {"ARR", MODE_IM},
+    [JMP_IND] = {"JMP", MODE_IND, 1},
+    [ADC_ABS] = {"ADC", MODE_ABS, 1},
+    [ROR_ABS] = {"ROR", MODE_ABS, 1},
+    [RRA_ABS] = {"RRA", MODE_ABS},
+    [BVS_REL] = {"BVS", MODE_REL, 1},
+    [ADC_INDY] = {"ADC", MODE_INDY, 1},
+    [0x72] = {"JAM", MODE_IMPL},
+    [RRA_INDY] = {"RRA", MODE_INDY},
+    [0x74] = {"NOP", MODE_ZPX},
+    [ADC_ZPX] = {"ADC", MODE_ZPX, 1},
+    [ROR_ZPX] = {"ROR", MODE_ZPX, 1},
+    [RRA_ZPX] = {"RRA", MODE_ZPX},
+    [SEI_IMPL] = {"SEI", MODE_IMPL, 1},
+    [ADC_ABSY] = {"ADC", MODE_ABSY, 1},
+    [0x7A] = {"NOP", MODE_IMPL},
+    [RRA_ABSY] = {"RRA", MODE_ABSY},
+    [0x7C] = {"NOP", MODE_ABSX},
+    [ADC_ABSX] = {"ADC", MODE_ABSX, 1},
+    [ROR_ABSX] = {"ROR", MODE_ABSX, 1},
+    [RRA_ABSX] = {"RRA", MODE_ABSX},
+    [0x80] = {"NOP", MODE_IM},
+    [STA_INDX] = {"STA", MODE_INDX, 1},
+    [0x82] = {"NOP", MODE_IM},
+    [SAX_INDX] = {"SAX", MODE_INDX},
+    [STY_ZP] = {"STY", MODE_ZP, 1},
+    [STA_ZP] = {"STA", MODE_ZP, 1},
+    [STX_ZP] = {"STX", MODE_ZP, 1},
+    [SAX_ZP] = {"SAX", MODE_ZP},
+    [DEY_IMPL] = {"DEY", MODE_IMPL, 1},
+    [0x89] = {"NOP", MODE_IM},
+    [TXA_IMPL] = {"TXA", MODE_IMPL, 1},
+    [ANE_IM] = {"ANE", MODE_IM},
+    [STY_ABS] = {"STY", MODE_ABS, 1},
+    [STA_ABS] = {"STA", MODE_ABS, 1},
+    [STX_ABS] = {"STX", MODE_ABS, 1},
+    [SAX_ABS] = {"SAX", MODE_ABS},
+    [BCC_REL] = {"BCC", MODE_REL, 1},
+    [STA_INDY] = {"STA", MODE_INDY, 1},
+    [0x92] = {"JAM", MODE_IMPL},
+    [SHA_INDY] = {"SHA", MODE_INDY},
+    [STY_ZPX] = {"STY", MODE_ZPX, 1},
+    [STA_ZPX] = {"STA", MODE_ZPX, 1},
+    [STX_ZPY] = {"STX", MODE_ZPY, 1},
+    [SAX_ZPY] = {"SAX", MODE_ZPY},
+    [TYA_IMPL] = {"TYA", MODE_IMPL, 1},
+    [STA_ABSY] = {"STA", MODE_ABSY, 1},
+    [TXS_IMPL] = {"TXS", MODE_IMPL, 1},
+    [TAS_ABSY] = {"TAS", MODE_ABSY},
+    [SHY_ABSX] = {"SHY", MODE_ABSX},
+    [STA_ABSX] = {"STA", MODE_ABSX, 1},
+    [SHX_ABSY] = {"SHX", MODE_ABSY},
+    [SHA_ABSY] = {"SHA", MODE_ABSY},
+    [LDY_IM] = {"LDY", MODE_IM, 1},
+    [LDA_INDX] = {"LDA", MODE_INDX, 1},
+    [LDX_IM] = {"LDX", MODE_IM, 1},
+    [LAX_INDX] = {"LAX", MODE_INDX},
+    [LDY_ZP] = {"LDY", MODE_ZP, 1},
+    [LDA_ZP] = {"LDA", MODE_ZP, 1},
+    [LDX_ZP] = {"LDX", MODE_ZP, 1},
+    [LAX_ZP] = {"LAX", MODE_ZP},
+    [TAY_IMPL] = {"TAY", MODE_IMPL, 1},
+    [LDA_IM] = {"LDA", MODE_IM, 1},
+    [TAX_IMPL] = {"TAX", MODE_IMPL, 1},
+    [LAX_IM] = {"LAX", MODE_IM},
+    [LDY_ABS] = {"LDY", MODE_ABS, 1},
+    [LDA_ABS] = {"LDA", MODE_ABS, 1},
+    [LDX_ABS] = {"LDX", MODE_ABS, 1},
+    [LAX_ABS] = {"LAX", MODE_ABS},
+    [BCS_REL] = {"BCS", MODE_REL, 1},
+    [LDA_INDY] = {"LDA", MODE_INDY, 1},
+    [0xB2] = {"JAM", MODE_IMPL},
+    [LAX_INDY] = {"LAX", MODE_INDY},
+    [LDY_ZPX] = {"LDY", MODE_ZPX, 1},
+    [LDA_ZPX] = {"LDA", MODE_ZPX, 1},
+    [LDX_ZPY] = {"LDX", MODE_ZPY, 1},
+    [LAX_ZPY] = {"LAX", MODE_ZPY},
+    [CLV_IMPL] = {"CLV", MODE_IMPL, 1},
+    [LDA_ABSY] = {"LDA", MODE_ABSY, 1},
+    [TSX_IMPL] = {"TSX", MODE_IMPL, 1},
+    [LAS_ABSY] = {"LAS", MODE_ABSY},
+    [LDY_ABSX] = {"LDY", MODE_ABSX, 1},
+    [LDA_ABSX] = {"LDA", MODE_ABSX, 1},
+    [LDX_ABSY] = {"LDX", MODE_ABSY, 1},
+    [LAX_ABSY] = {"LAX", MODE_ABSY},
+    [CPY_IM] = {"CPY", MODE_IM, 1},
+    [CMP_INDX] = {"CMP", MODE_INDX, 1},
+    [0xC2] = {"NOP", MODE_IM},
+    [DCP_INDX] = {"DCP", MODE_INDX},
+    [CPY_ZP] = {"CPY", MODE_ZP, 1},
+    [CMP_ZP] = {"CMP", MODE_ZP, 1},
+    [DEC_ZP] = {"DEC", MODE_ZP, 1},
+    [DCP_ZP] = {"DCP", MODE_ZP},
+    [INY_IMPL] = {"INY", MODE_IMPL, 1},
+    [CMP_IM] = {"CMP", MODE_IM, 1},
+    [DEX_IMPL] = {"DEX", MODE_IMPL, 1},
+    [SBX_IM] = {"SBX", MODE_IM},
+    [CPY_ABS] = {"CPY", MODE_ABS, 1},
+    [CMP_ABS] = {"CMP", MODE_ABS, 1},
+    [DEC_ABS] = {"DEC", MODE_ABS, 1},
+    [DCP_ABS] = {"DCP", MODE_ABS},
+    [BNE_REL] = {"BNE", MODE_REL, 1},
+    [CMP_INDY] = {"CMP", MODE_INDY, 1},
+    [0xD2] = {"JAM", MODE_IMPL},
+    [DCP_INDY] = {"DCP", MODE_INDY},
+    [0xD4] = {"NOP", MODE_ZPX},
+    [CMP_ZPX] = {"CMP", MODE_ZPX, 1},
+    [DEC_ZPX] = {"DEC", MODE_ZPX, 1},
+    [DCP_ZPX] = {"DCP", MODE_ZPX},
+    [CLD_IMPL] = {"CLD", MODE_IMPL, 1},
+    [CMP_ABSY] = {"CMP", MODE_ABSY, 1},
+    [0xDA] = {"NOP", MODE_IMPL},
+    [DCP_ABSY] = {"DCP", MODE_ABSY},
+    [0xDC] = {"NOP", MODE_ABSX},
+    [CMP_ABSX] = {"CMP", MODE_ABSX, 1},
+    [DEC_ABSX] = {"DEC", MODE_ABSX, 1},
+    [DCP_ABSX] = {"DCP", MODE_ABSX},
+    [CPX_IM] = {"CPX", MODE_IM, 1},
+    [SBC_INDX] = {"SBC", MODE_INDX, 1},
+    [0xE2] = {"NOP", MODE_IM},
+    [ISC_INDX] = {"ISC", MODE_INDX},
+    [CPX_ZP] = {"CPX", MODE_ZP, 1},
+    [SBC_ZP] = {"SBC", MODE_ZP, 1},
+    [INC_ZP] = {"INC", MODE_ZP, 1},
+    [ISC_ZP] = {"ISC", MODE_ZP},
+    [INX_IMPL] = {"INX", MODE_IMPL, 1},
+    [SBC_IM] = {"SBC", MODE_IM, 1},
+    [NOP_IMPL] = {"NOP", MODE_IMPL, 1},
+    [SBC_IM2] = {"SBC", MODE_IM},
+    [CPX_ABS] = {"CPX", MODE_ABS, 1},
+    [SBC_ABS] = {"SBC", MODE_ABS, 1},
+    [INC_ABS] = {"INC", MODE_ABS, 1},
+    [ISC_ABS] = {"ISC", MODE_ABS},
+    [BEQ_REL] = {"BEQ", MODE_REL, 1},
+    [SBC_INDY] = {"SBC", MODE_INDY, 1},
+    [0xF2] = {"JAM", MODE_IMPL},
+    [ISC_INDY] = {"ISC", MODE_INDY},
+    [0xF4] = {"NOP", MODE_ZPX},
+    [SBC_ZPX] = {"SBC", MODE_ZPX, 1},
+    [INC_ZPX] = {"INC", MODE_ZPX, 1},
+    [ISC_ZPX] = {"ISC", MODE_ZPX},
+    [SED_IMPL] = {"SED", MODE_IMPL, 1},
+    [SBC_ABSY] = {"SBC", MODE_ABSY, 1},
+    [0xFA] = {"NOP", MODE_IMPL},
+    [ISC_ABSY] = {"ISC", MODE_ABSY},
+    [0xFC] = {"NOP", MODE_ABSX},
+    [SBC_ABSX] = {"SBC", MODE_ABSX, 1},
+    [INC_ABSX] = {"INC", MODE_ABSX, 1},
+    [ISC_ABSX] = {"ISC", MODE_ABSX},
+};
+
+int disassemble(const Byte *mem, Word pc, char *out, size_t size) {
+    const OpInfo *op = &opinfo[mem[pc]];
+    Byte lo = mem[(Word)(pc + 1)], hi = mem[(Word)(pc + 2)];
+    Word abs = lo | hi << 8;
+    switch (op->mode) {
+        case MODE_ACC: snprintf(out, size, "%s A", op->name); break;
+        case MODE_IM: snprintf(out, size, "%s #$%02X", op->name, lo); break;
+        case MODE_ZP: snprintf(out, size, "%s $%02X", op->name, lo); break;
+        case MODE_ZPX: snprintf(out, size, "%s $%02X,X", op->name, lo); break;
+        case MODE_ZPY: snprintf(out, size, "%s $%02X,Y", op->name, lo); break;
+        case MODE_ABS: snprintf(out, size, "%s $%04X", op->name, abs); break;
+        case MODE_ABSX: snprintf(out, size, "%s $%04X,X", op->name, abs); break;
+        case MODE_ABSY: snprintf(out, size, "%s $%04X,Y", op->name, abs); break;
+        case MODE_IND: snprintf(out, size, "%s ($%04X)", op->name, abs); break;
+        case MODE_INDX: snprintf(out, size, "%s ($%02X,X)", op->name, lo); break;
+        case MODE_INDY: snprintf(out, size, "%s ($%02X),Y", op->name, lo); break;
+        case MODE_REL: snprintf(out, size, "%s $%04X", op->name, (Word)(pc + 2 + (int8_t)lo)); break;
+        default: snprintf(out, size, "%s", op->name); break;
+    }
+    return mode_bytes[op->mode];
+}
@@ -0,0 +1,26 @@
+#ifndef OPINFO_H
+#define OPINFO_H
+
+#include "6502.h"
+
+// what each opcode is, for tools that read 6502 code rather than run it
+
+typedef enum {
+    MODE_IMPL, MODE_ACC, MODE_IM, MODE_ZP, MODE_ZPX, MODE_ZPY, MODE_ABS,
+    MODE_ABSX, MODE_ABSY, MODE_IND, MODE_INDX, MODE_INDY, MODE_REL,
+} AddrMode;
+
+typedef struct {
+    const char *name;   // mnemonic
+    Byte mode;          // AddrMode
+    Byte documented;    // part of the NMOS instruction set proper
+} OpInfo;
+
+extern const OpInfo opinfo[256];
+extern const Byte mode_bytes[];     // instruction length per AddrMode
+
+// writes the instruction at pc as assembler ("LDA ($10),Y", branch targets
+// resolved) and returns its length in bytes
+int disassemble(const Byte *mem, Word pc, char *out, size_t size);
+
+#endif
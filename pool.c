@@ -0,0 +1,80 @@
+#define _DEFAULT_SOURCE
+#include "pool.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define HUGE_PAGE (2u << 20)
+
+// capacity instances in one mapping; -1 if it cannot be had
+int pool_init(Pool *p, int capacity, int flags) {
+    memset(p, 0, sizeof(*p));
+    if (capacity <= 0) return -1;
+    size_t bytes = (size_t)capacity * sizeof(PoolInstance);
+    size_t align = flags & POOL_HUGE_PAGES ? HUGE_PAGE : POOL_LINE;
+    size_t size = (bytes + align - 1) / align * align + align;
+    Byte *arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) return -1;
+    p->arena = arena;
+    p->arena_size = size;
+    Byte *start = (Byte *)(((uintptr_t)arena + align - 1) / align * align);
+#ifdef MADV_HUGEPAGE
+    if (flags & POOL_HUGE_PAGES) p->huge = madvise(start, size - (start - arena), MADV_HUGEPAGE) == 0;
+#endif
+    p->instances = (PoolInstance *)start;
+    p->capacity = capacity;
+    p->dirty_only = (flags & POOL_DIRTY_ONLY) != 0;
+    return 0;
+}
+
+void pool_free(Pool *p) {
+    if (p->arena) munmap(p->arena, p->arena_size);
+    memset(p, 0, sizeof(*p));
+}
+
+// a zeroed machine, NULL when the pool is used up
+CPU *pool_create(Pool *p) {
+    PoolInstance *in = p->free;
+    if (in != NULL) {
+        p->free = in->next_free;
+        p->recycled++;
+    } else if (p->fresh < p->capacity) {
+        in = &p->instances[p->fresh++];
+    } else {
+        return NULL;
+    }
+    in->next_free = NULL;
+    in->cpu.mem = &in->mem;
+    p->created++;
+    if (++p->live > p->peak) p->peak = p->live;
+    return &in->cpu;
+}
+
+static bool empty(const Byte *page) {
+    static const Byte zero[256];
+    return memcmp(page, zero, 256) == 0;
+}
+
+// puts a machine from pool_create() back, clean for the next one
+void pool_destroy(Pool *p, CPU *cpu) {
+    PoolInstance *in = (PoolInstance *)((Byte *)cpu - offsetof(PoolInstance, cpu));
+    Memory *mem = &in->mem;
+    for (int page = 0; page < 0x100; page++) {
+        Byte *data = &mem->Data[page << 8];
+        if (!mem->dirty[page] && !mem->touched[page] && (p->dirty_only || empty(data))) continue;
+        memset(data, 0, 256);
+        p->pages_zeroed++;
+    }
+    memset(mem->io, 0, sizeof(mem->io));
+    memset(mem->dirty, 0, sizeof(mem->dirty));
+    memset(mem->touched, 0, sizeof(mem->touched));
+#ifdef COVERAGE
+    memset(mem->executed, 0, sizeof(mem->executed));
+    memset(mem->accessed, 0, sizeof(mem->accessed));
+#endif
+    memset(&in->cpu, 0, sizeof(in->cpu));
+    in->next_free = p->free;
+    p->free = in;
+    p->live--;
+}
@@ -0,0 +1,64 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "6502.h"
+
+/*
+ * A pool of machines carved out of one anonymous mapping instead of a
+ * malloc() per CPU and Memory. Each instance starts on a cache line with
+ * its CPU, and its Memory starts on a line of its own, so the registers a
+ * run keeps hitting never share a line with guest memory. With
+ * POOL_HUGE_PAGES the arena is aligned to 2 MiB and the kernel is asked to
+ * back it with huge pages (pool.huge says whether it agreed), which keeps
+ * the TLB footprint of thousands of machines small.
+ *
+ * pool_create() hands out an instance in O(1) from a free list: a CPU
+ * zeroed but for cpu->mem, with memory all zero and nothing mapped or
+ * hooked. pool_destroy() puts it back, zeroing only the pages that are not
+ * zero any more (the ones mem->dirty or mem->touched marks, or that turn
+ * out not to be empty), so an instance that used a few pages costs a few
+ * pages to recycle. Instances never handed out are still as the kernel
+ * gave them. Save states, digests, the rewinder and the fuzzer clear the
+ * dirty flags with clean_page(), which keeps them in mem->touched, and a
+ * state load marks the pages it brings in there, so the pool still sees
+ * every page they changed.
+ *
+ * With POOL_DIRTY_ONLY the owner promises to mark every page it stores to
+ * itself, and pool_destroy() zeroes the marked pages without looking at
+ * the rest, for machines that are recycled after a few thousand cycles.
+ * It is not the default because hosts commonly copy images straight into
+ * mem->Data; without the promise pool_destroy() compares each unmarked
+ * page with zero, a 64 KiB read per recycle.
+ */
+
+#define POOL_HUGE_PAGES 1
+#define POOL_DIRTY_ONLY 2
+#define POOL_LINE 64
+
+typedef struct PoolInstance {
+    _Alignas(POOL_LINE) CPU cpu;
+    _Alignas(POOL_LINE) Memory mem;
+    struct PoolInstance *next_free;
+} PoolInstance;
+
+typedef struct {
+    PoolInstance *instances;
+    int capacity;
+    void *arena;
+    size_t arena_size;
+    int huge;                   // the kernel was asked for huge pages and agreed
+    int dirty_only;             // POOL_DIRTY_ONLY
+    PoolInstance *free;         // recycled instances, most recent first
+    int fresh;                  // instances from here on were never handed out
+
+    int live, peak;
+    u_int64_t created, recycled;
+    u_int64_t pages_zeroed;     // by pool_destroy(), over the pool's life
+} Pool;
+
+int pool_init(Pool *p, int capacity, int flags);
+void pool_free(Pool *p);
+CPU *pool_create(Pool *p);
+void pool_destroy(Pool *p, CPU *cpu);
+
+#endif
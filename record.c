@@ -0,0 +1,306 @@
+#include "record.h"
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+// record types, in the low two bits of the varint that starts a record
+enum { REC_READ, REC_INTERRUPT, REC_HOOK, REC_END };
+
+static const char magic[8] = "6502LOG1";
+
+static void flush(Recorder *r) {
+    for (size_t done = 0; done < r->len;) {
+        ssize_t n = write(r->fd, r->buffer + done, r->len - done);
+        if (n <= 0) {
+            r->error = 1;
+            break;
+        }
+        done += n;
+    }
+    r->len = 0;
+}
+
+static inline void put(Recorder *r, Byte b) {
+    if (r->len == RECORD_BUFFER) flush(r);
+    r->buffer[r->len++] = b;
+}
+
+static void put_varint(Recorder *r, u_int64_t v) {
+    for (; v >= 0x80; v >>= 7) put(r, v | 0x80);
+    put(r, v);
+}
+
+static void begin(Recorder *r, int type) {
+    u_int64_t now = r->cpu->cycles;
+    put_varint(r, (now - r->last) << 2 | type);
+    r->last = now;
+    r->records++;
+}
+
+static int get(Recorder *r) {
+    if (r->pos == r->len) {
+        ssize_t n = read(r->fd, r->buffer, RECORD_BUFFER);
+        if (n < 0) r->error = 1;
+        if (n <= 0) return -1;
+        r->len = n;
+        r->pos = 0;
+    }
+    return r->buffer[r->pos++];
+}
+
+static int get_varint(Recorder *r, u_int64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int b = get(r);
+        if (b < 0) return -1;
+        *v |= (u_int64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return 0;
+    }
+    return -1;
+}
+
+// decodes the type and cycle of the next record; a log cut short ends
+// where it stops. The run in progress is cut short where the next
+// interrupt is due, or the log ends.
+static void advance(Recorder *r) {
+    u_int64_t v;
+    if (get_varint(r, &v) != 0) {
+        r->next_type = REC_END;
+        r->next_cycle = r->last;
+    } else {
+        r->next_type = v & 3;
+        r->next_cycle = r->last + (v >> 2);
+        r->last = r->next_cycle;
+        r->records++;
+    }
+    bool stop = r->next_type == REC_INTERRUPT || r->next_type == REC_END;
+    if (stop && r->next_cycle < r->cpu->until) r->cpu->until = r->next_cycle;
+}
+
+// stops the run in progress after this instruction
+static void diverge(Recorder *r) {
+    r->diverged = 1;
+    r->cpu->until = r->cpu->cycles;
+}
+
+// the next record has to be of type and at this cycle
+static int expect(Recorder *r, int type) {
+    if (r->next_type == type && r->next_cycle == r->cpu->cycles) return 0;
+    diverge(r);
+    return -1;
+}
+
+static Byte tap_read(void *ctx, Word addr) {
+    Recorder *r = ctx;
+    if (r->replaying) {
+        int value = expect(r, REC_READ) == 0 ? get(r) : 0xFF;
+        if (value < 0) diverge(r);
+        if (!r->diverged) advance(r);
+        return value;
+    }
+    const PageHandler *dev = r->under[addr >> 8];
+    Byte value = dev->read(dev->ctx, addr);
+    if (!r->in_hook) {
+        begin(r, REC_READ);
+        put(r, value);
+    }
+    return value;
+}
+
+static void tap_write(void *ctx, Word addr, Byte value) {
+    Recorder *r = ctx;
+    if (r->replaying) return;
+    const PageHandler *dev = r->under[addr >> 8];
+    dev->write(dev->ctx, addr, value);
+}
+
+static void tap_interrupt(void *ctx, Word vector) {
+    Recorder *r = ctx;
+    begin(r, REC_INTERRUPT);
+    put(r, vector & 0xFF);
+}
+
+static Byte get_p(const CPU *cpu) {
+    return cpu->N << 7 | cpu->V << 6 | cpu->B << 4 | cpu->D << 3 | cpu->I << 2 | cpu->Z << 1 | cpu->C;
+}
+
+static void set_p(CPU *cpu, Byte p) {
+    cpu->N = p >> 7 & 1;
+    cpu->V = p >> 6 & 1;
+    cpu->B = p >> 4 & 1;
+    cpu->D = p >> 3 & 1;
+    cpu->I = p >> 2 & 1;
+    cpu->Z = p >> 1 & 1;
+    cpu->C = p & 1;
+}
+
+// reads a hook record's registers and pages, the pages into hook_data,
+// so that nothing is stored from a record cut short or out of range
+static int get_hook(Recorder *r, int regs[5], u_int64_t *pages) {
+    for (int i = 0; i < 5; i++) {
+        if ((regs[i] = get(r)) < 0) return -1;
+    }
+    if (get_varint(r, pages) != 0 || *pages > 0x100) return -1;
+    for (u_int64_t i = 0; i < *pages; i++) {
+        int page = get(r);
+        if (page < 0) return -1;
+        r->hook_page[i] = page;
+        for (int a = 0; a < 0x100; a++) {
+            int value = get(r);
+            if (value < 0) return -1;
+            r->hook_data[i][a] = value;
+        }
+    }
+    return 0;
+}
+
+// a hook's effect is the registers it leaves and the pages it stores to,
+// found by running it with the dirty flags cleared
+static void tap_hook(CPU *cpu, void *ctx) {
+    RecordedHook *h = ctx;
+    Recorder *r = h->r;
+    Memory *mem = cpu->mem;
+    if (r->replaying) {
+        if (expect(r, REC_HOOK) != 0) return;
+        int regs[5];
+        u_int64_t pages;
+        if (get_hook(r, regs, &pages) != 0) {
+            diverge(r);
+            return;
+        }
+        cpu->A = regs[0];
+        cpu->X = regs[1];
+        cpu->Y = regs[2];
+        cpu->SP = regs[3];
+        set_p(cpu, regs[4]);
+        for (u_int64_t i = 0; i < pages; i++) {
+            memcpy(&mem->Data[r->hook_page[i] << 8], r->hook_data[i], 0x100);
+            mem->dirty[r->hook_page[i]] = 1;
+        }
+        advance(r);
+        return;
+    }
+    Byte dirty[0x100];
+    memcpy(dirty, mem->dirty, sizeof(dirty));
+    memset(mem->dirty, 0, sizeof(mem->dirty));
+    r->in_hook = 1;
+    h->fn(cpu, h->ctx);
+    r->in_hook = 0;
+    begin(r, REC_HOOK);
+    put(r, cpu->A);
+    put(r, cpu->X);
+    put(r, cpu->Y);
+    put(r, cpu->SP);
+    put(r, get_p(cpu));
+    int pages = 0;
+    for (int page = 0; page < 0x100; page++) pages += mem->dirty[page] != 0;
+    put_varint(r, pages);
+    for (int page = 0; page < 0x100; page++) {
+        if (!mem->dirty[page]) continue;
+        put(r, page);
+        for (int a = 0; a < 256; a++) put(r, mem->Data[page << 8 | a]);
+    }
+    for (int page = 0; page < 0x100; page++) mem->dirty[page] |= dirty[page];
+}
+
+// puts the log in front of every mapped page and every hook
+static void tap(Recorder *r, CPU *cpu, int fd, int replaying) {
+    memset(r, 0, sizeof(*r));
+    r->cpu = cpu;
+    r->fd = fd;
+    r->replaying = replaying;
+    r->last = cpu->cycles;
+    r->io = (PageHandler){ .read = tap_read, .write = tap_write, .ctx = r };
+    for (int page = IO_FIRST_PAGE; page < 0x100; page++) {
+        if (cpu->mem->io[page] == NULL) continue;
+        r->under[page] = cpu->mem->io[page];
+        cpu->mem->io[page] = &r->io;
+    }
+    Hooks *hooks = cpu->hooks;
+    for (int i = 0; hooks && i < hooks->count; i++) {
+        r->hook[i] = (RecordedHook){ r, hooks->hook[i].fn, hooks->hook[i].ctx };
+        hooks->hook[i].fn = tap_hook;
+        hooks->hook[i].ctx = &r->hook[i];
+    }
+}
+
+static void untap(Recorder *r) {
+    CPU *cpu = r->cpu;
+    for (int page = IO_FIRST_PAGE; page < 0x100; page++) {
+        if (cpu->mem->io[page] == &r->io) cpu->mem->io[page] = r->under[page];
+    }
+    Hooks *hooks = cpu->hooks;
+    for (int i = 0; hooks && i < hooks->count; i++) {
+        if (hooks->hook[i].fn != tap_hook) continue;
+        RecordedHook *h = hooks->hook[i].ctx;
+        hooks->hook[i].fn = h->fn;
+        hooks->hook[i].ctx = h->ctx;
+    }
+    if (cpu->interrupted == tap_interrupt) cpu->interrupted = NULL;
+}
+
+// logs to fd from here on
+int record_start(Recorder *r, CPU *cpu, int fd) {
+    tap(r, cpu, fd, 0);
+    cpu->interrupted = tap_interrupt;
+    cpu->interrupted_ctx = r;
+    for (size_t i = 0; i < sizeof(magic); i++) put(r, magic[i]);
+    for (int i = 0; i < 64; i += 8) put(r, cpu->cycles >> i);
+    return 0;
+}
+
+// replays the log on fd; the CPU and memory have to be as they were when
+// recording started. Returns -1 if fd does not hold a log starting here.
+int replay_start(Recorder *r, CPU *cpu, int fd) {
+    tap(r, cpu, fd, 1);
+    u_int64_t start = 0;
+    int ok = 1;
+    for (size_t i = 0; i < sizeof(magic); i++) ok &= get(r) == (Byte)magic[i];
+    for (int i = 0; i < 64; i += 8) start |= (u_int64_t)(Byte)get(r) << i;
+    if (!ok || start != cpu->cycles) {
+        untap(r);
+        return -1;
+    }
+    cpu->irq = 0;
+    advance(r);
+    return 0;
+}
+
+// runs the replay to until, taking the logged interrupts on the way
+RunResult replay_run(Recorder *r, u_int64_t until) {
+    CPU *cpu = r->cpu;
+    while (!r->diverged) {
+        if (r->next_type == REC_END && cpu->cycles >= r->next_cycle) return RUN_TRAP;
+        if (cpu->cycles >= until) return RUN_DEADLINE;
+        if (r->next_type == REC_INTERRUPT && r->next_cycle <= cpu->cycles) {
+            if (r->next_cycle < cpu->cycles) {
+                r->diverged = 1;
+                break;
+            }
+            int vector = get(r);
+            if (vector < 0) {
+                r->diverged = 1;
+                break;
+            }
+            advance(r);
+            cpu_interrupt(cpu, 0xFF00 | vector);
+            continue;
+        }
+        u_int64_t stop = until;
+        if ((r->next_type == REC_INTERRUPT || r->next_type == REC_END) && r->next_cycle < stop) stop = r->next_cycle;
+        RunResult result = cpu_run(cpu, stop);
+        if (result != RUN_DEADLINE) return result;
+    }
+    return RUN_TRAP;
+}
+
+// ends recording, writing out what is buffered, or replaying; returns -1
+// if the log could not be written or read
+int record_finish(Recorder *r) {
+    if (!r->replaying) {
+        begin(r, REC_END);
+        flush(r);
+    }
+    untap(r);
+    return r->error ? -1 : 0;
+}
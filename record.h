@@ -0,0 +1,68 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "6502.h"
+
+/*
+ * Deterministic record and replay. Everything that reaches the CPU from
+ * outside its own RAM goes in a log: the value of every device read, the
+ * cycle each interrupt was taken at, and what each native hook did (the
+ * registers it left and the pages it stored to). Replaying the log on the
+ * same image from the same state gives the same run, bit for bit, with
+ * the devices and hooks left out: reads are answered from the log, device
+ * writes go nowhere, hooks are not called and interrupts are taken where
+ * the log says. The replaying machine needs something mapped on the same
+ * pages, but what does not matter. replay_run() stops with RUN_TRAP at the
+ * cycle the recording finished at.
+ *
+ * The log is a stream of records, each the cycles since the previous one
+ * and its type in a varint followed by its payload, so a device read
+ * costs two or three bytes. It is buffered RECORD_BUFFER bytes at a time.
+ *
+ * Start recording or replaying once devices are mapped and hooks added.
+ * Memory the host changes directly, not through a device or a hook, is
+ * not in the log. A replay that reaches a record out of step with the run
+ * has diverged: it stops with RUN_TRAP and sets diverged.
+ */
+
+#ifndef RECORD_BUFFER
+#define RECORD_BUFFER 65536
+#endif
+
+typedef struct Recorder Recorder;
+
+typedef struct {
+    Recorder *r;
+    HookFn fn;
+    void *ctx;
+} RecordedHook;
+
+struct Recorder {
+    CPU *cpu;
+    int fd;
+    int replaying;
+    int diverged;
+    int error;                      // a write or read of the log failed
+    u_int64_t last;                 // cycle of the previous record
+    u_int64_t records;
+    const PageHandler *under[0x100];    // devices the log stands in for
+    PageHandler io;
+    RecordedHook hook[HOOKS_MAX];   // the hooks, as they were added
+    int in_hook;                    // a hook is running: its reads are its own
+
+    // replay: the next record, decoded up to its payload
+    int next_type;
+    u_int64_t next_cycle;
+    Byte hook_page[0x100];          // a hook's pages, read in full before
+    Byte hook_data[0x100][0x100];   // any is stored
+
+    Byte buffer[RECORD_BUFFER];
+    size_t len, pos;
+};
+
+int record_start(Recorder *r, CPU *cpu, int fd);
+int replay_start(Recorder *r, CPU *cpu, int fd);
+RunResult replay_run(Recorder *r, u_int64_t until);
+int record_finish(Recorder *r);
+
+#endif
@@ -0,0 +1,211 @@
+#include "rewind.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGE_COST 257   // bytes a saved page costs against the budget
+
+static Checkpoint *at(Rewinder *r, int i) {
+    return &r->checkpoint[(r->first + i) % REWIND_MAX];
+}
+
+static void drop_pages(Rewinder *r, Checkpoint *c) {
+    r->used -= (size_t)c->count * PAGE_COST;
+    free(c->pages);
+    c->pages = NULL;
+    c->count = 0;
+}
+
+static void drop_oldest(Rewinder *r) {
+    drop_pages(r, at(r, 0));
+    r->first = (r->first + 1) % REWIND_MAX;
+    r->count--;
+}
+
+static void start_checkpoint(Rewinder *r) {
+    if (r->count == REWIND_MAX) drop_oldest(r);
+    Checkpoint *c = at(r, r->count++);
+    c->cpu = *r->cpu;
+    c->pages = NULL;
+    c->count = 0;
+}
+
+// history starts over from here
+static void restart(Rewinder *r) {
+    while (r->count > 0) drop_oldest(r);
+    memcpy(r->shadow, r->cpu->mem->Data, sizeof(r->shadow));
+    clean_pages(r->cpu->mem);
+    start_checkpoint(r);
+}
+
+// the newest checkpoint keeps what the pages stored to since held then,
+// from the shadow, and a new one starts here
+static void checkpoint(Rewinder *r) {
+    Memory *mem = r->cpu->mem;
+    Checkpoint *last = at(r, r->count - 1);
+    int n = 0;
+    for (int page = 0; page < 0x100; page++) n += mem->dirty[page] != 0;
+    if (n > 0) {
+        last->pages = malloc((size_t)n * PAGE_COST);
+        if (last->pages == NULL) {
+            restart(r);
+            return;
+        }
+        for (int page = 0, i = 0; page < 0x100; page++) {
+            if (!mem->dirty[page]) continue;
+            memcpy(&last->pages[i * 256], &r->shadow[page << 8], 256);
+            memcpy(&r->shadow[page << 8], &mem->Data[page << 8], 256);
+            last->pages[n * 256 + i++] = page;
+            clean_page(mem, page);
+        }
+        last->count = n;
+        r->used += (size_t)n * PAGE_COST;
+    }
+    start_checkpoint(r);
+    while (r->used > r->budget && r->count > 1) drop_oldest(r);
+}
+
+// puts memory and the CPU back as they were at checkpoint k and forgets
+// the later ones; the CPU keeps what it is attached to
+static void restore(Rewinder *r, int k) {
+    CPU *cpu = r->cpu;
+    Memory *mem = cpu->mem;
+    for (int page = 0; page < 0x100; page++) {
+        if (!mem->dirty[page]) continue;
+        memcpy(&mem->Data[page << 8], &r->shadow[page << 8], 256);
+        clean_page(mem, page);
+    }
+    for (int i = r->count - 2; i >= k; i--) {
+        Checkpoint *c = at(r, i);
+        for (int j = 0; j < c->count; j++) {
+            int page = c->pages[c->count * 256 + j];
+            memcpy(&mem->Data[page << 8], &c->pages[j * 256], 256);
+            memcpy(&r->shadow[page << 8], &c->pages[j * 256], 256);
+        }
+        drop_pages(r, c);
+    }
+    r->count = k + 1;
+
+    CPU saved = at(r, k)->cpu;
+    saved.mem = cpu->mem;
+    saved.hooks = cpu->hooks;
+    saved.debug = cpu->debug;
+    saved.edges = cpu->edges;
+    saved.interrupted = cpu->interrupted;
+    saved.interrupted_ctx = cpu->interrupted_ctx;
+    saved.until = cpu->until;
+    *cpu = saved;
+}
+
+// the newest checkpoint at or before cycle, -1 if there is none
+static int find(Rewinder *r, u_int64_t cycle) {
+    int k = r->count - 1;
+    while (k >= 0 && at(r, k)->cpu.cycles > cycle) k--;
+    return k;
+}
+
+static RunResult run(Rewinder *r, u_int64_t until) {
+    return r->run ? r->run(r->run_ctx, until) : cpu_run(r->cpu, until);
+}
+
+// one instruction, not a fused pair
+static void step(Rewinder *r) {
+    r->cpu->debug->step = 1;
+    run(r, r->cpu->cycles + 1);
+    r->cpu->debug->step = 0;
+}
+
+// interval is in cycles, budget in bytes of saved pages; the shadow and
+// the checkpoints' registers come on top
+void rewind_init(Rewinder *r, CPU *cpu, u_int64_t interval, size_t budget) {
+    memset(r, 0, sizeof(*r));
+    r->cpu = cpu;
+    r->interval = interval ? interval : 1;
+    r->budget = budget;
+    restart(r);
+}
+
+void rewind_free(Rewinder *r) {
+    while (r->count > 0) drop_oldest(r);
+}
+
+/*
+ * Like cpu_run(), taking checkpoints on the way. The run is cut where a
+ * checkpoint is due; a breakpoint right at a cut still stops it.
+ */
+RunResult rewind_run(Rewinder *r, u_int64_t until) {
+    CPU *cpu = r->cpu;
+    for (bool first = true;; first = false) {
+        u_int64_t due = at(r, r->count - 1)->cpu.cycles + r->interval;
+        if (!first && breakpoint(cpu, cpu->PC)) return RUN_BREAKPOINT;
+        RunResult result = run(r, due < until ? due : until);
+        if (cpu->cycles >= due) checkpoint(r);
+        if (result != RUN_DEADLINE || cpu->cycles >= until) return result;
+    }
+}
+
+// how far back history goes
+u_int64_t rewind_oldest(const Rewinder *r) {
+    return r->checkpoint[r->first].cpu.cycles;
+}
+
+// goes back to the last instruction boundary at or before cycle; -1 if
+// cycle is still to come, or older than the history kept
+int rewind_to(Rewinder *r, u_int64_t cycle) {
+    CPU *cpu = r->cpu;
+    int k = find(r, cycle);
+    if (k < 0 || cycle > cpu->cycles) return -1;
+    bool own = cpu->debug == NULL;
+    if (own) debug_init(&r->own, cpu);
+    restore(r, k);
+    u_int64_t steps = 0;
+    for (; cpu->cycles < cycle; steps++) step(r);
+    if (cpu->cycles > cycle) {
+        restore(r, k);
+        for (; steps > 1; steps--) step(r);
+    }
+    if (own) debug_detach(&r->own);
+    return 0;
+}
+
+// back to the instruction before this one
+int rewind_step(Rewinder *r) {
+    return r->cpu->cycles ? rewind_to(r, r->cpu->cycles - 1) : -1;
+}
+
+/*
+ * Back to the last breakpoint or watchpoint hit before here, searching
+ * one checkpoint interval at a time from the newest. Returns the reason
+ * the machine stopped there, or RUN_DEADLINE with the machine at the
+ * oldest checkpoint when there was none.
+ */
+RunResult rewind_continue(Rewinder *r) {
+    CPU *cpu = r->cpu;
+    u_int64_t now = cpu->cycles, end = now;
+    int k = now ? find(r, now - 1) : -1;
+    if (k < 0) return RUN_DEADLINE;
+    for (; k >= 0; k--) {
+        restore(r, k);
+        int stops = 0;
+        RunResult last = RUN_DEADLINE, result;
+        while ((result = run(r, end)) == RUN_BREAKPOINT || result == RUN_WATCHPOINT) {
+            if (cpu->cycles >= end) break;
+            stops++;
+            last = result;
+        }
+        // a breakpoint at the start of the later interval, which the search
+        // there stepped over
+        if (end != now && cpu->cycles == end && breakpoint(cpu, cpu->PC)) {
+            stops++;
+            last = RUN_BREAKPOINT;
+        }
+        if (stops > 0) {
+            restore(r, k);
+            for (int i = 0; i < stops && run(r, end) != RUN_DEADLINE; i++) {}
+            return last;
+        }
+        end = at(r, k)->cpu.cycles;
+    }
+    restore(r, 0);
+    return RUN_DEADLINE;
+}
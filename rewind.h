@@ -0,0 +1,55 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "6502.h"
+
+/*
+ * Reverse execution. While the machine runs forward through rewind_run(),
+ * a checkpoint is taken every interval cycles: the CPU, plus what each
+ * page stored to since the previous checkpoint held at that checkpoint,
+ * found through mem->dirty and a shadow copy of memory as of the newest
+ * checkpoint. Going back restores the nearest checkpoint before the
+ * target and runs forward again, one instruction at a time where it has
+ * to land exactly; checkpoints after it are dropped and taken again as
+ * the machine moves forward.
+ *
+ * The oldest checkpoints are dropped once the saved pages use more than
+ * budget bytes, or there are more than REWIND_MAX of them, so history
+ * reaches back as far as the budget allows. Re-execution is only exact
+ * for what lives in the CPU and RAM: memory must change through the core
+ * (or mark its page dirty), and devices and hooks must behave the same
+ * every time they are run over.
+ */
+
+#ifndef REWIND_MAX
+#define REWIND_MAX 1024
+#endif
+
+typedef struct {
+    CPU cpu;
+    Byte *pages;    // what count pages held here, before the next checkpoint
+                    // stored to them, 256 bytes each, then their page numbers
+    int count;
+} Checkpoint;
+
+typedef struct {
+    CPU *cpu;
+    RunResult (*run)(void *ctx, u_int64_t until);   // cpu_run() when NULL
+    void *run_ctx;
+    u_int64_t interval;
+    size_t budget, used;
+    Checkpoint checkpoint[REWIND_MAX];  // a ring, oldest at first
+    int first, count;
+    Byte shadow[0x10000];   // memory at the newest checkpoint
+    Debugger own;           // to single step when no debugger is attached
+} Rewinder;
+
+void rewind_init(Rewinder *r, CPU *cpu, u_int64_t interval, size_t budget);
+void rewind_free(Rewinder *r);
+RunResult rewind_run(Rewinder *r, u_int64_t until);
+u_int64_t rewind_oldest(const Rewinder *r);
+int rewind_to(Rewinder *r, u_int64_t cycle);
+int rewind_step(Rewinder *r);
+RunResult rewind_continue(Rewinder *r);
+
+#endif
@@ -0,0 +1,101 @@
+#include "sched.h"
+#include <string.h>
+#include <stdbool.h>
+
+void sched_init(Scheduler *s, CPU *cpu) {
+    memset(s, 0, sizeof(*s));
+    s->cpu = cpu;
+    s->seq = 1;
+}
+
+static bool before(const Event *a, const Event *b) {
+    return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static void swap(Event *a, Event *b) {
+    Event t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static void sift_up(Scheduler *s, int i) {
+    while (i > 0 && before(&s->heap[i], &s->heap[(i - 1) / 2])) {
+        swap(&s->heap[i], &s->heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+}
+
+static void sift_down(Scheduler *s, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, min = i;
+        if (l < s->count && before(&s->heap[l], &s->heap[min])) min = l;
+        if (r < s->count && before(&s->heap[r], &s->heap[min])) min = r;
+        if (min == i) return;
+        swap(&s->heap[i], &s->heap[min]);
+        i = min;
+    }
+}
+
+static void remove_at(Scheduler *s, int i) {
+    s->heap[i] = s->heap[--s->count];
+    if (i < s->count) {
+        sift_up(s, i);
+        sift_down(s, i);
+    }
+}
+
+/*
+ * Queues fn(ctx, when) to run once the CPU reaches cycle when. Returns an
+ * id for sched_cancel(), or 0 if the queue is full.
+ */
+u_int64_t sched_add(Scheduler *s, u_int64_t when, EventFn fn, void *ctx) {
+    if (s->count == SCHED_MAX) return 0;
+    u_int64_t id = s->seq++;
+    int i = s->count++;
+    s->heap[i] = (Event){ .when = when, .seq = id, .fn = fn, .ctx = ctx };
+    sift_up(s, i);
+    // pull in the deadline of a cpu_run() in progress
+    if (s->cpu != NULL && when < s->cpu->until) s->cpu->until = when;
+    return id;
+}
+
+// drops a pending event, returns 0 if it already fired or was cancelled
+int sched_cancel(Scheduler *s, u_int64_t id) {
+    for (int i = 0; i < s->count; i++) {
+        if (s->heap[i].seq == id) {
+            remove_at(s, i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// cycle of the earliest pending event
+u_int64_t sched_next(Scheduler *s) {
+    return s->count ? s->heap[0].when : CYCLES_FOREVER;
+}
+
+// runs every event due at or before now, earliest first; events they add
+// that are also due run in the same call
+void sched_fire(Scheduler *s, u_int64_t now) {
+    while (s->count && s->heap[0].when <= now) {
+        Event e = s->heap[0];
+        remove_at(s, 0);
+        e.fn(e.ctx, e.when);
+    }
+}
+
+/*
+ * Runs the CPU to cycle until, stopping at each pending event to fire it.
+ * Returns RUN_TRAP if the CPU gets stuck with no event left to wake it.
+ */
+RunResult sched_run(Scheduler *s, u_int64_t until) {
+    CPU *cpu = s->cpu;
+    for (;;) {
+        sched_fire(s, cpu->cycles);
+        if (cpu->cycles >= until) return RUN_DEADLINE;
+        u_int64_t next = sched_next(s);
+        RunResult r = cpu_run(cpu, next < until ? next : until);
+        if (r != RUN_DEADLINE) return r;
+    }
+}
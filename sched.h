@@ -0,0 +1,44 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "6502.h"
+
+/*
+ * Cycle based event scheduler. Devices do not tick along with the CPU:
+ * they keep whatever state they can derive from cpu->cycles on access and
+ * register an event for the cycle at which something has to happen on its
+ * own (a timer underflow, an interrupt, a byte arriving). sched_run() runs
+ * the CPU uninterrupted up to the earliest event, fires every event that
+ * is due in cycle order, and carries on.
+ *
+ * Events at the same cycle fire in the order they were added. An event
+ * added while the CPU is running, from a device access, shortens the
+ * current cpu_run() if it is due before its deadline.
+ */
+
+#define SCHED_MAX 64
+
+typedef void (*EventFn)(void *ctx, u_int64_t when);
+
+typedef struct {
+    u_int64_t when;     // cycle the event is due
+    u_int64_t seq;      // insertion order, breaks ties and identifies it
+    EventFn fn;
+    void *ctx;
+} Event;
+
+typedef struct {
+    CPU *cpu;
+    Event heap[SCHED_MAX];  // min-heap on (when, seq)
+    int count;
+    u_int64_t seq;
+} Scheduler;
+
+void sched_init(Scheduler *s, CPU *cpu);
+u_int64_t sched_add(Scheduler *s, u_int64_t when, EventFn fn, void *ctx);
+int sched_cancel(Scheduler *s, u_int64_t id);
+u_int64_t sched_next(Scheduler *s);
+void sched_fire(Scheduler *s, u_int64_t now);
+RunResult sched_run(Scheduler *s, u_int64_t until);
+
+#endif
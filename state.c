@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 200809L
+#include "state.h"
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Layout, little endian:
+ *   "6502STAT", version, 0
+ *   PC(2) SP A X Y P opcodes irq edge_prev(2) cycles(8) writes(8) idle_cycles(8)
+ *   page count(2), then per page in ascending order:
+ *     page number, n, then n bytes of packed page, or 256 raw bytes if n is 0
+ *
+ * A packed page is a sequence of: c < 0x80, then c + 1 literal bytes; or
+ * c >= 0x80, then d, copying (c & 0x7F) + 3 bytes from d + 1 back, which
+ * may overlap what is being copied so runs of a byte cost two bytes.
+ */
+
+static const char magic[8] = "6502STAT";
+
+#define HEADER 47
+#define MATCH_MIN 3
+#define MATCH_MAX (0x7F + MATCH_MIN)
+#define LITERAL_MAX 0x80
+#define HASH_BITS 8
+
+static inline u_int32_t prefix(const Byte *p) {
+    return p[0] | p[1] << 8 | p[2] << 16;
+}
+
+static int match_length(const Byte *page, int from, int at) {
+    int n = MATCH_MIN;
+    while (at + n < 256 && n < MATCH_MAX && page[from + n] == page[at + n]) n++;
+    return n;
+}
+
+static int literals(Byte *out, int n, const Byte *from, int count) {
+    while (count > 0) {
+        int run = count < LITERAL_MAX ? count : LITERAL_MAX;
+        out[n++] = run - 1;
+        memcpy(&out[n], from, run);
+        n += run;
+        from += run;
+        count -= run;
+    }
+    return n;
+}
+
+// packs a page into out, which has room for 520 bytes; returns the packed
+// length, or 0 when packing does not make it smaller. Matches are looked
+// for at one byte back, for runs, and at the last place the same three
+// bytes were seen.
+static int pack(const Byte *page, Byte *out) {
+    short head[1 << HASH_BITS];
+    memset(head, 0xFF, sizeof(head));
+    int n = 0, pending = 0;
+    for (int i = 0; i + MATCH_MIN <= 256;) {
+        u_int32_t here = prefix(&page[i]);
+        unsigned h = (here * 2654435761u) >> (32 - HASH_BITS);
+        int from = head[h], best = 0, dist = 0;
+        head[h] = i;
+        if (i > 0 && prefix(&page[i - 1]) == here) {
+            best = match_length(page, i - 1, i);
+            dist = 1;
+        }
+        if (from >= 0 && best < MATCH_MAX && prefix(&page[from]) == here) {
+            int len = match_length(page, from, i);
+            if (len > best) {
+                best = len;
+                dist = i - from;
+            }
+        }
+        if (best == 0) {
+            i++;
+            continue;
+        }
+        n = literals(out, n, &page[pending], i - pending);
+        out[n++] = 0x80 | (best - MATCH_MIN);
+        out[n++] = dist - 1;
+        for (int j = i + 1; j < i + best && j + MATCH_MIN <= 256; j++) {
+            head[(prefix(&page[j]) * 2654435761u) >> (32 - HASH_BITS)] = j;
+        }
+        i += best;
+        pending = i;
+        if (n >= 256) return 0;
+    }
+    n = literals(out, n, &page[pending], 256 - pending);
+    return n < 256 ? n : 0;
+}
+
+static int unpack(const Byte *in, size_t len, Byte *page) {
+    size_t i = 0;
+    int at = 0;
+    while (i < len) {
+        Byte c = in[i++];
+        if (c < 0x80) {
+            int run = c + 1;
+            if (i + run > len || at + run > 256) return -1;
+            memcpy(&page[at], &in[i], run);
+            i += run;
+            at += run;
+            continue;
+        }
+        if (i == len) return -1;
+        int run = (c & 0x7F) + MATCH_MIN, dist = in[i++] + 1;
+        if (dist > at || at + run > 256) return -1;
+        if (dist == 1) {
+            memset(&page[at], page[at - 1], run);
+            at += run;
+            continue;
+        }
+        // eight at a time where the copy does not overlap within a word
+        if (dist >= 8) {
+            for (; run >= 8; run -= 8, at += 8) memcpy(&page[at], &page[at - dist], 8);
+        }
+        for (; run > 0; run--, at++) page[at] = page[at - dist];
+    }
+    return at == 256 ? 0 : -1;
+}
+
+typedef struct {
+    int fd;
+    int error;
+    size_t len;
+    Byte buffer[STATE_BUFFER];
+} Out;
+
+static void flush(Out *o) {
+    for (size_t done = 0; done < o->len;) {
+        ssize_t n = write(o->fd, o->buffer + done, o->len - done);
+        if (n <= 0) {
+            o->error = 1;
+            break;
+        }
+        done += n;
+    }
+    o->len = 0;
+}
+
+static void put(Out *o, const void *data, size_t len) {
+    const Byte *p = data;
+    while (len > 0) {
+        if (o->len == STATE_BUFFER) flush(o);
+        size_t n = STATE_BUFFER - o->len < len ? STATE_BUFFER - o->len : len;
+        memcpy(o->buffer + o->len, p, n);
+        o->len += n;
+        p += n;
+        len -= n;
+    }
+}
+
+static void put_le(Byte *at, u_int64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) at[i] = v >> (8 * i);
+}
+
+static u_int64_t get_le(const Byte *at, int bytes) {
+    u_int64_t v = 0;
+    for (int i = 0; i < bytes; i++) v |= (u_int64_t)at[i] << (8 * i);
+    return v;
+}
+
+static int empty(const Byte *page) {
+    static const Byte zero[256];
+    return memcmp(page, zero, 256) == 0;
+}
+
+int state_save(const CPU *cpu, int fd) {
+    Out o = { .fd = fd };
+    const Byte *data = cpu->mem->Data;
+    int pages = 0;
+    for (int page = 0; page < 0x100; page++) pages += !empty(&data[page << 8]);
+
+    Byte h[HEADER];
+    memcpy(h, magic, sizeof(magic));
+    h[8] = STATE_VERSION;
+    h[9] = 0;
+    put_le(&h[10], cpu->PC, 2);
+    h[12] = cpu->SP;
+    h[13] = cpu->A;
+    h[14] = cpu->X;
+    h[15] = cpu->Y;
+    h[16] = cpu->N << 7 | cpu->V << 6 | cpu->B << 4 | cpu->D << 3 | cpu->I << 2 | cpu->Z << 1 | cpu->C;
+    h[17] = cpu->opcodes;
+    h[18] = cpu->irq;
+    put_le(&h[19], cpu->edge_prev, 2);
+    put_le(&h[21], cpu->cycles, 8);
+    put_le(&h[29], cpu->writes, 8);
+    put_le(&h[37], cpu->idle_cycles, 8);
+    put_le(&h[45], pages, 2);
+    put(&o, h, sizeof(h));
+
+    Byte packed[520];
+    for (int page = 0; page < 0x100; page++) {
+        const Byte *p = &data[page << 8];
+        if (empty(p)) continue;
+        int n = pack(p, packed);
+        Byte tag[2] = { page, n };
+        put(&o, tag, 2);
+        put(&o, n ? packed : p, n ? (size_t)n : 256);
+    }
+    flush(&o);
+    return o.error ? -1 : 0;
+}
+
+int state_decode(CPU *cpu, const Byte *data, size_t len) {
+    if (len < HEADER || memcmp(data, magic, sizeof(magic)) != 0 || data[8] > STATE_VERSION) return -1;
+    Memory *mem = cpu->mem;
+    int pages = get_le(&data[45], 2), next = 0;
+    size_t at = HEADER;
+    for (int i = 0; i < pages; i++) {
+        if (at + 2 > len) return -1;
+        int page = data[at], n = data[at + 1];
+        at += 2;
+        if (page < next) return -1;
+        memset(&mem->Data[next << 8], 0, (page - next) << 8);
+        mem->touched[page] = 1;
+        if (n == 0) {
+            if (at + 256 > len) return -1;
+            memcpy(&mem->Data[page << 8], &data[at], 256);
+            at += 256;
+        } else {
+            if (at + n > len || unpack(&data[at], n, &mem->Data[page << 8]) != 0) return -1;
+            at += n;
+        }
+        next = page + 1;
+    }
+    if (at != len) return -1;
+    memset(&mem->Data[next << 8], 0, (0x100 - next) << 8);
+    clean_pages(mem);
+
+    cpu->PC = get_le(&data[10], 2);
+    cpu->SP = data[12];
+    cpu->A = data[13];
+    cpu->X = data[14];
+    cpu->Y = data[15];
+    Byte p = data[16];
+    cpu->N = p >> 7 & 1;
+    cpu->V = p >> 6 & 1;
+    cpu->B = p >> 4 & 1;
+    cpu->D = p >> 3 & 1;
+    cpu->I = p >> 2 & 1;
+    cpu->Z = p >> 1 & 1;
+    cpu->C = p & 1;
+    cpu->opcodes = data[17];
+    cpu->irq = data[18];
+    cpu->edge_prev = get_le(&data[19], 2);
+    cpu->cycles = get_le(&data[21], 8);
+    cpu->writes = get_le(&data[29], 8);
+    cpu->idle_cycles = get_le(&data[37], 8);
+    return 0;
+}
+
+int state_load(CPU *cpu, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < HEADER) return -1;
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return -1;
+    int result = state_decode(cpu, map, st.st_size);
+    munmap(map, st.st_size);
+    return result;
+}
@@ -0,0 +1,36 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include "6502.h"
+
+/*
+ * Save states. A state is the CPU's registers and counters and the pages
+ * of memory that are not all zero, each compressed on its own with a small
+ * LZ codec (literal runs and back references within the page) or stored
+ * as is where that does not make it smaller. A typical image with some
+ * code and a lot of empty space comes to a few KiB.
+ *
+ * state_save() streams the state to fd through a STATE_BUFFER byte
+ * buffer. state_load() maps fd and decodes straight into memory, writing
+ * each byte of Data once, which is less work than init_mem() and copying
+ * an image in; state_decode() does the same from a state already in
+ * memory, so one mapping can load any number of machines. Device mappings,
+ * hooks and the rest of what the CPU is attached to stay as they are, and
+ * mem->dirty is cleared.
+ *
+ * A state that is truncated, malformed or from a newer STATE_VERSION is
+ * refused with -1; memory may be partly loaded by then, the registers are
+ * not touched.
+ */
+
+#define STATE_VERSION 1
+
+#ifndef STATE_BUFFER
+#define STATE_BUFFER 16384
+#endif
+
+int state_save(const CPU *cpu, int fd);
+int state_load(CPU *cpu, int fd);
+int state_decode(CPU *cpu, const Byte *data, size_t len);
+
+#endif
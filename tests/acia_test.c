@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../acia.h"
+#include "check.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Checks the console ACIA: output reaches the host in one write per
+ * buffer, input comes from a preloaded buffer or a non-blocking pipe
+ * without a syscall per poll, and receive interrupts wake an idle guest.
+ */
+
+#define PAGE 0x70
+
+static CPU cpu;
+static Memory mem;
+static Scheduler s;
+static Acia acia;
+static int out[2];
+
+static void setup(const Byte *code, size_t size) {
+    machine(&cpu, &mem, code, size, 0x0400);
+    cpu.I = 1;
+    sched_init(&s, &cpu);
+    check(pipe(out) == 0, "pipe");
+    check(acia_init(&acia, &s, PAGE, 2, out[1]) == 0, "map the ACIA");
+}
+
+// what the guest sent, once flushed
+static size_t output(char *buf, size_t size) {
+    close(out[1]);
+    size_t len = 0;
+    ssize_t n;
+    while ((n = read(out[0], buf + len, size - len)) > 0) len += n;
+    close(out[0]);
+    return len;
+}
+
+static void print(void) {
+    static const Byte code[] = {
+        0xA0, 0x04,             // 0400 LDY #4
+        0xA2, 0x00,             // 0402 LDX #0
+        0xBD, 0x00, 0x10,       // 0404 LDA $1000,X
+        0x8D, 0x00, 0x70,       // 0407 STA $7000
+        0xE8,                   // 040A INX
+        0xD0, 0xF7,             // 040B BNE $0404
+        0x88,                   // 040D DEY
+        0xD0, 0xF2,             // 040E BNE $0402
+        0x4C, 0x10, 0x04,       // 0410 JMP $0410
+    };
+    setup(code, sizeof(code));
+    for (int i = 0; i < 256; i++) mem.Data[0x1000 + i] = 'a' + i % 26;
+
+    sched_run(&s, 50000);
+    check(acia.writes == 0, "output held while the buffer has room");
+    acia_flush(&acia);
+    check(acia.writes == 1, "1024 bytes in one write");
+    char buf[2048];
+    size_t len = output(buf, sizeof(buf));
+    check(len == 1024 && buf[0] == 'a' && buf[1023] == 'a' + 255 % 26, "output intact");
+
+    // a lone byte goes out on its own after ACIA_FLUSH_CYCLES
+    setup(code, sizeof(code));
+    mem.Data[0x0401] = 0x01;
+    mem.Data[0x0403] = 0xFF;
+    sched_run(&s, ACIA_FLUSH_CYCLES / 2);
+    check(acia.writes == 0, "no write before the flush is due");
+    sched_run(&s, 2 * ACIA_FLUSH_CYCLES);
+    check(acia.writes == 1 && output(buf, sizeof(buf)) == 1, "timed flush");
+}
+
+static const Byte echo[] = {
+    0xAD, 0x01, 0x70,       // 0400 LDA $7001
+    0x29, 0x08,             // 0403 AND #$08
+    0xF0, 0xF9,             // 0405 BEQ $0400
+    0xAD, 0x00, 0x70,       // 0407 LDA $7000
+    0x8D, 0x00, 0x70,       // 040A STA $7000
+    0x4C, 0x00, 0x04,       // 040D JMP $0400
+};
+
+static void polled(void) {
+    char buf[64];
+    setup(echo, sizeof(echo));
+    acia_input_buffer(&acia, (const Byte *)"hello\n", 6);
+    sched_run(&s, 10000);
+    acia_flush(&acia);
+    check(acia_input_done(&acia), "preloaded input consumed");
+    check(acia.reads == 0, "preloaded input needs no syscalls");
+    check(output(buf, sizeof(buf)) == 6 && memcmp(buf, "hello\n", 6) == 0, "preloaded echo");
+
+    int in[2];
+    check(pipe(in) == 0, "pipe");
+    setup(echo, sizeof(echo));
+    acia_input_fd(&acia, in[0]);
+    check(!(fcntl(in[0], F_GETFL) & O_NONBLOCK), "the fd is left blocking");
+    check(write(in[1], "abc", 3) == 3, "feed the pipe");
+    sched_run(&s, 100 * ACIA_POLL_CYCLES);
+    check(acia.reads <= 101, "at most one read per poll interval");
+    check(!acia_input_done(&acia), "open pipe is not done");
+    close(in[1]);
+    sched_run(&s, 102 * ACIA_POLL_CYCLES);
+    check(acia_input_done(&acia), "closed pipe is done");
+    acia_flush(&acia);
+    check(output(buf, sizeof(buf)) == 3 && memcmp(buf, "abc", 3) == 0, "echo from a pipe");
+    close(in[0]);
+}
+
+static void interrupts(void) {
+    static const Byte code[] = {
+        0xA9, 0x01,             // 0400 LDA #$01        DTR, receive IRQ on
+        0x8D, 0x02, 0x70,       // 0402 STA $7002
+        0x58,                   // 0405 CLI
+        0x4C, 0x06, 0x04,       // 0406 JMP $0406
+    };
+    static const Byte handler[] = {
+        0xAD, 0x00, 0x70,       // 0500 LDA $7000
+        0x8D, 0x00, 0x70,       // 0503 STA $7000
+        0x40,                   // 0506 RTI
+    };
+    char buf[64];
+    int in[2];
+    check(pipe(in) == 0, "pipe");
+    setup(code, sizeof(code));
+    memcpy(&mem.Data[0x0500], handler, sizeof(handler));
+    mem.Data[0xFFFE] = 0x00;
+    mem.Data[0xFFFF] = 0x05;
+    acia_input_fd(&acia, in[0]);
+
+    sched_run(&s, 5 * ACIA_POLL_CYCLES);
+    check(write(in[1], "irq!", 4) == 4, "feed the pipe");
+    sched_run(&s, 10 * ACIA_POLL_CYCLES);
+    acia_flush(&acia);
+    check(output(buf, sizeof(buf)) == 4 && memcmp(buf, "irq!", 4) == 0, "echo from the IRQ handler");
+    check(cpu.PC == 0x0406 && cpu.SP == 0xFF, "back in the idle loop");
+#ifndef NO_IDLE_SKIP
+    check(cpu.idle_cycles > 8 * ACIA_POLL_CYCLES, "idle between polls");
+#endif
+    close(in[0]);
+    close(in[1]);
+}
+
+int main(void) {
+    print();
+    polled();
+    interrupts();
+    if (!failed) printf("acia  : ok\n");
+    return failed;
+}
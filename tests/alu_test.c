@@ -0,0 +1,200 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../6502.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Exhaustive check of the ALU helpers against an independent reference
+ * model. Every op is swept over decimal x carry x register x operand,
+ * which is 2^18 cases (2^17 per decimal setting).
+ *
+ * Case index layout : D << 17 | C << 16 | register << 8 | operand
+ * Result layout     : result byte | P << 8
+ *
+ * The reference loops are branch free so the compiler vectorizes them,
+ * the helpers themselves are driven one case at a time.
+ *
+ * Decimal mode follows the NMOS part: ADC takes Z from the binary sum and
+ * N/V from the sum before the high nibble is adjusted, SBC takes every flag
+ * from the binary difference. The decimal reference is written from the
+ * step by step description on 6502.org rather than the core's formulas.
+ */
+
+#define CASES (1 << 18)
+
+#define FLAG_C 0x01
+#define FLAG_Z 0x02
+#define FLAG_I 0x04
+#define FLAG_D 0x08
+#define FLAG_V 0x40
+#define FLAG_N 0x80
+
+static u_int16_t ref[CASES];
+static u_int16_t got[CASES];
+
+// flags that are not an output of the op are seeded from the case index so
+// that both values are checked for being preserved
+static inline u_int32_t seed_v(u_int32_t i) {
+    return (i ^ (i >> 9)) & 1;
+}
+
+static inline u_int32_t pack(u_int32_t r, u_int32_t c, u_int32_t v, u_int32_t d) {
+    r &= 0xFF;
+    return r | (c | (r == 0) << 1 | FLAG_I | d << 3 | v << 6 | (r & 0x80)) << 8;
+}
+
+static void ref_adc(void) {
+    for (u_int32_t i = 0; i < CASES; i++) {
+        u_int32_t a = (i >> 8) & 0xFF, m = i & 0xFF, c = (i >> 16) & 1, d = i >> 17;
+        u_int32_t r = a + m + c;
+        u_int32_t v = ((a ^ r) & (m ^ r) & 0x80) >> 7;
+        u_int32_t bin = pack(r, r >> 8, v, d);
+
+        int32_t al = (a & 0x0F) + (m & 0x0F) + c;
+        al = al >= 0x0A ? ((al + 0x06) & 0x0F) + 0x10 : al;
+        int32_t s = (int32_t)(int8_t)(a & 0xF0) + (int32_t)(int8_t)(m & 0xF0) + al;
+        u_int32_t sv = s < -128 || s > 127;
+        int32_t u = (a & 0xF0) + (m & 0xF0) + al;
+        u = u >= 0xA0 ? u + 0x60 : u;
+        u_int32_t dec = (u & 0xFF) | ((u >= 0x100) | (bin >> 8 & FLAG_Z) | FLAG_I | FLAG_D | sv << 6 | (s & 0x80)) << 8;
+
+        ref[i] = d ? dec : bin;
+    }
+}
+
+static void ref_sbc(void) {
+    for (u_int32_t i = 0; i < CASES; i++) {
+        u_int32_t a = (i >> 8) & 0xFF, m = ~i & 0xFF, c = (i >> 16) & 1, d = i >> 17;
+        u_int32_t r = a + m + c;
+        u_int32_t v = ((a ^ r) & (m ^ r) & 0x80) >> 7;
+        u_int32_t bin = pack(r, r >> 8, v, d);
+
+        u_int32_t b = i & 0xFF;
+        int32_t al = (int32_t)(a & 0x0F) - (int32_t)(b & 0x0F) + (int32_t)c - 1;
+        al = al < 0 ? ((al - 0x06) & 0x0F) - 0x10 : al;
+        int32_t s = (int32_t)(a & 0xF0) - (int32_t)(b & 0xF0) + al;
+        s = s < 0 ? s - 0x60 : s;
+
+        ref[i] = d ? ((bin & 0xFF00) | (s & 0xFF)) : bin;
+    }
+}
+
+// CMP, CPX and CPY share the model, result byte is the untouched register
+static void ref_cmp(void) {
+    for (u_int32_t i = 0; i < CASES; i++) {
+        u_int32_t a = (i >> 8) & 0xFF, m = ~i & 0xFF, d = i >> 17;
+        u_int32_t r = a + m + 1;
+        ref[i] = (pack(r, r >> 8, seed_v(i), d) & 0xFF00) | a;
+    }
+}
+
+static void ref_asl(void) {
+    for (u_int32_t i = 0; i < CASES; i++) {
+        u_int32_t m = i & 0xFF, d = i >> 17;
+        ref[i] = pack(m << 1, m >> 7, seed_v(i), d);
+    }
+}
+
+static void ref_rol(void) {
+    for (u_int32_t i = 0; i < CASES; i++) {
+        u_int32_t m = i & 0xFF, c = (i >> 16) & 1, d = i >> 17;
+        ref[i] = pack(m << 1 | c, m >> 7, seed_v(i), d);
+    }
+}
+
+static void ref_ror(void) {
+    for (u_int32_t i = 0; i < CASES; i++) {
+        u_int32_t m = i & 0xFF, c = (i >> 16) & 1, d = i >> 17;
+        ref[i] = pack(m >> 1 | c << 7, m & 1, seed_v(i), d);
+    }
+}
+
+static void ref_lsr(void) {
+    for (u_int32_t i = 0; i < CASES; i++) {
+        u_int32_t m = i & 0xFF, d = i >> 17;
+        ref[i] = pack(m >> 1, m & 1, seed_v(i), d);
+    }
+}
+
+enum { OP_ADC, OP_SBC, OP_CMP, OP_CPX, OP_CPY, OP_ASL, OP_ROL, OP_ROR, OP_LSR };
+
+static const struct {
+    const char *name;
+    void (*ref)(void);
+} ops[] = {
+    [OP_ADC] = { "adc", ref_adc },
+    [OP_SBC] = { "sbc", ref_sbc },
+    [OP_CMP] = { "cmp", ref_cmp },
+    [OP_CPX] = { "cpx", ref_cmp },
+    [OP_CPY] = { "cpy", ref_cmp },
+    [OP_ASL] = { "asl", ref_asl },
+    [OP_ROL] = { "rol", ref_rol },
+    [OP_ROR] = { "ror", ref_ror },
+    [OP_LSR] = { "lsr", ref_lsr },
+};
+
+static void run_core(int op) {
+    CPU c;
+    for (u_int32_t i = 0; i < CASES; i++) {
+        Byte reg = (i >> 8) & 0xFF, m = i & 0xFF;
+        memset(&c, 0, sizeof(c));
+        c.A = c.X = c.Y = reg;
+        c.C = (i >> 16) & 1;
+        c.D = i >> 17;
+        c.I = 1;
+        c.V = seed_v(i);
+
+        Byte r;
+        switch (op) {
+            case OP_ADC: adc(&c, m); r = c.A; break;
+            case OP_SBC: sbc(&c, m); r = c.A; break;
+            case OP_CMP: cmp(&c, m); r = c.A; break;
+            case OP_CPX: cpx(&c, m); r = c.X; break;
+            case OP_CPY: cpy(&c, m); r = c.Y; break;
+            case OP_ASL: r = asl(&c, m); break;
+            case OP_ROL: r = rol(&c, m); break;
+            case OP_ROR: r = ror(&c, m); break;
+            default:     r = lsr(&c, m); break;
+        }
+        Byte p = c.C | c.Z << 1 | c.I << 2 | c.D << 3 | c.V << 6 | c.N << 7;
+        got[i] = r | p << 8;
+    }
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(void) {
+    int failed = 0;
+    double t0 = now();
+
+    for (size_t op = 0; op < sizeof(ops) / sizeof(ops[0]); op++) {
+        ops[op].ref();
+        run_core(op);
+
+        u_int32_t bad = 0;
+        for (u_int32_t i = 0; i < CASES; i++) {
+            bad += ref[i] != got[i];
+        }
+        if (bad == 0) {
+            printf("%s : ok\n", ops[op].name);
+            continue;
+        }
+        failed = 1;
+        printf("%s : %u mismatches\n", ops[op].name, bad);
+        for (u_int32_t i = 0, shown = 0; i < CASES && shown < 4; i++) {
+            if (ref[i] == got[i]) continue;
+            printf("    D=%u C=%u reg=0x%02X m=0x%02X : expected %02X P=%02X, got %02X P=%02X\n",
+                   i >> 17, (i >> 16) & 1, (i >> 8) & 0xFF, i & 0xFF,
+                   ref[i] & 0xFF, ref[i] >> 8, got[i] & 0xFF, got[i] >> 8);
+            shown++;
+        }
+    }
+
+    printf("%zu ops x %d cases in %.1f ms\n", sizeof(ops) / sizeof(ops[0]), CASES, (now() - t0) * 1e3);
+    return failed;
+}
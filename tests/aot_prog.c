@@ -0,0 +1,246 @@
+#include "../6502.h"
+#include "../opcodes.h"
+#include "../opinfo.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Writes the image aot_test runs compiled and interpreted: a main loop at
+ * $1000 calling ROUTINES generated routines, each a random mix of every
+ * documented instruction and addressing mode, forward branches, counted
+ * loops, calls to later routines, stack pairs, decimal arithmetic, and the
+ * things compiled code hands to the interpreter: BRK (the handler is an
+ * RTI), JMP (ind), undocumented opcodes and a branch to itself. Stores only
+ * go to $00-$BF and $0300-$05FF so the code never changes.
+ *
+ *   $00-$BF   data           $0200-$02FF   JMP (ind) vectors
+ *   $C0       loop counter   $0300-$05FF   data
+ *   $DF       main counter   $0600-$0FFF   read-only data, BRK handler
+ *   $E0-$FD   pointers       $1000-        code
+ */
+
+#define ROUTINES 12
+#define REPEAT 20
+#define SEGMENTS 30
+#define MAIN 0x1000
+#define HANDLER 0x0FF0
+#define COUNTER 0xC0
+
+static Byte mem[0x10000];
+static Word pc;
+static Word vectors = 0x0200;
+static u_int32_t seed = 6502;
+
+static unsigned rnd(unsigned n) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed % n;
+}
+
+static void b(Byte v) { mem[pc++] = v; }
+static void w(Word v) { b(v & 0xFF); b(v >> 8); }
+
+static int named(Byte op, const char *const *names) {
+    for (; *names != NULL; names++) {
+        if (strcmp(opinfo[op].name, *names) == 0) return 1;
+    }
+    return 0;
+}
+
+// a random documented opcode with one of the names
+static Byte pick(const char *const *names) {
+    for (;;) {
+        Byte op = rnd(256);
+        if (opinfo[op].documented && named(op, names)) return op;
+    }
+}
+
+static const char *const reads[] = {"LDA", "LDX", "LDY", "ADC", "SBC", "AND", "ORA", "EOR",
+                                    "CMP", "CPX", "CPY", "BIT", NULL};
+static const char *const writes[] = {"STA", "STX", "STY", "ASL", "LSR", "ROL", "ROR", "INC", "DEC", NULL};
+static const char *const implied[] = {"TAX", "TAY", "TXA", "TYA", "TSX", "INX", "INY", "DEX", "DEY",
+                                      "CLC", "SEC", "CLV", "NOP", NULL};
+static const char *const decimal[] = {"ADC", "SBC", NULL};
+
+static Byte pointer(void) {
+    return 0xE0 + 2 * rnd(15);
+}
+
+static void read_op(const char *const *names) {
+    Byte op = pick(names);
+    b(op);
+    switch (opinfo[op].mode) {
+        case MODE_IM: case MODE_ZP: case MODE_ZPX: case MODE_ZPY: case MODE_INDX: b(rnd(256)); break;
+        case MODE_ABS: case MODE_ABSX: case MODE_ABSY: w(rnd(0x1000)); break;
+        case MODE_INDY: b(pointer()); break;
+    }
+}
+
+// zero page indexed and (zp,X) stores load their index first so they land
+// in the data areas
+static void write_op(void) {
+    Byte op = pick(writes);
+    Byte mode = opinfo[op].mode;
+    Byte index = rnd(256);
+    if (mode == MODE_ZPX || mode == MODE_INDX) {
+        b(LDX_IM);
+        b(index);
+    } else if (mode == MODE_ZPY) {
+        b(LDY_IM);
+        b(index);
+    }
+    b(op);
+    switch (mode) {
+        case MODE_ZP: b(rnd(0xC0)); break;
+        case MODE_ZPX: case MODE_ZPY: b(rnd(0xC0) - index); break;
+        case MODE_ABS: w(0x0300 + rnd(0x300)); break;
+        case MODE_ABSX: case MODE_ABSY: w(0x0300 + rnd(0x200)); break;
+        case MODE_INDX: b(pointer() - index); break;
+        case MODE_INDY: b(pointer()); break;
+    }
+}
+
+static void simple_op(void) {
+    unsigned r = rnd(100);
+    if (r < 45) read_op(reads);
+    else if (r < 75) write_op();
+    else b(pick(implied));
+}
+
+static void simple_ops(int n) {
+    while (n-- > 0) simple_op();
+}
+
+// patches the branch at at to land on pc
+static void land(Word at) {
+    mem[at + 1] = pc - (at + 2);
+}
+
+static void routine(int i, const Word *entry) {
+    int calls = 0;
+    for (int s = 0; s < SEGMENTS; s++) {
+        unsigned r = rnd(100);
+        if (r < 50) {
+            simple_op();
+        } else if (r < 60) {
+            Word at = pc;
+            b(BPL_REL + 0x20 * rnd(8));
+            b(0);
+            simple_ops(1 + rnd(4));
+            land(at);
+        } else if (r < 68) {
+            b(LDA_IM);
+            b(1 + rnd(5));
+            b(STA_ZP);
+            b(COUNTER);
+            Word loop = pc;
+            simple_ops(2 + rnd(5));
+            b(DEC_ZP);
+            b(COUNTER);
+            b(BNE_REL);
+            b(loop - (pc + 1));
+        } else if (r < 73) {
+            b(PHA_IMPL);
+            simple_ops(1 + rnd(3));
+            b(PLA_IMPL);
+        } else if (r < 77) {
+            b(PHP_IMPL);
+            simple_ops(1 + rnd(3));
+            b(PLP_IMPL);
+        } else if (r < 81) {
+            if (i + 1 < ROUTINES && calls < 2) {
+                int j = i + 1 + rnd(ROUTINES - 1 - i < 3 ? ROUTINES - 1 - i : 3);
+                b(JSR_ABS);
+                w(entry[j]);
+                calls++;
+            }
+        } else if (r < 83) {
+            b(JMP_IND);
+            w(vectors);
+            mem[vectors] = pc & 0xFF;
+            mem[vectors + 1] = pc >> 8;
+            vectors += 2;
+        } else if (r < 85) {
+            b(BRK_IMPL);
+            b(rnd(256));
+        } else if (r < 87) {
+            b(rnd(2) ? LAX_ZP : LAX_ABSY);
+            if (mem[pc - 1] == LAX_ZP) b(rnd(256));
+            else w(rnd(0x1000));
+        } else if (r < 89) {
+            Word at = pc;
+            b(JMP_ABS);
+            w(0);
+            for (int n = 1 + rnd(3); n > 0; n--) b(rnd(256));
+            mem[at + 1] = pc & 0xFF;
+            mem[at + 2] = pc >> 8;
+        } else if (r < 90) {
+            b(CLC_IMPL);
+            b(BCS_REL);
+            b(0xFE);
+        } else if (r < 94) {
+            b(SED_IMPL);
+            for (int n = 1 + rnd(3); n > 0; n--) read_op(decimal);
+            b(CLD_IMPL);
+        } else {
+            simple_op();
+        }
+    }
+    b(RTS_IMPL);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s out.bin\n", argv[0]);
+        return 1;
+    }
+    for (int i = 0; i < 0x1000; i++) mem[i] = rnd(256);
+    for (Byte p = 0xE0; p < 0xFE; p += 2) {
+        mem[p] = rnd(256);
+        mem[p + 1] = 0x03;
+    }
+    mem[HANDLER] = RTI_IMPL;
+    mem[0xFFFE] = HANDLER & 0xFF;
+    mem[0xFFFF] = HANDLER >> 8;
+    mem[0xFFFC] = MAIN & 0xFF;
+    mem[0xFFFD] = MAIN >> 8;
+
+    // callees first so every JSR knows where it goes
+    Word entry[ROUTINES];
+    Word end = 0x1100;
+    for (int i = ROUTINES - 1; i >= 0; i--) {
+        pc = entry[i] = end;
+        routine(i, entry);
+        end = pc;
+    }
+    if (end > 0xF000 || vectors > 0x02FE) {
+        fprintf(stderr, "aot_prog: program too large\n");
+        return 1;
+    }
+
+    pc = MAIN;
+    b(LDA_IM);
+    b(REPEAT);
+    b(STA_ZP);
+    b(0xDF);
+    Word loop = pc;
+    for (int i = 0; i < ROUTINES; i++) {
+        b(JSR_ABS);
+        w(entry[i]);
+    }
+    b(DEC_ZP);
+    b(0xDF);
+    b(BNE_REL);
+    b(loop - (pc + 1));
+    b(JMP_ABS);
+    w(pc - 1);
+
+    FILE *f = fopen(argv[1], "wb");
+    if (f == NULL || fwrite(mem, 1, sizeof(mem), f) != sizeof(mem)) {
+        perror(argv[1]);
+        return 1;
+    }
+    fclose(f);
+    return 0;
+}
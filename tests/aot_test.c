@@ -0,0 +1,83 @@
+#include "../aot.h"
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Checks code from tools/recompile against the interpreter on the image
+ * aot_prog writes: a run to the end must leave registers, flags, cycles,
+ * store counts and memory exactly as cpu_run() does, and a run cut into
+ * short slices must match an interpreter stepped to the same cycle at every
+ * slice boundary both land on.
+ */
+
+static Byte image[0x10000];
+static Memory mem, ref_mem;
+static CPU cpu, ref;
+
+static void start(CPU *c, Memory *m) {
+    memcpy(m->Data, image, sizeof(image));
+    memset(c, 0, sizeof(*c));
+    c->mem = m;
+    c->opcodes = OPCODES_NMOS;
+    cpu_reset(c);
+    c->PC = image[0xFFFC] | image[0xFFFD] << 8;
+    c->SP = 0xFF;
+}
+
+static int same(void) {
+    return cpu.PC == ref.PC && cpu.SP == ref.SP && cpu.A == ref.A && cpu.X == ref.X && cpu.Y == ref.Y &&
+           cpu.C == ref.C && cpu.Z == ref.Z && cpu.I == ref.I && cpu.D == ref.D && cpu.B == ref.B &&
+           cpu.V == ref.V && cpu.N == ref.N && cpu.cycles == ref.cycles && cpu.writes == ref.writes &&
+           memcmp(mem.Data, ref_mem.Data, sizeof(mem.Data)) == 0;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "tests/aot_prog.bin";
+    FILE *f = fopen(path, "rb");
+    if (f == NULL || fread(image, 1, sizeof(image), f) != sizeof(image)) {
+        perror(path);
+        return 1;
+    }
+    fclose(f);
+    init_mem(&mem);
+    init_mem(&ref_mem);
+
+    start(&ref, &ref_mem);
+    check(cpu_run(&ref, CYCLES_FOREVER) == RUN_TRAP, "interpreter reaches the final JMP");
+    AotStats stats = {0};
+    start(&cpu, &mem);
+    check(aot_matches(&mem), "image holds the compiled code");
+    check(aot_run(&cpu, CYCLES_FOREVER, &stats) == RUN_TRAP, "compiled run reaches the final JMP");
+    check(same(), "compiled run ends in the interpreter's state");
+    check(stats.compiled > 0 && stats.interpreted > 0, "ran both compiled and interpreted code");
+    u_int64_t total = ref.cycles;
+
+    // slices of a few hundred cycles: compiled code stops at the first block
+    // boundary past each deadline, and wherever the interpreter lands on the
+    // same cycle the two must agree
+    start(&cpu, &mem);
+    start(&ref, &ref_mem);
+    int compared = 0, differed = 0;
+    u_int32_t r = 1;
+    while (cpu.cycles < total) {
+        r = r * 1103515245 + 12345;
+        aot_run(&cpu, cpu.cycles + 1 + (r >> 16) % 500, NULL);
+        while (ref.cycles < cpu.cycles) execute_instructions(&ref);
+        if (ref.cycles != cpu.cycles) continue;
+        compared++;
+        if (!same()) differed++;
+    }
+    check(differed == 0, "sliced run matches the interpreter at every common point");
+    check(compared > 1000, "slices compared");
+
+    mem.Data[0x1000] ^= 1;
+    check(!aot_matches(&mem), "changed code is noticed");
+
+    if (!failed) {
+        printf("aot   : ok, %llu cycles, %llu compiled calls, %llu instructions interpreted, %d slices compared\n",
+               (unsigned long long)total, (unsigned long long)stats.compiled,
+               (unsigned long long)stats.interpreted, compared);
+    }
+    return failed;
+}
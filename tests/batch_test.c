@@ -0,0 +1,151 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../batch.h"
+#include "check.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Checks batch mode end to end through memory streams: programs from hex
+ * and from files run stuck or capped with the registers and memory asked
+ * for, options and unknown keys are taken or skipped, bad lines get an
+ * error each without stopping the rest, blank lines get nothing, and
+ * thousands of jobs through a small window all come back exactly once.
+ */
+
+#define MANY 3000
+
+static char *output;
+static size_t output_len;
+
+// the result line for an id, as it appears after {"id":
+static const char *result(const char *id) {
+    char key[128];
+    snprintf(key, sizeof(key), "{\"id\":%s,", id);
+    for (const char *line = output; line < output + output_len; line = strchr(line, '\n') + 1) {
+        if (strncmp(line, key, strlen(key)) == 0) return line;
+    }
+    return "";
+}
+
+static int has(const char *line, const char *text) {
+    const char *end = strchr(line, '\n');
+    const char *at = strstr(line, text);
+    return at != NULL && end != NULL && at < end;
+}
+
+static BatchStats run(const char *input, int workers, int window, int *status) {
+    FILE *in = fmemopen((void *)input, strlen(input), "r");
+    free(output);
+    FILE *out = open_memstream(&output, &output_len);
+    BatchStats stats;
+    *status = batch_run(in, out, workers, window, &stats);
+    fclose(in);
+    fclose(out);
+    return stats;
+}
+
+int main(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/6502-batch-test-%ld", (long)getpid());
+    // counts in $20/$21 for ever, loaded at $0600
+    static const unsigned char count[] = { 0xE6, 0x20, 0xD0, 0xFC, 0xE6, 0x21, 0x4C, 0x00, 0x06 };
+    FILE *f = fopen(path, "wb");
+    fwrite(count, 1, sizeof(count), f);
+    fclose(f);
+
+    static char input[1 << 20];
+    char *o = input;
+    // sums 0..15 into $20, then JMP to itself
+    o += sprintf(o, "{\"id\":\"sum\",\"hex\":\"a2008a1865208520e8e010d0f54c0d04\",\"load\":1024}\n");
+    o += sprintf(o, "{ \"read\" : [ [32, 1], [1024, 2] ], \"load\": 1024, \"id\": \"sum2\", \"unknown\": "
+                    "{\"a\": [1, true, null, \"}\"]},\t\"hex\": \"A2008A1865208520E8E010D0F54C0D04\" }\n");
+    o += sprintf(o, "{\"id\":7,\"file\":\"%s\",\"load\":1536,\"cycles\":250000,\"read\":[[32,2]]}\n", path);
+    // LAX $0200, then JMP to itself: undocumented, so it runs or traps
+    o += sprintf(o, "{\"id\":8,\"hex\":\"af00024c0302\",\"load\":512,\"opcodes\":\"nmos\"}\n");
+    o += sprintf(o, "{\"id\":10,\"hex\":\"af00024c0302\",\"load\":512}\n");
+    // INX, then JMP to itself, entered at the JMP
+    o += sprintf(o, "{\"id\":9,\"hex\":\"e84c0102\",\"load\":512,\"entry\":513,\"cycles\":1000}\n");
+    o += sprintf(o, "\n   \n");
+    o += sprintf(o, "{\"id\":20,\"hex\":\"a20\"}\n");
+    o += sprintf(o, "{\"id\":21,\"hex\":\"zz\"}\n");
+    o += sprintf(o, "{\"id\":22}\n");
+    o += sprintf(o, "{\"id\":23,\"hex\":\"ea\",\"file\":\"x\"}\n");
+    o += sprintf(o, "{\"id\":24,\"hex\":\"ea\",\"read\":[[65535,2]]}\n");
+    o += sprintf(o, "{\"id\":25,\"hex\":\"eaea\",\"load\":65535}\n");
+    o += sprintf(o, "{\"id\":26,\"file\":\"/nonexistent/image.bin\"}\n");
+    o += sprintf(o, "{\"id\":27,\"hex\":\"ea\",\"cycles\":0}\n");
+    o += sprintf(o, "{\"id\":28,\"hex\":\"ea\"} trailing\n");
+    o += sprintf(o, "not json at all\n");
+    // the line number stands in for a missing id
+    o += sprintf(o, "{\"hex\":\"4c0000\"}\n");
+    // ids go back as they came, so they have to be valid JSON
+    o += sprintf(o, "{\"id\":-1.5e+3,\"hex\":\"4c0000\"}\n");
+    o += sprintf(o, "{\"id\":\"tab\\t\\u00e9\",\"hex\":\"4c0000\"}\n");
+    o += sprintf(o, "{\"id\":-e,\"hex\":\"4c0000\"}\n");
+    o += sprintf(o, "{\"id\":01,\"hex\":\"4c0000\"}\n");
+    o += sprintf(o, "{\"id\":\"a\\q\",\"hex\":\"4c0000\"}\n");
+    o += sprintf(o, "{\"id\":\"a\tb\",\"hex\":\"4c0000\"}\n");
+    o += sprintf(o, "{\"id\":\"tru\",\"x\":tru,\"hex\":\"4c0000\"}\n");
+    strcpy(o, "{\"id\":\"last\",\"hex\":\"4c0000\"}");     // no newline at the end
+
+    int status;
+    BatchStats stats = run(input, 3, 4, &status);
+    check(status == 0, "batch ran");
+    check(stats.jobs == 25 && stats.errors == 15, "every job answered, blank lines skipped");
+
+    const char *sum = result("\"sum\"");
+    check(has(sum, "\"status\":\"stuck\"") && has(sum, "\"pc\":1037") && has(sum, "\"x\":16") &&
+          has(sum, "\"read\":[]"), "a program that stops is stuck");
+    check(has(result("\"sum2\""), "\"read\":[\"78\",\"a200\"]"), "ranges read, spacing and unknown keys");
+    const char *counted = result("7");
+    check(has(counted, "\"status\":\"capped\"") && has(counted, "\"cycles\":25000"), "a file capped");
+    check(has(result("8"), "\"pc\":515") && has(result("8"), "\"a\":175,\"x\":175"), "nmos opcodes run");
+    check(has(result("10"), "\"status\":\"stuck\"") && has(result("10"), "\"pc\":512"), "strict opcodes trap");
+    check(has(result("9"), "\"pc\":513") && has(result("9"), "\"x\":0,"), "entry point");
+    check(has(result("20"), "\"error\":\"hex has an odd number of digits\""), "odd hex");
+    check(has(result("21"), "\"error\":"), "bad hex");
+    check(has(result("22"), "\"error\":\"needs one of hex and file\""), "no program");
+    check(has(result("23"), "\"error\":\"needs one of hex and file\""), "two programs");
+    check(has(result("24"), "\"error\":\"a range to read runs past $FFFF\""), "read past $FFFF");
+    check(has(result("25"), "\"error\":\"program runs past $FFFF\""), "load past $FFFF");
+    check(has(result("26"), "\"error\":\"file cannot be opened\""), "missing file");
+    check(has(result("27"), "\"error\":"), "no cycles");
+    check(has(result("28"), "\"error\":\"more after the object\""), "trailing text");
+    check(has(result("18"), "\"error\":\"not a JSON object\""), "not JSON, by line number");
+    check(has(result("19"), "\"status\":\"stuck\""), "line number as the id");
+    check(has(result("\"last\""), "\"status\":\"stuck\""), "last line without a newline");
+    check(has(result("-1.5e+3"), "\"status\":\"stuck\"") && has(result("\"tab\\t\\u00e9\""), "\"status\""),
+          "numbers and escapes in ids");
+    int bad_ids = 0;
+    for (const char *at = output; (at = strstr(at, "\"error\":\"id is not a string or a number\"")); at++) bad_ids++;
+    check(bad_ids == 3 && has(result("0"), "\"error\":\"not a JSON object\""), "ids that are not valid JSON refused");
+    check(has(result("\"tru\""), "\"error\":\"not a JSON object\""), "a bad literal");
+
+    // many jobs through a narrow window
+    o = input;
+    for (int i = 0; i < MANY; i++) {
+        o += sprintf(o, "{\"id\":%d,\"hex\":\"a9%02x8520a2%02xe8d0fd4c0902\",\"load\":512,\"read\":[[32,1]]}\n", i,
+                     i & 0xFF, i * 7 & 0xFF);
+    }
+    stats = run(input, 4, 8, &status);
+    int all = status == 0 && stats.jobs == MANY && stats.errors == 0;
+    for (int i = 0; i < MANY && all; i++) {
+        char id[16], value[32];
+        snprintf(id, sizeof(id), "%d", i);
+        snprintf(value, sizeof(value), "\"read\":[\"%02x\"]", i & 0xFF);
+        const char *line = result(id);
+        all = has(line, value) && has(line, "\"status\":\"stuck\"") && strstr(strchr(line, '\n'), line) == NULL;
+    }
+    check(all, "thousands of jobs, each answered once");
+    size_t lines = 0;
+    for (size_t i = 0; i < output_len; i++) lines += output[i] == '\n';
+    check(lines == MANY, "one line per job");
+
+    check(run("", 1, 1, &status).jobs == 0 && status == 0 && output_len == 0, "no input");
+
+    free(output);
+    unlink(path);
+    if (!failed) printf("batch : ok, %d jobs\n", MANY);
+    return failed;
+}
@@ -0,0 +1,35 @@
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * What the tests share. check() prints each failure and sets failed,
+ * which main() returns. Tests built on the core (anything that includes
+ * 6502.h first) also get machine(), the usual start: a cleared CPU on
+ * fresh memory with code at pc, the stack pointer at the top of page 1
+ * and PC on the code.
+ */
+
+static int failed;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failed = 1;
+    }
+}
+
+#ifdef MOS6502_H
+static inline void machine(CPU *cpu, Memory *mem, const Byte *code, size_t size, Word pc) {
+    init_mem(mem);
+    if (size > 0) memcpy(&mem->Data[pc], code, size);
+    memset(cpu, 0, sizeof(*cpu));
+    cpu->mem = mem;
+    cpu->SP = 0xFF;
+    cpu->PC = pc;
+}
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../coverage.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Checks a -DCOVERAGE build: every instruction that runs is marked,
+ * including the second half of a fused DEX/BNE, and nothing else is; data
+ * accesses are marked where they happen; and the report gives each routine
+ * its share of instructions run.
+ */
+
+static const Byte main_code[] = {
+    0x20, 0x00, 0x06,   // 0400 JSR $0600
+    0x20, 0x0C, 0x06,   // 0403 JSR $060C
+    0x4C, 0x06, 0x04,   // 0406 JMP $0406
+};
+
+static const Byte routines[] = {
+    0xA2, 0x03,         // 0600 LDX #3
+    0xCA,               // 0602 DEX
+    0xD0, 0xFD,         // 0603 BNE $0602
+    0xAD, 0x00, 0x07,   // 0605 LDA $0700
+    0xF0, 0x01,         // 0608 BEQ $060B
+    0xE8,               // 060A INX             never runs
+    0x60,               // 060B RTS
+    0xA9, 0x01,         // 060C LDA #1
+    0xD0, 0x03,         // 060E BNE $0613
+    0xAD, 0x01, 0x07,   // 0610 LDA $0701       never runs
+    0x8D, 0x02, 0x07,   // 0613 STA $0702
+    0x60,               // 0616 RTS
+};
+
+static const Word ran[] = {0x0400, 0x0403, 0x0406, 0x0600, 0x0602, 0x0603, 0x0605,
+                           0x0608, 0x060B, 0x060C, 0x060E, 0x0613, 0x0616};
+
+static CPU cpu;
+static Memory mem;
+
+static int executed(Word addr) {
+    return mem.executed[addr >> 6] >> (addr & 63) & 1;
+}
+
+static int accessed(Word addr) {
+    return mem.accessed[addr >> 6] >> (addr & 63) & 1;
+}
+
+int main(void) {
+    machine(&cpu, &mem, main_code, sizeof(main_code), 0x0400);
+    memcpy(&mem.Data[0x0600], routines, sizeof(routines));
+    check(cpu_run(&cpu, CYCLES_FOREVER) == RUN_TRAP, "program runs to its end");
+
+    int expected = 0;
+    for (Word a = 0x0400; a < 0x0700; a++) {
+        int should = 0;
+        for (size_t i = 0; i < sizeof(ran) / sizeof(ran[0]); i++) should |= ran[i] == a;
+        expected += executed(a) == should;
+    }
+    check(expected == 0x0300, "exactly the instructions that ran are marked");
+    check(coverage_count(mem.executed, 0, 0xFFFF) == sizeof(ran) / sizeof(ran[0]), "no other code marked");
+    check(accessed(0x0700) && !accessed(0x0701) && accessed(0x0702), "data reads and writes marked");
+    check(accessed(0x01FE) && accessed(0x01FF), "stack marked");
+    check(!accessed(0x0606) && !accessed(0x0401), "operand fetches are not data");
+
+    char *text;
+    size_t size;
+    FILE *out = open_memstream(&text, &size);
+    coverage_report(out, &mem, 0x0600, 0x0616);
+    fclose(out);
+    check(strstr(text, "10 of 12 instructions ran (83.3%), 0 data bytes accessed here, 4 in all") != NULL, "summary");
+    check(strstr(text, "$0600: 6 of 7 instructions ran (85.7%)") != NULL, "first routine");
+    check(strstr(text, "$060C: 4 of 5 instructions ran (80.0%)") != NULL, "second routine");
+    check(strstr(text, "*  0603  D0 FD     BNE $0602") != NULL, "fused branch listed as run");
+    check(strstr(text, "   060A  E8        INX") != NULL, "skipped instruction listed");
+    if (failed) printf("%s", text);
+    free(text);
+
+    Memory other;
+    init_mem(&other);
+    other.executed[0x060A >> 6] |= 1ull << (0x060A & 63);
+    coverage_merge(&mem, &other);
+    check(executed(0x060A), "merge adds another run");
+    coverage_clear(&mem);
+    check(coverage_count(mem.executed, 0, 0xFFFF) == 0 && coverage_count(mem.accessed, 0, 0xFFFF) == 0, "clear");
+
+    if (!failed) printf("cover : ok\n");
+    return failed;
+}
@@ -0,0 +1,96 @@
+#include "../6502.h"
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Checks breakpoints and watchpoints: a run stops before a breakpoint even
+ * when it is the second half of a fused pair, stops after an instruction
+ * that touches a watched address, and carries on from either; watched
+ * device pages still reach the device; and stopping and carrying on ends
+ * in the same state, on the same cycle, as a run with no debugger.
+ */
+
+static const Byte program[] = {
+    0xA2, 0x05,         // 0400 LDX #5
+    0xA9, 0x00,         // 0402 LDA #0
+    0x8D, 0x00, 0x05,   // 0404 STA $0500      fused with the LDA
+    0xCA,               // 0407 DEX
+    0xD0, 0xF8,         // 0408 BNE $0402      fused with the DEX
+    0xAD, 0x01, 0x05,   // 040A LDA $0501
+    0x8D, 0x00, 0x06,   // 040D STA $0600
+    0x4C, 0x10, 0x04,   // 0410 JMP $0410
+};
+
+static CPU cpu;
+static Memory mem;
+static Debugger dbg;
+
+static void start(void) {
+    machine(&cpu, &mem, program, sizeof(program), 0x0400);
+    mem.Data[0x0500] = 0xFF;
+    mem.Data[0x0501] = 0x42;
+}
+
+// a device on page 6 that remembers what was stored
+static Byte stored;
+
+static Byte dev_read(void *ctx, Word addr) {
+    (void)ctx;
+    return addr & 0xFF;
+}
+
+static void dev_write(void *ctx, Word addr, Byte value) {
+    (void)ctx;
+    (void)addr;
+    stored = value;
+}
+
+static const PageHandler device = { .read = dev_read, .write = dev_write };
+
+int main(void) {
+    start();
+    check(cpu_run(&cpu, CYCLES_FOREVER) == RUN_TRAP, "plain run ends");
+    u_int64_t cycles = cpu.cycles;
+
+    start();
+    debug_init(&dbg, &cpu);
+    check(cpu_run(&cpu, CYCLES_FOREVER) == RUN_TRAP && cpu.cycles == cycles, "no breakpoints, no stops");
+
+    start();
+    debug_init(&dbg, &cpu);
+    break_add(&dbg, 0x0404);
+    check(cpu_run(&cpu, CYCLES_FOREVER) == RUN_BREAKPOINT, "stops at a breakpoint");
+    check(cpu.PC == 0x0404 && cpu.X == 5 && mem.Data[0x0500] == 0xFF, "breakpoint in a fused pair stops before it");
+    check(cpu_run(&cpu, CYCLES_FOREVER) == RUN_BREAKPOINT && cpu.PC == 0x0404 && cpu.X == 4,
+          "running on gets past the breakpoint and stops there next time");
+    break_remove(&dbg, 0x0404);
+    break_add(&dbg, 0x0408);
+    check(cpu_run(&cpu, CYCLES_FOREVER) == RUN_BREAKPOINT && cpu.PC == 0x0408 && cpu.X == 3,
+          "breakpoint on a fused branch");
+    break_remove(&dbg, 0x0408);
+
+    check(watch_add(&dbg, 0x0500, WATCH_WRITE) == 0, "watch");
+    check(cpu_run(&cpu, CYCLES_FOREVER) == RUN_WATCHPOINT, "stops on a write");
+    check(cpu.PC == 0x0407 && cpu.X == 3 && dbg.hit_addr == 0x0500 && dbg.hit_write && dbg.hit_value == 0,
+          "after the store, before the next instruction");
+    check(mem.dirty[0x05], "watched store dirties its page");
+    watch_remove(&dbg, 0x0500, WATCH_WRITE);
+    check(mem.io[0x05] == NULL, "unwatched page is plain RAM again");
+
+    check(watch_add(&dbg, 0x0501, WATCH_READ) == 0, "watch");
+    check(cpu_run(&cpu, CYCLES_FOREVER) == RUN_WATCHPOINT, "stops on a read");
+    check(cpu.PC == 0x040D && cpu.A == 0x42 && !dbg.hit_write && dbg.hit_value == 0x42, "read hit");
+    check(watch_add(&dbg, 0x00F0, WATCH_READ) == -1 && watch_add(&dbg, 0x01F0, WATCH_WRITE) == -1,
+          "zero page and stack cannot be watched");
+
+    map_io(&mem, 0x06, &device);
+    check(watch_add(&dbg, 0x0600, WATCH_WRITE) == 0, "watch a device");
+    check(cpu_run(&cpu, CYCLES_FOREVER) == RUN_WATCHPOINT && stored == 0x42, "device still sees the store");
+    debug_detach(&dbg);
+    check(cpu.debug == NULL && mem.io[0x05] == NULL && mem.io[0x06] == &device, "detach restores the pages");
+    check(cpu_run(&cpu, CYCLES_FOREVER) == RUN_TRAP && cpu.cycles == cycles, "stops leave the timing alone");
+
+    if (!failed) printf("debug : ok\n");
+    return failed;
+}
@@ -0,0 +1,87 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../6502.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Runs Klaus Dormann's 6502 functional test binary through the core.
+ * The suite signals both success and failure by trapping in a branch or
+ * JMP to itself, so the only check made per dispatch is whether PC came
+ * back to where a single instruction started. A fused pair may loop back
+ * to itself without trapping (DEX / BNE).
+ *
+ * usage: functional_test <rom.bin> [start] [success]
+ */
+
+#define DEFAULT_START 0x0400
+#define DEFAULT_SUCCESS 0x3469
+#define MAX_INSTRUCTIONS 2000000000ULL
+
+static CPU cpu;
+static Memory mem;
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <rom.bin> [start] [success]\n", argv[0]);
+        return 2;
+    }
+    Word start = argc > 2 ? (Word)strtol(argv[2], NULL, 16) : DEFAULT_START;
+    Word success = argc > 3 ? (Word)strtol(argv[3], NULL, 16) : DEFAULT_SUCCESS;
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        perror(argv[1]);
+        return 2;
+    }
+    cpu.mem = &mem;
+    init_mem(&mem);
+    size_t size = fread(mem.Data, 1, sizeof(mem.Data), f);
+    fclose(f);
+    if (size == 0) {
+        fprintf(stderr, "%s: empty image\n", argv[1]);
+        return 2;
+    }
+
+    cpu_reset(&cpu);
+    cpu.PC = start;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    unsigned long long count = 0, dispatches = 0;
+    Word pc;
+    int n;
+    do {
+        pc = cpu.PC;
+        n = execute_instructions(&cpu);
+        count += n;
+        dispatches++;
+    } while ((cpu.PC != pc || n > 1) && count < MAX_INSTRUCTIONS);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    printf("instructions : %llu\n", count);
+    printf("dispatches   : %llu (%llu saved by fusion, %.1f%%)\n", dispatches,
+           count - dispatches, 100.0 * (count - dispatches) / count);
+    printf("cycles       : %llu\n", (unsigned long long)cpu.cycles);
+    printf("elapsed      : %.3f s\n", elapsed);
+    printf("speed        : %.2f MIPS\n", count / elapsed / 1e6);
+
+#ifdef PAIR_STATS
+    print_pair_stats(20);
+#endif
+
+    if (cpu.PC != pc || n > 1) {
+        printf("FAIL: no trap after %llu instructions\n", count);
+        return 1;
+    }
+    if (pc != success) {
+        printf("FAIL: trapped at 0x%04X\n", pc);
+        print_debug(&cpu);
+        return 1;
+    }
+    printf("PASS: trapped at success address 0x%04X\n", pc);
+    return 0;
+}
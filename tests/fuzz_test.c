@@ -0,0 +1,113 @@
+#include "../fuzz.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Checks the fuzzing harness on a small guest parser: runs end as ok, crash
+ * (at a crash address or on a JAM) or hang as they should, every run starts
+ * from the snapshot whatever the previous one stored, and edge coverage is
+ * enough for a naive mutation loop to find the four byte magic that crashes
+ * the parser.
+ */
+
+#define INPUT 0x0300
+#define LENGTH 0xF0
+#define EXIT 0x0403
+#define CRASH 0x0700
+
+static const Byte harness[] = {
+    0x20, 0x00, 0x06,   // 0400 JSR $0600
+    0x4C, 0x03, 0x04,   // 0403 JMP $0403
+};
+
+// input at $0300, length at $F0
+static const Byte parser[] = {
+    0xA5, 0xF0,         // 0600 LDA $F0
+    0xC9, 0x04,         // 0602 CMP #4
+    0x90, 0x2B,         // 0604 BCC $0631       too short
+    0xAD, 0x00, 0x03,   // 0606 LDA $0300
+    0xC9, 0x4A,         // 0609 CMP #'J'
+    0xD0, 0x01,         // 060B BNE $060E
+    0x02,               // 060D JAM
+    0xC9, 0xFF,         // 060E CMP #$FF
+    0xD0, 0x03,         // 0610 BNE $0615
+    0x4C, 0x12, 0x06,   // 0612 JMP $0612       hang
+    0xC9, 0x46,         // 0615 CMP #'F'
+    0xD0, 0x18,         // 0617 BNE $0631
+    0xAD, 0x01, 0x03,   // 0619 LDA $0301
+    0xC9, 0x55,         // 061C CMP #'U'
+    0xD0, 0x11,         // 061E BNE $0631
+    0xAD, 0x02, 0x03,   // 0620 LDA $0302
+    0xC9, 0x5A,         // 0623 CMP #'Z'
+    0xD0, 0x0A,         // 0625 BNE $0631
+    0xAD, 0x03, 0x03,   // 0627 LDA $0303
+    0xC9, 0x21,         // 062A CMP #'!'
+    0xD0, 0x03,         // 062C BNE $0631
+    0x4C, 0x00, 0x07,   // 062E JMP $0700       crash
+    0xA0, 0x00,         // 0631 LDY #0          copy the input to $0500
+    0xB9, 0x00, 0x03,   // 0633 LDA $0300,Y
+    0x99, 0x00, 0x05,   // 0636 STA $0500,Y
+    0xC8,               // 0639 INY
+    0xC4, 0xF0,         // 063A CPY $F0
+    0x90, 0xF5,         // 063C BCC $0633
+    0xE6, 0x10,         // 063E INC $10         runs seen
+    0x60,               // 0640 RTS
+};
+
+static CPU cpu;
+static Memory mem;
+static Fuzzer f;
+
+static FuzzResult run(const char *input) {
+    return fuzz_run(&f, (const Byte *)input, strlen(input));
+}
+
+int main(void) {
+    machine(&cpu, &mem, harness, sizeof(harness), 0x0400);
+    memcpy(&mem.Data[0x0600], parser, sizeof(parser));
+    mem.Data[CRASH] = 0x4C;     // JMP $0700
+    mem.Data[CRASH + 1] = 0x00;
+    mem.Data[CRASH + 2] = 0x07;
+
+    check(fuzz_init(&f, &cpu, INPUT, 64, EXIT, 100000) == 0, "init");
+    fuzz_length_at(&f, LENGTH);
+    check(fuzz_crash_at(&f, CRASH) == 0, "crash address");
+
+    check(run("") == FUZZ_OK, "empty input is ok");
+    check(run("hello") == FUZZ_OK, "text is ok");
+    check(f.mem.Data[0x10] == 1, "runs start from the snapshot");
+    check(run("J...") == FUZZ_CRASH, "JAM is a crash");
+    check(run("\xFF...") == FUZZ_HANG, "endless loop is a hang");
+    check(run("FUZ!") == FUZZ_CRASH, "magic reaches the crash address");
+
+    // the same input after a different one leaves the same coverage and state
+    run("hello world");
+    Byte edges[EDGE_MAP_SIZE];
+    memcpy(edges, f.edges, sizeof(edges));
+    u_int64_t cycles = f.cpu.cycles;
+    run("a much longer input that copies more of itself");
+    run("hello world");
+    check(memcmp(edges, f.edges, sizeof(edges)) == 0 && f.cpu.cycles == cycles, "runs are repeatable");
+    check(f.mem.Data[0x0500 + 20] == 0, "stores of earlier runs are undone");
+
+    // keep inputs that reach new edges, mutate one byte at a time
+    static Byte corpus[256][8];
+    int kept = 1, execs = 0, found = 0;
+    memcpy(corpus[0], "AAAAAAAA", 8);
+    fuzz_new_coverage(&f);
+    srand(6502);
+    for (execs = 0; execs < 200000 && !found; execs++) {
+        Byte input[8];
+        memcpy(input, corpus[rand() % kept], 8);
+        input[rand() % 4] = rand();
+        FuzzResult r = fuzz_run(&f, input, 8);
+        if (r == FUZZ_CRASH && memcmp(input, "FUZ!", 4) == 0) found = 1;
+        if (r == FUZZ_OK && fuzz_new_coverage(&f) && kept < 256) memcpy(corpus[kept++], input, 8);
+    }
+    check(found, "coverage guided mutation finds the magic");
+
+    if (!failed) printf("fuzz  : ok, magic found after %d execs, %d inputs kept\n", execs, kept);
+    return failed;
+}
@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../gdb.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Drives the GDB stub over a Unix socket with a scripted client, the way
+ * GDB would: registers, memory reads and writes, single steps through a
+ * fused pair, continue to a breakpoint and to a watchpoint, stepping and
+ * continuing backwards, an interrupt while the guest spins, no-ack mode
+ * and detach.
+ */
+
+static const Byte program[] = {
+    0xA2, 0x05,         // 0400 LDX #5
+    0xA9, 0x00,         // 0402 LDA #0
+    0x8D, 0x00, 0x05,   // 0404 STA $0500      fused with the LDA
+    0xCA,               // 0407 DEX
+    0xD0, 0xF8,         // 0408 BNE $0402
+    0xAD, 0x01, 0x05,   // 040A LDA $0501
+    0x4C, 0x0D, 0x04,   // 040D JMP $040D
+};
+
+static CPU cpu;
+static Memory mem;
+static GdbStub stub;
+static Rewinder rewinder;
+
+static int fd;
+static int acks = 1;
+static char answer[GDB_PACKET_MAX + 1];
+
+static int get(void) {
+    char c;
+    return read(fd, &c, 1) == 1 ? (unsigned char)c : -1;
+}
+
+// sends a packet and returns the reply, checking the acknowledgement
+static const char *ask(const char *packet) {
+    char frame[256];
+    unsigned sum = 0;
+    for (const char *p = packet; *p; p++) sum += (unsigned char)*p;
+    int n = snprintf(frame, sizeof(frame), "$%s#%02x", packet, sum & 0xFF);
+    if (write(fd, frame, n) != n) return "";
+    int c;
+    if (acks && (c = get()) != '+') {
+        printf("FAIL: %s not acknowledged\n", packet);
+        failed = 1;
+    }
+    while ((c = get()) != '$') {
+        if (c < 0) return "";
+    }
+    n = 0;
+    sum = 0;
+    while ((c = get()) != '#' && c >= 0) {
+        answer[n++] = c;
+        sum += c;
+    }
+    answer[n] = '\0';
+    char cs[3] = {0};
+    cs[0] = get();
+    cs[1] = get();
+    check(strtoul(cs, NULL, 16) == (sum & 0xFF), "reply checksum");
+    if (acks && write(fd, "+", 1) != 1) return "";
+    return answer;
+}
+
+static void expect(const char *packet, const char *reply, const char *what) {
+    const char *got = ask(packet);
+    if (strcmp(got, reply) != 0) {
+        printf("FAIL: %s: %s gave \"%s\", not \"%s\"\n", what, packet, got, reply);
+        failed = 1;
+    }
+}
+
+int main(void) {
+    machine(&cpu, &mem, program, sizeof(program), 0x0400);
+    mem.Data[0x0501] = 0x42;
+    gdb_init(&stub, &cpu);
+    rewind_init(&rewinder, &cpu, 20, 1 << 16);
+    stub.rewinder = &rewinder;
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/gdb_test.%d.sock", (int)getpid());
+    int listener = gdb_listen(path);
+    check(listener >= 0, "listen");
+    pid_t child = fork();
+    if (child == 0) {
+        int conn = accept(listener, NULL, NULL);
+        exit(conn >= 0 && gdb_serve(&stub, conn) == 0 ? 0 : 1);
+    }
+    close(listener);
+
+    struct sockaddr_un un = { .sun_family = AF_UNIX };
+    strcpy(un.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    check(connect(fd, (struct sockaddr *)&un, sizeof(un)) == 0, "connect");
+    unlink(path);
+
+    check(strstr(ask("qSupported:multiprocess+"), "ReverseContinue+") != NULL, "qSupported");
+    expect("?", "S05", "stop reason");
+    expect("g", "00000020ff0004", "registers");
+    expect("m400,5", "a205a9008d", "memory read");
+
+    expect("s", "S05", "step");
+    expect("s", "S05", "step");
+    expect("p5", "0404", "step runs the first of a fused pair alone");
+    expect("s", "S05", "step");
+    expect("p1", "05", "X after LDX");
+    expect("m500,1", "00", "STA ran");
+
+    expect("Z0,408,1", "OK", "set breakpoint");
+    expect("c", "S05", "continue to breakpoint");
+    expect("g", "00040020ff0804", "at the breakpoint, DEX run");
+    expect("c", "S05", "continue from breakpoint");
+    expect("p1", "03", "next time round");
+    expect("bs", "S05", "reverse step");
+    expect("g", "00040022ff0704", "back before the DEX");
+    expect("bc", "S05", "reverse continue");
+    expect("g", "00040020ff0804", "back at the first breakpoint hit");
+    expect("c", "S05", "forward again");
+    expect("p1", "03", "the same second hit");
+    expect("z0,408,1", "OK", "clear breakpoint");
+
+    expect("Z3,501,1", "OK", "set read watch");
+    expect("c", "T05rwatch:0501;", "continue to read watch");
+    expect("p5", "0d04", "after the read");
+    expect("z3,501,1", "OK", "clear read watch");
+    expect("Z2,0f0,1", "E01", "zero page cannot be watched");
+
+    expect("M500,2:beef", "OK", "memory write");
+    expect("m500,2", "beef", "written");
+    expect("P0=7e", "OK", "register write");
+    expect("p0", "7e", "A written");
+    expect("M500,2:zz01", "E01", "memory write that is not hex");
+    expect("m500,2", "beef", "left as it was");
+    expect("P0=g1", "E01", "register write that is not hex");
+    expect("G00040020ff08x4", "E01", "registers that are not hex");
+    expect("p0", "7e", "registers left as they were");
+    expect("Z2,1000,ffffffffffffffff", "E01", "watch longer than the address space");
+
+    // the guest now spins in JMP $040D; the interrupt has to get through
+    if (write(fd, "$c#63", 5) != 5) failed = 1;
+    check(get() == '+', "continue acknowledged");
+    nanosleep(&(struct timespec){ .tv_nsec = 20000000 }, NULL);
+    if (write(fd, "\x03", 1) != 1) failed = 1;
+    char stop[8] = {0};
+    for (int i = 0; i < 7 && (stop[i] = get()) != '#'; i++) {}
+    check(strncmp(stop, "$S02", 4) == 0, "interrupt stops a running guest");
+    get();
+    get();
+    if (write(fd, "+", 1) != 1) failed = 1;
+
+    expect("QStartNoAckMode", "OK", "no ack mode");
+    acks = 0;
+    expect("p5", "0d04", "still answering without acks");
+    expect("D", "OK", "detach");
+
+    int status;
+    waitpid(child, &status, 0);
+    check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "stub returns 0 on detach");
+
+    if (!failed) printf("gdb   : ok\n");
+    return failed;
+}
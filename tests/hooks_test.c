@@ -0,0 +1,120 @@
+#include "../6502.h"
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Checks native hooks: a hooked multiply gives the guest routine's results
+ * for every input pair whether it is entered by JSR or by a JMP, charges
+ * its configured cycles, and an inline argument routine can move its
+ * return address past the bytes after the JSR.
+ */
+
+#define MUL_CYCLES 150
+
+// $10 x $11 -> low in $10, high in $12 and A
+static const Byte multiply[] = {
+    0xA9, 0x00,         // 0600 LDA #0
+    0xA2, 0x08,         // 0602 LDX #8
+    0x46, 0x10,         // 0604 LSR $10
+    0x90, 0x03,         // 0606 BCC $060B
+    0x18,               // 0608 CLC
+    0x65, 0x11,         // 0609 ADC $11
+    0x6A,               // 060B ROR A
+    0x66, 0x10,         // 060C ROR $10
+    0xCA,               // 060E DEX
+    0xD0, 0xF5,         // 060F BNE $0606
+    0x85, 0x12,         // 0611 STA $12
+    0x60,               // 0613 RTS
+};
+
+static const Byte main_code[] = {
+    0x20, 0x00, 0x06,   // 0400 JSR $0600
+    0x4C, 0x03, 0x04,   // 0403 JMP $0403
+    0x20, 0x00, 0x07,   // 0406 JSR $0700       tail call through a JMP
+    0x4C, 0x09, 0x04,   // 0409 JMP $0409
+    0x20, 0x00, 0x08,   // 040C JSR $0800       print "hi" inline
+    'h', 'i', 0x00,
+    0x4C, 0x12, 0x04,   // 0412 JMP $0412
+};
+
+static void mul(CPU *cpu, void *ctx) {
+    (void)ctx;
+    Word p = cpu->mem->Data[0x10] * cpu->mem->Data[0x11];
+    write_byte(cpu, 0x10, p & 0xFF);
+    write_byte(cpu, 0x12, p >> 8);
+    cpu->A = p >> 8;
+    cpu->X = 0;
+    cpu->Z = 1;
+    cpu->N = 0;
+}
+
+static char printed[16];
+
+static void print_inline(CPU *cpu, void *ctx) {
+    (void)ctx;
+    Word at = (cpu->mem->Data[0x100 + (Byte)(cpu->SP + 1)] | cpu->mem->Data[0x100 + (Byte)(cpu->SP + 2)] << 8) + 1;
+    size_t n = 0;
+    while (cpu->mem->Data[at] != 0 && n < sizeof(printed) - 1) printed[n++] = cpu->mem->Data[at++];
+    printed[n] = 0;
+    // RTS adds one, landing after the terminator
+    cpu->mem->Data[0x100 + (Byte)(cpu->SP + 1)] = at & 0xFF;
+    cpu->mem->Data[0x100 + (Byte)(cpu->SP + 2)] = at >> 8;
+}
+
+static CPU cpu;
+static Memory mem;
+
+static void start(Hooks *hooks, Word pc, Byte a, Byte b) {
+    memset(&cpu, 0, sizeof(cpu));
+    cpu.mem = &mem;
+    cpu.hooks = hooks;
+    cpu.SP = 0xFF;
+    cpu.PC = pc;
+    mem.Data[0x10] = a;
+    mem.Data[0x11] = b;
+    cpu_run(&cpu, CYCLES_FOREVER);
+}
+
+int main(void) {
+    init_mem(&mem);
+    memcpy(&mem.Data[0x0400], main_code, sizeof(main_code));
+    memcpy(&mem.Data[0x0600], multiply, sizeof(multiply));
+    mem.Data[0x0700] = 0x4C;    // JMP $0600
+    mem.Data[0x0701] = 0x00;
+    mem.Data[0x0702] = 0x06;
+    mem.Data[0x0800] = 0x60;    // RTS, the hook skips the string
+
+    Hooks hooks;
+    hooks_init(&hooks);
+    check(hook_add(&hooks, 0x0600, mul, NULL, MUL_CYCLES) == 0, "add hook");
+    check(hook_add(&hooks, 0x0800, print_inline, NULL, 40) == 0, "add second hook");
+
+    int mismatches = 0;
+    for (int a = 0; a < 256; a++) {
+        for (int b = 0; b < 256; b += 7) {
+            start(NULL, 0x0400, a, b);
+            Byte lo = mem.Data[0x10], hi = mem.Data[0x12], A = cpu.A, X = cpu.X;
+            start(&hooks, 0x0400, a, b);
+            if (mem.Data[0x10] != lo || mem.Data[0x12] != hi || cpu.A != A || cpu.X != X ||
+                cpu.PC != 0x0403 || cpu.SP != 0xFF) mismatches++;
+            check(cpu.cycles == 6 + MUL_CYCLES + 3, "JSR, hook and one JMP charged");
+            start(&hooks, 0x0406, a, b);
+            if (mem.Data[0x10] != lo || mem.Data[0x12] != hi || cpu.PC != 0x0409 || cpu.SP != 0xFF) mismatches++;
+        }
+    }
+    check(mismatches == 0, "hooked multiply matches the guest routine");
+    check(hooks.calls == 2 * 256 * 37, "every call went native");
+
+    start(&hooks, 0x040C, 0, 0);
+    check(strcmp(printed, "hi") == 0, "inline argument read");
+    check(cpu.PC == 0x0412 && cpu.SP == 0xFF, "returned past the inline argument");
+
+    hook_remove(&hooks, 0x0600);
+    hooks.calls = 0;
+    start(&hooks, 0x0400, 12, 13);
+    check(hooks.calls == 0 && mem.Data[0x10] == 156, "removed hook runs the guest routine");
+
+    if (!failed) printf("hooks : ok\n");
+    return failed;
+}
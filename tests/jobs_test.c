@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include "../jobs.h"
+#include "../state.h"
+#include "check.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Checks the job server, client and server in one process: images go over
+ * as sealed memory files, raw or as save states, and unsealed ones are
+ * refused; jobs stop stuck or capped with the registers, cycles and memory
+ * they asked for, a short job overtakes a long one, bad requests are
+ * answered rather than run, images are only seen by the connection that
+ * sent them, a client that hangs up takes its jobs and images with it, one
+ * that stops reading is hung up on, and the stats add up.
+ */
+
+// sums 0..15 into $20, then stops
+static const Byte sum[] = {
+    0xA2, 0x00,         // 0400 LDX #0
+    0x8A,               // 0402 TXA
+    0x18,               // 0403 CLC
+    0x65, 0x20,         // 0404 ADC $20
+    0x85, 0x20,         // 0406 STA $20
+    0xE8,               // 0408 INX
+    0xE0, 0x10,         // 0409 CPX #$10
+    0xD0, 0xF5,         // 040B BNE $0402
+    0x4C, 0x0D, 0x04,   // 040D JMP $040D
+};
+
+// counts in $20/$21 for ever
+static const Byte count[] = {
+    0xE6, 0x20,         // 0600 INC $20
+    0xD0, 0xFC,         // 0602 BNE $0600
+    0xE6, 0x21,         // 0604 INC $21
+    0x4C, 0x00, 0x06,   // 0606 JMP $0600
+};
+
+static JobServer server;
+static int client;
+
+// serves until the connection from has a reply
+static int wait_on(int from, JobResult *result, void *out, size_t out_max) {
+    for (int round = 0; round < 100000; round++) {
+        struct pollfd p = { .fd = from, .events = POLLIN };
+        if (poll(&p, 1, 0) > 0) return job_receive(from, result, out, out_max);
+        job_serve(&server, 10);
+    }
+    return -1;
+}
+
+static int wait_reply(JobResult *result, void *out, size_t out_max) {
+    return wait_on(client, result, out, out_max);
+}
+
+static JobStatus share_image(int from, u_int32_t id, const void *data, size_t size, Word load, u_int32_t flags) {
+    int fd = job_share(data, size);
+    JobRequest req = { .type = JOB_IMAGE, .tag = id, .image = id, .flags = flags, .size = size, .load = load };
+    JobResult result;
+    int ok = fd >= 0 && job_send(from, &req, fd) == 0;
+    if (fd >= 0) close(fd);
+    return ok && wait_on(from, &result, NULL, 0) == 0 && result.tag == id ? result.status : JOB_BAD_REQUEST;
+}
+
+static JobStatus send_image(u_int32_t id, const void *data, size_t size, Word load, u_int32_t flags) {
+    return share_image(client, id, data, size, load, flags);
+}
+
+static void submit(u_int32_t tag, u_int32_t image, u_int64_t cycles, Word out_addr, Word out_len) {
+    JobRequest req = { .type = JOB_RUN, .tag = tag, .image = image, .cycles = cycles, .out_addr = out_addr,
+                       .out_len = out_len };
+    job_send(client, &req, -1);
+}
+
+int main(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/6502-jobs-test-%ld", (long)getpid());
+    check(job_server_init(&server, path, 4) == 0, "server");
+    client = job_connect(path);
+    check(client >= 0, "connect");
+
+    Byte image[0x10000] = { 0 };
+    memcpy(&image[0x0400], sum, sizeof(sum));
+    image[0xFFFC] = 0x00;
+    image[0xFFFD] = 0x04;
+    check(send_image(1, image, sizeof(image), 0, 0) == JOB_OK, "whole address space shared");
+    check(send_image(2, count, sizeof(count), 0x0600, 0) == JOB_OK, "a raw image at its address");
+    check(send_image(3, count, sizeof(count), 0xFFF8, 0) == JOB_BAD_IMAGE, "an image past $FFFF refused");
+    int unsealed = memfd_create("unsealed", 0);
+    JobRequest open_image = { .type = JOB_IMAGE, .tag = 5, .image = 5, .size = sizeof(count), .load = 0x0600 };
+    JobResult refused;
+    check(write(unsealed, count, sizeof(count)) == sizeof(count) && job_send(client, &open_image, unsealed) == 0 &&
+          wait_reply(&refused, NULL, 0) == 0 && refused.status == JOB_BAD_IMAGE, "an unsealed image refused");
+    close(unsealed);
+
+    // the same program straight on a CPU, for reference
+    static Memory mem;
+    CPU cpu = { .mem = &mem };
+    init_mem(&mem);
+    memcpy(mem.Data, image, sizeof(image));
+    cpu_reset(&cpu);
+    check(cpu_run(&cpu, CYCLES_FOREVER) == RUN_TRAP, "reference run");
+
+    JobResult r;
+    Byte out[JOB_OUTPUT_MAX];
+    submit(10, 1, 1000000, 0x0020, 2);
+    int n = wait_reply(&r, out, sizeof(out));
+    check(n == 2 && r.tag == 10 && r.status == JOB_STUCK, "a job that stops is stuck");
+    check(out[0] == 120 && out[1] == 0 && r.pc == 0x040D && r.x == 0x10 && r.sp == 0xFF,
+          "registers and memory sent back");
+    // the loop is noticed a couple of times round after the trap would be
+    check(r.cycles >= cpu.cycles && r.cycles <= cpu.cycles + 9, "cycles up to where it stopped");
+
+    // entry point, and a cap over several slices
+    JobRequest req = { .type = JOB_RUN, .tag = 11, .image = 2, .flags = JOB_AT_ENTRY, .entry = 0x0600,
+                       .cycles = 3 * JOB_SLICE_CYCLES + 17, .out_addr = 0x20, .out_len = 2 };
+    job_send(client, &req, -1);
+    n = wait_reply(&r, out, sizeof(out));
+    check(n == 2 && r.tag == 11 && r.status == JOB_CAPPED, "a job that does not stop is capped");
+    check(r.cycles >= req.cycles && r.cycles < req.cycles + 8 && (out[0] | out[1] << 8) > 0x1000, "ran its cycles");
+
+    // a long job and a short one behind it: the short one answers first
+    submit(20, 2, 40 * JOB_SLICE_CYCLES, 0, 0);
+    submit(21, 1, 1000000, 0x0020, 1);
+    check(wait_reply(&r, out, sizeof(out)) == 1 && r.tag == 21 && out[0] == 120, "the short job first");
+    check(wait_reply(&r, out, sizeof(out)) == 0 && r.tag == 20 && r.status == JOB_CAPPED, "then the long one");
+    check(r.run_ns > 0, "run time given");
+
+    // a save state as the image, picking up where it was saved
+    init_mem(&mem);
+    memcpy(&mem.Data[0x0600], count, sizeof(count));
+    cpu_reset(&cpu);
+    cpu.PC = 0x0600;
+    cpu_run(&cpu, 5000);
+    int fd = memfd_create("state", MFD_ALLOW_SEALING);
+    check(fd >= 0 && state_save(&cpu, fd) == 0 && job_seal(fd) == 0, "state saved to a sealed memory file");
+    JobRequest state = { .type = JOB_IMAGE, .tag = 4, .image = 4, .flags = JOB_STATE_IMAGE,
+                         .size = lseek(fd, 0, SEEK_CUR) };
+    job_send(client, &state, fd);
+    close(fd);
+    check(wait_reply(&r, NULL, 0) == 0 && r.status == JOB_OK, "state image registered");
+    submit(30, 4, 1000, 0x20, 2);
+    cpu_run(&cpu, cpu.cycles + 1000);
+    n = wait_reply(&r, out, sizeof(out));
+    check(n == 2 && r.status == JOB_CAPPED && r.pc == cpu.PC && out[0] == mem.Data[0x20] && out[1] == mem.Data[0x21],
+          "a state image carries on from where it was");
+
+    // requests that cannot run
+    submit(40, 99, 1000, 0, 0);
+    check(wait_reply(&r, NULL, 0) == 0 && r.tag == 40 && r.status == JOB_NO_IMAGE, "unknown image");
+    submit(41, 1, 0, 0, 0);
+    check(wait_reply(&r, NULL, 0) == 0 && r.tag == 41 && r.status == JOB_BAD_REQUEST, "no cycles");
+    submit(42, 1, 1000, 0xFFFF, 2);
+    check(wait_reply(&r, NULL, 0) == 0 && r.tag == 42 && r.status == JOB_BAD_REQUEST, "output past $FFFF");
+    req = (JobRequest){ .type = JOB_IMAGE, .tag = 43, .image = 2 };
+    job_send(client, &req, -1);
+    check(wait_reply(&r, NULL, 0) == 0 && r.status == JOB_OK, "image dropped");
+    submit(44, 2, 1000, 0, 0);
+    check(wait_reply(&r, NULL, 0) == 0 && r.tag == 44 && r.status == JOB_NO_IMAGE, "dropped image gone");
+
+    // images belong to the connection that sent them
+    int other = job_connect(path);
+    req = (JobRequest){ .type = JOB_RUN, .tag = 45, .image = 1, .cycles = 1000 };
+    job_send(other, &req, -1);
+    check(wait_on(other, &r, NULL, 0) == 0 && r.tag == 45 && r.status == JOB_NO_IMAGE,
+          "another client's image is out of reach");
+    check(share_image(other, 1, count, sizeof(count), 0x0600, 0) == JOB_OK, "the same id on another connection");
+
+    // more jobs than machines, from a client that then hangs up
+    for (int i = 0; i < 8; i++) {
+        JobRequest job = { .type = JOB_RUN, .tag = i, .image = 1, .cycles = 1000000 };
+        job_send(other, &job, -1);
+    }
+    for (int i = 0; i < 4; i++) job_serve(&server, 0);
+    close(other);
+    for (int i = 0; i < 4; i++) job_serve(&server, 0);
+    check(server.n_running == 0 && server.queued == 0, "jobs of a client that hung up are gone");
+    JobStats stats = { 0 };
+    job_stats(&server, &stats);
+    check(stats.images == 2, "and so are its images");
+
+    // a client that keeps asking and never reads is hung up on, not waited for
+    int deaf = job_connect(path);
+    fcntl(deaf, F_SETFL, O_NONBLOCK);
+    stats = (JobStats){ 0 };
+    req = (JobRequest){ .type = JOB_STATS, .tag = 60 };
+    for (int round = 0; round < 100000 && stats.clients != 1; round++) {
+        job_send(deaf, &req, -1);
+        job_serve(&server, 0);
+        job_stats(&server, &stats);
+    }
+    check(stats.clients == 1, "a client that stops reading is dropped");
+    close(deaf);
+
+    req = (JobRequest){ .type = JOB_STATS, .tag = 50 };
+    job_send(client, &req, -1);
+    n = wait_reply(&r, &stats, sizeof(stats));
+    check(n == sizeof(stats) && r.tag == 50 && stats.jobs >= 5 && stats.images == 2 && stats.clients == 1,
+          "stats");
+    check(stats.p50_ns > 0 && stats.p50_ns <= stats.p99_ns && stats.p99_ns <= stats.max_ns, "latency percentiles");
+    check(server.pool.live == 0 && server.pool.recycled > 0, "machines recycled");
+
+    close(client);
+    job_server_free(&server);
+    unlink(path);
+    if (!failed) {
+        printf("jobs  : ok, %llu jobs, p50 %.1f us, p99 %.1f us\n", (unsigned long long)stats.jobs,
+               stats.p50_ns / 1e3, stats.p99_ns / 1e3);
+    }
+    return failed;
+}
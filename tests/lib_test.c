@@ -0,0 +1,77 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../lib6502.h"
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Checks lib6502 through its public header only: machines start blank and
+ * apart, load and run from the reset vector, stop on a budget or when
+ * stuck, registers and memory read back what was set, copies clamp at
+ * $FFFF, and a saved state loads into another machine.
+ */
+
+// sums $00..$0F into $20, then stops
+static const uint8_t program[] = {
+    0xA2, 0x00,         // 0400 LDX #0
+    0x8A,               // 0402 TXA
+    0x18,               // 0403 CLC
+    0x65, 0x20,         // 0404 ADC $20
+    0x85, 0x20,         // 0406 STA $20
+    0xE8,               // 0408 INX
+    0xE0, 0x10,         // 0409 CPX #$10
+    0xD0, 0xF5,         // 040B BNE $0402
+    0x4C, 0x0D, 0x04,   // 040D JMP $040D
+};
+
+static const uint8_t vector[] = { 0x00, 0x04 };
+
+int main(void) {
+    check(m6502_version() == LIB6502_VERSION, "version");
+    M6502 *m = m6502_create(), *other = m6502_create();
+    check(m != NULL && other != NULL, "create");
+
+    uint8_t block[0x100], zero[0x100] = { 0 };
+    check(m6502_read(m, 0xFF00, block, sizeof(block)) == 0x100 && memcmp(block, zero, 0x100) == 0, "blank memory");
+    check(m6502_load(m, 0xFFFF, vector, 2) == -1, "a load past $FFFF is refused");
+    check(m6502_load(m, 0x0400, program, sizeof(program)) == 0 && m6502_load(m, 0xFFFC, vector, 2) == 0, "load");
+    check(m6502_load_file(m, "/nonexistent/image.bin", 0) == -1, "a missing file is refused");
+
+    m6502_reset(m);
+    check(m6502_get(m, M6502_PC) == 0x0400 && m6502_get(m, M6502_SP) == 0xFF, "reset from the vector");
+    check(m6502_run(m, 10) == M6502_BUDGET && m6502_cycles(m) >= 10 && m6502_cycles(m) < 20, "run for a budget");
+    check(m6502_run(m, 0) == M6502_STUCK && m6502_get(m, M6502_PC) == 0x040D, "run until stuck");
+    check(m6502_peek(m, 0x20) == 120 && m6502_get(m, M6502_X) == 0x10, "the program ran");
+    check(m6502_peek(other, 0x20) == 0 && m6502_get(other, M6502_PC) == 0, "machines are apart");
+
+    m6502_set(m, M6502_A, 0x12);
+    m6502_set(m, M6502_Y, 0x34);
+    m6502_set(m, M6502_P, 0xC3);
+    check(m6502_get(m, M6502_A) == 0x12 && m6502_get(m, M6502_Y) == 0x34 && m6502_get(m, M6502_P) == 0xE3,
+          "registers set and read back");
+    m6502_poke(m, 0x1234, 0x56);
+    check(m6502_peek(m, 0x1234) == 0x56, "poke");
+    check(m6502_write(m, 0xFFF0, block, sizeof(block)) == 0x10 && m6502_read(m, 0xFFF8, block, 0x20) == 8,
+          "copies clamp at $FFFF");
+
+    FILE *f = tmpfile();
+    check(f != NULL && m6502_save_state(m, fileno(f)) == 0, "save state");
+    lseek(fileno(f), 0, SEEK_SET);
+    check(m6502_load_state(other, fileno(f)) == 0, "load state");
+    fclose(f);
+    uint8_t a[0x100], b[0x100];
+    int same = 1;
+    for (int page = 0; page < 0x100; page++) {
+        m6502_read(m, page << 8, a, 0x100);
+        m6502_read(other, page << 8, b, 0x100);
+        same &= memcmp(a, b, 0x100) == 0;
+    }
+    for (M6502Register r = M6502_A; r <= M6502_PC; r++) same &= m6502_get(m, r) == m6502_get(other, r);
+    check(same && m6502_cycles(other) == m6502_cycles(m), "the state carried over");
+
+    m6502_destroy(m);
+    m6502_destroy(other);
+    if (!failed) printf("lib   : ok\n");
+    return failed;
+}
@@ -0,0 +1,279 @@
+#include "../6502.h"
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Opcode regressions: one small program for each conformance fix the core
+ * took before the functional test ROM could be run, so they stay checked on
+ * a tree without the ROM. Each program ends in a JMP to itself and runs
+ * twice, once as it comes and once single stepped, which keeps the pairs
+ * the core fuses from hiding a broken scalar opcode.
+ */
+
+static CPU cpu;
+static Memory mem;
+static Debugger dbg;
+static int stepped;
+
+static void load(const Byte *code, size_t size) {
+    machine(&cpu, &mem, code, size, 0x0400);
+}
+
+static int go(void) {
+    if (stepped) {
+        debug_init(&dbg, &cpu);
+        dbg.step = 1;
+    }
+    return cpu_run(&cpu, CYCLES_FOREVER) == RUN_TRAP;
+}
+
+static void operands(void) {
+    static const Byte code[] = {
+        0xAD, 0x34, 0x12,   // 0400 LDA $1234
+        0xA2, 0x05,         // 0403 LDX #5
+        0x8D, 0x00, 0x03,   // 0405 STA $0300
+        0x4C, 0x08, 0x04,   // 0408 JMP $0408
+    };
+    load(code, sizeof(code));
+    mem.Data[0x1234] = 0x55;
+    mem.Data[0x3412] = 0xAA;
+    check(go() && cpu.A == 0x55, "absolute operands are low byte first");
+    check(mem.Data[0x0300] == 0x55 && mem.Data[0x0305] == 0, "STA abs does not add X");
+}
+
+static void wrapping(void) {
+    static const Byte code[] = {
+        0xA2, 0xFF,         // 0400 LDX #$FF
+        0xB5, 0x80,         // 0402 LDA $80,X
+        0x85, 0x20,         // 0404 STA $20
+        0xA2, 0x02,         // 0406 LDX #2
+        0xA1, 0xFF,         // 0408 LDA ($FF,X)
+        0x85, 0x21,         // 040A STA $21
+        0xA0, 0x01,         // 040C LDY #1
+        0xB1, 0xFF,         // 040E LDA ($FF),Y
+        0x4C, 0x10, 0x04,   // 0410 JMP $0410
+    };
+    load(code, sizeof(code));
+    mem.Data[0x007F] = 0x11;
+    mem.Data[0x017F] = 0x22;
+    mem.Data[0x0001] = 0x00;    // ($FF,X) pointer at $01
+    mem.Data[0x0002] = 0x30;
+    mem.Data[0x3000] = 0x33;
+    mem.Data[0x00FF] = 0x00;    // ($FF),Y pointer at $FF, high byte at $00
+    mem.Data[0x0000] = 0x40;
+    mem.Data[0x0100] = 0x30;
+    mem.Data[0x4001] = 0x44;
+    mem.Data[0x3001] = 0x45;
+    check(go(), "wrapping runs");
+    check(mem.Data[0x20] == 0x11, "zp,X wraps in zero page");
+    check(mem.Data[0x21] == 0x33, "(zp,X) pointer wraps in zero page");
+    check(cpu.A == 0x44, "(zp),Y takes the high byte from zero page");
+}
+
+static void branches(void) {
+    static const Byte code[] = {
+        0xA2, 0x03,         // 0400 LDX #3
+        0xE6, 0x10,         // 0402 INC $10
+        0xCA,               // 0404 DEX
+        0xD0, 0xFB,         // 0405 BNE $0402      backwards
+        0x38,               // 0407 SEC
+        0xB0, 0x02,         // 0408 BCS $040C
+        0xE6, 0x11,         // 040A INC $11        skipped
+        0x18,               // 040C CLC
+        0xB0, 0x02,         // 040D BCS $0411      not taken
+        0xE6, 0x12,         // 040F INC $12
+        0x4C, 0x11, 0x04,   // 0411 JMP $0411
+    };
+    load(code, sizeof(code));
+    check(go(), "branches run");
+    check(mem.Data[0x10] == 3 && cpu.X == 0, "backward branch offsets are signed");
+    check(mem.Data[0x11] == 0 && mem.Data[0x12] == 1, "BCS tests the carry");
+}
+
+static void addressing(void) {
+    static const Byte code[] = {
+        0xA9, 0xF0,         // 0400 LDA #$F0
+        0x25, 0x10,         // 0402 AND $10
+        0x85, 0x20,         // 0404 STA $20
+        0xA2, 0x01,         // 0406 LDX #1
+        0xA0, 0x02,         // 0408 LDY #2
+        0xA9, 0xFF,         // 040A LDA #$FF
+        0x35, 0x10,         // 040C AND $10,X
+        0x85, 0x21,         // 040E STA $21
+        0xA9, 0x00,         // 0410 LDA #0
+        0x15, 0x10,         // 0412 ORA $10,X
+        0x85, 0x22,         // 0414 STA $22
+        0x38,               // 0416 SEC
+        0xA9, 0x10,         // 0417 LDA #$10
+        0xA0, 0x01,         // 0419 LDY #1
+        0xF9, 0x00, 0x03,   // 041B SBC $0300,Y
+        0x85, 0x23,         // 041E STA $23
+        0xA9, 0x05,         // 0420 LDA #5
+        0xD9, 0x00, 0x03,   // 0422 CMP $0300,Y
+        0x4C, 0x25, 0x04,   // 0425 JMP $0425
+    };
+    load(code, sizeof(code));
+    mem.Data[0x10] = 0x3C;
+    mem.Data[0x11] = 0x0F;
+    mem.Data[0x12] = 0x80;
+    mem.Data[0x0301] = 0x05;
+    mem.Data[0x0302] = 0xFF;
+    check(go(), "addressing runs");
+    check(mem.Data[0x20] == 0x30, "AND zp");
+    check(mem.Data[0x21] == 0x0F, "AND zp,X");
+    check(mem.Data[0x22] == 0x0F, "ORA zp,X indexes with X");
+    check(mem.Data[0x23] == 0x0B, "SBC abs,Y reads one byte and subtracts");
+    check(cpu.Z && cpu.C && !cpu.N, "CMP abs,Y reads one byte");
+}
+
+static void counters(void) {
+    static const Byte code[] = {
+        0xA2, 0x80,         // 0400 LDX #$80
+        0xA0, 0x01,         // 0402 LDY #1
+        0x88,               // 0404 DEY
+        0x08,               // 0405 PHP
+        0xA0, 0x7F,         // 0406 LDY #$7F
+        0xC8,               // 0408 INY
+        0x08,               // 0409 PHP
+        0xA2, 0x00,         // 040A LDX #0
+        0xCA,               // 040C DEX
+        0x08,               // 040D PHP
+        0xA9, 0x00,         // 040E LDA #0
+        0xC6, 0x10,         // 0410 DEC $10
+        0x08,               // 0412 PHP
+        0x4C, 0x13, 0x04,   // 0413 JMP $0413
+    };
+    load(code, sizeof(code));
+    mem.Data[0x10] = 5;
+    check(go(), "counters run");
+    check((mem.Data[0x1FF] & 0x82) == 0x02, "DEY sets Z and N from Y");
+    check((mem.Data[0x1FE] & 0x82) == 0x80, "INY sets Z and N from Y");
+    check((mem.Data[0x1FD] & 0x82) == 0x80, "DEX clears Z");
+    check((mem.Data[0x1FC] & 0x82) == 0x00 && mem.Data[0x10] == 4, "DEC clears Z");
+}
+
+static void compares(void) {
+    static const Byte code[] = {
+        0xA9, 0x05,         // 0400 LDA #5
+        0xC9, 0x05,         // 0402 CMP #5
+        0x08,               // 0404 PHP
+        0xC9, 0x06,         // 0405 CMP #6
+        0x08,               // 0407 PHP
+        0xA2, 0x05,         // 0408 LDX #5
+        0xE0, 0x05,         // 040A CPX #5
+        0xE0, 0x06,         // 040C CPX #6
+        0x08,               // 040E PHP
+        0xA0, 0x05,         // 040F LDY #5
+        0xC0, 0x05,         // 0411 CPY #5
+        0xC0, 0x06,         // 0413 CPY #6
+        0x08,               // 0415 PHP
+        0x4C, 0x16, 0x04,   // 0416 JMP $0416
+    };
+    load(code, sizeof(code));
+    check(go(), "compares run");
+    check((mem.Data[0x1FF] & 0x03) == 0x03, "CMP equal sets Z and C");
+    check((mem.Data[0x1FE] & 0x03) == 0x00, "CMP less clears Z and C");
+    check((mem.Data[0x1FD] & 0x03) == 0x00, "CPX less clears Z and C");
+    check((mem.Data[0x1FC] & 0x03) == 0x00, "CPY less clears Z and C");
+}
+
+static void shifts(void) {
+    static const Byte code[] = {
+        0xA9, 0x01,         // 0400 LDA #1
+        0x4A,               // 0402 LSR A
+        0x08,               // 0403 PHP
+        0x38,               // 0404 SEC
+        0xA9, 0x80,         // 0405 LDA #$80
+        0x2A,               // 0407 ROL A
+        0x85, 0x20,         // 0408 STA $20
+        0x38,               // 040A SEC
+        0xA9, 0x01,         // 040B LDA #1
+        0x6A,               // 040D ROR A
+        0x85, 0x21,         // 040E STA $21
+        0x38,               // 0410 SEC
+        0x26, 0x10,         // 0411 ROL $10
+        0x66, 0x11,         // 0413 ROR $11
+        0x46, 0x12,         // 0415 LSR $12
+        0x4C, 0x17, 0x04,   // 0417 JMP $0417
+    };
+    load(code, sizeof(code));
+    mem.Data[0x10] = 0x40;
+    mem.Data[0x11] = 0x02;
+    mem.Data[0x12] = 0x03;
+    check(go(), "shifts run");
+    check((mem.Data[0x1FF] & 0x03) == 0x03, "LSR takes carry from bit 0 before the shift");
+    check(mem.Data[0x20] == 0x01, "ROL A shifts the carry in");
+    check(mem.Data[0x21] == 0x80, "ROR A shifts the carry in");
+    check(mem.Data[0x10] == 0x81, "ROL zp writes back with the carry in");
+    check(mem.Data[0x11] == 0x01, "ROR zp writes back");
+    check(mem.Data[0x12] == 0x01 && cpu.C, "LSR zp writes back and sets carry");
+}
+
+static void stack(void) {
+    static const Byte call[] = {
+        0x20, 0x00, 0x05,   // 0400 JSR $0500
+        0x4C, 0x03, 0x04,   // 0403 JMP $0403
+    };
+    load(call, sizeof(call));
+    mem.Data[0x0500] = 0x60;    // RTS
+    check(go() && cpu.PC == 0x0403 && cpu.SP == 0xFF, "JSR and RTS come back after the JSR");
+    check(mem.Data[0x1FF] == 0x04 && mem.Data[0x1FE] == 0x02, "JSR pushes the return address less one");
+
+    static const Byte brk[] = {
+        0x00, 0xEA,         // 0400 BRK
+    };
+    load(brk, sizeof(brk));
+    mem.Data[0x0500] = 0x4C;    // JMP $0500
+    mem.Data[0x0501] = 0x00;
+    mem.Data[0x0502] = 0x05;
+    mem.Data[0xFFFE] = 0x00;
+    mem.Data[0xFFFF] = 0x05;
+    check(go() && cpu.PC == 0x0500 && cpu.SP == 0xFC, "BRK goes through the vector");
+    check(mem.Data[0x1FF] == 0x04 && mem.Data[0x1FE] == 0x02, "BRK pushes PC + 2");
+    check(mem.Data[0x1FD] & 0x10, "BRK pushes B set");
+
+    static const Byte transfer[] = {
+        0xA2, 0x80,         // 0400 LDX #$80
+        0x9A,               // 0402 TXS
+        0xA2, 0x00,         // 0403 LDX #0
+        0xBA,               // 0405 TSX
+        0x08,               // 0406 PHP
+        0x68,               // 0407 PLA
+        0x4C, 0x08, 0x04,   // 0408 JMP $0408
+    };
+    load(transfer, sizeof(transfer));
+    check(go(), "transfers run");
+    check(cpu.SP == 0x80 && cpu.X == 0x80 && mem.Data[0x1FF] == 0, "TXS loads SP, TSX reads it");
+    check((cpu.A & 0x30) == 0x30, "PHP pushes B set");
+}
+
+static void indirect(void) {
+    static const Byte code[] = {
+        0x6C, 0xFF, 0x02,   // 0400 JMP ($02FF)
+    };
+    load(code, sizeof(code));
+    mem.Data[0x02FF] = 0x00;
+    mem.Data[0x0200] = 0x06;    // NMOS: high byte from the start of the page
+    mem.Data[0x0300] = 0x07;
+    mem.Data[0x0600] = 0x4C;    // JMP $0600
+    mem.Data[0x0601] = 0x00;
+    mem.Data[0x0602] = 0x06;
+    check(go() && cpu.PC == 0x0600, "JMP (ind) wraps in the page");
+}
+
+int main(void) {
+    for (stepped = 0; stepped < 2; stepped++) {
+        operands();
+        wrapping();
+        branches();
+        addressing();
+        counters();
+        compares();
+        shifts();
+        stack();
+        indirect();
+    }
+    if (!failed) printf("opcode: ok\n");
+    return failed;
+}
@@ -0,0 +1,140 @@
+#include "../digest.h"
+#include "../pool.h"
+#include "../rewind.h"
+#include "../state.h"
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Checks the machine pool: instances come out aligned, zeroed and
+ * attached to their own memory until the pool is used up; a destroyed
+ * instance is handed out again clean, whether its memory was changed by
+ * the guest or by the host, with only the pages that were touched zeroed;
+ * the counts add up; and a dirty-only pool zeroes the pages marked dirty,
+ * even where a state load, a digest or the rewinder cleared the flags.
+ */
+
+#define CAPACITY 64
+
+// fills page $30 with its own index, then stops
+static const Byte program[] = {
+    0xA2, 0x00,         // 0400 LDX #0
+    0x8A,               // 0402 TXA
+    0x9D, 0x00, 0x30,   // 0403 STA $3000,X
+    0xE8,               // 0406 INX
+    0xD0, 0xF9,         // 0407 BNE $0402
+    0x4C, 0x09, 0x04,   // 0409 JMP $0409
+};
+
+static Byte device_read(void *ctx, Word addr) {
+    (void)ctx;
+    return addr;
+}
+
+static void device_write(void *ctx, Word addr, Byte value) {
+    (void)ctx;
+    (void)addr;
+    (void)value;
+}
+
+static const PageHandler device = { .read = device_read, .write = device_write };
+
+static int clean(const CPU *cpu) {
+    static const Byte zero[0x10000];
+    static const PageHandler *none[0x100];
+    static CPU blank;
+    blank.mem = cpu->mem;
+    return memcmp(cpu, &blank, sizeof(blank)) == 0 && memcmp(cpu->mem->Data, zero, sizeof(zero)) == 0 &&
+           memcmp(cpu->mem->io, none, sizeof(none)) == 0 && memcmp(cpu->mem->dirty, zero, 0x100) == 0 &&
+           memcmp(cpu->mem->touched, zero, 0x100) == 0;
+}
+
+static Pool pool;
+static CPU *machines[CAPACITY];
+static Digest digest;
+static Rewinder rewinder;
+
+// the program at $0400, with its page marked as the dirty-only pool needs
+static void load(CPU *cpu) {
+    memcpy(&cpu->mem->Data[0x0400], program, sizeof(program));
+    cpu->mem->dirty[0x04] = 1;
+    cpu->PC = 0x0400;
+    cpu->SP = 0xFF;
+}
+
+static CPU *recycle(CPU *cpu) {
+    pool_destroy(&pool, cpu);
+    return pool_create(&pool);
+}
+
+int main(void) {
+    check(pool_init(&pool, 0, 0) == -1, "an empty pool is refused");
+    check(pool_init(&pool, CAPACITY, POOL_HUGE_PAGES) == 0, "pool");
+
+    int ok = 1;
+    for (int i = 0; i < CAPACITY; i++) {
+        CPU *cpu = machines[i] = pool_create(&pool);
+        ok &= cpu != NULL && (uintptr_t)cpu % POOL_LINE == 0 && (uintptr_t)cpu->mem % POOL_LINE == 0 &&
+              (Byte *)cpu->mem >= (Byte *)cpu + sizeof(CPU) && clean(cpu);
+        if (i > 0) ok &= machines[i]->mem != machines[i - 1]->mem;
+    }
+    check(ok, "instances aligned, clean and apart");
+    check(pool_create(&pool) == NULL, "nothing once the pool is used up");
+    check(pool.live == CAPACITY && pool.peak == CAPACITY && pool.created == CAPACITY && pool.recycled == 0,
+          "counts after filling the pool");
+
+    CPU *cpu = machines[5];
+    memcpy(&cpu->mem->Data[0x0400], program, sizeof(program));   // the host's own stores
+    cpu->mem->Data[0xFF00] = 0xAA;
+    map_io(cpu->mem, 0x60, &device);
+    cpu->PC = 0x0400;
+    cpu->SP = 0xFF;
+    cpu_run(cpu, 10000);
+    check(cpu->mem->Data[0x30FF] == 0xFF, "the guest ran");
+    pool_destroy(&pool, cpu);
+    check(pool.pages_zeroed == 3 && pool.live == CAPACITY - 1, "only the three touched pages zeroed");
+
+    CPU *again = pool_create(&pool);
+    check(again == cpu && clean(again), "recycled instance comes back clean");
+    check(pool.recycled == 1 && pool.created == CAPACITY + 1 && pool.peak == CAPACITY, "counts after recycling");
+
+    for (int i = 0; i < CAPACITY; i++) pool_destroy(&pool, machines[i]);
+    check(pool.live == 0, "all back");
+    ok = 1;
+    for (int i = 0; i < CAPACITY; i++) ok &= pool_create(&pool) != NULL;
+    check(ok && pool_create(&pool) == NULL, "every instance handed out again");
+    int huge = pool.huge;
+    pool_free(&pool);
+
+    check(pool_init(&pool, 1, POOL_DIRTY_ONLY) == 0, "dirty-only pool");
+    cpu = pool_create(&pool);
+    load(cpu);
+    cpu_run(cpu, 10000);
+    cpu = recycle(cpu);
+    check(pool.pages_zeroed == 2 && clean(cpu), "dirty-only pool zeroes the marked pages");
+
+    load(cpu);
+    cpu_run(cpu, 10000);
+    FILE *f = tmpfile();
+    check(f != NULL && state_save(cpu, fileno(f)) == 0, "save a state");
+    cpu = recycle(cpu);
+    check(state_load(cpu, fileno(f)) == 0 && cpu->mem->Data[0x30FF] == 0xFF, "load it into a recycled instance");
+    fclose(f);
+    cpu = recycle(cpu);
+    check(clean(cpu), "dirty-only pool zeroes the pages a state load brought in");
+
+    load(cpu);
+    digest_init(&digest, cpu->mem);
+    rewind_init(&rewinder, cpu, 500, 1 << 20);
+    rewind_run(&rewinder, 10000);
+    digest_update(&digest, cpu->mem);
+    check(rewind_to(&rewinder, 1000) == 0 && cpu->mem->Data[0x30FF] == 0, "rewound to the middle of the fill");
+    rewind_free(&rewinder);
+    cpu = recycle(cpu);
+    check(clean(cpu), "dirty-only pool zeroes pages digested and rewound over");
+    pool_free(&pool);
+
+    if (!failed) printf("pool  : ok, huge pages %s\n", huge ? "on" : "off");
+    return failed;
+}
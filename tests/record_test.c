@@ -0,0 +1,176 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../record.h"
+#include "../acia.h"
+#include "../via.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Checks record and replay: a guest taking VIA timer interrupts, polling
+ * the ACIA for input and calling a hook that hands it host randomness is
+ * recorded, then replayed on a fresh machine whose devices have no input
+ * and whose hook does something else; the replay ends where the recording
+ * did with the same registers and memory. A replay of a different image
+ * is caught as a divergence.
+ */
+
+#define CYCLES 2000000
+#define VIA_PAGE 0x60
+#define ACIA_PAGE 0x61
+
+static const Byte program[] = {
+    0xA9, 0xC0,         // 0400 LDA #$C0        T1 interrupts on
+    0x8D, 0x0E, 0x60,   // 0402 STA $600E
+    0xA9, 0x40,         // 0405 LDA #$40        T1 free running
+    0x8D, 0x0B, 0x60,   // 0407 STA $600B
+    0xA9, 0x37,         // 040A LDA #$37
+    0x8D, 0x04, 0x60,   // 040C STA $6004
+    0xA9, 0x05,         // 040F LDA #$05
+    0x8D, 0x05, 0x60,   // 0411 STA $6005
+    0x58,               // 0414 CLI
+    0xAD, 0x01, 0x61,   // 0415 LDA $6101       ACIA status
+    0x29, 0x08,         // 0418 AND #$08
+    0xF0, 0x08,         // 041A BEQ $0424
+    0xAD, 0x00, 0x61,   // 041C LDA $6100       a byte in
+    0xA6, 0x30,         // 041F LDX $30
+    0x9D, 0x00, 0x03,   // 0421 STA $0300,X
+    0xE6, 0x30,         // 0424 INC $30         (also reached with nothing in)
+    0x20, 0x00, 0x07,   // 0426 JSR $0700       hooked: randomness
+    0x45, 0x31,         // 0429 EOR $31
+    0x85, 0x31,         // 042B STA $31
+    0x4C, 0x15, 0x04,   // 042D JMP $0415
+};
+
+static const Byte handler[] = {
+    0x48,               // 0500 PHA
+    0xAD, 0x04, 0x60,   // 0501 LDA $6004       acknowledge T1
+    0xE6, 0x32,         // 0504 INC $32
+    0xA5, 0x32,         // 0506 LDA $32
+    0x45, 0x31,         // 0508 EOR $31
+    0x85, 0x31,         // 050A STA $31
+    0x68,               // 050C PLA
+    0x40,               // 050D RTI
+};
+
+// a random byte in A and somewhere in page 2
+static void noise(CPU *cpu, void *ctx) {
+    (void)ctx;
+    int r = rand();
+    cpu->A = r;
+    write_byte(cpu, 0x0200 | (r >> 8 & 0xFF), r >> 16);
+}
+
+static void nothing(CPU *cpu, void *ctx) {
+    (void)cpu;
+    (void)ctx;
+}
+
+typedef struct {
+    CPU cpu;
+    Memory mem;
+    Hooks hooks;
+    Scheduler s;
+    Via via;
+    Acia acia;
+} Machine;
+
+static void start(Machine *m, HookFn hook, const char *input) {
+    machine(&m->cpu, &m->mem, program, sizeof(program), 0x0400);
+    memcpy(&m->mem.Data[0x0500], handler, sizeof(handler));
+    m->mem.Data[0x0700] = 0x60;
+    m->mem.Data[0xFFFE] = 0x00;
+    m->mem.Data[0xFFFF] = 0x05;
+    m->cpu.I = 1;
+    hooks_init(&m->hooks);
+    hook_add(&m->hooks, 0x0700, hook, NULL, 40);
+    m->cpu.hooks = &m->hooks;
+    sched_init(&m->s, &m->cpu);
+    via_init(&m->via, &m->s, VIA_PAGE, 1);
+    acia_init(&m->acia, &m->s, ACIA_PAGE, 2, -1);
+    acia_input_buffer(&m->acia, (const Byte *)input, strlen(input));
+}
+
+static int same(const Machine *a, const Machine *b) {
+    const CPU *x = &a->cpu, *y = &b->cpu;
+    return x->cycles == y->cycles && x->PC == y->PC && x->A == y->A && x->X == y->X && x->Y == y->Y &&
+           x->SP == y->SP && x->N == y->N && x->V == y->V && x->D == y->D && x->I == y->I &&
+           x->Z == y->Z && x->C == y->C && memcmp(a->mem.Data, b->mem.Data, 0x10000) == 0;
+}
+
+static Machine recorded, replayed;
+static Recorder rec, rep;
+
+int main(void) {
+    srand(time(NULL) ^ getpid());
+    FILE *log = tmpfile();
+    int fd = fileno(log);
+
+    start(&recorded, noise, "hello, replay");
+    check(record_start(&rec, &recorded.cpu, fd) == 0, "record");
+    sched_run(&recorded.s, CYCLES);
+    check(record_finish(&rec) == 0, "log written");
+    check(recorded.mem.Data[0x32] > 100 && acia_input_done(&recorded.acia), "the run took interrupts and input");
+    long size = lseek(fd, 0, SEEK_END);
+    u_int64_t records = rec.records;
+
+    start(&replayed, nothing, "");
+    lseek(fd, 0, SEEK_SET);
+    check(replay_start(&rep, &replayed.cpu, fd) == 0, "replay");
+    RunResult r = replay_run(&rep, CYCLES / 2);
+    check(r == RUN_DEADLINE && !rep.diverged, "replay in pieces");
+    r = replay_run(&rep, CYCLES_FOREVER);
+    check(r == RUN_TRAP && !rep.diverged, "replay ends where the recording did");
+    check(same(&recorded, &replayed), "replay is bit for bit the recorded run");
+    record_finish(&rep);
+    check(replayed.hooks.hook[0].fn == nothing && replayed.mem.io[VIA_PAGE] == &replayed.via.page,
+          "hooks and devices given back");
+
+    start(&replayed, nothing, "");
+    replayed.mem.Data[0x0419] = 0x04;   // AND #$04: never takes the input
+    lseek(fd, 0, SEEK_SET);
+    replay_start(&rep, &replayed.cpu, fd);
+    check(replay_run(&rep, CYCLES_FOREVER) == RUN_TRAP && rep.diverged && replayed.cpu.cycles < recorded.cpu.cycles,
+          "a different run diverges");
+    record_finish(&rep);
+
+    start(&replayed, nothing, "");
+    replayed.cpu.cycles = 5;
+    lseek(fd, 0, SEEK_SET);
+    check(replay_start(&rep, &replayed.cpu, fd) == -1 && replayed.hooks.hook[0].fn == nothing,
+          "a log from another starting point is refused");
+    fclose(log);
+
+    // a short log cut at every byte: the replay stops where it ends, and
+    // one cut inside a record diverges rather than taking part of it
+    log = tmpfile();
+    fd = fileno(log);
+    start(&recorded, noise, "cut");
+    record_start(&rec, &recorded.cpu, fd);
+    sched_run(&recorded.s, 1000);
+    record_finish(&rec);
+    long short_size = lseek(fd, 0, SEEK_END);
+    Byte *whole = malloc(short_size);
+    pread(fd, whole, short_size, 0);
+    int stops = 1, diverged = 0;
+    for (long cut = 16; cut < short_size; cut++) {
+        FILE *part = tmpfile();
+        write(fileno(part), whole, cut);
+        lseek(fileno(part), 0, SEEK_SET);
+        start(&replayed, nothing, "");
+        replay_start(&rep, &replayed.cpu, fileno(part));
+        stops &= replay_run(&rep, CYCLES_FOREVER) == RUN_TRAP && replayed.cpu.cycles <= recorded.cpu.cycles;
+        diverged |= rep.diverged;
+        record_finish(&rep);
+        fclose(part);
+    }
+    check(stops && diverged, "a log cut short stops where it ends");
+    free(whole);
+    fclose(log);
+
+    if (!failed) printf("record: ok, %llu records in %ld bytes\n", (unsigned long long)records, size);
+    return failed;
+}
@@ -0,0 +1,149 @@
+#include "../rewind.h"
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Checks reverse execution against a reference run stepped one
+ * instruction at a time: going back to any cycle lands on the instruction
+ * boundary the reference passed there, with the same registers and
+ * memory; stepping back walks the reference backwards; continuing back
+ * finds the last breakpoint and watchpoint hits; running forward again
+ * after going back gives the same result; and a small budget bounds the
+ * history kept.
+ */
+
+#define CYCLES 60000
+#define STEPS 30000
+
+// scribbles a counter over pages $20-$3F at addresses from an LFSR in $10
+static const Byte program[] = {
+    0xA5, 0x10,         // 0400 LDA $10
+    0x0A,               // 0402 ASL A
+    0x90, 0x02,         // 0403 BCC $0407
+    0x49, 0x1D,         // 0405 EOR #$1D
+    0x85, 0x10,         // 0407 STA $10
+    0x29, 0x1F,         // 0409 AND #$1F
+    0x09, 0x20,         // 040B ORA #$20
+    0x85, 0x13,         // 040D STA $13
+    0xA5, 0x10,         // 040F LDA $10
+    0x85, 0x12,         // 0411 STA $12
+    0xE6, 0x14,         // 0413 INC $14
+    0xA5, 0x14,         // 0415 LDA $14
+    0x91, 0x12,         // 0417 STA ($12),Y
+    0x4C, 0x00, 0x04,   // 0419 JMP $0400
+};
+
+// the reference run, at every instruction boundary
+static struct {
+    u_int64_t cycles, hash;
+    Word pc, ptr;
+} ref[STEPS];
+static int steps;
+
+static u_int64_t state(const CPU *cpu) {
+    u_int64_t h = 14695981039346656037ull;
+    Byte regs[] = { cpu->A, cpu->X, cpu->Y, cpu->SP, cpu->PC & 0xFF, cpu->PC >> 8,
+                    cpu->N << 7 | cpu->V << 6 | cpu->D << 3 | cpu->I << 2 | cpu->Z << 1 | cpu->C };
+    for (size_t i = 0; i < sizeof(regs); i++) h = (h ^ regs[i]) * 1099511628211ull;
+    for (int a = 0; a < 0x100; a++) h = (h ^ cpu->mem->Data[a]) * 1099511628211ull;
+    for (int a = 0x2000; a < 0x4000; a++) h = (h ^ cpu->mem->Data[a]) * 1099511628211ull;
+    return h;
+}
+
+static void start(CPU *cpu, Memory *mem) {
+    machine(cpu, mem, program, sizeof(program), 0x0400);
+    mem->Data[0x10] = 1;
+}
+
+// the reference boundary at or before cycle
+static int boundary(u_int64_t cycle) {
+    int i = steps - 1;
+    while (i > 0 && ref[i].cycles > cycle) i--;
+    return i;
+}
+
+static int matches(const CPU *cpu, int i) {
+    return cpu->cycles == ref[i].cycles && state(cpu) == ref[i].hash;
+}
+
+static CPU cpu;
+static Memory mem;
+static Rewinder rw;
+static Debugger dbg;
+
+int main(void) {
+    static CPU rcpu;
+    static Memory rmem;
+    static Debugger rdbg;
+    start(&rcpu, &rmem);
+    debug_init(&rdbg, &rcpu);
+    rdbg.step = 1;
+    while (steps < STEPS && rcpu.cycles <= CYCLES + 100) {
+        ref[steps].cycles = rcpu.cycles;
+        ref[steps].hash = state(&rcpu);
+        ref[steps].pc = rcpu.PC;
+        ref[steps].ptr = rmem.Data[0x12] | rmem.Data[0x13] << 8;
+        steps++;
+        cpu_run(&rcpu, rcpu.cycles + 1);
+    }
+
+    start(&cpu, &mem);
+    rewind_init(&rw, &cpu, 5000, 1 << 20);
+    check(rewind_run(&rw, CYCLES) == RUN_DEADLINE, "forward run");
+    int end = boundary(cpu.cycles);
+    check(matches(&cpu, end), "forward run in pieces matches the reference");
+
+    u_int64_t targets[] = { 59999, 45000, 44999, 30001, 12345, 5000, 4999, 100, 0 };
+    int ok = 1;
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+        ok &= rewind_to(&rw, targets[t]) == 0 && matches(&cpu, boundary(targets[t]));
+    }
+    check(ok, "back to any cycle");
+    check(rewind_to(&rw, 10) == -1, "not forward");
+
+    check(rewind_run(&rw, CYCLES) == RUN_DEADLINE && matches(&cpu, boundary(cpu.cycles)),
+          "forward again after going back");
+    int at = boundary(cpu.cycles);
+    ok = 1;
+    for (int i = 1; i <= 50; i++) ok &= rewind_step(&rw) == 0 && matches(&cpu, at - i);
+    check(ok, "stepping back walks the reference backwards");
+
+    debug_init(&dbg, &cpu);
+    break_add(&dbg, 0x0413);
+    at = boundary(cpu.cycles);
+    for (int n = 0; n < 3; n++) {
+        do at--;
+        while (ref[at].pc != 0x0413);
+        RunResult r = rewind_continue(&rw);
+        if (r != RUN_BREAKPOINT || !matches(&cpu, at)) ok = 0;
+    }
+    check(ok, "continuing back stops at the last breakpoint hits");
+    break_remove(&dbg, 0x0413);
+
+    // the write to watch: the next one the program makes, found back from the end
+    Word watched = ref[boundary(CYCLES / 2)].ptr;
+    check(watch_add(&dbg, watched, WATCH_WRITE) == 0, "watch");
+    rewind_run(&rw, CYCLES);
+    at = boundary(cpu.cycles);
+    do at--;
+    while (!(ref[at - 1].pc == 0x0417 && ref[at - 1].ptr == watched));
+    check(rewind_continue(&rw) == RUN_WATCHPOINT && matches(&cpu, at) && dbg.hit_addr == watched,
+          "continuing back stops after the last watched store");
+    watch_remove(&dbg, watched, WATCH_WRITE);
+    check(rewind_continue(&rw) == RUN_DEADLINE && cpu.cycles == rewind_oldest(&rw), "nothing left: oldest checkpoint");
+    debug_detach(&dbg);
+    rewind_free(&rw);
+
+    start(&cpu, &mem);
+    rewind_init(&rw, &cpu, 1000, 8 * 257);
+    rewind_run(&rw, CYCLES);
+    check(rw.used <= rw.budget && rewind_oldest(&rw) > 0, "history is bounded by the budget");
+    u_int64_t oldest = rewind_oldest(&rw);
+    check(rewind_to(&rw, oldest - 1) == -1, "nothing before the oldest checkpoint");
+    check(rewind_to(&rw, oldest + 10) == 0 && matches(&cpu, boundary(oldest + 10)), "back within what is kept");
+    rewind_free(&rw);
+
+    if (!failed) printf("rewind: ok, %d reference steps\n", steps);
+    return failed;
+}
@@ -0,0 +1,168 @@
+#include "../sched.h"
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Checks the event scheduler: events fire in cycle order with ties in the
+ * order they were added, cancelled events do not fire, events added from
+ * a callback fire when due, and sched_run() stops the CPU at each event.
+ * A guest polling a device register is skipped ahead to the next event
+ * only when the device says its reads are steady.
+ */
+
+#define EVENTS 48
+
+static u_int64_t fired[EVENTS * 2];
+static int fired_tag[EVENTS * 2];
+static int nfired;
+
+static void record(void *ctx, u_int64_t when) {
+    fired[nfired] = when;
+    fired_tag[nfired] = (int)(size_t)ctx;
+    nfired++;
+}
+
+static void order(void) {
+    Scheduler s;
+    sched_init(&s, NULL);
+    u_int64_t ids[EVENTS];
+    unsigned seed = 1;
+    for (int i = 0; i < EVENTS; i++) {
+        seed = seed * 1103515245 + 12345;
+        ids[i] = sched_add(&s, (seed >> 16) % 16, record, (void *)(size_t)i);
+    }
+    check(sched_cancel(&s, ids[5]) == 1, "cancel pending event");
+    check(sched_cancel(&s, ids[5]) == 0, "cancel twice");
+
+    nfired = 0;
+    sched_fire(&s, 7);
+    for (int i = 0; i < nfired; i++) check(fired[i] <= 7, "fired before due");
+    int early = nfired;
+    sched_fire(&s, CYCLES_FOREVER - 1);
+    check(nfired == EVENTS - 1, "every event but the cancelled one fires");
+    check(early < nfired, "later events wait");
+    for (int i = 1; i < nfired; i++) {
+        check(fired[i - 1] < fired[i] || (fired[i - 1] == fired[i] && fired_tag[i - 1] < fired_tag[i]),
+              "cycle order, ties in insertion order");
+    }
+    for (int i = 0; i < nfired; i++) check(fired_tag[i] != 5, "cancelled event fired");
+    check(sched_next(&s) == CYCLES_FOREVER, "empty queue has no deadline");
+
+    for (int i = 0; i < SCHED_MAX; i++) sched_add(&s, i, record, NULL);
+    check(sched_add(&s, 0, record, NULL) == 0, "add to a full queue");
+}
+
+// a periodic device: sets a mailbox the guest polls and re-arms itself
+typedef struct {
+    Scheduler *s;
+    Memory *mem;
+    u_int64_t period;
+    int ticks;
+    u_int64_t late;     // largest distance between due and actual cycle
+} Ticker;
+
+static void tick(void *ctx, u_int64_t when) {
+    Ticker *t = ctx;
+    u_int64_t late = t->s->cpu->cycles - when;
+    if (late > t->late) t->late = late;
+    t->mem->Data[0x0200] = 1;
+    t->ticks++;
+    sched_add(t->s, when + t->period, tick, t);
+}
+
+static void run(void) {
+    static const Byte poll[] = {
+        0xAD, 0x00, 0x02,   // 0400 LDA $0200
+        0xF0, 0xFB,         // 0403 BEQ $0400
+        0xEE, 0x01, 0x02,   // 0405 INC $0201
+        0xA9, 0x00,         // 0408 LDA #0
+        0x8D, 0x00, 0x02,   // 040A STA $0200
+        0x4C, 0x00, 0x04,   // 040D JMP $0400
+    };
+    static CPU cpu;
+    static Memory mem;
+    init_mem(&mem);
+    memcpy(&mem.Data[0x0400], poll, sizeof(poll));
+    cpu.mem = &mem;
+    cpu_reset(&cpu);
+    cpu.PC = 0x0400;
+
+    Scheduler s;
+    sched_init(&s, &cpu);
+    Ticker t = { .s = &s, .mem = &mem, .period = 1000 };
+    sched_add(&s, 1000, tick, &t);
+
+    check(sched_run(&s, 100500) == RUN_DEADLINE, "sched_run reaches its deadline");
+    check(t.ticks == 100, "periodic event count");
+    check(mem.Data[0x0201] == 100, "guest saw every event");
+    check(t.late < 8, "events fire within an instruction of their cycle");
+    check(cpu.cycles >= 100500 && cpu.cycles < 100508, "stopped at the deadline");
+
+    // nothing can wake a JMP to itself
+    Scheduler idle;
+    sched_init(&idle, &cpu);
+    mem.Data[0x0500] = 0x4C;
+    mem.Data[0x0501] = 0x00;
+    mem.Data[0x0502] = 0x05;
+    cpu.PC = 0x0500;
+    check(sched_run(&idle, CYCLES_FOREVER) == RUN_TRAP, "stuck CPU with no events traps");
+}
+
+// a raster line register at $D012, latched once every LINE cycles
+#define LINE 64
+
+typedef struct {
+    Scheduler *s;
+    Byte line;
+} Raster;
+
+static Byte raster_read(void *ctx, Word addr) {
+    (void)addr;
+    return ((Raster *)ctx)->line;
+}
+
+static void raster_write(void *ctx, Word addr, Byte value) {
+    (void)ctx;
+    (void)addr;
+    (void)value;
+}
+
+static void next_line(void *ctx, u_int64_t when) {
+    Raster *r = ctx;
+    r->line++;
+    sched_add(r->s, when + LINE, next_line, r);
+}
+
+// waits for line 100, then stores it; returns the cycles skipped
+static u_int64_t raster(int steady) {
+    static const Byte wait[] = {
+        0xAD, 0x12, 0xD0,   // 0400 LDA $D012
+        0xC9, 0x64,         // 0403 CMP #100
+        0xD0, 0xF9,         // 0405 BNE $0400
+        0x8D, 0x00, 0x02,   // 0407 STA $0200
+        0xEE, 0x01, 0x02,   // 040A INC $0201    busy, never idle
+        0x4C, 0x0A, 0x04,   // 040D JMP $040A
+    };
+    static CPU cpu;
+    static Memory mem;
+    machine(&cpu, &mem, wait, sizeof(wait), 0x0400);
+    Scheduler s;
+    sched_init(&s, &cpu);
+    Raster r = { .s = &s };
+    PageHandler page = { .read = raster_read, .write = raster_write, .ctx = &r, .steady_reads = steady };
+    map_io(&mem, 0xD0, &page);
+    sched_add(&s, LINE, next_line, &r);
+    sched_run(&s, 120 * LINE);
+    check(mem.Data[0x0200] == 100, "the poll sees line 100");
+    return cpu.idle_cycles;
+}
+
+int main(void) {
+    order();
+    run();
+    check(raster(1) > 50 * LINE, "a poll of steady reads is skipped");
+    check(raster(0) == 0, "a poll of other device reads is not");
+    if (!failed) printf("sched : ok\n");
+    return failed;
+}
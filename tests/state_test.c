@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../state.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Checks save states: a machine saved mid-run and loaded over a different
+ * one carries on exactly as the original does; memory of every kind (empty,
+ * runs, text, noise) comes back byte for byte; a typical image packs small;
+ * and truncated, corrupt or newer states are refused.
+ */
+
+// the LFSR scribbler from the rewind test
+static const Byte program[] = {
+    0xA5, 0x10,         // 0400 LDA $10
+    0x0A,               // 0402 ASL A
+    0x90, 0x02,         // 0403 BCC $0407
+    0x49, 0x1D,         // 0405 EOR #$1D
+    0x85, 0x10,         // 0407 STA $10
+    0x29, 0x1F,         // 0409 AND #$1F
+    0x09, 0x20,         // 040B ORA #$20
+    0x85, 0x13,         // 040D STA $13
+    0xA5, 0x10,         // 040F LDA $10
+    0x85, 0x12,         // 0411 STA $12
+    0xE6, 0x14,         // 0413 INC $14
+    0xA5, 0x14,         // 0415 LDA $14
+    0x91, 0x12,         // 0417 STA ($12),Y
+    0x4C, 0x00, 0x04,   // 0419 JMP $0400
+};
+
+static CPU cpu, copy;
+static Memory mem, mem2;
+static Byte state[0x20000];
+static size_t packed;
+
+static Byte dummy_read(void *ctx, Word addr) {
+    (void)ctx;
+    return addr;
+}
+
+static void dummy_write(void *ctx, Word addr, Byte value) {
+    (void)ctx;
+    (void)addr;
+    (void)value;
+}
+
+static const PageHandler device = { .read = dummy_read, .write = dummy_write };
+
+// saves cpu to a temporary file and reads the bytes back into state
+static size_t save(void) {
+    FILE *f = tmpfile();
+    int ok = state_save(&cpu, fileno(f)) == 0;
+    size_t len = lseek(fileno(f), 0, SEEK_END);
+    lseek(fileno(f), 0, SEEK_SET);
+    ok &= read(fileno(f), state, sizeof(state)) == (ssize_t)len;
+    fclose(f);
+    check(ok, "save");
+    return len;
+}
+
+static int same_registers(const CPU *a, const CPU *b) {
+    return a->PC == b->PC && a->SP == b->SP && a->A == b->A && a->X == b->X && a->Y == b->Y &&
+           a->N == b->N && a->V == b->V && a->B == b->B && a->D == b->D && a->I == b->I &&
+           a->Z == b->Z && a->C == b->C && a->opcodes == b->opcodes && a->irq == b->irq &&
+           a->cycles == b->cycles && a->writes == b->writes && a->edge_prev == b->edge_prev;
+}
+
+static void fresh_copy(void) {
+    memset(&copy, 0, sizeof(copy));
+    memset(mem2.Data, 0xA5, sizeof(mem2.Data));
+    memset(mem2.dirty, 1, sizeof(mem2.dirty));
+    copy.mem = &mem2;
+    map_io(&mem2, 0x60, &device);
+}
+
+static void roundtrip(void) {
+    machine(&cpu, &mem, program, sizeof(program), 0x0400);
+    mem.Data[0x10] = 1;
+    cpu.opcodes = OPCODES_NMOS;
+    cpu.irq = 0x04;
+    cpu.I = cpu.B = 1;
+    cpu.edge_prev = 0x1234;
+    cpu_run(&cpu, 123457);
+
+    size_t len = save();
+    check(len < 12 * 1024, "the image packs small");
+    fresh_copy();
+    check(state_decode(&copy, state, len) == 0, "load");
+    check(same_registers(&cpu, &copy) && memcmp(mem.Data, mem2.Data, 0x10000) == 0, "same registers and memory");
+    check(mem2.io[0x60] == &device && mem2.dirty[0x20] == 0, "mappings kept, dirty flags cleared");
+
+    cpu_run(&cpu, 300000);
+    cpu_run(&copy, 300000);
+    check(same_registers(&cpu, &copy) && memcmp(mem.Data, mem2.Data, 0x10000) == 0,
+          "the loaded machine carries on like the original");
+
+    FILE *f = tmpfile();
+    state_save(&cpu, fileno(f));
+    fresh_copy();
+    check(state_load(&copy, fileno(f)) == 0 && same_registers(&cpu, &copy) &&
+          memcmp(mem.Data, mem2.Data, 0x10000) == 0, "load from a mapped file");
+    fclose(f);
+    packed = len;
+}
+
+// pages of every kind, at random
+static void contents(void) {
+    int ok = 1;
+    for (int round = 0; round < 200; round++) {
+        init_mem(&mem);
+        for (int page = 0; page < 0x100; page++) {
+            Byte *p = &mem.Data[page << 8];
+            switch (rand() % 5) {
+                case 0: break;
+                case 1: for (int i = 0; i < 256; i++) p[i] = rand(); break;
+                case 2: for (int i = 0; i < 256; i++) p[i] = "HELLO, WORLD. "[i % 14]; break;
+                case 3:
+                    for (int i = 0; i < 256;) {
+                        int run = 1 + rand() % 40;
+                        Byte b = rand() % 3 ? rand() : 0;
+                        for (; run > 0 && i < 256; run--) p[i++] = b;
+                    }
+                    break;
+                default: p[rand() % 256] = 1 + rand() % 255; break;
+            }
+        }
+        cpu.PC = rand();
+        size_t len = save();
+        fresh_copy();
+        ok &= state_decode(&copy, state, len) == 0 && memcmp(mem.Data, mem2.Data, 0x10000) == 0 && copy.PC == cpu.PC;
+    }
+    check(ok, "every kind of page comes back");
+}
+
+static void refused(void) {
+    init_mem(&mem);
+    memcpy(&mem.Data[0x0400], program, sizeof(program));
+    memset(&mem.Data[0x2000], 0x42, 0x80);
+    for (int i = 0; i < 256; i++) mem.Data[0x3000 + i] = rand();
+    cpu.PC = 0x0400;
+    size_t len = save();
+    fresh_copy();
+    copy.PC = 0xBEEF;
+    int ok = 1;
+    for (size_t cut = 0; cut < len; cut++) ok &= state_decode(&copy, state, cut) == -1;
+    check(ok && copy.PC == 0xBEEF, "truncated states are refused, registers untouched");
+
+    state[8] = STATE_VERSION + 1;
+    check(state_decode(&copy, state, len) == -1, "newer version refused");
+    state[8] = STATE_VERSION;
+    check(state_decode(&copy, state, len) == 0, "the original loads");
+
+    // the first packed page starts with a back reference to nothing
+    size_t at = 47 + 2;
+    state[at] = 0x85;
+    state[at + 1] = 0x00;
+    check(state_decode(&copy, state, len) == -1, "a reference before the page start is refused");
+    state[0] ^= 1;
+    check(state_decode(&copy, state, len) == -1, "bad magic refused");
+}
+
+int main(void) {
+    srand(6502);
+    roundtrip();
+    contents();
+    refused();
+    if (!failed) printf("state : ok, %zu bytes for the test image\n", packed);
+    return failed;
+}
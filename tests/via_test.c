@@ -0,0 +1,169 @@
+#include "../via.h"
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Checks the 6522: timer counts worked out from the cycle counter against
+ * the datasheet sequence, interrupt flag and enable handling, the shift
+ * register, and an IRQ driven guest woken by a free running T1.
+ */
+
+#define PAGE 0x60
+#define REG(r) (PAGE << 8 | (r))
+
+static CPU cpu;
+static Memory mem;
+static Scheduler s;
+static Via via;
+
+static void setup(void) {
+    machine(&cpu, &mem, NULL, 0, 0);
+    cpu.cycles = 1000;
+    sched_init(&s, &cpu);
+    check(via_init(&via, &s, PAGE, 1) == 0, "map the VIA");
+}
+
+// moves the clock to cycle t, firing whatever falls due on the way
+static void at(u_int64_t t) {
+    while (sched_next(&s) <= t) {
+        cpu.cycles = sched_next(&s);
+        sched_fire(&s, cpu.cycles);
+    }
+    cpu.cycles = t;
+}
+
+static void timers(void) {
+    setup();
+    check(via_init(&via, &s, 0x01, 1) != 0, "stack page cannot be mapped");
+    setup();
+
+    // one-shot: N .. 0, FFFF and on down, one interrupt
+    write_byte(&cpu, REG(VIA_IER), 0x80 | VIA_T1);
+    write_byte(&cpu, REG(VIA_T1CL), 0x10);
+    write_byte(&cpu, REG(VIA_T1CH), 0x00);
+    check(via_t1(&via) == 0x10, "T1 loads from the latch");
+    at(1005);
+    check(read_byte(&cpu, REG(VIA_T1CH)) == 0 && via_t1(&via) == 11, "T1 counts down");
+    // an instruction reads with its own cycles already counted
+    mem.Data[0x0400] = 0xAD;        // LDA $6004
+    mem.Data[0x0401] = 0x04;
+    mem.Data[0x0402] = PAGE;
+    cpu.PC = 0x0400;
+    execute_instructions(&cpu);
+    check(cpu.A == 11 - 4, "a guest read sees the count after its instruction");
+    at(1016);
+    check(via_t1(&via) == 0 && !(via.ifr & VIA_T1), "no flag at zero");
+    at(1017);
+    check(via_t1(&via) == 0xFFFF && (via.ifr & VIA_T1), "flag as the count passes zero");
+    check(cpu.irq == 1, "enabled T1 pulls IRQ");
+    check(read_byte(&cpu, REG(VIA_IFR)) == (0x80 | VIA_T1), "IFR bit 7 follows IRQ");
+    check(read_byte(&cpu, REG(VIA_T1CL)) == 0xFF, "T1 keeps counting");
+    check(cpu.irq == 0 && via.ifr == 0, "reading T1C-L clears the flag");
+    at(1017 + 0x10000);
+    check(via.ifr == 0, "one-shot interrupts once");
+
+    // free running: N .. 0, FFFF, reload
+    setup();
+    write_byte(&cpu, REG(VIA_ACR), 0x40);
+    write_byte(&cpu, REG(VIA_T1CL), 3);
+    write_byte(&cpu, REG(VIA_T1CH), 0);
+    static const Word seq[] = { 3, 2, 1, 0, 0xFFFF, 3, 2, 1, 0, 0xFFFF, 3, 2 };
+    int underflows = 0;
+    for (int i = 0; i < (int)(sizeof(seq) / sizeof(seq[0])); i++) {
+        at(1000 + i);
+        check(via_t1(&via) == seq[i], "free running T1 sequence");
+        if (via.ifr & VIA_T1) {
+            underflows++;
+            write_byte(&cpu, REG(VIA_IFR), VIA_T1);
+        }
+    }
+    check(underflows == 2, "free running T1 interrupts every period");
+    at(1000 + 4 + 100 * 5);
+    check(via_t1(&via) == 0xFFFF, "free running T1 stays in phase");
+
+    // T2: one interrupt, then keeps counting
+    setup();
+    write_byte(&cpu, REG(VIA_T2CL), 0x20);
+    write_byte(&cpu, REG(VIA_T2CH), 0x01);
+    check(via_t2(&via) == 0x120, "T2 loads from latch and high byte");
+    at(1000 + 0x120 + 1);
+    check((via.ifr & VIA_T2) && via_t2(&via) == 0xFFFF, "T2 flags as it passes zero");
+    read_byte(&cpu, REG(VIA_T2CL));
+    at(1000 + 0x120 + 1 + 0x10000);
+    check(!(via.ifr & VIA_T2), "T2 interrupts once");
+}
+
+static void registers(void) {
+    setup();
+    write_byte(&cpu, REG(VIA_IER), 0x80 | VIA_CA1 | VIA_CB1);
+    check(read_byte(&cpu, REG(VIA_IER)) == (0x80 | VIA_CA1 | VIA_CB1), "IER set");
+    write_byte(&cpu, REG(VIA_IER), VIA_CB1);
+    check(read_byte(&cpu, REG(VIA_IER)) == (0x80 | VIA_CA1), "IER clear");
+    via_signal(&via, VIA_CB1);
+    check(via.ifr == VIA_CB1 && cpu.irq == 0, "disabled flag leaves IRQ alone");
+    via_signal(&via, VIA_CA1);
+    check(cpu.irq == 1, "enabled flag pulls IRQ");
+    read_byte(&cpu, REG(VIA_ORA));
+    check(via.ifr == VIA_CB1 && cpu.irq == 0, "reading port A clears CA1");
+
+    write_byte(&cpu, REG(VIA_DDRA), 0xF0);
+    write_byte(&cpu, REG(VIA_ORA), 0x5A);
+    via.pins_a = 0x0C;
+    check(read_byte(&cpu, REG(VIA_ORA_NH)) == 0x5C, "port A mixes outputs and input pins");
+    check(read_byte(&cpu, 0x6071) == 0x5C, "registers repeat through the page");
+
+    // shift out under the clock: eight bits, two cycles each
+    write_byte(&cpu, REG(VIA_ACR), 6 << 2);
+    write_byte(&cpu, REG(VIA_SR), 0xA5);
+    at(1015);
+    check(!(via.ifr & VIA_SR_DONE), "shift still running");
+    at(1016);
+    check((via.ifr & VIA_SR_DONE) && via.sr_out == 0xA5, "byte shifted out");
+    check(mem.Data[REG(VIA_SR)] == 0, "VIA page does not touch RAM");
+}
+
+// a guest that sleeps in a JMP * and counts T1 interrupts
+static void guest(void) {
+    static const Byte code[] = {
+        0xA9, 0x40,             // 0400 LDA #$40        free running T1
+        0x8D, 0x0B, 0x60,       // 0402 STA $600B
+        0xA9, 0xC0,             // 0405 LDA #$C0        enable T1 interrupt
+        0x8D, 0x0E, 0x60,       // 0407 STA $600E
+        0xA9, 0xE6,             // 040A LDA #<998
+        0x8D, 0x04, 0x60,       // 040C STA $6004
+        0xA9, 0x03,             // 040F LDA #>998
+        0x8D, 0x05, 0x60,       // 0411 STA $6005
+        0x58,                   // 0414 CLI
+        0x4C, 0x15, 0x04,       // 0415 JMP $0415
+    };
+    static const Byte handler[] = {
+        0xE6, 0x10,             // 0500 INC $10
+        0xAD, 0x04, 0x60,       // 0502 LDA $6004       acknowledge
+        0x40,                   // 0505 RTI
+    };
+    setup();
+    cpu.cycles = 0;
+    memcpy(&mem.Data[0x0400], code, sizeof(code));
+    memcpy(&mem.Data[0x0500], handler, sizeof(handler));
+    mem.Data[0xFFFE] = 0x00;
+    mem.Data[0xFFFF] = 0x05;
+    cpu.PC = 0x0400;
+    cpu.SP = 0xFF;
+    cpu.I = 1;
+
+    check(sched_run(&s, 100500) == RUN_DEADLINE, "guest runs to the deadline");
+    check(mem.Data[0x10] == 100, "one interrupt per 1000 cycles");
+    check(cpu.PC == 0x0415 && cpu.SP == 0xFF, "back in the idle loop");
+#ifndef NO_IDLE_SKIP
+    check(cpu.idle_cycles > 90000, "idle loop skipped between interrupts");
+#endif
+}
+
+int main(void) {
+    timers();
+    registers();
+    guest();
+    if (!failed) printf("via   : ok\n");
+    return failed;
+}
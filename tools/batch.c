@@ -0,0 +1,40 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../batch.h"
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Runs jobs from newline-delimited JSON on stdin, results to stdout:
+ *
+ *   batch [workers [window]]
+ *
+ * with a worker thread per online CPU and 64 jobs in flight per worker
+ * unless told otherwise, then prints throughput to stderr. See batch.h for
+ * the format.
+ */
+
+int main(int argc, char **argv) {
+    if (argc > 3) {
+        fprintf(stderr, "usage: %s [workers [window]]\n", argv[0]);
+        return 1;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = argc > 1 ? atoi(argv[1]) : cpus > 0 ? cpus : 1;
+    int window = argc > 2 ? atoi(argv[2]) : 64 * workers;
+    if (workers < 1 || window < 1) {
+        fprintf(stderr, "batch: workers and window must be at least 1\n");
+        return 1;
+    }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    BatchStats stats;
+    int result = batch_run(stdin, stdout, workers, window, &stats);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double seconds = t1.tv_sec - t0.tv_sec + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "batch: %llu jobs (%llu errors) in %.2f s, %.0f jobs/s, %.1f Mcycles/s, %d workers\n",
+            (unsigned long long)stats.jobs, (unsigned long long)stats.errors, seconds, stats.jobs / seconds,
+            stats.cycles / seconds / 1e6, workers);
+    if (result != 0) fprintf(stderr, "batch: input or output failed\n");
+    return result != 0;
+}
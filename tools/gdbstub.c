@@ -0,0 +1,73 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../gdb.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * Serves a binary image to GDB, or anything else speaking its remote
+ * protocol:
+ *
+ *   gdbstub image.bin load-address [socket-path | :port]
+ *
+ * The address is hex and the CPU starts at the reset vector. The socket
+ * defaults to :6502 on localhost. Clients are served one after the other
+ * against the same machine, until one of them kills it. A checkpoint every
+ * REVERSE_INTERVAL cycles, within REVERSE_BUDGET bytes, lets them step and
+ * continue backwards.
+ */
+
+#define REVERSE_INTERVAL 1000000
+#define REVERSE_BUDGET (64 << 20)
+
+static CPU cpu;
+static Memory mem;
+static GdbStub stub;
+static Rewinder rewinder;
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "usage: %s image.bin load-address [socket-path | :port]\n", argv[0]);
+        return 1;
+    }
+    char *end;
+    long load = strtol(argv[2], &end, 16);
+    if (*argv[2] == 0 || *end != 0 || load < 0 || load > 0xFFFF) {
+        fprintf(stderr, "gdbstub: bad address %s\n", argv[2]);
+        return 1;
+    }
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    init_mem(&mem);
+    fread(&mem.Data[load], 1, 0x10000 - load, f);
+    fclose(f);
+    cpu.mem = &mem;
+    cpu_reset(&cpu);
+    gdb_init(&stub, &cpu);
+    rewind_init(&rewinder, &cpu, REVERSE_INTERVAL, REVERSE_BUDGET);
+    stub.rewinder = &rewinder;
+
+    const char *where = argc == 4 ? argv[3] : ":6502";
+    int listener = gdb_listen(where);
+    if (listener < 0) {
+        perror(where);
+        return 1;
+    }
+    fprintf(stderr, "gdbstub: listening on %s, PC %04X\n", where, cpu.PC);
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            perror("accept");
+            return 1;
+        }
+        gdb_serve(&stub, fd);
+        close(fd);
+        if (stub.packet[0] == 'k') break;
+    }
+    close(listener);
+    return 0;
+}
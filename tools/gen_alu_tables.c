@@ -0,0 +1,98 @@
+#include "../6502.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Emits alu_tables.h for the ALU_TABLES backend. The tables are produced
+ * by running the computed helpers over every input, so both backends give
+ * the same answers by construction (and alu_test checks either build).
+ *
+ * Entries pack the result byte with the flags in their P positions:
+ * result | P << 8. alu_cmp only holds P since the register is unchanged.
+ * Tables are flat and indexed by carry << 16 | register << 8 | operand.
+ */
+
+static Byte flags(const CPU *c) {
+    return c->C | c->Z << 1 | c->V << 6 | c->N << 7;
+}
+
+static void emit_word(const char *decl, const Word *v, size_t n) {
+    printf("static const Word %s = {\n", decl);
+    for (size_t i = 0; i < n; i++) {
+        printf("%s0x%04X,%s", i % 12 ? " " : "    ", v[i], i % 12 == 11 || i == n - 1 ? "\n" : "");
+    }
+    printf("};\n\n");
+}
+
+static void emit_byte(const char *decl, const Byte *v, size_t n) {
+    printf("static const Byte %s = {\n", decl);
+    for (size_t i = 0; i < n; i++) {
+        printf("%s0x%02X,%s", i % 16 ? " " : "    ", v[i], i % 16 == 15 || i == n - 1 ? "\n" : "");
+    }
+    printf("};\n\n");
+}
+
+static Word adc_t[2][256][256], sbc_t[2][256][256];
+static Byte cmp_t[256][256];
+static Word asl_t[256], lsr_t[256], rol_t[2][256], ror_t[2][256];
+
+int main(void) {
+    CPU c;
+    for (int carry = 0; carry < 2; carry++) {
+        for (int a = 0; a < 256; a++) {
+            for (int val = 0; val < 256; val++) {
+                memset(&c, 0, sizeof(c));
+                c.A = a;
+                c.C = carry;
+                adc(&c, val);
+                adc_t[carry][a][val] = c.A | flags(&c) << 8;
+
+                memset(&c, 0, sizeof(c));
+                c.A = a;
+                c.C = carry;
+                sbc(&c, val);
+                sbc_t[carry][a][val] = c.A | flags(&c) << 8;
+            }
+        }
+        for (int val = 0; val < 256; val++) {
+            memset(&c, 0, sizeof(c));
+            c.C = carry;
+            Byte r = rol(&c, val);
+            rol_t[carry][val] = r | flags(&c) << 8;
+
+            memset(&c, 0, sizeof(c));
+            c.C = carry;
+            r = ror(&c, val);
+            ror_t[carry][val] = r | flags(&c) << 8;
+        }
+    }
+    for (int a = 0; a < 256; a++) {
+        for (int val = 0; val < 256; val++) {
+            memset(&c, 0, sizeof(c));
+            c.A = a;
+            cmp(&c, val);
+            cmp_t[a][val] = flags(&c);
+        }
+    }
+    for (int val = 0; val < 256; val++) {
+        memset(&c, 0, sizeof(c));
+        Byte r = asl(&c, val);
+        asl_t[val] = r | flags(&c) << 8;
+
+        memset(&c, 0, sizeof(c));
+        r = lsr(&c, val);
+        lsr_t[val] = r | flags(&c) << 8;
+    }
+
+    printf("// generated by tools/gen_alu_tables.c, do not edit\n\n");
+    printf("#ifndef ALU_TABLES_H\n#define ALU_TABLES_H\n\n");
+    emit_word("alu_adc[2 * 256 * 256]", &adc_t[0][0][0], 2 * 256 * 256);
+    emit_word("alu_sbc[2 * 256 * 256]", &sbc_t[0][0][0], 2 * 256 * 256);
+    emit_byte("alu_cmp[256 * 256]", &cmp_t[0][0], 256 * 256);
+    emit_word("alu_asl[256]", asl_t, 256);
+    emit_word("alu_lsr[256]", lsr_t, 256);
+    emit_word("alu_rol[2 * 256]", &rol_t[0][0], 2 * 256);
+    emit_word("alu_ror[2 * 256]", &ror_t[0][0], 2 * 256);
+    printf("#endif\n");
+    return 0;
+}
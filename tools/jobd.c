@@ -0,0 +1,52 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../jobs.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Runs the job server:
+ *
+ *   jobd socket-path [machines]
+ *
+ * with a pool of 64 machines unless told otherwise, until SIGINT or
+ * SIGTERM, then prints throughput and latency for the jobs it ran.
+ */
+
+static JobServer server;
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s socket-path [machines]\n", argv[0]);
+        return 1;
+    }
+    int machines = argc == 3 ? atoi(argv[2]) : 64;
+    if (job_server_init(&server, argv[1], machines) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    fprintf(stderr, "jobd: listening on %s, %d machines, huge pages %s\n", argv[1], machines,
+            server.pool.huge ? "on" : "off");
+    while (!stop) job_serve(&server, 1000);
+
+    JobStats stats;
+    job_stats(&server, &stats);
+    double seconds = stats.uptime_ns / 1e9;
+    fprintf(stderr, "jobd: %llu jobs in %.1f s, %.0f jobs/s, %.1f Mcycles/s\n", (unsigned long long)stats.jobs,
+            seconds, stats.jobs / seconds, stats.cycles / seconds / 1e6);
+    fprintf(stderr, "jobd: latency p50 %.1f us, p99 %.1f us, max %.1f us\n", stats.p50_ns / 1e3,
+            stats.p99_ns / 1e3, stats.max_ns / 1e3);
+    job_server_free(&server);
+    unlink(argv[1]);
+    return 0;
+}
@@ -0,0 +1,425 @@
+#include "../6502.h"
+#include "../opcodes.h"
+#include "../opinfo.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Ahead-of-time recompiler: reads a binary image and writes C for aot.h.
+ *
+ *   recompile image.bin load-address [entry ...]
+ *
+ * Addresses are hex. Without entries the reset vector is used. Every entry
+ * and every JSR target found from one becomes a routine, compiled into a
+ * function holding all the code reachable from it by branches, JMPs and
+ * returns from the JSRs it makes. Jump tables and vectors are invisible to
+ * the recompiler; give their targets as entries to have them compiled.
+ *
+ * Code it cannot follow ends a path with an exit to the interpreter: BRK,
+ * RTI, undocumented opcodes, bytes outside the image, and JMP (ind), which
+ * leaves with PC at wherever the pointer sends it.
+ */
+
+#define MAX_ROUTINES 4096
+
+static Byte image[0x10000];
+static bool loaded[0x10000];
+
+static Word routine[MAX_ROUTINES];
+static int routines;
+static bool is_routine[0x10000];
+
+// the routine being compiled
+static bool seen[0x10000], leader[0x10000];
+static Word todo[2 * 0x10000 + 1];
+
+// blocks aot_lookup() knows, and the code bytes aot_matches() checks
+static int owner[0x10000];
+static bool compiled[0x10000];
+
+static void add_routine(Word addr) {
+    if (is_routine[addr]) return;
+    if (routines == MAX_ROUTINES) {
+        fprintf(stderr, "recompile: more than %d routines\n", MAX_ROUTINES);
+        exit(1);
+    }
+    is_routine[addr] = true;
+    routine[routines++] = addr;
+}
+
+static int length(Word pc) {
+    return mode_bytes[opinfo[image[pc]].mode];
+}
+
+// documented and wholly inside the image
+static bool compilable(Word pc) {
+    if (!loaded[pc] || !opinfo[image[pc]].documented) return false;
+    for (int i = 1; i < length(pc); i++) {
+        if (!loaded[(Word)(pc + i)]) return false;
+    }
+    Byte op = image[pc];
+    return op != BRK_IMPL && op != RTI_IMPL;
+}
+
+static Word operand(Word pc) {
+    return image[(Word)(pc + 1)] | image[(Word)(pc + 2)] << 8;
+}
+
+static Word branch_target(Word pc) {
+    return pc + 2 + (int8_t)image[(Word)(pc + 1)];
+}
+
+// an instruction that jumps to itself is left to the interpreter, which
+// sees it as a trap or an idle loop
+static bool self_jump(Word pc) {
+    Byte op = image[pc];
+    if (op == JMP_ABS) return operand(pc) == pc;
+    return opinfo[op].mode == MODE_REL && branch_target(pc) == pc;
+}
+
+// stores outside zero page and the stack may reach a device
+static bool may_be_io(Word pc) {
+    Byte mode = opinfo[image[pc]].mode;
+    if (mode == MODE_ZP || mode == MODE_ZPX || mode == MODE_ZPY) return false;
+    return mode != MODE_ABS || operand(pc) >= IO_FIRST_PAGE << 8;
+}
+
+static bool writes(Byte op) {
+    static const char *const names[] = {"STA", "STX", "STY", "ASL", "LSR", "ROL", "ROR", "INC", "DEC"};
+    if (opinfo[op].mode == MODE_ACC) return false;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(opinfo[op].name, names[i]) == 0) return true;
+    }
+    return false;
+}
+
+static bool falls_through(Word pc) {
+    Byte op = image[pc];
+    return compilable(pc) && !self_jump(pc) && op != JMP_ABS && op != JMP_IND && op != RTS_IMPL;
+}
+
+// marks the code reachable from entry in seen, and its block leaders
+static void explore(Word entry) {
+    memset(seen, 0, sizeof(seen));
+    memset(leader, 0, sizeof(leader));
+    int n = 0;
+    todo[n++] = entry;
+    leader[entry] = true;
+    while (n > 0) {
+        Word pc = todo[--n];
+        if (seen[pc]) continue;
+        seen[pc] = true;
+        Byte op = image[pc];
+        Word next = pc + length(pc);
+        if (!compilable(pc)) {
+            // the interpreter comes back after BRK's signature byte once
+            // the handler returns, and after an undocumented opcode
+            if (op == BRK_IMPL) next = pc + 2;
+            else if (op == RTI_IMPL || strcmp(opinfo[op].name, "JAM") == 0) continue;
+            if (!loaded[pc] || !loaded[next]) continue;
+            leader[next] = true;
+            todo[n++] = next;
+            continue;
+        }
+        if (self_jump(pc)) {
+            // a branch to itself can still fall through once the
+            // interpreter has run it
+            if (op != JMP_ABS) {
+                leader[next] = true;
+                todo[n++] = next;
+            }
+            continue;
+        }
+        if (opinfo[op].mode == MODE_REL) {
+            leader[branch_target(pc)] = true;
+            todo[n++] = branch_target(pc);
+        } else if (op == JMP_ABS) {
+            leader[operand(pc)] = true;
+            todo[n++] = operand(pc);
+            continue;
+        } else if (op == JSR_ABS) {
+            add_routine(operand(pc));
+            leader[next] = true;
+        } else if (op == JMP_IND) {
+            // where the pointer goes now is likely where it goes later
+            Word ptr = operand(pc), high = (ptr & 0xFF00) | ((ptr + 1) & 0xFF);
+            if (loaded[ptr] && loaded[high]) add_routine(image[ptr] | image[high] << 8);
+            continue;
+        } else if (op == RTS_IMPL) {
+            continue;
+        } else if (op == CLI_IMPL || op == PLP_IMPL || (writes(op) && may_be_io(pc))) {
+            leader[next] = true;    // resumed here after an interrupt
+        }
+        todo[n++] = next;
+    }
+    // a fall through to code that is not emitted next needs a goto
+    Word prev = 0;
+    bool have_prev = false;
+    for (int pc = 0; pc < 0x10000; pc++) {
+        if (!seen[pc]) continue;
+        if (have_prev && falls_through(prev) && (Word)(prev + length(prev)) != pc) {
+            leader[(Word)(prev + length(prev))] = true;
+        }
+        prev = pc;
+        have_prev = true;
+    }
+    if (have_prev && falls_through(prev)) leader[(Word)(prev + length(prev))] = true;
+}
+
+// effective address of a memory operand, after any setup in pre
+static void address(Word pc, char *pre, char *ea) {
+    Byte zp = image[(Word)(pc + 1)];
+    Word abs = operand(pc);
+    pre[0] = 0;
+    switch (opinfo[image[pc]].mode) {
+        case MODE_ZP: sprintf(ea, "0x%02X", zp); break;
+        case MODE_ZPX: sprintf(ea, "(Byte)(0x%02X + X)", zp); break;
+        case MODE_ZPY: sprintf(ea, "(Byte)(0x%02X + Y)", zp); break;
+        case MODE_ABS: sprintf(ea, "0x%04X", abs); break;
+        case MODE_ABSX: sprintf(ea, "(Word)(0x%04X + X)", abs); break;
+        case MODE_ABSY: sprintf(ea, "(Word)(0x%04X + Y)", abs); break;
+        case MODE_INDX:
+            sprintf(pre, "Byte p_ = 0x%02X + X; Word a_ = RD(p_) | RD((Byte)(p_ + 1)) << 8; ", zp);
+            sprintf(ea, "a_");
+            break;
+        case MODE_INDY:
+            sprintf(pre, "Word b_ = RD(0x%02X) | RD(0x%02X) << 8; ", zp, (Byte)(zp + 1));
+            sprintf(ea, "(Word)(b_ + Y)");
+            break;
+        default: ea[0] = 0; break;
+    }
+}
+
+// the extra cycle a read pays for crossing a page, as page_cross in 6502.c
+static void page_penalty(Word pc, char *out) {
+    Byte mode = opinfo[image[pc]].mode;
+    out[0] = 0;
+    if (writes(image[pc])) return;
+    if (mode == MODE_ABSX) sprintf(out, "cpu->cycles += 0x%02X + X > 0xFF; ", image[(Word)(pc + 1)]);
+    if (mode == MODE_ABSY) sprintf(out, "cpu->cycles += 0x%02X + Y > 0xFF; ", image[(Word)(pc + 1)]);
+    if (mode == MODE_INDY) sprintf(out, "cpu->cycles += (b_ & 0xFF) + Y > 0xFF; ");
+}
+
+static const char *register_of(const char *name) {
+    char r = name[2];
+    if (strcmp(name, "CPX") == 0) return "X";
+    if (strcmp(name, "CPY") == 0) return "Y";
+    if (strcmp(name, "CMP") == 0) return "A";
+    return r == 'X' ? "X" : r == 'Y' ? "Y" : "A";
+}
+
+// code for one instruction; returns whether it falls through to the next
+static bool emit(Word pc) {
+    char text[32], pre[96], ea[32], val[40], cross[48], body[256];
+    Byte op = image[pc];
+    const char *name = opinfo[op].name;
+    Byte mode = opinfo[op].mode;
+    Word next = pc + length(pc);
+
+    if (leader[pc]) printf("L_%04X:\n", pc);
+    if (!loaded[pc]) {
+        printf("    EXIT(0x%04X);    // %04X outside the image\n", pc, pc);
+        return false;
+    }
+    disassemble(image, pc, text, sizeof(text));
+    if (!compilable(pc) || self_jump(pc)) {
+        printf("    EXIT(0x%04X);    // %04X %s\n", pc, pc, text);
+        return false;
+    }
+    printf("    // %04X %s\n", pc, text);
+
+    address(pc, pre, ea);
+    page_penalty(pc, cross);
+    if (mode == MODE_IM) sprintf(val, "0x%02X", image[(Word)(pc + 1)]);
+    else sprintf(val, "RD(%s)", ea);
+    body[0] = 0;
+    bool falls = true;
+
+    if (strncmp(name, "LD", 2) == 0) {
+        sprintf(body, "%s = %s; NZ(%s);", register_of(name), val, register_of(name));
+    } else if (strncmp(name, "ST", 2) == 0) {
+        sprintf(body, "WR(%s, %s);", ea, register_of(name));
+        if (may_be_io(pc)) sprintf(body + strlen(body), " POLL(0x%04X);", next);
+    } else if (!strcmp(name, "ADC") || !strcmp(name, "SBC") || !strcmp(name, "BIT")) {
+        sprintf(body, "%s(%s);", name, val);
+    } else if (!strcmp(name, "AND") || !strcmp(name, "ORA") || !strcmp(name, "EOR")) {
+        sprintf(body, "A %s= %s; NZ(A);", name[0] == 'A' ? "&" : name[0] == 'O' ? "|" : "^", val);
+    } else if (!strcmp(name, "CMP") || !strcmp(name, "CPX") || !strcmp(name, "CPY")) {
+        sprintf(body, "CMP(%s, %s);", register_of(name), val);
+    } else if (!strcmp(name, "ASL") || !strcmp(name, "LSR") || !strcmp(name, "ROL") || !strcmp(name, "ROR") ||
+               !strcmp(name, "INC") || !strcmp(name, "DEC")) {
+        if (mode == MODE_ACC) sprintf(body, "%s(A);", name);
+        else sprintf(body, "RMW(%s, %s);", ea, name);
+        if (mode != MODE_ACC && may_be_io(pc)) sprintf(body + strlen(body), " POLL(0x%04X);", next);
+    } else if (!strcmp(name, "INX") || !strcmp(name, "INY")) {
+        sprintf(body, "INC(%c);", name[2]);
+    } else if (!strcmp(name, "DEX") || !strcmp(name, "DEY")) {
+        sprintf(body, "DEC(%c);", name[2]);
+    } else if (!strcmp(name, "TXS")) {
+        sprintf(body, "SP = X;");
+    } else if (!strcmp(name, "TSX")) {
+        sprintf(body, "X = SP; NZ(X);");
+    } else if (name[0] == 'T') {
+        sprintf(body, "%c = %c; NZ(%c);", name[2], name[1], name[2]);
+    } else if (!strcmp(name, "CLC") || !strcmp(name, "SEC") || !strcmp(name, "CLD") || !strcmp(name, "SED") ||
+               !strcmp(name, "SEI") || !strcmp(name, "CLV")) {
+        sprintf(body, "%c = %d;", name[2], name[0] == 'S');
+    } else if (!strcmp(name, "CLI")) {
+        sprintf(body, "I = 0; POLL(0x%04X);", next);
+    } else if (!strcmp(name, "PHA")) {
+        sprintf(body, "PUSH(A);");
+    } else if (!strcmp(name, "PHP")) {
+        sprintf(body, "PUSH(P());");
+    } else if (!strcmp(name, "PLA")) {
+        sprintf(body, "A = PULL(); NZ(A);");
+    } else if (!strcmp(name, "PLP")) {
+        sprintf(body, "Byte p_ = PULL(); N = p_ >> 7; V = p_ >> 6 & 1; cpu->B = p_ >> 4 & 1; D = p_ >> 3 & 1; "
+                      "I = p_ >> 2 & 1; Z = p_ >> 1 & 1; C = p_ & 1; POLL(0x%04X);", next);
+    } else if (!strcmp(name, "NOP")) {
+        sprintf(body, ";");
+    } else if (mode == MODE_REL) {
+        static const char *const cond[] = {"!N", "N", "!V", "V", "!C", "C", "!Z", "Z"};
+        Word target = branch_target(pc);
+        sprintf(body, "if (%s) { cpu->cycles += %d; CHECK(0x%04X); goto L_%04X; }", cond[op >> 5],
+                1 + ((target ^ next) > 0xFF), target, target);
+    } else if (op == JMP_ABS) {
+        sprintf(body, "CHECK(0x%04X); goto L_%04X;", operand(pc), operand(pc));
+        falls = false;
+    } else if (op == JMP_IND) {
+        Word ptr = operand(pc);
+        sprintf(body, "EXIT(RD(0x%04X) | RD(0x%04X) << 8);", ptr, (ptr & 0xFF00) | ((ptr + 1) & 0xFF));
+        falls = false;
+    } else if (op == JSR_ABS) {
+        Word target = operand(pc), ret = pc + 2;
+        sprintf(body, "PUSH(0x%02X); PUSH(0x%02X); SAVE(); cpu->PC = 0x%04X;\n"
+                      "      if (hooked(cpu, 0x%04X)) call_hook(cpu);\n"
+                      "      else if (depth < AOT_DEPTH) f_%04X(cpu, 0x%04X, depth + 1);\n"
+                      "      else return;\n"
+                      "      if (cpu->PC != 0x%04X) return;\n"
+                      "      LOAD(); CHECK(0x%04X);",
+                ret >> 8, ret & 0xFF, target, target, target, target, next, next);
+    } else if (op == RTS_IMPL) {
+        sprintf(body, "Byte lo_ = PULL(); Byte hi_ = PULL(); EXIT((Word)((hi_ << 8 | lo_) + 1));");
+        falls = false;
+    } else {
+        fprintf(stderr, "recompile: no code for %s at %04X\n", name, pc);
+        exit(1);
+    }
+    printf("    { cpu->cycles += %d; %s%s%s }\n", opcode_cycles[op], pre, cross, body);
+    return falls;
+}
+
+static void compile(int r) {
+    Word entry = routine[r];
+    explore(entry);
+    printf("static void f_%04X(CPU *cpu, Word entry, int depth) {\n", entry);
+    printf("    Byte A, X, Y, SP, C, Z, I, D, V, N;\n");
+    printf("    LOAD();\n");
+    printf("    (void)depth;\n");
+    printf("    switch (entry) {\n");
+    for (int pc = 0; pc < 0x10000; pc++) {
+        if (!leader[pc]) continue;
+        printf("        case 0x%04X: goto L_%04X;\n", pc, pc);
+        if (loaded[pc] && compilable(pc) && !self_jump(pc) && (owner[pc] < 0 || pc == entry)) owner[pc] = r;
+    }
+    printf("        default: return;\n");
+    printf("    }\n");
+
+    bool falls = false;
+    Word after = 0;
+    for (int pc = 0; pc < 0x10000; pc++) {
+        if (!seen[pc]) continue;
+        if (falls && after != pc) printf("    goto L_%04X;\n", after);
+        if (compilable(pc)) {
+            for (int i = 0; i < length(pc); i++) compiled[(Word)(pc + i)] = true;
+        }
+        falls = emit(pc);
+        after = pc + length(pc);
+    }
+    if (falls) printf("    goto L_%04X;\n", after);
+    // leaders nobody reached by decoding: fall throughs off the end
+    for (int pc = 0; pc < 0x10000; pc++) {
+        if (leader[pc] && !seen[pc]) printf("L_%04X:\n    EXIT(0x%04X);\n", pc, pc);
+    }
+    printf("}\n\n");
+}
+
+static long hex(const char *s) {
+    char *end;
+    long v = strtol(s, &end, 16);
+    if (*s == 0 || *end != 0 || v < 0 || v > 0xFFFF) {
+        fprintf(stderr, "recompile: bad address %s\n", s);
+        exit(1);
+    }
+    return v;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s image.bin load-address [entry ...]\n", argv[0]);
+        return 1;
+    }
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    Word load = hex(argv[2]);
+    size_t n = fread(&image[load], 1, 0x10000 - load, f);
+    fclose(f);
+    for (size_t i = 0; i < n; i++) loaded[load + i] = true;
+
+    if (argc == 3) {
+        if (!loaded[0xFFFC] || !loaded[0xFFFD]) {
+            fprintf(stderr, "recompile: no entry given and no reset vector in the image\n");
+            return 1;
+        }
+        add_routine(image[0xFFFC] | image[0xFFFD] << 8);
+    }
+    for (int i = 3; i < argc; i++) add_routine(hex(argv[i]));
+
+    // find every routine first so each can be declared before use
+    for (int r = 0; r < routines; r++) explore(routine[r]);
+    for (int pc = 0; pc < 0x10000; pc++) owner[pc] = -1;
+
+    printf("// generated by tools/recompile from %s, do not edit\n\n", argv[1]);
+    printf("#define AOT_GENERATED\n#include \"aot.h\"\n#include <string.h>\n\n");
+    for (int r = 0; r < routines; r++) printf("static void f_%04X(CPU *cpu, Word entry, int depth);\n", routine[r]);
+    printf("\n");
+    for (int r = 0; r < routines; r++) compile(r);
+
+    printf("AotFn aot_lookup(Word pc) {\n    switch (pc) {\n");
+    for (int pc = 0; pc < 0x10000; pc++) {
+        if (owner[pc] >= 0) printf("        case 0x%04X: return f_%04X;\n", pc, routine[owner[pc]]);
+    }
+    printf("        default: return NULL;\n    }\n}\n\n");
+
+    printf("static const struct { Word addr, len; } ranges[] = {\n");
+    int total = 0;
+    for (int pc = 0; pc < 0x10000;) {
+        if (!compiled[pc]) {
+            pc++;
+            continue;
+        }
+        int start = pc;
+        while (pc < 0x10000 && compiled[pc]) pc++;
+        printf("    {0x%04X, %d},\n", start, pc - start);
+        total += pc - start;
+    }
+    printf("};\n\nstatic const Byte code[] = {");
+    int k = 0;
+    for (int pc = 0; pc < 0x10000; pc++) {
+        if (compiled[pc]) printf("%s0x%02X,", k++ % 16 ? " " : "\n    ", image[pc]);
+    }
+    printf("\n};\n\n");
+    printf("int aot_matches(const Memory *mem) {\n");
+    printf("    const Byte *c = code;\n");
+    printf("    for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {\n");
+    printf("        if (memcmp(&mem->Data[ranges[i].addr], c, ranges[i].len) != 0) return 0;\n");
+    printf("        c += ranges[i].len;\n");
+    printf("    }\n    return 1;\n}\n");
+    fprintf(stderr, "recompile: %d routines, %d bytes of code\n", routines, total);
+    return 0;
+}
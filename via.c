@@ -0,0 +1,236 @@
+#include "via.h"
+#include <string.h>
+
+#define ACR_T1_FREE 0x40
+#define ACR_T1_PB7 0x80
+#define ACR_T2_PULSES 0x20
+#define ACR_SR_MODE(acr) (((acr) >> 2) & 7)
+
+static u_int64_t now(Via *via) {
+    return via->sched->cpu->cycles;
+}
+
+static void update_irq(Via *via) {
+    set_irq(via->sched->cpu, via->irq_source, via->ifr & via->ier & 0x7F);
+}
+
+static void set_flags(Via *via, Byte flags) {
+    via->ifr |= flags;
+    update_irq(via);
+}
+
+static void clear_flags(Via *via, Byte flags) {
+    via->ifr &= ~flags;
+    update_irq(via);
+}
+
+static void reschedule(Via *via, u_int64_t *id, u_int64_t when, EventFn fn) {
+    if (*id) sched_cancel(via->sched, *id);
+    *id = fn ? sched_add(via->sched, when, fn, via) : 0;
+}
+
+// T1 count at cycle t: once past zero it shows FFFF for a cycle, then
+// reloads from the latch when free running or keeps counting down if not
+static Word t1_at(Via *via, u_int64_t t) {
+    if (t < via->t1_base) return 0xFFFF;
+    u_int64_t e = t - via->t1_base;
+    if (e <= via->t1_n || !(via->acr & ACR_T1_FREE)) return (Word)(via->t1_n - e);
+    u_int64_t k = (e - via->t1_n - 1) % ((u_int64_t)via->t1_latch + 2);
+    return k == 0 ? 0xFFFF : (Word)(via->t1_latch - (k - 1));
+}
+
+static void t1_underflow(void *ctx, u_int64_t when) {
+    Via *via = ctx;
+    via->t1_event = 0;
+    if (via->acr & ACR_T1_FREE) {
+        set_flags(via, VIA_T1);
+        via->pb7 ^= 0x80;
+        via->t1_base = when + 1;
+        via->t1_n = via->t1_latch;
+        reschedule(via, &via->t1_event, when + via->t1_latch + 2, t1_underflow);
+    } else if (via->t1_armed) {
+        set_flags(via, VIA_T1);
+        via->pb7 = 0x80;
+        via->t1_armed = false;
+    }
+}
+
+// restarts T1 from count n at the current cycle
+static void t1_load(Via *via, Word n) {
+    via->t1_base = now(via);
+    via->t1_n = n;
+    bool pending = via->t1_armed || (via->acr & ACR_T1_FREE);
+    reschedule(via, &via->t1_event, via->t1_base + n + 1, pending ? t1_underflow : NULL);
+}
+
+static Word t2_at(Via *via, u_int64_t t) {
+    // no pulses ever arrive on PB6, so a counting T2 holds its value
+    if (via->acr & ACR_T2_PULSES) return via->t2_n;
+    return (Word)(via->t2_n - (t - via->t2_base));
+}
+
+static void t2_underflow(void *ctx, u_int64_t when) {
+    (void)when;
+    Via *via = ctx;
+    via->t2_event = 0;
+    if (via->t2_armed) set_flags(via, VIA_T2);
+    via->t2_armed = false;
+}
+
+static void t2_load(Via *via, Word n) {
+    via->t2_base = now(via);
+    via->t2_n = n;
+    bool timed = !(via->acr & ACR_T2_PULSES) && via->t2_armed;
+    reschedule(via, &via->t2_event, via->t2_base + n + 1, timed ? t2_underflow : NULL);
+}
+
+static void sr_done(void *ctx, u_int64_t when) {
+    (void)when;
+    Via *via = ctx;
+    via->sr_event = 0;
+    if (ACR_SR_MODE(via->acr) < 4) via->sr = via->sr_in;
+    else via->sr_out = via->sr;
+    set_flags(via, VIA_SR_DONE);
+}
+
+// an SR access starts eight shifts: two cycles a bit from the clock, or a
+// T2 low byte timeout per clock edge. CB1 clocked modes never finish and
+// free running shift out does not interrupt
+static void sr_start(Via *via) {
+    clear_flags(via, VIA_SR_DONE);
+    u_int64_t bit;
+    switch (ACR_SR_MODE(via->acr)) {
+        case 2: case 6: bit = 2; break;
+        case 1: case 5: bit = 2 * ((u_int64_t)via->t2_latch + 2); break;
+        default: bit = 0; break;
+    }
+    reschedule(via, &via->sr_event, now(via) + 8 * bit, bit ? sr_done : NULL);
+}
+
+static Byte port_b(Via *via) {
+    Byte value = (via->orb & via->ddrb) | (via->pins_b & ~via->ddrb);
+    if (via->acr & ACR_T1_PB7) value = (value & 0x7F) | via->pb7;
+    return value;
+}
+
+static Byte via_read(void *ctx, Word addr) {
+    Via *via = ctx;
+    switch (addr & 0x0F) {
+        case VIA_ORB:
+            clear_flags(via, VIA_CB1 | VIA_CB2);
+            return port_b(via);
+        case VIA_ORA:
+            clear_flags(via, VIA_CA1 | VIA_CA2);
+            return (via->ora & via->ddra) | (via->pins_a & ~via->ddra);
+        case VIA_ORA_NH:
+            return (via->ora & via->ddra) | (via->pins_a & ~via->ddra);
+        case VIA_DDRB: return via->ddrb;
+        case VIA_DDRA: return via->ddra;
+        case VIA_T1CL:
+            clear_flags(via, VIA_T1);
+            return t1_at(via, now(via)) & 0xFF;
+        case VIA_T1CH: return t1_at(via, now(via)) >> 8;
+        case VIA_T1LL: return via->t1_latch & 0xFF;
+        case VIA_T1LH: return via->t1_latch >> 8;
+        case VIA_T2CL:
+            clear_flags(via, VIA_T2);
+            return t2_at(via, now(via)) & 0xFF;
+        case VIA_T2CH: return t2_at(via, now(via)) >> 8;
+        case VIA_SR: {
+            Byte value = via->sr;
+            sr_start(via);
+            return value;
+        }
+        case VIA_ACR: return via->acr;
+        case VIA_PCR: return via->pcr;
+        case VIA_IFR: return via->ifr | (via->ifr & via->ier & 0x7F ? 0x80 : 0);
+        default: return via->ier | 0x80;
+    }
+}
+
+static void via_write(void *ctx, Word addr, Byte value) {
+    Via *via = ctx;
+    switch (addr & 0x0F) {
+        case VIA_ORB:
+            via->orb = value;
+            clear_flags(via, VIA_CB1 | VIA_CB2);
+            break;
+        case VIA_ORA:
+            via->ora = value;
+            clear_flags(via, VIA_CA1 | VIA_CA2);
+            break;
+        case VIA_ORA_NH: via->ora = value; break;
+        case VIA_DDRB: via->ddrb = value; break;
+        case VIA_DDRA: via->ddra = value; break;
+        case VIA_T1CL:
+        case VIA_T1LL:
+            via->t1_latch = (via->t1_latch & 0xFF00) | value;
+            break;
+        case VIA_T1CH:
+            via->t1_latch = (via->t1_latch & 0x00FF) | value << 8;
+            clear_flags(via, VIA_T1);
+            via->t1_armed = true;
+            via->pb7 = 0;
+            t1_load(via, via->t1_latch);
+            break;
+        case VIA_T1LH:
+            via->t1_latch = (via->t1_latch & 0x00FF) | value << 8;
+            clear_flags(via, VIA_T1);
+            break;
+        case VIA_T2CL: via->t2_latch = value; break;
+        case VIA_T2CH:
+            clear_flags(via, VIA_T2);
+            via->t2_armed = true;
+            t2_load(via, value << 8 | via->t2_latch);
+            break;
+        case VIA_SR:
+            via->sr = value;
+            sr_start(via);
+            break;
+        case VIA_ACR: {
+            // carry on counting from where the timers are under the new mode
+            Word t1 = t1_at(via, now(via)), t2 = t2_at(via, now(via));
+            via->acr = value;
+            t1_load(via, t1);
+            t2_load(via, t2);
+            break;
+        }
+        case VIA_PCR: via->pcr = value; break;
+        case VIA_IFR: clear_flags(via, value & 0x7F); break;
+        case VIA_IER:
+            if (value & 0x80) via->ier |= value & 0x7F;
+            else via->ier &= ~value;
+            update_irq(via);
+            break;
+    }
+}
+
+/*
+ * Maps a VIA at page of the scheduler's CPU, raising irq_source in cpu->irq
+ * while an enabled interrupt is flagged. Returns -1 if the page cannot be
+ * mapped.
+ */
+int via_init(Via *via, Scheduler *sched, Byte page, Byte irq_source) {
+    memset(via, 0, sizeof(*via));
+    via->sched = sched;
+    via->irq_source = irq_source;
+    via->page = (PageHandler){ .read = via_read, .write = via_write, .ctx = via };
+    via->pins_a = via->pins_b = 0xFF;
+    via->sr_in = 0xFF;
+    via->t1_base = via->t2_base = now(via);
+    return map_io(sched->cpu->mem, page, &via->page);
+}
+
+// active edges the host saw on CA1, CA2, CB1 or CB2, as IFR bits
+void via_signal(Via *via, Byte edges) {
+    set_flags(via, edges & (VIA_CA1 | VIA_CA2 | VIA_CB1 | VIA_CB2));
+}
+
+// timer counts as of the current cycle, without the side effects of a read
+Word via_t1(Via *via) {
+    return t1_at(via, now(via));
+}
+
+Word via_t2(Via *via) {
+    return t2_at(via, now(via));
+}
@@ -0,0 +1,72 @@
+#ifndef VIA_H
+#define VIA_H
+
+#include "sched.h"
+#include <stdbool.h>
+
+/*
+ * MOS 6522 Versatile Interface Adapter: two 8 bit ports, two 16 bit timers,
+ * a shift register and the interrupt flag and enable registers, mapped at
+ * a page of its own (the 16 registers repeat through the page).
+ *
+ * Nothing here runs per cycle. A timer is kept as the value it was loaded
+ * with and the cycle it was loaded at, and a read works out the count from
+ * cpu->cycles. Underflows and shift register completion are scheduler
+ * events, which set the flag in IFR and the CPU's IRQ line if enabled.
+ * An access is seen at cpu->cycles with the accessing instruction's own
+ * cycles (and any page crossing) already counted, as the interpreter
+ * charges them before running it: LDA of T1C-L at cycle c reads the count
+ * as of c + 4.
+ */
+
+// register offsets
+enum {
+    VIA_ORB, VIA_ORA, VIA_DDRB, VIA_DDRA,
+    VIA_T1CL, VIA_T1CH, VIA_T1LL, VIA_T1LH,
+    VIA_T2CL, VIA_T2CH, VIA_SR, VIA_ACR,
+    VIA_PCR, VIA_IFR, VIA_IER, VIA_ORA_NH,
+};
+
+// IFR and IER bits
+#define VIA_CA2 0x01
+#define VIA_CA1 0x02
+#define VIA_SR_DONE 0x04
+#define VIA_CB2 0x08
+#define VIA_CB1 0x10
+#define VIA_T2 0x20
+#define VIA_T1 0x40
+
+typedef struct {
+    Scheduler *sched;
+    PageHandler page;
+    Byte irq_source;        // this VIA's bit of cpu->irq
+
+    Byte ora, orb, ddra, ddrb;
+    Byte pins_a, pins_b;    // levels the host drives on input pins
+    Byte acr, pcr, ifr, ier;
+
+    // a timer counts n - (cycles - base) and underflows at base + n + 1
+    Word t1_latch, t1_n;
+    u_int64_t t1_base;
+    u_int64_t t1_event;     // pending underflow, 0 for none
+    bool t1_armed;          // one-shot interrupt not yet delivered
+    Byte pb7;               // PB7 level when T1 drives it (ACR bit 7)
+
+    Byte t2_latch;          // low byte only, the high byte loads directly
+    Word t2_n;
+    u_int64_t t2_base;
+    u_int64_t t2_event;
+    bool t2_armed;
+
+    Byte sr;
+    Byte sr_in;             // what shifting in reads from CB2, a byte at a time
+    Byte sr_out;            // last byte shifted out
+    u_int64_t sr_event;
+} Via;
+
+int via_init(Via *via, Scheduler *sched, Byte page, Byte irq_source);
+void via_signal(Via *via, Byte edges);
+Word via_t1(Via *via);
+Word via_t2(Via *via);
+
+#endif